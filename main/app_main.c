@@ -1,8 +1,23 @@
 #include "smart_assistant.h"
+#include "audio_bargein.h"
+#include "audio_calibration.h"
+#include "audio_codec.h"
 #include "audio_controller.h"
+#include "audio_endpoint.h"
+#include "audio_history.h"
 #include "audio_playback.h"
+#include "audio_wakeword.h"
+#include "deep_sleep.h"
+#include "dsp_kernels.h"
+#include "executor.h"
+#include "flash_safety.h"
+#include "latency_hist.h"
 #include "proxy_client.h"
+#include "proxy_endpoints.h"
+#include "psram_bench.h"
+#include "telemetry.h"
 #include "websocket_client.h"
+#include "ws_bench.h"
 #include "ui.h"
 #include "wifi_credentials.h"
 
@@ -29,16 +44,92 @@ static assistant_status_t g_status = {
 
 // Microphone control state
 static bool s_user_wants_mic_on = false;  // User button state (pressed/released)
+static bool s_uplink_dtx = false;         // Negotiated: muted chunks are not sent at all
+static volatile bool s_touch_pending = false;  // A tap turned the mic on; its first live chunk is timed
+static volatile uint32_t s_touch_us = 0;
+
+// Log the per-kernel DSP cycle table at boot (adds ~100 ms to startup)
+#define DSP_BENCHMARK_AT_BOOT 0
+
+// Log CPU per second of audio for PCM, µ-law, IMA-ADPCM and Opus at boot (adds ~1 s to startup)
+#define CODEC_BENCHMARK_AT_BOOT 0
+
+// Log the cycle cost of recording a latency sample at boot
+#define LATENCY_BENCHMARK_AT_BOOT 0
+
+// Log a task spawn against an executor round trip at boot
+#define EXECUTOR_BENCHMARK_AT_BOOT 0
+
+// Audio codecs offered first in the hello on connect (AUDIO_CODEC_PCM, AUDIO_CODEC_ULAW or
+// AUDIO_CODEC_IMA_ADPCM); the session stays on raw PCM unless the proxy's hello_ack picks one
+#define SESSION_UPLINK_CODEC   AUDIO_CODEC_PCM
+#define SESSION_DOWNLINK_CODEC AUDIO_CODEC_PCM
+
+// Offer a second WebSocket for control messages, so they never queue behind audio
+// (used only if the proxy's hello_ack accepts it)
+#define SESSION_CONTROL_CHANNEL false
+
+// Heartbeat ping period and silent periods before the link counts as dead
+// (200 ms × 4: a dead path is noticed within a second, or 1.8 s while sends
+// stall on it; Wi-Fi power save and a busy proxy still fit in 800 ms)
+#define LINK_HEARTBEAT_MS      200
+#define LINK_HEARTBEAT_MISSES  4
+
+// Uplink backlog (pre-roll, audio queued through a fast reconnect or behind a
+// stalled send) drains at this percentage of real time, after a burst of up to
+// UPLINK_BURST_MS; slower while assistant audio arrived within DOWNLINK_BUSY_MS
+#define UPLINK_CATCHUP_PCT       200
+#define UPLINK_BUSY_CATCHUP_PCT  125
+#define UPLINK_BURST_MS          200
+#define DOWNLINK_BUSY_MS         500
+
+// Bench test: emulate a bad network on the WebSocket (see main/net_impair.h),
+// e.g. "wifi_poor,seed=7" or "delay=80,jitter=40,loss=20,burst=4"; "" is off
+#define NET_IMPAIR_PROFILE ""
+
+// Bench test: hammer NVS with commits while a session streams, and log audio
+// glitches (capture overruns, playback underruns) against the flash writes
+#define FLASH_STRESS_ON_CONNECT 0
+#define FLASH_STRESS_DURATION_S 60
+
+// Bench test: sweep WebSocket message sizes and rates both ways once connected
+// and log throughput, latency and CPU per step (needs tools/stand_in_proxy.py)
+#define WS_BENCH_ON_CONNECT 0
+
+// Measure PSRAM contention between the display and audio loads at boot and log
+// buffer placement advice (adds ~10 s to startup and draws test patterns)
+#define PSRAM_BENCH_AT_BOOT 0
+
+// Deep sleep after this many seconds without a session, playback or mic use, and
+// wake on a touch (0: stay awake). Not while a wake word is enrolled: it needs the mic.
+#define DEEP_SLEEP_IDLE_S 0
 
 // Pre-allocated silence buffer for muting (allocated from PSRAM at startup)
 #define SILENCE_BUFFER_SIZE 4096
 static uint8_t *s_silence_buffer = NULL;
 
+static esp_netif_t *s_sta_netif = NULL;
+
 // Track when AI is speaking based on audio reception
 static int64_t s_last_audio_received_us = 0;
 static bool s_was_muted_by_ai = false;  // Track auto-mute state changes
 #define AI_SPEAKING_TIMEOUT_MS 2000  // Keep mic muted for 2s after last audio received (accounts for 500ms pre-buffer + 1500ms safety)
 
+// With a measured acoustic loop the timeout is buffering allowance + loop delay + echo tail
+#define AI_SPEAKING_BUFFER_MS  1500  // 500ms pre-buffer + ring drain margin
+#define AI_SPEAKING_ECHO_TAIL_MS 200
+static uint32_t s_ai_speaking_timeout_ms = AI_SPEAKING_TIMEOUT_MS;
+
+// After a local barge-in, downlink audio of the interrupted response is dropped
+// until the proxy goes quiet for this long or announces a new response
+#define BARGEIN_DISCARD_GAP_MS 500
+static volatile bool s_discard_downlink = false;
+static int64_t s_last_discarded_us = 0;
+
+// Audio sent ahead of the keyword on a wake-word session start, on top of the
+// keyword itself (covers the detector queue lag and the lead-in to the word)
+#define WAKEWORD_PREROLL_MARGIN_MS 500
+
 // Forward declarations
 static void streaming_chunk_handler(const uint8_t *pcm_data, size_t pcm_len, void *ctx);
 static void websocket_connected_handler(bool connected, uint16_t close_code, void *ctx);
@@ -91,12 +182,16 @@ static void wifi_event_handler(void *arg, esp_event_base_t event_base,
         ESP_LOGI(TAG, "Wi-Fi connecting...");
     } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
         assistant_set_wifi_connected(false);
+        proxy_client_set_link_up(false);  // A live session is declared dead now, not at the TCP timeout
+        deep_sleep_wifi_failed(s_sta_netif);
         esp_wifi_connect();
         ESP_LOGI(TAG, "Reconnecting to Wi-Fi...");
     } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
         ip_event_got_ip_t *event = (ip_event_got_ip_t *)event_data;
         ESP_LOGI(TAG, "Got IP: " IPSTR, IP2STR(&event->ip_info.ip));
         assistant_set_wifi_connected(true);
+        proxy_client_set_link_up(true);   // Lets a pending fast reconnect go ahead, probes the proxies
+        deep_sleep_note_got_ip();
 
         // Note: WebSocket connection deferred until user presses button
         ESP_LOGI(TAG, "WiFi ready - waiting for user to start conversation");
@@ -107,7 +202,7 @@ static void initialise_wifi(void)
 {
     ESP_ERROR_CHECK(esp_netif_init());
     ESP_ERROR_CHECK(esp_event_loop_create_default());
-    esp_netif_create_default_wifi_sta();
+    s_sta_netif = esp_netif_create_default_wifi_sta();
 
     // Register event handlers
     ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &wifi_event_handler, NULL));
@@ -120,6 +215,7 @@ static void initialise_wifi(void)
     wifi_config.sta.threshold.authmode = WIFI_AUTH_WPA2_PSK;
     strncpy((char *)wifi_config.sta.ssid, WIFI_SSID, sizeof(wifi_config.sta.ssid));
     strncpy((char *)wifi_config.sta.password, WIFI_PASSWORD, sizeof(wifi_config.sta.password));
+    deep_sleep_apply_wifi(&wifi_config, s_sta_netif);  // On a wake: the last AP and address
 
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
     ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
@@ -142,11 +238,14 @@ static void streaming_chunk_handler(const uint8_t *pcm_data, size_t pcm_len, voi
         // Check if AI is currently speaking (received audio recently)
         int64_t now_us = esp_timer_get_time();
         int64_t time_since_audio_ms = (now_us - s_last_audio_received_us) / 1000;
-        bool ai_is_speaking = (time_since_audio_ms < AI_SPEAKING_TIMEOUT_MS);
+        bool ai_is_speaking = (time_since_audio_ms < s_ai_speaking_timeout_ms) || audio_history_is_replaying();
 
         // Mute if: (1) User hasn't enabled mic, OR (2) AI is speaking
         bool should_mute = !s_user_wants_mic_on || ai_is_speaking;
 
+        // Endpointing only makes sense while live mic audio goes upstream
+        audio_endpoint_set_enabled(!should_mute);
+
         // Log state changes for auto-mute
         if (s_user_wants_mic_on) {
             if (ai_is_speaking && !s_was_muted_by_ai) {
@@ -158,6 +257,11 @@ static void streaming_chunk_handler(const uint8_t *pcm_data, size_t pcm_len, voi
             }
         }
 
+        // With DTX the proxy treats missing audio as silence
+        if (should_mute && s_uplink_dtx) {
+            return;
+        }
+
         if (should_mute && s_silence_buffer) {
             // Use pre-allocated silence buffer from PSRAM
             if (pcm_len <= SILENCE_BUFFER_SIZE) {
@@ -165,6 +269,9 @@ static void streaming_chunk_handler(const uint8_t *pcm_data, size_t pcm_len, voi
             } else {
                 ESP_LOGW(TAG, "Chunk size %zu exceeds silence buffer, sending real audio", pcm_len);
             }
+        } else if (!should_mute && s_touch_pending) {
+            s_touch_pending = false;
+            latency_hist_record_since(LATENCY_METRIC_TOUCH_TO_ACTION, s_touch_us);
         } else if (!should_mute && debug_counter++ % 100 == 0) {
             // Debug: Check audio level every 100 chunks when unmuted
             int16_t *samples = (int16_t *)pcm_data;
@@ -197,10 +304,44 @@ static void streaming_chunk_handler(const uint8_t *pcm_data, size_t pcm_len, voi
             }
         } else {
             consecutive_errors = 0;  // Reset on success
+
+            // Commit the turn as soon as the user stops instead of waiting for server VAD
+            int64_t end_of_speech_us = 0;
+            if (audio_endpoint_take_end(&end_of_speech_us)) {
+                ESP_LOGI(TAG, "End of turn detected locally (%lld ms after speech) - sending marker",
+                         (esp_timer_get_time() - end_of_speech_us) / 1000);
+                ws_client_send_audio(NULL, 0);
+            }
         }
     }
 }
 
+// Uplink pacing leaves the link to assistant audio while it is arriving
+static bool downlink_busy(void)
+{
+    return (esp_timer_get_time() - s_last_audio_received_us) / 1000 < DOWNLINK_BUSY_MS;
+}
+
+// Telemetry waits while the mic is live or the assistant is talking
+static bool telemetry_link_idle(void)
+{
+    int64_t since_audio_ms = (esp_timer_get_time() - s_last_audio_received_us) / 1000;
+    return !s_user_wants_mic_on && since_audio_ms >= s_ai_speaking_timeout_ms && !audio_history_is_replaying();
+}
+
+static void update_speaking_timeout(void)
+{
+    audio_calibration_result_t cal = audio_calibration_get_result();
+    if (!cal.valid) {
+        s_ai_speaking_timeout_ms = AI_SPEAKING_TIMEOUT_MS;
+        return;
+    }
+
+    s_ai_speaking_timeout_ms = AI_SPEAKING_BUFFER_MS + cal.delay_us / 1000 + AI_SPEAKING_ECHO_TAIL_MS;
+    ESP_LOGI(TAG, "Auto-mute timeout %lu ms (measured loop delay %lu us)",
+             (unsigned long)s_ai_speaking_timeout_ms, (unsigned long)cal.delay_us);
+}
+
 /**
  * @brief WebSocket state change callback - starts continuous streaming
  */
@@ -212,6 +353,7 @@ static void websocket_connected_handler(bool connected, uint16_t close_code, voi
         ESP_LOGI(TAG, "WebSocket connected - starting continuous audio streaming");
         g_status.proxy_connected = true;
         ui_update_state(g_status);
+        update_speaking_timeout();
 
         // Start playback stream to receive OpenAI responses
         if (!audio_playback_stream_start()) {
@@ -219,23 +361,61 @@ static void websocket_connected_handler(bool connected, uint16_t close_code, voi
             return;
         }
 
-        // Start continuous audio capture (will send silence when muted)
+        // Frame the uplink as negotiated before the first chunk goes out
+        session_params_t session = ws_client_get_session();
+        audio_set_uplink_chunk_ms(session.uplink_frame_ms);
+        s_uplink_dtx = session.uplink_dtx;
+
+        // Start continuous audio capture (will send silence when muted, or nothing with DTX)
         audio_start_streaming_capture(streaming_chunk_handler, NULL);
         ESP_LOGI(TAG, "Continuous streaming started (mic muted by default)");
 
+#if FLASH_STRESS_ON_CONNECT
+        flash_safety_stress_start(FLASH_STRESS_DURATION_S);
+#endif
+#if WS_BENCH_ON_CONNECT
+        ws_bench_start();
+#endif
+
     } else {
         ESP_LOGW(TAG, "WebSocket disconnected (code=%d) - stopping continuous streaming", close_code);
         g_status.proxy_connected = false;
-
-        // Reset mic state - user must explicitly re-enable after disconnect
-        s_user_wants_mic_on = false;
-
-        // Stop streaming
-        audio_stop_streaming_capture();
+        s_touch_pending = false;
+        latency_hist_log_session();
+        executor_log_stats();
+        proxy_endpoints_log();
+        audio_uplink_stats_t uplink = audio_get_uplink_stats(true);
+        ESP_LOGI(TAG, "Uplink: %lu backlogs, peak %lu ms, longest drain %lu ms, %lu ms dropped",
+                 (unsigned long)uplink.backlogs, (unsigned long)uplink.peak_backlog_ms,
+                 (unsigned long)uplink.longest_drain_ms, (unsigned long)uplink.dropped_ms);
+
+        // A dead link reconnects on its own; the user's mic choice carries over to the new session
+        bool link_lost = close_code == WS_CLOSE_LINK_LOST;
+        if (!link_lost) {
+            // Reset mic state - user must explicitly re-enable after disconnect
+            s_user_wants_mic_on = false;
+            audio_bargein_set_enabled(false);
+        }
+        s_discard_downlink = false;
+
+        // Stop streaming (a wake-word pre-roll held for a failed connect is dropped);
+        // the mic keeps running if the wake word is listening. With the mic on, a
+        // fast reconnect keeps capturing instead: the new session gets the queued
+        // audio first, paced out faster than real time.
+        audio_wakeword_set_enabled(!s_user_wants_mic_on);
+        if (link_lost && s_user_wants_mic_on) {
+            audio_pause_uplink();
+        } else {
+            audio_stop_streaming_capture();
+            audio_release_uplink();
+        }
         audio_playback_stream_end();
 
         // Determine state based on close code
-        if (close_code == 1000) {
+        if (link_lost) {
+            // Keep the current state while the fast reconnect runs; a failed one reports an error
+            ESP_LOGW(TAG, "Link lost - reconnecting");
+        } else if (close_code == 1000) {
             // Normal closure (timeout) - go to IDLE, user can tap button to reconnect
             assistant_set_state(ASSISTANT_STATE_IDLE);
             ESP_LOGI(TAG, "Session ended due to timeout - tap button to start new conversation");
@@ -253,60 +433,213 @@ static void audio_received_handler(const uint8_t *audio_data, size_t audio_len,
     (void)ctx;
 
     static int audio_chunk_count = 0;
+    int64_t now_us = esp_timer_get_time();
+
+    // Drop the tail of a response the user talked over
+    if (s_discard_downlink) {
+        if ((now_us - s_last_discarded_us) / 1000 < BARGEIN_DISCARD_GAP_MS) {
+            s_last_discarded_us = now_us;
+            return;
+        }
+        ESP_LOGI(TAG, "Downlink resumed after barge-in");
+        s_discard_downlink = false;
+    }
+
+    audio_endpoint_mark_response();
+
+    // A gap longer than the speaking timeout means this is a new response
+    if ((now_us - s_last_audio_received_us) / 1000 >= s_ai_speaking_timeout_ms) {
+        audio_history_begin_response();
+    }
 
     // Update timestamp - AI is speaking
-    s_last_audio_received_us = esp_timer_get_time();
+    s_last_audio_received_us = now_us;
 
     // Log occasionally to show AI audio is being received
     if (audio_chunk_count++ % 50 == 0) {
         ESP_LOGI(TAG, "AI audio received (%d bytes, chunk #%d)", (int)audio_len, audio_chunk_count);
     }
 
-    // Forward to playback
+    // Forward to playback; the stream ring is the history arena, so this also keeps it for replay
     if (audio_len > 0) {
         audio_playback_stream_write(audio_data, audio_len);
     }
 }
 
+static void speech_event_handler(bool is_speaking, void *ctx)
+{
+    (void)ctx;
+
+    // Proxy-signalled response boundary (complements the audio gap heuristic)
+    if (is_speaking) {
+        s_discard_downlink = false;
+        audio_history_begin_response();
+    }
+}
+
+static void bargein_event_handler(audio_bargein_event_t event, void *ctx)
+{
+    (void)ctx;
+
+    switch (event) {
+    case AUDIO_BARGEIN_EVENT_DETECTED:
+        if (audio_history_is_replaying()) {
+            // Talking over a local replay just stops it
+            audio_history_stop_replay();
+            break;
+        }
+        // Stop feeding the speaker and unmute right away so the user's speech goes upstream
+        s_last_discarded_us = esp_timer_get_time();
+        s_discard_downlink = true;
+        s_last_audio_received_us = 0;
+        break;
+
+    case AUDIO_BARGEIN_EVENT_FLUSHED:
+        if (s_discard_downlink && ws_client_is_connected()) {
+            ws_client_send_text("{\"type\":\"interrupt\"}");
+        }
+        break;
+    }
+}
+
+static bool ai_is_speaking(void)
+{
+    return (s_last_audio_received_us != 0 &&
+            (esp_timer_get_time() - s_last_audio_received_us) / 1000 < s_ai_speaking_timeout_ms) ||
+           audio_history_is_replaying();
+}
+
+static void wakeword_event_handler(audio_wakeword_event_t event, void *ctx)
+{
+    (void)ctx;
+
+    switch (event) {
+    case AUDIO_WAKEWORD_EVENT_DETECTED: {
+        // The assistant's own voice (or a replay) must not open the mic
+        if (audio_calibration_is_running() || s_user_wants_mic_on || ai_is_speaking()) {
+            ESP_LOGI(TAG, "Wake word ignored (calibrating, mic already on or assistant speaking)");
+            break;
+        }
+
+        audio_wakeword_stats_t stats;
+        audio_wakeword_get_stats(&stats);
+        s_user_wants_mic_on = true;
+        audio_bargein_set_enabled(true);
+
+        if (!g_status.proxy_connected) {
+            // Keep the keyword and everything after it for the session that is about to open
+            ESP_LOGI(TAG, "Wake word - connecting with %lu ms pre-roll",
+                     (unsigned long)(stats.keyword_ms + WAKEWORD_PREROLL_MARGIN_MS));
+            audio_hold_uplink(stats.keyword_ms + WAKEWORD_PREROLL_MARGIN_MS);
+            proxy_client_connect();
+        } else {
+            ESP_LOGI(TAG, "Wake word - enabling microphone");
+            assistant_set_state(ASSISTANT_STATE_STREAMING);
+        }
+        audio_wakeword_set_enabled(false);
+        break;
+    }
+
+    case AUDIO_WAKEWORD_EVENT_ENROLL_NEXT:
+        ui_show_text("Say wake word");
+        break;
+
+    case AUDIO_WAKEWORD_EVENT_ENROLL_DONE:
+    case AUDIO_WAKEWORD_EVENT_ENROLL_FAILED:
+        ui_update_state(g_status);
+        audio_wakeword_set_enabled(!s_user_wants_mic_on);
+        break;
+    }
+}
+
 static void ui_event_handler(const ui_event_t *event, void *ctx)
 {
     (void)ctx;
 
     switch (event->type) {
     case UI_EVENT_RECORD_START:
+        if (audio_calibration_is_running()) {
+            ESP_LOGW(TAG, "Button pressed during acoustic calibration - try again shortly");
+            break;
+        }
+        s_touch_us = event->time_us;
+        s_touch_pending = true;
         if (!g_status.proxy_connected) {
             ESP_LOGI(TAG, "Button pressed while disconnected - reconnecting...");
             proxy_client_connect();
             // Connection will trigger websocket_connected_handler which starts streaming
             // Then we'll enable the mic once connected
             s_user_wants_mic_on = true;
+            audio_bargein_set_enabled(true);
+            audio_wakeword_set_enabled(false);
             break;
         }
 
         ESP_LOGI(TAG, "Button pressed - enabling microphone");
         s_user_wants_mic_on = true;
+        audio_bargein_set_enabled(true);
+        audio_wakeword_set_enabled(false);
         assistant_set_state(ASSISTANT_STATE_STREAMING);
         break;
 
     case UI_EVENT_RECORD_STOP:
         ESP_LOGI(TAG, "Button released - disabling microphone");
         s_user_wants_mic_on = false;
+        audio_bargein_set_enabled(false);
+        audio_wakeword_set_enabled(true);
         assistant_set_state(ASSISTANT_STATE_IDLE);
         break;
 
+    case UI_EVENT_REPLAY:
+        if (s_last_audio_received_us != 0 &&
+            (esp_timer_get_time() - s_last_audio_received_us) / 1000 < s_ai_speaking_timeout_ms) {
+            ESP_LOGI(TAG, "Long press while assistant is speaking - ignoring replay");
+            break;
+        }
+        ESP_LOGI(TAG, "Long press - replaying last response (%zu in history)", audio_history_count());
+        audio_history_replay_latest();
+        break;
+
+    case UI_EVENT_WAKEWORD_ENROLL:
+        if (audio_calibration_is_running() || s_user_wants_mic_on) {
+            ESP_LOGW(TAG, "Wake word enrollment needs the mic off and no calibration running");
+            break;
+        }
+        ESP_LOGI(TAG, "Very long press - enrolling a wake word");
+        audio_wakeword_enroll_start();
+        break;
+
     default:
         ESP_LOGW(TAG, "Unhandled UI event: %d", event->type);
         break;
     }
 }
 
+// Deep sleep only when nothing is going on and nothing is about to
+static bool device_idle(void)
+{
+    return !g_status.proxy_connected && !s_user_wants_mic_on && telemetry_link_idle() &&
+           !audio_calibration_is_running() && !audio_playback_source_is_active() &&
+           !audio_playback_stream_is_active() && !audio_wakeword_is_enrolled();
+}
+
+// On a wake the panel comes up alongside the audio and network bring-up
+static void ui_init_task(void *arg)
+{
+    ui_init(ui_event_handler, NULL);
+    xTaskNotifyGive((TaskHandle_t)arg);
+    vTaskDelete(NULL);
+}
+
 static void lvgl_task(void *pvParameter)
 {
     (void)pvParameter;
 
     while (1) {
         // Call LVGL task handler to process timers and render UI
+        ui_lock();
         lv_timer_handler();
+        ui_unlock();
 
         // Delay for 10ms (LVGL recommends 5-20ms)
         vTaskDelay(pdMS_TO_TICKS(10));
@@ -315,6 +648,7 @@ static void lvgl_task(void *pvParameter)
 
 void app_main(void)
 {
+    deep_sleep_init();
     ESP_ERROR_CHECK(nvs_flash_init());
 
     // Allocate silence buffer from PSRAM (not internal RAM to avoid display SPI conflicts)
@@ -323,18 +657,91 @@ void app_main(void)
         ESP_LOGE(TAG, "Failed to allocate silence buffer from PSRAM!");
     } else {
         ESP_LOGI(TAG, "Allocated %d byte silence buffer from PSRAM", SILENCE_BUFFER_SIZE);
+        psram_bench_track_buffer("silence_buffer", s_silence_buffer, SILENCE_BUFFER_SIZE, 32000, 100);  // 100ms muted chunks
     }
 
+    // Check the DSP kernels before any audio stage uses them (falls back to the reference code on mismatch)
+    dsp_kernels_selftest();
+#if DSP_BENCHMARK_AT_BOOT
+    dsp_kernels_benchmark();
+#endif
+#if CODEC_BENCHMARK_AT_BOOT
+    audio_codec_benchmark();
+#endif
+#if LATENCY_BENCHMARK_AT_BOOT
+    latency_hist_benchmark();
+#endif
+
+    // Workers for one-off async jobs; audio, proxy and enrollment submit to them
+    executor_init();
+#if EXECUTOR_BENCHMARK_AT_BOOT
+    executor_benchmark();
+#endif
+
+    ui_lock_init();  // The Wi-Fi handlers update the UI
     initialise_wifi();
 
-    ui_init(ui_event_handler, NULL);
+    bool wake = deep_sleep_is_wake();
+    if (!wake) {
+        ui_init(ui_event_handler, NULL);
+    } else if (xTaskCreatePinnedToCore(ui_init_task, "ui_init", 4096, xTaskGetCurrentTaskHandle(), 5, NULL,
+                                       1) != pdPASS) {
+        ESP_LOGW(TAG, "Failed to start UI init task, bringing the UI up inline");
+        wake = false;
+        ui_init(ui_event_handler, NULL);
+    }
     audio_controller_init();
+    const audio_uplink_pacing_t pacing = {
+        .catchup_pct = UPLINK_CATCHUP_PCT,
+        .busy_catchup_pct = UPLINK_BUSY_CATCHUP_PCT,
+        .burst_ms = UPLINK_BURST_MS,
+        .downlink_busy = downlink_busy,
+    };
+    audio_set_uplink_pacing(&pacing);
     audio_playback_init();
     audio_playback_set_callback(playback_event_handler, NULL);
-    proxy_client_init(websocket_connected_handler, audio_received_handler, NULL, NULL);  // WebSocket callbacks for continuous streaming
-    assistant_set_state(ASSISTANT_STATE_IDLE);
+    audio_history_init();
+    audio_bargein_init(bargein_event_handler, NULL);
+    audio_endpoint_init();
+    audio_wakeword_init(wakeword_event_handler, NULL);
+
+    // Measure the speaker-to-mic loop once per unit (first boot or after NVS erase),
+    // backing off after failures
+    if (!audio_calibration_load() && audio_calibration_due()) {
+        audio_calibration_start();
+    }
+    assistant_state_t state = ASSISTANT_STATE_IDLE;
+    uint8_t volume;
+    if (deep_sleep_get_ui(&state, &volume)) {
+        audio_playback_set_volume(volume);
+    }
+    proxy_client_init(websocket_connected_handler, audio_received_handler, speech_event_handler, NULL);  // WebSocket callbacks for continuous streaming
+    ws_client_set_codec(SESSION_UPLINK_CODEC, SESSION_DOWNLINK_CODEC);
+    ws_client_set_control_channel(SESSION_CONTROL_CHANNEL);
+    ws_client_set_heartbeat(LINK_HEARTBEAT_MS, LINK_HEARTBEAT_MISSES);
+    ws_client_set_impairment(NET_IMPAIR_PROFILE);
+    telemetry_start(telemetry_link_idle);
+
+    if (wake) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);  // UI init task done
+    }
+
+#if PSRAM_BENCH_AT_BOOT
+    // Runs once the panel is up and before the LVGL task owns it; the first LVGL pass repaints over the test patterns
+    psram_bench_run();
+    ui_lock();
+    lv_obj_invalidate(lv_scr_act());
+    ui_unlock();
+#endif
+    assistant_set_state(state);
+
+    // Listen for the wake word while the mic is off (no-op until a keyword is enrolled)
+    audio_wakeword_set_enabled(true);
 
     // Create LVGL task to periodically update the display
     xTaskCreate(lvgl_task, "lvgl_task", 4096, NULL, 5, NULL);
     ESP_LOGI(TAG, "LVGL task created");
+    deep_sleep_mark_ready(DEEP_SLEEP_READY_UI);
+
+    deep_sleep_start(DEEP_SLEEP_IDLE_S, device_idle);
 }
@@ -0,0 +1,251 @@
+#include "audio_bargein.h"
+#include "audio_calibration.h"
+#include "audio_controller.h"
+#include "audio_playback.h"
+#include "dsp_kernels.h"
+#include "executor.h"
+
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#define REF_SAMPLE_RATE          24000  // Playback rate (matches PLAYBACK_SAMPLE_RATE)
+#define REF_BLOCK_SAMPLES        240    // 10 ms reference resolution
+#define REF_RING_ENTRIES         128    // 1.28 s, covers the longest calibrated delay
+#define MIC_SAMPLE_RATE          16000  // Matches AUDIO_SAMPLE_RATE_HZ
+
+// Used until the unit has been calibrated
+#define DEFAULT_LOOP_DELAY_US    120000
+#define DEFAULT_ECHO_GAIN_Q16    65536  // Assume no acoustic loss (conservative)
+
+#define REF_JITTER_US            40000  // Search window around the loop delay
+#define PLAYBACK_HOLD_US         300000 // Playback counts as audible this long after the last block
+#define ECHO_MARGIN              4      // Near-end must exceed expected echo by 6 dB
+#define NOISE_MARGIN             8      // ... and the noise floor by 9 dB
+#define MIN_SPEECH_ENERGY        (300 * 300)  // Absolute floor (mean square)
+#define ONSET_FRAMES             4      // 64 ms of consecutive speech frames
+#define FLUSH_TIMEOUT_MS         200
+#define I2S_DMA_TAIL_MS          80     // Audio already queued in I2S DMA when the flush lands (8 x 10 ms)
+
+static const char *TAG = "barge_in";
+
+typedef struct {
+    int64_t time_us;   // When the last sample of the block left the playback path
+    uint32_t energy;   // Mean square of the block
+} ref_entry_t;
+
+static ref_entry_t s_ref[REF_RING_ENTRIES];
+static size_t s_ref_head = 0;
+static size_t s_ref_count = 0;
+static SemaphoreHandle_t s_ref_mutex = NULL;
+
+static audio_bargein_callback_t s_callback = NULL;
+static void *s_callback_ctx = NULL;
+static volatile bool s_enabled = false;
+
+static uint32_t s_loop_delay_us = DEFAULT_LOOP_DELAY_US;
+static uint32_t s_echo_gain_q16 = DEFAULT_ECHO_GAIN_Q16;
+
+// Detector state (capture task only)
+static uint32_t s_noise_floor = MIN_SPEECH_ENERGY / NOISE_MARGIN;
+static int s_speech_frames = 0;
+static int64_t s_onset_us = 0;
+static bool s_triggered = false;
+
+static audio_bargein_stats_t s_stats = { 0 };
+static volatile bool s_flush_queued = false;
+
+// Playback tap: record the energy of what was just handed to I2S, in 10 ms blocks
+static void playback_tap(const int16_t *samples, size_t num_samples, void *ctx)
+{
+    (void)ctx;
+    int64_t now_us = esp_timer_get_time();
+
+    xSemaphoreTake(s_ref_mutex, portMAX_DELAY);
+    for (size_t start = 0; start < num_samples; start += REF_BLOCK_SAMPLES) {
+        size_t n = num_samples - start;
+        if (n > REF_BLOCK_SAMPLES) {
+            n = REF_BLOCK_SAMPLES;
+        }
+        size_t remaining = num_samples - start - n;
+
+        s_ref_head = (s_ref_head + 1) % REF_RING_ENTRIES;
+        s_ref[s_ref_head].time_us = now_us - (int64_t)remaining * 1000000 / REF_SAMPLE_RATE;
+        s_ref[s_ref_head].energy = dsp_mean_square_s16(samples + start, n);
+        if (s_ref_count < REF_RING_ENTRIES) {
+            s_ref_count++;
+        }
+    }
+    xSemaphoreGive(s_ref_mutex);
+}
+
+// Loudest reference block that can be echoing in [from_us, to_us]; also reports
+// whether playback was audible at all in that window.
+static uint32_t reference_energy(int64_t from_us, int64_t to_us, bool *playing)
+{
+    uint32_t peak = 0;
+    *playing = false;
+
+    xSemaphoreTake(s_ref_mutex, portMAX_DELAY);
+    if (s_ref_count > 0 && s_ref[s_ref_head].time_us + PLAYBACK_HOLD_US >= from_us) {
+        *playing = true;
+    }
+    for (size_t i = 0; i < s_ref_count; i++) {
+        const ref_entry_t *entry = &s_ref[(s_ref_head + REF_RING_ENTRIES - i) % REF_RING_ENTRIES];
+        if (entry->time_us < from_us) {
+            break;  // Ring is in time order, everything older is out of the window
+        }
+        if (entry->time_us <= to_us && entry->energy > peak) {
+            peak = entry->energy;
+        }
+    }
+    xSemaphoreGive(s_ref_mutex);
+
+    return peak;
+}
+
+// Audio worker: waits for playback's acknowledgement, at most FLUSH_TIMEOUT_MS
+static esp_err_t flush_job(void *arg)
+{
+    (void)arg;
+    int64_t onset_us = s_onset_us;
+
+    bool flushed = audio_playback_stream_flush(FLUSH_TIMEOUT_MS);
+    int64_t silent_us = esp_timer_get_time();
+
+    uint32_t silence_ms = (uint32_t)((silent_us - onset_us) / 1000);
+    s_stats.last_silence_ms = silence_ms;
+    if (silence_ms > s_stats.max_silence_ms) {
+        s_stats.max_silence_ms = silence_ms;
+    }
+
+    if (flushed) {
+        ESP_LOGI(TAG, "Reaction: onset→detect %lu ms, onset→flushed %lu ms (+~%d ms I2S DMA tail)",
+                 (unsigned long)s_stats.last_detect_ms, (unsigned long)silence_ms, I2S_DMA_TAIL_MS);
+    } else {
+        ESP_LOGW(TAG, "Playback flush not acknowledged within %d ms", FLUSH_TIMEOUT_MS);
+    }
+
+    if (s_callback) {
+        s_callback(AUDIO_BARGEIN_EVENT_FLUSHED, s_callback_ctx);
+    }
+
+    s_flush_queued = false;
+    return flushed ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+static void trigger(int64_t now_us)
+{
+    s_triggered = true;
+    s_stats.triggers++;
+    s_stats.last_detect_ms = (uint32_t)((now_us - s_onset_us) / 1000);
+    ESP_LOGI(TAG, "Barge-in #%lu detected", (unsigned long)s_stats.triggers);
+
+    if (s_callback) {
+        s_callback(AUDIO_BARGEIN_EVENT_DETECTED, s_callback_ctx);
+    }
+
+    // Flush from the audio worker so the capture task never blocks on playback
+    if (!s_flush_queued) {
+        s_flush_queued = executor_submit(EXECUTOR_CORE_AUDIO, EXECUTOR_PRIORITY_HIGH, flush_job, NULL, NULL, NULL);
+        if (!s_flush_queued) {
+            ESP_LOGE(TAG, "Failed to queue the playback flush");
+        }
+    }
+}
+
+// Capture tap: one 16 ms microphone frame
+static void capture_tap(const int16_t *samples, size_t num_samples, void *ctx)
+{
+    (void)ctx;
+    int64_t now_us = esp_timer_get_time();
+    int64_t frame_start_us = now_us - (int64_t)num_samples * 1000000 / MIC_SAMPLE_RATE;
+    uint32_t energy = dsp_mean_square_s16(samples, num_samples);
+
+    bool playing = false;
+    uint32_t ref = reference_energy(frame_start_us - s_loop_delay_us - REF_JITTER_US,
+                                    now_us - s_loop_delay_us + REF_JITTER_US, &playing);
+
+    if (!playing) {
+        // Track the room noise floor while nothing is playing; re-arm after a barge-in
+        if (energy < s_noise_floor) {
+            s_noise_floor = energy;
+        } else {
+            s_noise_floor += (energy - s_noise_floor) / 64;
+        }
+        s_triggered = false;
+        s_speech_frames = 0;
+        return;
+    }
+
+    if (!s_enabled || s_triggered) {
+        s_speech_frames = 0;
+        return;
+    }
+
+    // Expected echo = reference × gain² (gain applied in two steps to stay in 64 bits)
+    uint64_t echo = (((uint64_t)ref * s_echo_gain_q16) >> 16) * s_echo_gain_q16 >> 16;
+    uint64_t threshold = ECHO_MARGIN * echo + (uint64_t)NOISE_MARGIN * s_noise_floor;
+    if (threshold < MIN_SPEECH_ENERGY) {
+        threshold = MIN_SPEECH_ENERGY;
+    }
+
+    if (energy > threshold) {
+        if (s_speech_frames++ == 0) {
+            s_onset_us = frame_start_us;
+        }
+        if (s_speech_frames >= ONSET_FRAMES) {
+            s_speech_frames = 0;
+            trigger(now_us);
+        }
+    } else {
+        s_speech_frames = 0;
+    }
+}
+
+void audio_bargein_init(audio_bargein_callback_t callback, void *user_ctx)
+{
+    if (!s_ref_mutex) {
+        s_ref_mutex = xSemaphoreCreateMutex();
+        if (!s_ref_mutex) {
+            ESP_LOGE(TAG, "Failed to create reference mutex");
+            return;
+        }
+    }
+
+    s_callback = callback;
+    s_callback_ctx = user_ctx;
+
+    audio_playback_set_output_tap(playback_tap, NULL);
+    audio_add_capture_frame_tap(capture_tap, NULL);
+
+    ESP_LOGI(TAG, "Barge-in detector initialised");
+}
+
+void audio_bargein_set_enabled(bool enabled)
+{
+    if (enabled && !s_enabled) {
+        audio_calibration_result_t cal = audio_calibration_get_result();
+        if (cal.valid) {
+            s_loop_delay_us = cal.delay_us;
+            s_echo_gain_q16 = cal.echo_gain_q16;
+        } else {
+            s_loop_delay_us = DEFAULT_LOOP_DELAY_US;
+            s_echo_gain_q16 = DEFAULT_ECHO_GAIN_Q16;
+        }
+        ESP_LOGI(TAG, "Armed (loop delay %lu us, echo gain %.3f%s)", (unsigned long)s_loop_delay_us,
+                 s_echo_gain_q16 / 65536.0, cal.valid ? "" : ", uncalibrated defaults");
+    }
+    s_enabled = enabled;
+}
+
+void audio_bargein_get_stats(audio_bargein_stats_t *stats)
+{
+    if (stats) {
+        *stats = s_stats;
+    }
+}
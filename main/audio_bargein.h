@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * @brief Local barge-in detection (near-end speech over assistant playback)
+ *
+ * The playback path reports the energy of every block it hands to I2S, which
+ * serves as the echo reference. Each 16 ms microphone frame is compared with
+ * the reference energy from one acoustic loop delay earlier (scaled by the
+ * calibrated echo gain, see audio_calibration.h) and with the tracked noise
+ * floor. A short run of frames clearly above both counts as the user talking
+ * over the assistant: playback is flushed locally without waiting for the
+ * server, and the reaction time from speech onset to silence is logged.
+ */
+
+typedef enum {
+    AUDIO_BARGEIN_EVENT_DETECTED,   // From the capture task, before the flush
+    AUDIO_BARGEIN_EVENT_FLUSHED,    // From the barge-in task, once playback is silent
+} audio_bargein_event_t;
+
+typedef void (*audio_bargein_callback_t)(audio_bargein_event_t event, void *user_ctx);
+
+typedef struct {
+    uint32_t triggers;              // Barge-ins since init
+    uint32_t last_detect_ms;        // Speech onset → detection
+    uint32_t last_silence_ms;       // Speech onset → playback flushed
+    uint32_t max_silence_ms;
+} audio_bargein_stats_t;
+
+/**
+ * @brief Register the capture and playback taps (call after audio init)
+ *
+ * @param callback Event callback (can be NULL)
+ * @param user_ctx User context passed to the callback
+ */
+void audio_bargein_init(audio_bargein_callback_t callback, void *user_ctx);
+
+/**
+ * @brief Arm or disarm detection (arm only while the user has the mic open)
+ *
+ * Arming reloads the loop delay and echo gain from the latest calibration.
+ */
+void audio_bargein_set_enabled(bool enabled);
+
+/**
+ * @brief Snapshot barge-in statistics
+ */
+void audio_bargein_get_stats(audio_bargein_stats_t *stats);
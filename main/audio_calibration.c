@@ -0,0 +1,350 @@
+#include "audio_calibration.h"
+#include "audio_controller.h"
+#include "audio_playback.h"
+#include "audio_probe.h"
+#include "audio_source.h"
+#include "dsp_kernels.h"
+#include "executor.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "nvs.h"
+
+#define CAL_PLAYBACK_RATE        24000  // Matches PLAYBACK_SAMPLE_RATE
+#define CAL_CAPTURE_RATE         16000  // Matches AUDIO_SAMPLE_RATE_HZ
+#define CAL_LEAD_IN_MS           200    // Capture before the probe (noise floor)
+#define CAL_CAPTURE_MS           1200   // Total capture window
+#define CAL_MAX_DELAY_MS         (CAL_CAPTURE_MS - CAL_LEAD_IN_MS - AUDIO_PROBE_CHIRP_MS)
+#define CAL_MAX_CHUNKS           32
+#define CAL_MAX_SKIPPED_BOOTS    32     // Backoff after failures: 1, 3, 7, ... boots without a retry
+
+#define CAPTURE_SAMPLES          (CAL_CAPTURE_RATE * CAL_CAPTURE_MS / 1000)
+
+#define NVS_NAMESPACE            "audio_calib"
+#define NVS_DELAY_KEY            "delay_us"
+#define NVS_GAIN_KEY             "echo_gain"
+#define NVS_CORR_KEY             "corr"
+#define NVS_FAILS_KEY            "fails"
+#define NVS_SKIP_KEY             "skip"
+
+static const char *TAG = "audio_calib";
+
+typedef struct {
+    int16_t *samples;
+    size_t count;
+    // Delivery time of each capture chunk, to timestamp individual samples
+    int64_t chunk_time_us[CAL_MAX_CHUNKS];
+    size_t chunk_end[CAL_MAX_CHUNKS];
+    size_t num_chunks;
+    SemaphoreHandle_t done;
+} capture_ctx_t;
+
+static audio_calibration_result_t s_result = { 0 };
+static volatile bool s_running = false;
+
+static void capture_cb(const uint8_t *pcm_data, size_t pcm_len, void *ctx)
+{
+    capture_ctx_t *cap = (capture_ctx_t *)ctx;
+    if (cap->count >= CAPTURE_SAMPLES) {
+        return;
+    }
+
+    size_t samples = pcm_len / sizeof(int16_t);
+    if (samples > CAPTURE_SAMPLES - cap->count) {
+        samples = CAPTURE_SAMPLES - cap->count;
+    }
+    memcpy(cap->samples + cap->count, pcm_data, samples * sizeof(int16_t));
+    cap->count += samples;
+
+    if (cap->num_chunks < CAL_MAX_CHUNKS) {
+        cap->chunk_time_us[cap->num_chunks] = esp_timer_get_time();
+        cap->chunk_end[cap->num_chunks] = cap->count;
+        cap->num_chunks++;
+    }
+
+    if (cap->count >= CAPTURE_SAMPLES) {
+        xSemaphoreGive(cap->done);
+    }
+}
+
+// Time at which capture sample `index` was produced, from its chunk delivery time
+static int64_t capture_sample_time_us(const capture_ctx_t *cap, size_t index)
+{
+    for (size_t c = 0; c < cap->num_chunks; c++) {
+        if (index < cap->chunk_end[c]) {
+            return cap->chunk_time_us[c] - (int64_t)(cap->chunk_end[c] - index) * 1000000 / CAL_CAPTURE_RATE;
+        }
+    }
+    return 0;
+}
+
+static void save_result(const audio_calibration_result_t *result)
+{
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to open NVS namespace: %s", esp_err_to_name(err));
+        return;
+    }
+
+    // A success ends any failure backoff
+    nvs_erase_key(nvs_handle, NVS_FAILS_KEY);
+    nvs_erase_key(nvs_handle, NVS_SKIP_KEY);
+
+    err = nvs_set_u32(nvs_handle, NVS_DELAY_KEY, result->delay_us);
+    if (err == ESP_OK) {
+        err = nvs_set_u32(nvs_handle, NVS_GAIN_KEY, result->echo_gain_q16);
+    }
+    if (err == ESP_OK) {
+        err = nvs_set_u32(nvs_handle, NVS_CORR_KEY, result->correlation_q16);
+    }
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs_handle);
+    }
+    nvs_close(nvs_handle);
+
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "Saved calibration to NVS");
+    } else {
+        ESP_LOGW(TAG, "Failed to save calibration to NVS: %s", esp_err_to_name(err));
+    }
+}
+
+// Count a failure and skip the next boots before trying again (1, 3, 7, ... up to the cap)
+static void save_failure(void)
+{
+    nvs_handle_t nvs_handle;
+    if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle) != ESP_OK) {
+        return;
+    }
+
+    uint8_t fails = 0;
+    nvs_get_u8(nvs_handle, NVS_FAILS_KEY, &fails);
+    if (fails < 8) {
+        fails++;
+    }
+    uint32_t skip = (1u << fails) - 1;
+    if (skip > CAL_MAX_SKIPPED_BOOTS) {
+        skip = CAL_MAX_SKIPPED_BOOTS;
+    }
+
+    esp_err_t err = nvs_set_u8(nvs_handle, NVS_FAILS_KEY, fails);
+    if (err == ESP_OK) {
+        err = nvs_set_u8(nvs_handle, NVS_SKIP_KEY, (uint8_t)skip);
+    }
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs_handle);
+    }
+    nvs_close(nvs_handle);
+
+    if (err == ESP_OK) {
+        ESP_LOGW(TAG, "Calibration failed %u time(s), next boot-time attempt in %lu boots", fails,
+                 (unsigned long)skip + 1);
+    }
+}
+
+bool audio_calibration_due(void)
+{
+    nvs_handle_t nvs_handle;
+    if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle) != ESP_OK) {
+        return true;
+    }
+
+    uint8_t skip = 0;
+    bool due = nvs_get_u8(nvs_handle, NVS_SKIP_KEY, &skip) != ESP_OK || skip == 0;
+    if (!due) {
+        skip--;
+        if (nvs_set_u8(nvs_handle, NVS_SKIP_KEY, skip) == ESP_OK) {
+            nvs_commit(nvs_handle);
+        }
+        ESP_LOGI(TAG, "Skipping calibration after earlier failures (%u more boots)", skip);
+    }
+    nvs_close(nvs_handle);
+    return due;
+}
+
+bool audio_calibration_load(void)
+{
+    nvs_handle_t nvs_handle;
+    audio_calibration_result_t result = { 0 };
+
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs_handle);
+    if (err != ESP_OK) {
+        return false;
+    }
+    err = nvs_get_u32(nvs_handle, NVS_DELAY_KEY, &result.delay_us);
+    if (err == ESP_OK) {
+        err = nvs_get_u32(nvs_handle, NVS_GAIN_KEY, &result.echo_gain_q16);
+    }
+    if (err == ESP_OK) {
+        err = nvs_get_u32(nvs_handle, NVS_CORR_KEY, &result.correlation_q16);
+    }
+    nvs_close(nvs_handle);
+
+    if (err != ESP_OK) {
+        return false;
+    }
+
+    result.valid = true;
+    s_result = result;
+    ESP_LOGI(TAG, "Loaded calibration: loop delay %lu us, echo gain %.3f",
+             (unsigned long)result.delay_us, result.echo_gain_q16 / 65536.0);
+    return true;
+}
+
+static bool run_calibration(audio_calibration_result_t *result)
+{
+    const size_t play_len = AUDIO_PROBE_SAMPLES(CAL_PLAYBACK_RATE);
+    const size_t ref_len = AUDIO_PROBE_SAMPLES(CAL_CAPTURE_RATE);
+    const size_t lead_in = CAL_CAPTURE_RATE * CAL_LEAD_IN_MS / 1000;
+    bool ok = false;
+
+    capture_ctx_t *cap = calloc(1, sizeof(capture_ctx_t));
+    int16_t *probe = heap_caps_malloc(play_len * sizeof(int16_t), MALLOC_CAP_SPIRAM);
+    int16_t *ref = heap_caps_malloc(ref_len * sizeof(int16_t), MALLOC_CAP_SPIRAM);
+    if (cap) {
+        cap->samples = heap_caps_malloc(CAPTURE_SAMPLES * sizeof(int16_t), MALLOC_CAP_SPIRAM);
+        cap->done = xSemaphoreCreateBinary();
+    }
+    if (!cap || !cap->samples || !cap->done || !probe || !ref) {
+        ESP_LOGE(TAG, "Failed to allocate calibration buffers");
+        goto cleanup;
+    }
+
+    audio_probe_chirp(probe, CAL_PLAYBACK_RATE);
+    audio_probe_chirp(ref, CAL_CAPTURE_RATE);
+
+    audio_start_streaming_capture(capture_cb, cap);
+
+    // Let the capture run through the lead-in before probing so the noise floor is captured
+    while (cap->count < lead_in) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+
+    // Playback owns the probe from here and frees it when done. It is scaled by
+    // volume only, which is what the echo gain below is measured against.
+    audio_playback_source_t source = { 0 };
+    bool playing = audio_source_buffer(probe, play_len, heap_caps_free, &source);
+    probe = NULL;
+    source.dsp_bypass = true;
+    int64_t play_time_us = esp_timer_get_time();
+    if (!playing || !audio_playback_play_source(&source)) {
+        ESP_LOGE(TAG, "Failed to play the probe");
+        audio_stop_streaming_capture();
+        goto cleanup;
+    }
+
+    bool captured = xSemaphoreTake(cap->done, pdMS_TO_TICKS(CAL_CAPTURE_MS * 2)) == pdTRUE;
+    audio_stop_streaming_capture();
+
+    if (!captured) {
+        ESP_LOGE(TAG, "Capture timed out (%zu samples)", cap->count);
+        goto cleanup;
+    }
+
+    // Search from the probe start (in capture samples) up to the maximum plausible delay
+    size_t play_index = cap->count;
+    for (size_t i = 0; i < cap->count; i++) {
+        if (capture_sample_time_us(cap, i) >= play_time_us) {
+            play_index = i;
+            break;
+        }
+    }
+    if (play_index + ref_len > cap->count) {
+        ESP_LOGE(TAG, "Probe started too late in the capture window");
+        goto cleanup;
+    }
+    size_t last_lag = play_index + CAL_CAPTURE_RATE * CAL_MAX_DELAY_MS / 1000;
+
+    float corr = 0.0f;
+    size_t lag = audio_probe_find(cap->samples, cap->count, ref, ref_len, play_index, last_lag, &corr);
+
+    float noise = (float)dsp_rms_s16(cap->samples, lead_in);
+    float echo = (float)dsp_rms_s16(cap->samples + lag, ref_len);
+    float played = (float)dsp_rms_s16(ref, ref_len) * audio_playback_get_volume() / 100.0f;
+    int64_t delay_us = capture_sample_time_us(cap, lag) - play_time_us;
+
+    ESP_LOGI(TAG, "Probe found at lag %zu: delay %lld us, correlation %.2f, echo RMS %.0f, noise RMS %.0f",
+             lag, delay_us, corr, echo, noise);
+
+    if (corr < AUDIO_PROBE_MIN_CORRELATION || delay_us < 0 || played <= 0.0f) {
+        ESP_LOGW(TAG, "Calibration failed: probe not detected reliably");
+        goto cleanup;
+    }
+
+    result->valid = true;
+    result->delay_us = (uint32_t)delay_us;
+    result->echo_gain_q16 = (uint32_t)lrintf(echo / played * 65536.0f);
+    result->correlation_q16 = (uint32_t)lrintf(corr * 65536.0f);
+    ok = true;
+
+cleanup:
+    if (cap) {
+        if (cap->done) {
+            vSemaphoreDelete(cap->done);
+        }
+        heap_caps_free(cap->samples);
+        free(cap);
+    }
+    heap_caps_free(probe);
+    heap_caps_free(ref);
+    return ok;
+}
+
+static esp_err_t calibration_job(void *arg)
+{
+    (void)arg;
+    ESP_LOGI(TAG, "Starting acoustic loop calibration");
+
+    audio_calibration_result_t result = { 0 };
+    bool ok = run_calibration(&result);
+    if (ok) {
+        s_result = result;
+        ESP_LOGI(TAG, "Calibration complete: loop delay %lu us, echo gain %.3f",
+                 (unsigned long)result.delay_us, result.echo_gain_q16 / 65536.0);
+        save_result(&result);
+    } else {
+        save_failure();
+    }
+
+    s_running = false;
+    return ok ? ESP_OK : ESP_FAIL;
+}
+
+bool audio_calibration_start(void)
+{
+    if (s_running) {
+        ESP_LOGW(TAG, "Calibration already running");
+        return false;
+    }
+    if (audio_playback_stream_is_active()) {
+        ESP_LOGW(TAG, "Cannot calibrate during an active session");
+        return false;
+    }
+
+    s_running = true;
+    if (!executor_submit(EXECUTOR_CORE_AUDIO, EXECUTOR_PRIORITY_LOW, calibration_job, NULL, NULL, NULL)) {
+        ESP_LOGE(TAG, "Failed to queue calibration");
+        s_running = false;
+        return false;
+    }
+    return true;
+}
+
+bool audio_calibration_is_running(void)
+{
+    return s_running;
+}
+
+audio_calibration_result_t audio_calibration_get_result(void)
+{
+    return s_result;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * @brief Acoustic loop calibration (speaker → room → microphone)
+ *
+ * Plays a short linear chirp through the playback path while capturing, then
+ * cross-correlates the capture with the chirp to find the loop delay and echo
+ * gain. The delay is measured in software time: from handing the probe to the
+ * playback path until the chirp shows up in the capture stream, which is what
+ * echo handling on the device has to line up. Results are stored in NVS.
+ */
+
+typedef struct {
+    bool valid;
+    uint32_t delay_us;        // Playback write → capture arrival
+    uint32_t echo_gain_q16;   // Captured RMS / played RMS at 100% volume (1.0 = 65536)
+    uint32_t correlation_q16; // Normalized cross-correlation peak (confidence, 1.0 = 65536)
+} audio_calibration_result_t;
+
+/**
+ * @brief Load a stored calibration from NVS
+ *
+ * @return true if a valid calibration was found
+ */
+bool audio_calibration_load(void);
+
+/**
+ * @brief Whether a boot-time calibration should run (call once per boot)
+ *
+ * False for a number of boots after a failure, growing with each failure in a
+ * row (1, 3, 7, ... up to 32), so a unit that cannot hear itself does not
+ * chirp at every start. Counts the boot towards the next attempt.
+ */
+bool audio_calibration_due(void);
+
+/**
+ * @brief Run the calibration as a background executor job
+ *
+ * Capture and playback must be idle (no active session).
+ *
+ * @return true if the calibration was queued
+ */
+bool audio_calibration_start(void);
+
+/**
+ * @brief Check whether a calibration is currently running
+ */
+bool audio_calibration_is_running(void);
+
+/**
+ * @brief Get the latest calibration result (valid == false if none)
+ */
+audio_calibration_result_t audio_calibration_get_result(void);
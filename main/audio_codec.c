@@ -0,0 +1,566 @@
+#include "audio_codec.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef ESP_PLATFORM
+#include "esp_cpu.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+#include "encoder/impl/esp_opus_enc.h"
+#include "decoder/impl/esp_opus_dec.h"
+#endif
+
+#define ULAW_BIAS           0x84
+#define ULAW_CLIP           32635
+#define ADPCM_MAX_INDEX     88
+
+#define BENCH_SECONDS       1
+#define BENCH_SLICE_MS      200     // Coded in slices so the buffers fit in internal RAM
+#define BENCH_BLOCK_MS      20
+#define BENCH_OPUS_BITRATE  24000
+
+static const int16_t s_step_table[ADPCM_MAX_INDEX + 1] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45, 50, 55, 60, 66, 73, 80, 88, 97,
+    107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+    876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871,
+    5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623,
+    27086, 29794, 32767,
+};
+
+static const int8_t s_index_table[8] = { -1, -1, -1, -1, 2, 4, 6, 8 };
+
+// Decode tables: the step-dependent difference and next step index for each
+// (index, magnitude) pair, so the decoder does one load instead of shifts and adds
+static int16_t s_adpcm_diff[ADPCM_MAX_INDEX + 1][8];
+static uint8_t s_adpcm_next[ADPCM_MAX_INDEX + 1][8];
+static int16_t s_ulaw_table[256];
+static bool s_tables_ready = false;
+
+static void build_tables(void)
+{
+    for (int index = 0; index <= ADPCM_MAX_INDEX; index++) {
+        int step = s_step_table[index];
+        for (int code = 0; code < 8; code++) {
+            int diff = step >> 3;
+            if (code & 4) {
+                diff += step;
+            }
+            if (code & 2) {
+                diff += step >> 1;
+            }
+            if (code & 1) {
+                diff += step >> 2;
+            }
+            int next = index + s_index_table[code];
+            s_adpcm_diff[index][code] = (int16_t)diff;
+            s_adpcm_next[index][code] = (uint8_t)(next < 0 ? 0 : next > ADPCM_MAX_INDEX ? ADPCM_MAX_INDEX : next);
+        }
+    }
+
+    for (int i = 0; i < 256; i++) {
+        int u = ~i & 0xFF;
+        int t = (((u & 0x0F) << 3) + ULAW_BIAS) << ((u & 0x70) >> 4);
+        s_ulaw_table[i] = (int16_t)((u & 0x80) ? ULAW_BIAS - t : t - ULAW_BIAS);
+    }
+    s_tables_ready = true;
+}
+
+const char *audio_codec_name(audio_codec_t codec)
+{
+    switch (codec) {
+    case AUDIO_CODEC_ULAW:
+        return "ulaw";
+    case AUDIO_CODEC_IMA_ADPCM:
+        return "ima_adpcm";
+    case AUDIO_CODEC_PCM:
+    default:
+        return "pcm16";
+    }
+}
+
+bool audio_codec_from_name(const char *name, audio_codec_t *codec)
+{
+    static const audio_codec_t all[] = { AUDIO_CODEC_PCM, AUDIO_CODEC_ULAW, AUDIO_CODEC_IMA_ADPCM };
+    for (size_t i = 0; name && i < sizeof(all) / sizeof(all[0]); i++) {
+        if (strcmp(name, audio_codec_name(all[i])) == 0) {
+            *codec = all[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+uint32_t audio_codec_bitrate(audio_codec_t codec, uint32_t sample_rate, uint16_t block_samples)
+{
+    switch (codec) {
+    case AUDIO_CODEC_ULAW:
+        return sample_rate * 8;
+    case AUDIO_CODEC_IMA_ADPCM:
+        return block_samples ? sample_rate * 4 + sample_rate / block_samples * AUDIO_CODEC_ADPCM_HEADER_BYTES * 8 : 0;
+    case AUDIO_CODEC_PCM:
+    default:
+        return sample_rate * 16;
+    }
+}
+
+static inline uint8_t ulaw_encode_sample(int32_t s)
+{
+    uint8_t sign = (s < 0) ? 0x80 : 0;
+    if (sign) {
+        s = -s;
+    }
+    if (s > ULAW_CLIP) {
+        s = ULAW_CLIP;
+    }
+    s += ULAW_BIAS;
+    // Segment = position of the top set bit above bit 7 (s >> 7 is 1..255 after the bias)
+    int exponent = 31 - __builtin_clz((uint32_t)s >> 7);
+    int mantissa = (s >> (exponent + 3)) & 0x0F;
+    return (uint8_t)~(sign | (exponent << 4) | mantissa);
+}
+
+void audio_codec_ulaw_encode(const int16_t *pcm, uint8_t *out, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        out[i] = ulaw_encode_sample(pcm[i]);
+        out[i + 1] = ulaw_encode_sample(pcm[i + 1]);
+        out[i + 2] = ulaw_encode_sample(pcm[i + 2]);
+        out[i + 3] = ulaw_encode_sample(pcm[i + 3]);
+    }
+    for (; i < n; i++) {
+        out[i] = ulaw_encode_sample(pcm[i]);
+    }
+}
+
+void audio_codec_ulaw_decode(const uint8_t *in, int16_t *pcm, size_t n)
+{
+    if (!s_tables_ready) {
+        build_tables();
+    }
+
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        pcm[i] = s_ulaw_table[in[i]];
+        pcm[i + 1] = s_ulaw_table[in[i + 1]];
+        pcm[i + 2] = s_ulaw_table[in[i + 2]];
+        pcm[i + 3] = s_ulaw_table[in[i + 3]];
+    }
+    for (; i < n; i++) {
+        pcm[i] = s_ulaw_table[in[i]];
+    }
+}
+
+static inline uint8_t adpcm_encode_sample(int32_t *predictor, int *index, int32_t sample)
+{
+    int32_t diff = sample - *predictor;
+    uint8_t code = 0;
+    if (diff < 0) {
+        code = 8;
+        diff = -diff;
+    }
+
+    int32_t step = s_step_table[*index];
+    int32_t vpdiff = step >> 3;
+    if (diff >= step) {
+        code |= 4;
+        diff -= step;
+        vpdiff += step;
+    }
+    step >>= 1;
+    if (diff >= step) {
+        code |= 2;
+        diff -= step;
+        vpdiff += step;
+    }
+    step >>= 1;
+    if (diff >= step) {
+        code |= 1;
+        vpdiff += step;
+    }
+
+    int32_t p = (code & 8) ? *predictor - vpdiff : *predictor + vpdiff;
+    *predictor = p > INT16_MAX ? INT16_MAX : p < INT16_MIN ? INT16_MIN : p;
+    *index = s_adpcm_next[*index][code & 7];
+    return code;
+}
+
+size_t audio_codec_adpcm_encode_block(audio_codec_adpcm_state_t *state, const int16_t *pcm, size_t n, uint8_t *out)
+{
+    if (!s_tables_ready) {
+        build_tables();
+    }
+
+    int32_t predictor = state->predictor;
+    int index = state->step_index;
+
+    out[0] = (uint8_t)(predictor & 0xFF);
+    out[1] = (uint8_t)((uint16_t)predictor >> 8);
+    out[2] = (uint8_t)index;
+    out[3] = 0;
+    uint8_t *nibbles = out + AUDIO_CODEC_ADPCM_HEADER_BYTES;
+
+    for (size_t i = 0; i < n; i += 2) {
+        uint8_t lo = adpcm_encode_sample(&predictor, &index, pcm[i]);
+        uint8_t hi = adpcm_encode_sample(&predictor, &index, pcm[i + 1]);
+        nibbles[i / 2] = (uint8_t)(lo | (hi << 4));
+    }
+
+    state->predictor = (int16_t)predictor;
+    state->step_index = (uint8_t)index;
+    return AUDIO_CODEC_ADPCM_BLOCK_BYTES(n);
+}
+
+static inline int16_t adpcm_decode_sample(int32_t *predictor, int *index, uint8_t code)
+{
+    int32_t diff = s_adpcm_diff[*index][code & 7];
+    int32_t p = (code & 8) ? *predictor - diff : *predictor + diff;
+    *predictor = p > INT16_MAX ? INT16_MAX : p < INT16_MIN ? INT16_MIN : p;
+    *index = s_adpcm_next[*index][code & 7];
+    return (int16_t)*predictor;
+}
+
+void audio_codec_adpcm_decode_block(const uint8_t *in, size_t n, int16_t *pcm)
+{
+    if (!s_tables_ready) {
+        build_tables();
+    }
+
+    int32_t predictor = (int16_t)(in[0] | (in[1] << 8));
+    int index = in[2] > ADPCM_MAX_INDEX ? ADPCM_MAX_INDEX : in[2];
+    const uint8_t *nibbles = in + AUDIO_CODEC_ADPCM_HEADER_BYTES;
+
+    for (size_t i = 0; i < n; i += 2) {
+        uint8_t byte = nibbles[i / 2];
+        pcm[i] = adpcm_decode_sample(&predictor, &index, byte & 0x0F);
+        pcm[i + 1] = adpcm_decode_sample(&predictor, &index, byte >> 4);
+    }
+}
+
+static bool block_samples_valid(audio_codec_t codec, uint16_t block_samples)
+{
+    return codec != AUDIO_CODEC_IMA_ADPCM ||
+           (block_samples >= AUDIO_CODEC_MIN_BLOCK_SAMPLES && block_samples <= AUDIO_CODEC_MAX_BLOCK_SAMPLES &&
+            block_samples % 2 == 0);
+}
+
+bool audio_codec_encoder_init(audio_codec_encoder_t *enc, audio_codec_t codec, uint16_t block_samples)
+{
+    if (!block_samples_valid(codec, block_samples)) {
+        return false;
+    }
+    if (!s_tables_ready) {
+        build_tables();
+    }
+
+    memset(enc, 0, sizeof(*enc));
+    enc->codec = codec;
+    enc->block_samples = block_samples;
+    return true;
+}
+
+size_t audio_codec_encode(audio_codec_encoder_t *enc, const int16_t *pcm, size_t num_samples, uint8_t *out)
+{
+    switch (enc->codec) {
+    case AUDIO_CODEC_ULAW:
+        audio_codec_ulaw_encode(pcm, out, num_samples);
+        return num_samples;
+
+    case AUDIO_CODEC_IMA_ADPCM: {
+        size_t written = 0;
+        const size_t block = enc->block_samples;
+
+        // Top up a held-back partial block first
+        if (enc->num_pending > 0) {
+            size_t take = block - enc->num_pending;
+            if (take > num_samples) {
+                take = num_samples;
+            }
+            memcpy(enc->pending + enc->num_pending, pcm, take * sizeof(int16_t));
+            enc->num_pending += take;
+            pcm += take;
+            num_samples -= take;
+            if (enc->num_pending < block) {
+                return 0;
+            }
+            written += audio_codec_adpcm_encode_block(&enc->adpcm, enc->pending, block, out);
+            enc->num_pending = 0;
+        }
+
+        while (num_samples >= block) {
+            written += audio_codec_adpcm_encode_block(&enc->adpcm, pcm, block, out + written);
+            pcm += block;
+            num_samples -= block;
+        }
+
+        memcpy(enc->pending, pcm, num_samples * sizeof(int16_t));
+        enc->num_pending = num_samples;
+        return written;
+    }
+
+    case AUDIO_CODEC_PCM:
+    default:
+        memcpy(out, pcm, num_samples * sizeof(int16_t));
+        return num_samples * sizeof(int16_t);
+    }
+}
+
+bool audio_codec_decoder_init(audio_codec_decoder_t *dec, audio_codec_t codec, uint16_t block_samples)
+{
+    if (!block_samples_valid(codec, block_samples)) {
+        return false;
+    }
+    if (!s_tables_ready) {
+        build_tables();
+    }
+
+    dec->codec = codec;
+    dec->block_samples = block_samples;
+    dec->num_partial = 0;
+    return true;
+}
+
+void audio_codec_decode(audio_codec_decoder_t *dec, const uint8_t *data, size_t len, audio_codec_sink_t sink,
+                        void *ctx)
+{
+    switch (dec->codec) {
+    case AUDIO_CODEC_ULAW:
+        while (len > 0) {
+            size_t n = len < AUDIO_CODEC_MAX_BLOCK_SAMPLES ? len : AUDIO_CODEC_MAX_BLOCK_SAMPLES;
+            audio_codec_ulaw_decode(data, dec->pcm, n);
+            sink((const uint8_t *)dec->pcm, n * sizeof(int16_t), ctx);
+            data += n;
+            len -= n;
+        }
+        break;
+
+    case AUDIO_CODEC_IMA_ADPCM: {
+        const size_t block = dec->block_samples;
+        const size_t block_bytes = AUDIO_CODEC_ADPCM_BLOCK_BYTES(block);
+
+        while (len > 0) {
+            const uint8_t *src = data;
+            size_t take = block_bytes;
+
+            // A block split across fragments is reassembled; whole blocks decode in place
+            if (dec->num_partial > 0 || len < block_bytes) {
+                take = block_bytes - dec->num_partial;
+                if (take > len) {
+                    take = len;
+                }
+                memcpy(dec->partial + dec->num_partial, data, take);
+                dec->num_partial += take;
+                if (dec->num_partial < block_bytes) {
+                    return;
+                }
+                src = dec->partial;
+                dec->num_partial = 0;
+            }
+
+            audio_codec_adpcm_decode_block(src, block, dec->pcm);
+            sink((const uint8_t *)dec->pcm, block * sizeof(int16_t), ctx);
+            data += take;
+            len -= take;
+        }
+        break;
+    }
+
+    case AUDIO_CODEC_PCM:
+    default:
+        sink(data, len, ctx);
+        break;
+    }
+}
+
+#ifdef ESP_PLATFORM
+static const char *TAG = "audio_codec";
+
+// Speech-like test signal: a gliding harmonic voice with a 4 Hz syllable envelope and a noise floor
+static void fill_test_signal(int16_t *pcm, size_t n, uint32_t sample_rate, size_t offset)
+{
+    uint32_t seed = 0x9E3779B9u + (uint32_t)offset;
+    for (size_t i = 0; i < n; i++) {
+        float t = (float)(i + offset) / sample_rate;
+        float f0 = 140.0f + 40.0f * sinf(2.0f * (float)M_PI * 1.5f * t);
+        float envelope = 0.55f + 0.45f * sinf(2.0f * (float)M_PI * 4.0f * t);
+        float v = 0.0f;
+        for (int h = 1; h <= 12; h++) {
+            v += sinf(2.0f * (float)M_PI * f0 * h * t) / h;
+        }
+        seed = seed * 1664525u + 1013904223u;
+        float noise = ((int32_t)(seed >> 16) - 32768) / 32768.0f;
+        pcm[i] = (int16_t)(6000.0f * envelope * v + 300.0f * noise);
+    }
+}
+
+typedef struct {
+    const char *name;
+    uint32_t sample_rate;
+    uint32_t cycles;
+    uint32_t bitrate;
+    double signal;
+    double error;
+} bench_row_t;
+
+static void log_row(const bench_row_t *row)
+{
+    float us_per_s = (float)row->cycles / CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ / BENCH_SECONDS;
+    if (row->error > 0) {
+        ESP_LOGI(TAG, "  %-16s %5lu %9.0f %7.2f%% %8lu %7.1f", row->name, (unsigned long)row->sample_rate, us_per_s,
+                 us_per_s / 10000.0f, (unsigned long)(row->bitrate / 1000), 10.0 * log10(row->signal / row->error));
+    } else {
+        ESP_LOGI(TAG, "  %-16s %5lu %9.0f %7.2f%% %8lu %7s", row->name, (unsigned long)row->sample_rate, us_per_s,
+                 us_per_s / 10000.0f, (unsigned long)(row->bitrate / 1000), "-");
+    }
+}
+
+// Encode then decode BENCH_SECONDS of the test signal in slices, timing each side
+static void bench_codec(audio_codec_t codec, uint32_t sample_rate, int16_t *pcm, uint8_t *coded, int16_t *decoded)
+{
+    static audio_codec_encoder_t enc;
+    const size_t slice = sample_rate * BENCH_SLICE_MS / 1000;
+    const uint16_t block = sample_rate * BENCH_BLOCK_MS / 1000;
+    bench_row_t enc_row = { .sample_rate = sample_rate, .bitrate = audio_codec_bitrate(codec, sample_rate, block) };
+    bench_row_t dec_row = enc_row;
+    char enc_name[24], dec_name[24];
+
+    audio_codec_encoder_init(&enc, codec, block);
+    for (size_t offset = 0; offset < sample_rate * BENCH_SECONDS; offset += slice) {
+        fill_test_signal(pcm, slice, sample_rate, offset);
+
+        uint32_t start = esp_cpu_get_cycle_count();
+        size_t bytes = audio_codec_encode(&enc, pcm, slice, coded);
+        uint32_t mid = esp_cpu_get_cycle_count();
+
+        switch (codec) {
+        case AUDIO_CODEC_ULAW:
+            audio_codec_ulaw_decode(coded, decoded, slice);
+            break;
+        case AUDIO_CODEC_IMA_ADPCM:
+            for (size_t b = 0; b * AUDIO_CODEC_ADPCM_BLOCK_BYTES(block) < bytes; b++) {
+                audio_codec_adpcm_decode_block(coded + b * AUDIO_CODEC_ADPCM_BLOCK_BYTES(block), block,
+                                               decoded + b * block);
+            }
+            break;
+        default:
+            memcpy(decoded, coded, bytes);
+            break;
+        }
+        uint32_t end = esp_cpu_get_cycle_count();
+
+        enc_row.cycles += mid - start;
+        dec_row.cycles += end - mid;
+        for (size_t i = 0; i < slice; i++) {
+            double e = (double)pcm[i] - decoded[i];
+            dec_row.signal += (double)pcm[i] * pcm[i];
+            dec_row.error += e * e;
+        }
+    }
+
+    snprintf(enc_name, sizeof(enc_name), "%s enc", audio_codec_name(codec));
+    snprintf(dec_name, sizeof(dec_name), "%s dec", audio_codec_name(codec));
+    enc_row.name = enc_name;
+    dec_row.name = dec_name;
+    log_row(&enc_row);
+    log_row(&dec_row);
+}
+
+// Opus through esp_audio_codec at the same rates: 20 ms VoIP frames
+static void bench_opus(uint32_t sample_rate, int16_t *pcm, uint8_t *coded, int16_t *decoded)
+{
+    esp_opus_enc_config_t enc_cfg = ESP_OPUS_ENC_CONFIG_DEFAULT();
+    enc_cfg.sample_rate = sample_rate;
+    enc_cfg.channel = 1;
+    enc_cfg.bitrate = BENCH_OPUS_BITRATE;
+    enc_cfg.frame_duration = ESP_OPUS_ENC_FRAME_DURATION_20_MS;
+    enc_cfg.application_mode = ESP_OPUS_ENC_APPLICATION_VOIP;
+    esp_opus_dec_cfg_t dec_cfg = {
+        .sample_rate = sample_rate,
+        .channel = 1,
+        .frame_duration = ESP_OPUS_DEC_FRAME_DURATION_20_MS,
+        .self_delimited = false,
+    };
+
+    void *encoder = NULL, *decoder = NULL;
+    if (esp_opus_enc_open(&enc_cfg, sizeof(enc_cfg), &encoder) != ESP_AUDIO_ERR_OK ||
+        esp_opus_dec_open(&dec_cfg, sizeof(dec_cfg), &decoder) != ESP_AUDIO_ERR_OK) {
+        ESP_LOGW(TAG, "  opus: codec open failed, skipped");
+        goto cleanup;
+    }
+
+    const size_t frame = sample_rate * BENCH_BLOCK_MS / 1000;
+    const size_t slice = sample_rate * BENCH_SLICE_MS / 1000;
+    bench_row_t enc_row = { .name = "opus enc", .sample_rate = sample_rate, .bitrate = BENCH_OPUS_BITRATE };
+    bench_row_t dec_row = { .name = "opus dec", .sample_rate = sample_rate, .bitrate = BENCH_OPUS_BITRATE };
+
+    for (size_t offset = 0; offset < sample_rate * BENCH_SECONDS; offset += slice) {
+        fill_test_signal(pcm, slice, sample_rate, offset);
+        for (size_t f = 0; f + frame <= slice; f += frame) {
+            esp_audio_enc_in_frame_t in = { .buffer = (uint8_t *)(pcm + f), .len = frame * sizeof(int16_t) };
+            esp_audio_enc_out_frame_t out = { .buffer = coded, .len = AUDIO_CODEC_ENCODE_BOUND(frame) };
+
+            uint32_t start = esp_cpu_get_cycle_count();
+            esp_opus_enc_process(encoder, &in, &out);
+            uint32_t mid = esp_cpu_get_cycle_count();
+
+            esp_audio_dec_in_raw_t raw = { .buffer = coded, .len = out.encoded_bytes };
+            esp_audio_dec_out_frame_t dec_out = { .buffer = (uint8_t *)decoded, .len = frame * sizeof(int16_t) };
+            esp_audio_dec_info_t info = { 0 };
+            esp_opus_dec_decode(decoder, &raw, &dec_out, &info);
+            uint32_t end = esp_cpu_get_cycle_count();
+
+            enc_row.cycles += mid - start;
+            dec_row.cycles += end - mid;
+        }
+    }
+
+    // Opus is not waveform-matching (and has look-ahead delay), so no SNR column
+    log_row(&enc_row);
+    log_row(&dec_row);
+
+cleanup:
+    if (encoder) {
+        esp_opus_enc_close(encoder);
+    }
+    if (decoder) {
+        esp_opus_dec_close(decoder);
+    }
+}
+
+void audio_codec_benchmark(void)
+{
+    static const uint32_t rates[] = { 16000, 24000 };  // Uplink, downlink
+    static const audio_codec_t codecs[] = { AUDIO_CODEC_PCM, AUDIO_CODEC_ULAW, AUDIO_CODEC_IMA_ADPCM };
+    const size_t max_slice = 24000 * BENCH_SLICE_MS / 1000;
+
+    int16_t *pcm = heap_caps_malloc(max_slice * sizeof(int16_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    int16_t *decoded = heap_caps_malloc(max_slice * sizeof(int16_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    uint8_t *coded = heap_caps_malloc(AUDIO_CODEC_ENCODE_BOUND(max_slice) * sizeof(int16_t),
+                                      MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (!pcm || !decoded || !coded) {
+        ESP_LOGW(TAG, "Codec benchmark skipped: out of memory");
+        goto cleanup;
+    }
+
+    ESP_LOGI(TAG, "Codec benchmark (%d MHz, CPU per second of mono audio):", CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ);
+    ESP_LOGI(TAG, "  %-16s %5s %9s %8s %8s %7s", "codec", "rate", "us/s", "core", "kbit/s", "SNR dB");
+    for (size_t r = 0; r < sizeof(rates) / sizeof(rates[0]); r++) {
+        for (size_t c = 0; c < sizeof(codecs) / sizeof(codecs[0]); c++) {
+            bench_codec(codecs[c], rates[r], pcm, coded, decoded);
+        }
+        bench_opus(rates[r], pcm, coded, decoded);
+    }
+
+cleanup:
+    heap_caps_free(pcm);
+    heap_caps_free(decoded);
+    heap_caps_free(coded);
+}
+#else
+void audio_codec_benchmark(void)
+{
+}
+#endif
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Lightweight speech codecs for the WebSocket binary audio path
+ *
+ * Raw PCM costs 256 kbit/s uplink (16 kHz) and 384 kbit/s downlink (24 kHz).
+ * Opus would cut that ~10x but costs a large share of a core that also runs
+ * Wi-Fi and LVGL. These two codecs cost a few percent of a core:
+ *
+ *   - G.711 µ-law: 8 bits per sample (2:1). Stateless, so any byte count is
+ *     a valid message.
+ *   - IMA-ADPCM: 4 bits per sample plus a 4-byte header per block (~3.9:1 at
+ *     20 ms blocks). Every block is self-contained: the header holds the
+ *     predictor (int16 LE) and step index (uint8, then one reserved byte) in
+ *     effect before its first sample. Nibbles follow, low nibble first. A
+ *     WebSocket message always carries whole blocks, so a receiver can
+ *     decode any message without earlier ones.
+ *
+ * The stream encoder and decoder handle framing. The encoder holds back a
+ * partial block until the next call. The decoder reassembles blocks split
+ * across transport fragments. Both are plain C and build on the host.
+ */
+
+typedef enum {
+    AUDIO_CODEC_PCM = 0,            // 16-bit little-endian PCM (legacy)
+    AUDIO_CODEC_ULAW,               // G.711 µ-law
+    AUDIO_CODEC_IMA_ADPCM,          // IMA-ADPCM blocks
+} audio_codec_t;
+
+#define AUDIO_CODEC_ADPCM_HEADER_BYTES      4
+#define AUDIO_CODEC_ADPCM_BLOCK_BYTES(n)    (AUDIO_CODEC_ADPCM_HEADER_BYTES + (n) / 2)
+#define AUDIO_CODEC_MIN_BLOCK_SAMPLES       8
+#define AUDIO_CODEC_MAX_BLOCK_SAMPLES       1024
+#define AUDIO_CODEC_ENCODE_BOUND(n)         (2 * (n) + AUDIO_CODEC_MAX_BLOCK_SAMPLES)  // Output bytes for n input samples, any codec
+
+typedef struct {
+    int16_t predictor;
+    uint8_t step_index;
+} audio_codec_adpcm_state_t;
+
+typedef struct {
+    audio_codec_t codec;
+    uint16_t block_samples;         // ADPCM block length (even)
+    audio_codec_adpcm_state_t adpcm;
+    uint16_t num_pending;           // Samples held back until a block fills
+    int16_t pending[AUDIO_CODEC_MAX_BLOCK_SAMPLES];
+} audio_codec_encoder_t;
+
+typedef struct {
+    audio_codec_t codec;
+    uint16_t block_samples;
+    uint16_t num_partial;           // Bytes of a block split across messages
+    uint8_t partial[AUDIO_CODEC_ADPCM_BLOCK_BYTES(AUDIO_CODEC_MAX_BLOCK_SAMPLES)];
+    int16_t pcm[AUDIO_CODEC_MAX_BLOCK_SAMPLES];
+} audio_codec_decoder_t;
+
+/**
+ * @brief Receives decoded PCM (bytes, 16-bit little-endian)
+ */
+typedef void (*audio_codec_sink_t)(const uint8_t *pcm, size_t len, void *ctx);
+
+/**
+ * @brief Wire name of a codec ("pcm16", "ulaw", "ima_adpcm")
+ */
+const char *audio_codec_name(audio_codec_t codec);
+
+/**
+ * @brief Look up a codec by wire name
+ *
+ * @return false if the name is unknown (codec left unchanged)
+ */
+bool audio_codec_from_name(const char *name, audio_codec_t *codec);
+
+/**
+ * @brief Encoded bits per second for a codec at a sample rate
+ */
+uint32_t audio_codec_bitrate(audio_codec_t codec, uint32_t sample_rate, uint16_t block_samples);
+
+/**
+ * @brief G.711 µ-law encode/decode (n samples, any n)
+ */
+void audio_codec_ulaw_encode(const int16_t *pcm, uint8_t *out, size_t n);
+void audio_codec_ulaw_decode(const uint8_t *in, int16_t *pcm, size_t n);
+
+/**
+ * @brief Encode one IMA-ADPCM block of n samples (n even), continuing from state
+ *
+ * @return Bytes written (AUDIO_CODEC_ADPCM_BLOCK_BYTES(n))
+ */
+size_t audio_codec_adpcm_encode_block(audio_codec_adpcm_state_t *state, const int16_t *pcm, size_t n, uint8_t *out);
+
+/**
+ * @brief Decode one IMA-ADPCM block of n samples (state comes from its header)
+ */
+void audio_codec_adpcm_decode_block(const uint8_t *in, size_t n, int16_t *pcm);
+
+/**
+ * @brief Reset a stream encoder
+ *
+ * @return false if block_samples is odd or out of range (ADPCM only)
+ */
+bool audio_codec_encoder_init(audio_codec_encoder_t *enc, audio_codec_t codec, uint16_t block_samples);
+
+/**
+ * @brief Encode PCM into whole blocks, holding back any partial block
+ *
+ * @param out At least AUDIO_CODEC_ENCODE_BOUND(num_samples) bytes
+ * @return Bytes written (0 if everything was held back)
+ */
+size_t audio_codec_encode(audio_codec_encoder_t *enc, const int16_t *pcm, size_t num_samples, uint8_t *out);
+
+/**
+ * @brief Reset a stream decoder
+ *
+ * @return false if block_samples is odd or out of range (ADPCM only)
+ */
+bool audio_codec_decoder_init(audio_codec_decoder_t *dec, audio_codec_t codec, uint16_t block_samples);
+
+/**
+ * @brief Decode a received fragment and pass the PCM to sink
+ *
+ * PCM passes straight through. Coded audio is handed over one block (ADPCM)
+ * or up to AUDIO_CODEC_MAX_BLOCK_SAMPLES samples (µ-law) at a time.
+ */
+void audio_codec_decode(audio_codec_decoder_t *dec, const uint8_t *data, size_t len, audio_codec_sink_t sink,
+                        void *ctx);
+
+/**
+ * @brief Log CPU per second of audio for PCM, µ-law, IMA-ADPCM and Opus, plus round-trip SNR
+ */
+void audio_codec_benchmark(void);
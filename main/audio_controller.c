@@ -1,24 +1,337 @@
 #include "audio_controller.h"
+#include "audio_graph.h"
+#include "flash_safety.h"
+#include "latency_hist.h"
+#include "psram_bench.h"
 #include "smart_assistant.h"
 
+#include <string.h>
+
 #include "driver/i2s_std.h"
+#include "esp_attr.h"
 #include "esp_check.h"
 #include "esp_log.h"
 #include "esp_heap_caps.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include "freertos/task.h"
 
 #define AUDIO_SAMPLE_RATE_HZ     16000
 #define AUDIO_BITS_PER_SAMPLE    I2S_DATA_BIT_WIDTH_32BIT  // MEMS mic outputs 32-bit I2S data
 #define AUDIO_CHANNEL_COUNT      1
 #define AUDIO_FRAME_SAMPLES      256
+#define AUDIO_CHUNK_SAMPLES      1600   // 100ms uplink chunks
+#define AUDIO_DMA_DESC_NUM       8      // 8 x 16ms of DMA carries capture across a flash write
+#define AUDIO_DMA_FRAME_NUM      AUDIO_FRAME_SAMPLES
+#define CAPTURE_TASK_PRIORITY    5
+#define UPLINK_TASK_PRIORITY     4      // Below the capture task so I2S reads are never starved
+#define DETECTOR_TASK_PRIORITY   2      // Always-on detectors yield to everything on the audio path
+#define CAPTURE_IDLE_TIMEOUT_MS  200
+#define CAPTURE_PARK_TIMEOUT_MS  50
+#define UPLINK_RING_MS           6000   // Pre-roll history, and backlog while a session connects
+#define UPLINK_RING_SAMPLES      (AUDIO_SAMPLE_RATE_HZ / 1000 * UPLINK_RING_MS)
+#define UPLINK_RING_SPAN         (UPLINK_RING_SAMPLES - AUDIO_FRAME_SAMPLES)  // The writer may be filling one frame
+#define UPLINK_PACE_UNITS        1000000ULL  // Token units per sample (us × Hz)
+#define UPLINK_BACKLOG_LOG_MS    500    // Log backlogs that peaked at least this old
 
 static const char *TAG = "audio_ctrl";
 
 static TaskHandle_t streaming_capture_task_handle = NULL;
+static volatile bool s_capture_running = false;
+static volatile bool s_capture_parked = true;
 static i2s_chan_handle_t s_rx_chan = NULL;
 static audio_capture_chunk_cb_t s_chunk_cb = NULL;
 static void *s_chunk_ctx = NULL;
+static audio_capture_frame_cb_t s_frame_cbs[AUDIO_MAX_FRAME_TAPS];
+static void *s_frame_ctxs[AUDIO_MAX_FRAME_TAPS];
+static volatile size_t s_num_frame_taps = 0;
+static audio_capture_frame_cb_t s_worker_cbs[AUDIO_MAX_WORKER_TAPS];
+static void *s_worker_ctxs[AUDIO_MAX_WORKER_TAPS];
+static volatile size_t s_num_worker_taps = 0;
+
+// Who needs the microphone: a streaming consumer, idle listening, or a held uplink
+static SemaphoreHandle_t s_capture_mutex = NULL;
+static bool s_idle_capture = false;
+static bool s_uplink_hold = false;
+
+// Capture graph: I2S frames → local detectors and the uplink ring (inline) →
+// worker detectors (own low-priority task). The uplink task drains the ring
+// into the chunk callback, which may block on the network; nothing it does
+// stalls the graph, so a stalled send only grows the backlog in the ring.
+static audio_graph_t *s_capture_graph = NULL;
+static TaskHandle_t s_uplink_task_handle = NULL;
+static SemaphoreHandle_t s_uplink_send_mutex = NULL;  // Held by the uplink task around the chunk callback
+static int16_t s_uplink_chunk[AUDIO_CHUNK_SAMPLES];
+static volatile uint32_t s_chunk_samples = AUDIO_CHUNK_SAMPLES;  // Negotiated per session, ≤ AUDIO_CHUNK_SAMPLES
+
+// Every captured sample goes through a PSRAM ring; the callback is fed from the
+// read position, which normally trails the write position by less than a chunk.
+// A hold keeps history from before the session so it can be sent as pre-roll.
+// Positions are sample counts. The ring node owns the write side, the uplink
+// task the read side; s_ring_lock covers what they share.
+static int16_t *s_uplink_ring = NULL;
+static portMUX_TYPE s_ring_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint64_t s_ring_write = 0;
+static uint64_t s_ring_start = 0;           // First sample of the current capture run
+static bool s_ring_reset_request = false;
+static uint64_t s_ring_read = 0;
+static bool s_uplink_holding = false;
+static volatile uint32_t s_preroll_request = 0;  // Samples, applied by the uplink task
+static volatile bool s_release_request = false;
+static volatile bool s_uplink_paused = false;
+
+// Token bucket in sample × 1e6 units, refilled from the wall clock by the uplink task.
+// Real time only until the app sets its pacing.
+static audio_uplink_pacing_t s_pacing = {
+    .catchup_pct = 100,
+    .busy_catchup_pct = 100,
+};
+static uint64_t s_pace_tokens = 0;
+static int64_t s_pace_last_us = 0;
+
+// Backlog tracking, owned by the uplink task
+static audio_uplink_stats_t s_uplink_stats;
+static volatile bool s_uplink_stats_reset = false;
+static int64_t s_backlog_start_us = 0;      // 0: no backlog
+static uint32_t s_backlog_peak_ms = 0;
+
+static volatile uint32_t s_capture_overruns = 0;
+
+// I2S ISR: the DMA wrapped onto a buffer the capture task had not read yet
+static bool IRAM_ATTR capture_overrun_cb(i2s_chan_handle_t handle, i2s_event_data_t *event, void *ctx)
+{
+    (void)handle;
+    (void)event;
+    (void)ctx;
+    s_capture_overruns++;
+    return false;
+}
+
+static void convert_i2s_frame(const int32_t *in, int16_t *out, size_t num_samples)
+{
+    for (size_t i = 0; i < num_samples; i++) {
+        // Convert 32-bit I2S to 16-bit PCM
+        out[i] = (int16_t)(in[i] >> 14);
+    }
+}
+
+static void mic_taps_process(int16_t *block, size_t num_samples, void *ctx)
+{
+    (void)ctx;
+    for (size_t t = 0; t < s_num_frame_taps; t++) {
+        s_frame_cbs[t](block, num_samples, s_frame_ctxs[t]);
+    }
+}
+
+// Copy n samples between the ring and a linear buffer, wrapping at the end of the ring
+static void ring_copy(int16_t *dst, const int16_t *src, uint64_t ring_pos, size_t n, bool to_ring)
+{
+    while (n > 0) {
+        size_t index = (size_t)(ring_pos % UPLINK_RING_SAMPLES);
+        size_t run = UPLINK_RING_SAMPLES - index;
+        if (run > n) {
+            run = n;
+        }
+        if (to_ring) {
+            memcpy(s_uplink_ring + index, src, run * sizeof(int16_t));
+            src += run;
+        } else {
+            memcpy(dst, s_uplink_ring + index, run * sizeof(int16_t));
+            dst += run;
+        }
+        ring_pos += run;
+        n -= run;
+    }
+}
+
+// Capture task: never blocks, so a stalled send cannot back up the graph
+static void uplink_ring_process(int16_t *block, size_t num_samples, void *ctx)
+{
+    (void)ctx;
+
+    ring_copy(NULL, block, s_ring_write, num_samples, true);
+    portENTER_CRITICAL(&s_ring_lock);
+    s_ring_write += num_samples;
+    portEXIT_CRITICAL(&s_ring_lock);
+    if (s_uplink_task_handle) {
+        xTaskNotifyGive(s_uplink_task_handle);
+    }
+}
+
+static void uplink_ring_reset(void *ctx)
+{
+    (void)ctx;
+    portENTER_CRITICAL(&s_ring_lock);
+    s_ring_start = s_ring_write;
+    s_ring_reset_request = true;
+    portEXIT_CRITICAL(&s_ring_lock);
+}
+
+static uint64_t ring_write_pos(void)
+{
+    portENTER_CRITICAL(&s_ring_lock);
+    uint64_t write = s_ring_write;
+    portEXIT_CRITICAL(&s_ring_lock);
+    return write;
+}
+
+// Uplink task: catch the read position up with a backlog the writer has lapped
+static uint64_t skip_overrun(void)
+{
+    uint64_t write = ring_write_pos();
+    if (write - s_ring_read > UPLINK_RING_SPAN) {
+        uint64_t skipped = write - s_ring_read - UPLINK_RING_SPAN;
+        if (!s_uplink_paused) {
+            ESP_LOGW(TAG, "Uplink backlog overran the ring, skipping %llu samples", (unsigned long long)skipped);
+        }
+        s_uplink_stats.dropped_ms += (uint32_t)(skipped / (AUDIO_SAMPLE_RATE_HZ / 1000));
+        s_ring_read = write - UPLINK_RING_SPAN;
+    }
+    return write;
+}
+
+// Uplink task: hand paced chunks from the ring to the consumer, after every captured frame
+static void uplink_drain(void)
+{
+    portENTER_CRITICAL(&s_ring_lock);
+    uint64_t write = s_ring_write;
+    uint64_t start = s_ring_start;
+    bool reset = s_ring_reset_request;
+    s_ring_reset_request = false;
+    portEXIT_CRITICAL(&s_ring_lock);
+
+    if (reset) {
+        s_ring_read = start;
+        s_uplink_holding = false;
+        s_backlog_start_us = 0;
+        s_pace_last_us = 0;                 // Starts full: the first chunks of a run go out at once
+    }
+
+    uint32_t preroll = s_preroll_request;
+    if (preroll > 0) {
+        s_preroll_request = 0;
+        uint64_t available = write - start;
+        if (available > UPLINK_RING_SPAN) {
+            available = UPLINK_RING_SPAN;
+        }
+        s_ring_read = write - (preroll < available ? preroll : available);
+        s_uplink_holding = true;
+    }
+    if (s_release_request) {
+        s_release_request = false;
+        s_uplink_holding = false;
+    }
+
+    if (s_uplink_stats_reset) {
+        s_uplink_stats_reset = false;
+        memset(&s_uplink_stats, 0, sizeof(s_uplink_stats));
+    }
+
+    audio_capture_chunk_cb_t chunk_cb = s_chunk_cb;
+    if (!chunk_cb) {
+        if (s_uplink_holding && write - s_ring_read > UPLINK_RING_SPAN) {
+            ESP_LOGW(TAG, "Uplink hold expired after %d ms without a consumer", UPLINK_RING_MS);
+            s_uplink_holding = false;
+        }
+        if (!s_uplink_holding) {
+            s_ring_read = write;
+        }
+        s_backlog_start_us = 0;
+        s_uplink_stats.backlog_ms = 0;
+        return;
+    }
+
+    // Refill the bucket for the time since the last pass, up to one chunk plus the burst
+    const uint32_t chunk = s_chunk_samples;
+    int64_t now_us = esp_timer_get_time();
+    audio_link_busy_fn_t busy = s_pacing.downlink_busy;
+    uint32_t pct = (busy && busy()) ? s_pacing.busy_catchup_pct : s_pacing.catchup_pct;
+    uint64_t capacity = (uint64_t)(chunk + s_pacing.burst_ms * (AUDIO_SAMPLE_RATE_HZ / 1000)) * UPLINK_PACE_UNITS;
+    s_pace_tokens += (uint64_t)(now_us - s_pace_last_us) * AUDIO_SAMPLE_RATE_HZ * pct / 100;
+    if (s_pace_tokens > capacity) {
+        s_pace_tokens = capacity;
+    }
+    s_pace_last_us = now_us;
+
+    const uint64_t cost = (uint64_t)chunk * UPLINK_PACE_UNITS;
+    while (!s_uplink_paused && s_pace_tokens >= cost) {
+        write = skip_overrun();
+        if (write - s_ring_read < chunk) {
+            break;
+        }
+        ring_copy(s_uplink_chunk, NULL, s_ring_read, chunk, false);
+        if (ring_write_pos() - s_ring_read > UPLINK_RING_SPAN) {
+            continue;  // The writer lapped the chunk mid-copy; skipped on the next pass
+        }
+        s_pace_tokens -= cost;
+        // Age of the chunk's first sample: the chunk itself plus any backlog behind it
+        latency_hist_record_metric(LATENCY_METRIC_CAPTURE_TO_SEND,
+                                   (uint32_t)(write - s_ring_read) * 1000 / (AUDIO_SAMPLE_RATE_HZ / 1000));
+        s_ring_read += chunk;
+        chunk_cb((const uint8_t *)s_uplink_chunk, chunk * sizeof(int16_t), s_chunk_ctx);
+    }
+
+    // A whole chunk still waiting means the pacer (or a pause) is holding audio back
+    write = skip_overrun();
+    now_us = esp_timer_get_time();
+    uint32_t waiting = (uint32_t)(write - s_ring_read);
+    uint32_t age_ms = waiting / (AUDIO_SAMPLE_RATE_HZ / 1000);
+    s_uplink_stats.backlog_ms = age_ms;
+    if (age_ms > s_uplink_stats.peak_backlog_ms) {
+        s_uplink_stats.peak_backlog_ms = age_ms;
+    }
+    if (waiting >= chunk) {
+        if (!s_backlog_start_us) {
+            s_backlog_start_us = now_us;
+            s_backlog_peak_ms = 0;
+        }
+        if (age_ms > s_backlog_peak_ms) {
+            s_backlog_peak_ms = age_ms;
+        }
+    } else if (s_backlog_start_us) {
+        uint32_t drain_ms = (uint32_t)((now_us - s_backlog_start_us) / 1000);
+        s_backlog_start_us = 0;
+        s_uplink_stats.backlogs++;
+        if (drain_ms > s_uplink_stats.longest_drain_ms) {
+            s_uplink_stats.longest_drain_ms = drain_ms;
+        }
+        latency_hist_record_metric(LATENCY_METRIC_UPLINK_BACKLOG, s_backlog_peak_ms * 1000);
+        if (s_backlog_peak_ms >= UPLINK_BACKLOG_LOG_MS) {
+            ESP_LOGI(TAG, "Uplink caught up with a %lu ms backlog in %lu ms", (unsigned long)s_backlog_peak_ms,
+                     (unsigned long)drain_ms);
+        }
+    }
+}
+
+// Created once at init; woken by the ring node after every captured frame
+static void uplink_task(void *arg)
+{
+    (void)arg;
+
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        xSemaphoreTake(s_uplink_send_mutex, portMAX_DELAY);
+        uplink_drain();
+        xSemaphoreGive(s_uplink_send_mutex);
+    }
+}
+
+static void detectors_process(int16_t *block, size_t num_samples, void *ctx)
+{
+    (void)ctx;
+    for (size_t t = 0; t < s_num_worker_taps; t++) {
+        s_worker_cbs[t](block, num_samples, s_worker_ctxs[t]);
+    }
+}
+
+static const audio_graph_node_config_t s_capture_nodes[] = {
+    { .name = "mic_taps", .process = mic_taps_process, .core = AUDIO_GRAPH_INLINE },
+    { .name = "uplink_ring", .process = uplink_ring_process, .reset = uplink_ring_reset,
+      .core = AUDIO_GRAPH_INLINE },
+    { .name = "detectors", .process = detectors_process,
+      .core = 1, .priority = DETECTOR_TASK_PRIORITY, .stack_size = 6144 },
+};
 
 static esp_err_t configure_i2s(void)
 {
@@ -27,6 +340,8 @@ static esp_err_t configure_i2s(void)
     }
 
     i2s_chan_config_t chan_cfg = I2S_CHANNEL_DEFAULT_CONFIG(I2S_NUM_1, I2S_ROLE_MASTER);
+    chan_cfg.dma_desc_num = AUDIO_DMA_DESC_NUM;
+    chan_cfg.dma_frame_num = AUDIO_DMA_FRAME_NUM;
     esp_err_t ret = i2s_new_channel(&chan_cfg, NULL, &s_rx_chan);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "i2s_new_channel failed: %d", ret);
@@ -58,6 +373,12 @@ static esp_err_t configure_i2s(void)
         return ret;
     }
 
+    const i2s_event_callbacks_t callbacks = { .on_recv_q_ovf = capture_overrun_cb };
+    ret = i2s_channel_register_event_callback(s_rx_chan, &callbacks, NULL);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Overrun callback not registered: %d", ret);
+    }
+
     ret = i2s_channel_enable(s_rx_chan);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "i2s_channel_enable failed: %d", ret);
@@ -68,50 +389,34 @@ static esp_err_t configure_i2s(void)
     return ESP_OK;
 }
 
-void audio_controller_init(void)
-{
-    esp_err_t err = configure_i2s();
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "I2S configuration failed: %d", err);
-        return;
-    }
-
-    ESP_LOGI(TAG, "Audio controller initialised (I2S channel: %p)", (void*)s_rx_chan);
-}
-
+// Created once at init; parks between captures instead of exiting
 static void streaming_capture_task(void *arg)
 {
     (void)arg;
-    ESP_LOGI(TAG, "Streaming capture task started");
 
-    if (!s_rx_chan) {
-        ESP_LOGE(TAG, "I2S channel is NULL!");
-        streaming_capture_task_handle = NULL;
-        vTaskDelete(NULL);
-        return;
-    }
+    // Raw microphone path: I2S → 16-bit PCM frames → capture graph (buffers stay out of PSRAM)
+    int32_t *i2s_buffer = heap_caps_malloc(AUDIO_FRAME_SAMPLES * sizeof(int32_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    int16_t *pcm_frame = heap_caps_malloc(AUDIO_FRAME_SAMPLES * sizeof(int16_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
 
-    // Raw microphone path: I2S → 16-bit PCM → callback
-    const size_t chunk_samples = 1600;  // 100ms @ 16kHz
-    const size_t chunk_bytes = chunk_samples * sizeof(int16_t);
-
-    int32_t *i2s_buffer = malloc(chunk_samples * sizeof(int32_t));
-    int16_t *pcm_chunk = malloc(chunk_bytes);
-
-    if (!i2s_buffer || !pcm_chunk) {
+    if (!i2s_buffer || !pcm_frame) {
         ESP_LOGE(TAG, "Failed to allocate streaming buffers");
         if (i2s_buffer) free(i2s_buffer);
-        if (pcm_chunk) free(pcm_chunk);
+        if (pcm_frame) free(pcm_frame);
         streaming_capture_task_handle = NULL;
         vTaskDelete(NULL);
         return;
     }
 
-    ESP_LOGI(TAG, "Using raw microphone (no processing)");
+    size_t dropped_frames = 0;
 
-    size_t samples_in_chunk = 0;
+    while (true) {
+        if (!s_capture_running) {
+            s_capture_parked = true;
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            dropped_frames = 0;
+            continue;
+        }
 
-    while (streaming_capture_task_handle != NULL) {
         size_t bytes_read = 0;
         size_t i2s_bytes = AUDIO_FRAME_SAMPLES * sizeof(int32_t);
         esp_err_t err = i2s_channel_read(s_rx_chan, i2s_buffer, i2s_bytes, &bytes_read, portMAX_DELAY);
@@ -121,53 +426,300 @@ static void streaming_capture_task(void *arg)
         }
 
         size_t samples_read = bytes_read / sizeof(int32_t);
-        for (size_t i = 0; i < samples_read; i++) {
-            if (samples_in_chunk < chunk_samples) {
-                // Convert 32-bit I2S to 16-bit PCM
-                pcm_chunk[samples_in_chunk++] = (int16_t)(i2s_buffer[i] >> 14);
-            }
-        }
+        convert_i2s_frame(i2s_buffer, pcm_frame, samples_read);
 
-        if (samples_in_chunk >= chunk_samples) {
-            if (s_chunk_cb) {
-                s_chunk_cb((const uint8_t *)pcm_chunk, chunk_bytes, s_chunk_ctx);
+        if (!audio_graph_push(s_capture_graph, pcm_frame, samples_read)) {
+            if (dropped_frames++ == 0) {
+                ESP_LOGW(TAG, "Worker detectors stalled, dropping capture frames");
             }
-            samples_in_chunk = 0;
+        } else if (dropped_frames > 0) {
+            ESP_LOGW(TAG, "Worker detectors recovered after dropping %u frames", (unsigned)dropped_frames);
+            dropped_frames = 0;
         }
     }
+}
+
+void audio_controller_init(void)
+{
+    esp_err_t err = configure_i2s();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "I2S configuration failed: %d", err);
+        return;
+    }
+
+    s_capture_mutex = xSemaphoreCreateMutex();
+    s_uplink_send_mutex = xSemaphoreCreateMutex();
+    s_uplink_ring = heap_caps_malloc(UPLINK_RING_SAMPLES * sizeof(int16_t), MALLOC_CAP_SPIRAM);
+    if (!s_capture_mutex || !s_uplink_send_mutex || !s_uplink_ring) {
+        ESP_LOGE(TAG, "Failed to allocate uplink ring");
+        return;
+    }
+    psram_bench_track_buffer("uplink_ring", s_uplink_ring, UPLINK_RING_SAMPLES * sizeof(int16_t),
+                             AUDIO_SAMPLE_RATE_HZ * sizeof(int16_t), AUDIO_FRAME_SAMPLES * 1000 / AUDIO_SAMPLE_RATE_HZ);
+
+    const audio_graph_config_t graph_cfg = {
+        .name = "capture",
+        .sample_rate = AUDIO_SAMPLE_RATE_HZ,
+        .block_samples = AUDIO_FRAME_SAMPLES,
+        .link_depth = 16,  // 256ms of slack for the worker detectors
+        .nodes = s_capture_nodes,
+        .num_nodes = sizeof(s_capture_nodes) / sizeof(s_capture_nodes[0]),
+    };
+    s_capture_graph = audio_graph_create(&graph_cfg);
+    if (!s_capture_graph) {
+        ESP_LOGE(TAG, "Failed to create capture graph");
+        return;
+    }
+
+    // Only the overrun callback runs during a flash write. The capture and uplink
+    // tasks (and the PSRAM uplink ring they use) wait it out while the DMA ring
+    // carries the capture.
+    const flash_safety_entry_t hot_paths[] = {
+        FLASH_SAFETY_CODE(capture_overrun_cb),
+    };
+    flash_safety_verify(TAG, hot_paths, sizeof(hot_paths) / sizeof(hot_paths[0]));
+
+    // The paced sender: blocks in the chunk callback while the graph keeps filling the ring
+    if (xTaskCreatePinnedToCore(uplink_task, "audio_uplink", 4096, NULL, UPLINK_TASK_PRIORITY,
+                                &s_uplink_task_handle, 0) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create uplink task");
+        s_uplink_task_handle = NULL;
+        return;
+    }
 
-    free(i2s_buffer);
-    free(pcm_chunk);
+    // One capture task for the device's lifetime: sessions wake it rather than spawning their own
+    if (xTaskCreatePinnedToCore(streaming_capture_task, "audio_stream", 4096, NULL, CAPTURE_TASK_PRIORITY,
+                                &streaming_capture_task_handle, 0) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create capture task");
+        streaming_capture_task_handle = NULL;
+        return;
+    }
 
-    streaming_capture_task_handle = NULL;
-    vTaskDelete(NULL);
+    ESP_LOGI(TAG, "Audio controller initialised (I2S channel: %p)", (void*)s_rx_chan);
+}
+
+uint32_t audio_get_capture_overruns(void)
+{
+    return s_capture_overruns;
+}
+
+uint32_t audio_get_capture_drops(void)
+{
+    audio_graph_stats_t stats = {0};
+    audio_graph_get_stats(s_capture_graph, &stats, NULL);
+    return stats.dropped;
+}
+
+void audio_set_uplink_chunk_ms(uint32_t chunk_ms)
+{
+    uint32_t samples = AUDIO_SAMPLE_RATE_HZ / 1000 * chunk_ms;
+    if (samples == 0 || samples > AUDIO_CHUNK_SAMPLES) {
+        ESP_LOGW(TAG, "Unsupported uplink chunk of %lu ms, keeping %lu samples", (unsigned long)chunk_ms,
+                 (unsigned long)s_chunk_samples);
+        return;
+    }
+    s_chunk_samples = samples;
+}
+
+// Caller holds s_capture_mutex
+static void start_capture_task(void)
+{
+    if (s_capture_running || !streaming_capture_task_handle) {
+        return;
+    }
+
+    audio_graph_reset(s_capture_graph);
+    ESP_LOGI(TAG, "Starting audio capture");
+    s_capture_parked = false;
+    s_capture_running = true;
+    xTaskNotifyGive(streaming_capture_task_handle);
+}
+
+// Caller holds s_capture_mutex
+static void stop_capture_task(void)
+{
+    if (!s_capture_running) {
+        return;
+    }
+    ESP_LOGI(TAG, "Stopping audio capture");
+
+    // The task parks after the frame it is reading (16ms at most)
+    s_capture_running = false;
+    for (int waited_ms = 0; !s_capture_parked && waited_ms < CAPTURE_PARK_TIMEOUT_MS; waited_ms += 5) {
+        vTaskDelay(pdMS_TO_TICKS(5));
+    }
+    audio_graph_wait_idle(s_capture_graph, CAPTURE_IDLE_TIMEOUT_MS);
+}
+
+// Caller holds s_capture_mutex
+static void update_capture_task(void)
+{
+    if (s_chunk_cb || s_idle_capture || s_uplink_hold) {
+        start_capture_task();
+    } else {
+        stop_capture_task();
+    }
 }
 
 void audio_start_streaming_capture(audio_capture_chunk_cb_t chunk_cb, void *ctx)
 {
-    if (streaming_capture_task_handle) {
-        ESP_LOGW(TAG, "Streaming capture already running");
+    if (!s_capture_graph) {
+        ESP_LOGE(TAG, "Capture graph not initialised");
         return;
     }
 
-    s_chunk_cb = chunk_cb;
-    s_chunk_ctx = ctx;
+    xSemaphoreTake(s_capture_mutex, portMAX_DELAY);
+    if (s_chunk_cb) {
+        if (s_uplink_paused && chunk_cb == s_chunk_cb) {
+            s_chunk_ctx = ctx;
+            s_uplink_paused = false;
+            ESP_LOGI(TAG, "Resuming streaming capture with %lu ms queued",
+                     (unsigned long)s_uplink_stats.backlog_ms);
+        } else {
+            ESP_LOGW(TAG, "Streaming capture already running");
+        }
+        xSemaphoreGive(s_capture_mutex);
+        return;
+    }
 
-    ESP_LOGI(TAG, "Starting streaming audio capture (100ms chunks)");
-    xTaskCreatePinnedToCore(streaming_capture_task, "audio_stream", 4096, NULL, 5, &streaming_capture_task_handle, 0);
+    // A held uplink is consumed by this stream: its pre-roll goes out first
+    if (s_uplink_hold) {
+        s_uplink_hold = false;
+        s_release_request = true;
+    }
+    s_chunk_ctx = ctx;
+    s_chunk_cb = chunk_cb;
+    ESP_LOGI(TAG, "Starting streaming audio capture (%lums chunks)",
+             (unsigned long)(s_chunk_samples * 1000 / AUDIO_SAMPLE_RATE_HZ));
+    update_capture_task();
+    xSemaphoreGive(s_capture_mutex);
 }
 
 void audio_stop_streaming_capture(void)
 {
-    if (!streaming_capture_task_handle) {
+    if (!s_capture_graph) {
+        return;
+    }
+
+    xSemaphoreTake(s_capture_mutex, portMAX_DELAY);
+    if (!s_chunk_cb) {
         ESP_LOGW(TAG, "Streaming capture not running");
+        xSemaphoreGive(s_capture_mutex);
         return;
     }
     ESP_LOGI(TAG, "Stopping streaming capture");
 
-    // Clear task handle to signal task to exit
-    streaming_capture_task_handle = NULL;
+    // Let the uplink task finish its current chunk so the callback is not used after return
+    s_chunk_cb = NULL;
+    s_uplink_paused = false;
+    if (xSemaphoreTake(s_uplink_send_mutex, pdMS_TO_TICKS(CAPTURE_IDLE_TIMEOUT_MS)) == pdTRUE) {
+        xSemaphoreGive(s_uplink_send_mutex);
+    } else {
+        ESP_LOGW(TAG, "Uplink send still blocked after %d ms", CAPTURE_IDLE_TIMEOUT_MS);
+    }
+    update_capture_task();
+    xSemaphoreGive(s_capture_mutex);
+}
+
+void audio_pause_uplink(void)
+{
+    if (!s_capture_graph) {
+        return;
+    }
+
+    xSemaphoreTake(s_capture_mutex, portMAX_DELAY);
+    if (s_chunk_cb && !s_uplink_paused) {
+        s_uplink_paused = true;
+        ESP_LOGI(TAG, "Pausing the uplink, capture continues");
+    }
+    xSemaphoreGive(s_capture_mutex);
+}
+
+void audio_set_uplink_pacing(const audio_uplink_pacing_t *pacing)
+{
+    audio_uplink_pacing_t p = *pacing;
+    p.catchup_pct = p.catchup_pct < 100 ? 100 : p.catchup_pct;
+    p.busy_catchup_pct = p.busy_catchup_pct < 100 ? 100 : p.busy_catchup_pct;
+    // Read field by field by the uplink task; a block paced with a mix of old and new values is harmless
+    s_pacing = p;
+    ESP_LOGI(TAG, "Uplink pacing: catch-up %u%% (%u%% with the downlink busy), burst %lu ms",
+             p.catchup_pct, p.busy_catchup_pct, (unsigned long)p.burst_ms);
+}
+
+audio_uplink_stats_t audio_get_uplink_stats(bool reset)
+{
+    audio_uplink_stats_t stats = s_uplink_stats;
+    if (reset) {
+        s_uplink_stats_reset = true;
+    }
+    return stats;
+}
+
+void audio_set_idle_capture(bool enabled)
+{
+    if (!s_capture_graph) {
+        return;
+    }
+
+    xSemaphoreTake(s_capture_mutex, portMAX_DELAY);
+    if (s_idle_capture != enabled) {
+        s_idle_capture = enabled;
+        ESP_LOGI(TAG, "Idle capture %s", enabled ? "on" : "off");
+        update_capture_task();
+    }
+    xSemaphoreGive(s_capture_mutex);
+}
+
+void audio_hold_uplink(uint32_t preroll_ms)
+{
+    if (!s_capture_graph) {
+        return;
+    }
+
+    xSemaphoreTake(s_capture_mutex, portMAX_DELAY);
+    s_uplink_hold = true;
+    s_preroll_request = preroll_ms * (AUDIO_SAMPLE_RATE_HZ / 1000);
+    update_capture_task();
+    xSemaphoreGive(s_capture_mutex);
+}
+
+void audio_release_uplink(void)
+{
+    if (!s_capture_graph) {
+        return;
+    }
+
+    xSemaphoreTake(s_capture_mutex, portMAX_DELAY);
+    if (s_uplink_hold) {
+        s_uplink_hold = false;
+        s_release_request = true;
+        update_capture_task();
+    }
+    xSemaphoreGive(s_capture_mutex);
+}
+
+bool audio_add_capture_frame_tap(audio_capture_frame_cb_t frame_cb, void *ctx)
+{
+    if (!frame_cb || s_num_frame_taps >= AUDIO_MAX_FRAME_TAPS) {
+        ESP_LOGE(TAG, "Cannot add capture frame tap");
+        return false;
+    }
+
+    s_frame_cbs[s_num_frame_taps] = frame_cb;
+    s_frame_ctxs[s_num_frame_taps] = ctx;
+    s_num_frame_taps++;  // Publish after the slot is filled
+    return true;
+}
+
+bool audio_add_capture_worker_tap(audio_capture_frame_cb_t frame_cb, void *ctx)
+{
+    if (!frame_cb || s_num_worker_taps >= AUDIO_MAX_WORKER_TAPS) {
+        ESP_LOGE(TAG, "Cannot add capture worker tap");
+        return false;
+    }
 
-    // Wait a bit for task to exit gracefully
-    vTaskDelay(pdMS_TO_TICKS(50));
+    s_worker_cbs[s_num_worker_taps] = frame_cb;
+    s_worker_ctxs[s_num_worker_taps] = ctx;
+    s_num_worker_taps++;  // Publish after the slot is filled
+    return true;
 }
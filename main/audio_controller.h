@@ -2,11 +2,78 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <stdbool.h>
 
 typedef void (*audio_capture_chunk_cb_t)(const uint8_t *pcm_data, size_t pcm_len, void *ctx);
 
+// Called from the capture task with every 16-bit frame as it comes off I2S (16ms)
+typedef void (*audio_capture_frame_cb_t)(const int16_t *samples, size_t num_samples, void *ctx);
+
 void audio_controller_init(void);
 
+// I2S receive overruns since boot (the capture task fell behind the DMA ring)
+uint32_t audio_get_capture_overruns(void);
+
+// Captured blocks dropped on full capture graph queues since boot (a consumer task fell behind)
+uint32_t audio_get_capture_drops(void);
+
 // Streaming capture API
 void audio_start_streaming_capture(audio_capture_chunk_cb_t chunk_cb, void *ctx);
+
+// Duration of each streaming chunk (at most and by default 100 ms), takes effect at the next chunk
+void audio_set_uplink_chunk_ms(uint32_t chunk_ms);
 void audio_stop_streaming_capture(void);
+
+// Keep the microphone running without a streaming consumer (taps and workers still see every frame)
+void audio_set_idle_capture(bool enabled);
+
+// Keep the last preroll_ms of audio, plus everything captured from now on, for
+// the next streaming consumer (up to 6 s); the consumer receives it first.
+// audio_release_uplink() drops the hold if no consumer is coming.
+void audio_hold_uplink(uint32_t preroll_ms);
+void audio_release_uplink(void);
+
+// Keep capturing but stop handing chunks to the streaming consumer (up to 6 s
+// queue, then the oldest audio is dropped). Starting the same consumer again
+// resumes it with the queued audio first; stopping it drops the queue.
+void audio_pause_uplink(void);
+
+// Reports whether the downlink is busy, called from the uplink task once per block
+typedef bool (*audio_link_busy_fn_t)(void);
+
+// Uplink pacing (token bucket). Live audio always goes out in real time; a
+// backlog (pre-roll, audio queued through a reconnect or behind a stalled
+// send) drains at catchup_pct of real time after an initial burst of at most
+// burst_ms, or at busy_catchup_pct while downlink_busy() returns true, so
+// assistant audio and control frames keep their share of the link.
+// Percentages below 100 are raised to 100. Until this is called a backlog
+// only goes out at real time; app_main.c sets the defaults.
+typedef struct {
+    uint16_t catchup_pct;
+    uint16_t busy_catchup_pct;
+    uint32_t burst_ms;
+    audio_link_busy_fn_t downlink_busy;  // NULL: never busy
+} audio_uplink_pacing_t;
+
+void audio_set_uplink_pacing(const audio_uplink_pacing_t *pacing);
+
+typedef struct {
+    uint32_t backlog_ms;            // Age of the oldest unsent sample now
+    uint32_t peak_backlog_ms;       // Oldest unsent sample seen
+    uint32_t backlogs;              // Backlogs drained back to real time
+    uint32_t longest_drain_ms;      // Backlog forming → caught up
+    uint32_t dropped_ms;            // Audio dropped because the queue outgrew the ring
+} audio_uplink_stats_t;
+
+// Uplink backlog figures since boot or the last reset (each backlog's peak age
+// is also the uplink_backlog latency metric)
+audio_uplink_stats_t audio_get_uplink_stats(bool reset);
+
+// Per-frame taps for local detectors (up to AUDIO_MAX_FRAME_TAPS, register at init)
+#define AUDIO_MAX_FRAME_TAPS 4
+bool audio_add_capture_frame_tap(audio_capture_frame_cb_t frame_cb, void *ctx);
+
+// Per-frame workers for heavier detectors: run after the uplink in a low-priority
+// task on core 1 (frames are dropped, not queued forever, if they fall behind)
+#define AUDIO_MAX_WORKER_TAPS 2
+bool audio_add_capture_worker_tap(audio_capture_frame_cb_t frame_cb, void *ctx);
@@ -0,0 +1,266 @@
+#include "audio_endpoint.h"
+#include "audio_controller.h"
+#include "audio_vad.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+
+#define MIC_SAMPLE_RATE              16000  // Matches AUDIO_SAMPLE_RATE_HZ
+
+#define DEFAULT_TRAILING_SILENCE_MS  600
+#define DEFAULT_MIN_SPEECH_MS        250
+#define MIN_TRAILING_SILENCE_MS      200
+#define PROSODY_SILENCE_PCT          60     // Fading phrase ends after 60% of the silence
+#define PROSODY_TAIL_FRAMES          3      // Last ~50 ms of speech ...
+#define PROSODY_HEAD_FRAMES          5      // ... compared with the ~80 ms before it
+#define PROSODY_HISTORY              (PROSODY_TAIL_FRAMES + PROSODY_HEAD_FRAMES)
+
+#define NVS_NAMESPACE                "endpoint"
+#define NVS_SILENCE_KEY              "silence_ms"
+#define NVS_MIN_SPEECH_KEY           "min_speech_ms"
+#define NVS_PROSODY_KEY              "prosody"
+
+static const char *TAG = "endpoint";
+
+static audio_endpoint_config_t s_config = {
+    .trailing_silence_ms = DEFAULT_TRAILING_SILENCE_MS,
+    .min_speech_ms = DEFAULT_MIN_SPEECH_MS,
+    .prosody = true,
+};
+
+// Enable/take calls come from the uplink task; the detector runs in the capture task
+static volatile bool s_enabled = false;
+static volatile bool s_reset_requested = false;
+static volatile bool s_end_pending = false;
+
+// Detector state (capture task only)
+static audio_vad_t s_vad;
+static uint32_t s_speech_ms = 0;       // Speech in the current utterance
+static uint32_t s_silence_ms = 0;      // Silence since the last speech frame
+static uint32_t s_required_silence_ms = DEFAULT_TRAILING_SILENCE_MS;
+static int64_t s_last_speech_end_us = 0;
+static uint32_t s_recent_energy[PROSODY_HISTORY];
+static size_t s_recent_count = 0;
+static int64_t s_end_of_speech_us = 0;
+
+// Response timing (end-of-turn in the capture task, response in the WebSocket task)
+static volatile int64_t s_awaiting_since_us = 0;
+static audio_endpoint_stats_t s_stats = { 0 };
+
+static void reset_utterance(void)
+{
+    s_speech_ms = 0;
+    s_silence_ms = 0;
+    s_recent_count = 0;
+}
+
+// Energy of the last speech frames falling by 3 dB or more = phrase fading out
+static bool phrase_is_fading(void)
+{
+    if (s_recent_count < PROSODY_HISTORY) {
+        return false;
+    }
+
+    uint64_t head = 0, tail = 0;
+    for (size_t i = 0; i < PROSODY_HEAD_FRAMES; i++) {
+        head += s_recent_energy[i];
+    }
+    for (size_t i = PROSODY_HEAD_FRAMES; i < PROSODY_HISTORY; i++) {
+        tail += s_recent_energy[i];
+    }
+    // Compare means: tail/TAIL * 2 <= head/HEAD
+    return tail * PROSODY_HEAD_FRAMES * 2 <= head * PROSODY_TAIL_FRAMES;
+}
+
+static void capture_tap(const int16_t *samples, size_t num_samples, void *ctx)
+{
+    (void)ctx;
+    uint32_t frame_ms = num_samples * 1000 / MIC_SAMPLE_RATE;
+    bool speech = audio_vad_process(&s_vad, samples, num_samples);
+
+    if (s_reset_requested) {
+        s_reset_requested = false;
+        reset_utterance();
+    }
+    if (!s_enabled || s_end_pending) {
+        return;
+    }
+
+    if (speech) {
+        s_speech_ms += frame_ms;
+        s_silence_ms = 0;
+        s_last_speech_end_us = esp_timer_get_time();
+
+        // Sliding window of the most recent speech frame energies (oldest first)
+        if (s_recent_count == PROSODY_HISTORY) {
+            for (size_t i = 1; i < PROSODY_HISTORY; i++) {
+                s_recent_energy[i - 1] = s_recent_energy[i];
+            }
+            s_recent_count--;
+        }
+        s_recent_energy[s_recent_count++] = s_vad.energy;
+        return;
+    }
+
+    if (s_speech_ms < s_config.min_speech_ms) {
+        // Nothing worth ending yet; let short bursts decay away
+        if (s_speech_ms > 0) {
+            s_silence_ms += frame_ms;
+            if (s_silence_ms >= s_config.trailing_silence_ms) {
+                reset_utterance();
+            }
+        }
+        return;
+    }
+
+    if (s_silence_ms == 0) {
+        // First silent frame after speech: decide how long to wait
+        s_required_silence_ms = s_config.trailing_silence_ms;
+        if (s_config.prosody && phrase_is_fading()) {
+            s_required_silence_ms = s_config.trailing_silence_ms * PROSODY_SILENCE_PCT / 100;
+        }
+    }
+    s_silence_ms += frame_ms;
+
+    if (s_silence_ms >= s_required_silence_ms) {
+        bool early = s_required_silence_ms < s_config.trailing_silence_ms;
+        s_end_of_speech_us = s_last_speech_end_us;
+        s_end_pending = true;  // Published last, consumed by audio_endpoint_take_end()
+        s_stats.turns++;
+        if (early) {
+            s_stats.prosody_ends++;
+        }
+        ESP_LOGI(TAG, "End of utterance (%lu ms speech, %lu ms silence%s)",
+                 (unsigned long)s_speech_ms, (unsigned long)s_silence_ms, early ? ", fading phrase" : "");
+        reset_utterance();
+    }
+}
+
+static void load_config(void)
+{
+    nvs_handle_t nvs_handle;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs_handle) != ESP_OK) {
+        return;  // Defaults
+    }
+
+    uint16_t silence_ms, min_speech_ms;
+    uint8_t prosody;
+    if (nvs_get_u16(nvs_handle, NVS_SILENCE_KEY, &silence_ms) == ESP_OK && silence_ms >= MIN_TRAILING_SILENCE_MS) {
+        s_config.trailing_silence_ms = silence_ms;
+    }
+    if (nvs_get_u16(nvs_handle, NVS_MIN_SPEECH_KEY, &min_speech_ms) == ESP_OK) {
+        s_config.min_speech_ms = min_speech_ms;
+    }
+    if (nvs_get_u8(nvs_handle, NVS_PROSODY_KEY, &prosody) == ESP_OK) {
+        s_config.prosody = prosody != 0;
+    }
+    nvs_close(nvs_handle);
+}
+
+static void save_config(void)
+{
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to open NVS namespace: %s", esp_err_to_name(err));
+        return;
+    }
+
+    err = nvs_set_u16(nvs_handle, NVS_SILENCE_KEY, s_config.trailing_silence_ms);
+    if (err == ESP_OK) {
+        err = nvs_set_u16(nvs_handle, NVS_MIN_SPEECH_KEY, s_config.min_speech_ms);
+    }
+    if (err == ESP_OK) {
+        err = nvs_set_u8(nvs_handle, NVS_PROSODY_KEY, s_config.prosody ? 1 : 0);
+    }
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs_handle);
+    }
+    nvs_close(nvs_handle);
+
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to save endpoint config: %s", esp_err_to_name(err));
+    }
+}
+
+void audio_endpoint_init(void)
+{
+    load_config();
+    audio_vad_init(&s_vad);
+    audio_add_capture_frame_tap(capture_tap, NULL);
+
+    ESP_LOGI(TAG, "Endpointing initialised (trailing silence %u ms, min speech %u ms, prosody %s)",
+             s_config.trailing_silence_ms, s_config.min_speech_ms, s_config.prosody ? "on" : "off");
+}
+
+void audio_endpoint_set_config(const audio_endpoint_config_t *config, bool persist)
+{
+    if (!config) {
+        return;
+    }
+
+    s_config = *config;
+    if (s_config.trailing_silence_ms < MIN_TRAILING_SILENCE_MS) {
+        s_config.trailing_silence_ms = MIN_TRAILING_SILENCE_MS;
+    }
+    if (persist) {
+        save_config();
+    }
+    ESP_LOGI(TAG, "Config: trailing silence %u ms, min speech %u ms, prosody %s",
+             s_config.trailing_silence_ms, s_config.min_speech_ms, s_config.prosody ? "on" : "off");
+}
+
+void audio_endpoint_get_config(audio_endpoint_config_t *config)
+{
+    if (config) {
+        *config = s_config;
+    }
+}
+
+void audio_endpoint_set_enabled(bool enabled)
+{
+    if (enabled != s_enabled) {
+        s_reset_requested = true;  // Applied by the detector on its next frame
+        s_end_pending = false;
+    }
+    s_enabled = enabled;
+}
+
+bool audio_endpoint_take_end(int64_t *end_of_speech_us)
+{
+    if (!s_end_pending) {
+        return false;
+    }
+
+    s_end_pending = false;
+    if (end_of_speech_us) {
+        *end_of_speech_us = s_end_of_speech_us;
+    }
+    s_awaiting_since_us = s_end_of_speech_us;
+    return true;
+}
+
+void audio_endpoint_mark_response(void)
+{
+    int64_t since_us = s_awaiting_since_us;
+    if (since_us == 0) {
+        return;
+    }
+    s_awaiting_since_us = 0;
+
+    uint32_t latency_ms = (uint32_t)((esp_timer_get_time() - since_us) / 1000);
+    s_stats.responses++;
+    s_stats.last_latency_ms = latency_ms;
+    s_stats.avg_latency_ms += ((int32_t)latency_ms - (int32_t)s_stats.avg_latency_ms) / (int32_t)s_stats.responses;
+
+    ESP_LOGI(TAG, "End of speech → first response byte: %lu ms (avg %lu ms over %lu turns)",
+             (unsigned long)latency_ms, (unsigned long)s_stats.avg_latency_ms, (unsigned long)s_stats.responses);
+}
+
+void audio_endpoint_get_stats(audio_endpoint_stats_t *stats)
+{
+    if (stats) {
+        *stats = s_stats;
+    }
+}
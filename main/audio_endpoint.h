@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * @brief On-device end-of-utterance detection for the uplink
+ *
+ * Runs the capture VAD (audio_vad.h) on every 16 ms frame. Once an utterance of
+ * at least min_speech_ms has been followed by trailing_silence_ms of silence,
+ * the turn is over and the app sends the empty-frame end-of-turn marker instead
+ * of waiting for the server's own silence timeout.
+ *
+ * With prosody cues enabled, an utterance whose last syllables fade out (energy
+ * falling by 3 dB or more) is taken as a finished phrase and ends after a
+ * shorter silence; an abrupt stop keeps the full threshold because it is more
+ * often a mid-sentence pause.
+ *
+ * Configuration is stored in NVS (namespace "endpoint").
+ */
+
+typedef struct {
+    uint16_t trailing_silence_ms;   // Silence that ends a turn
+    uint16_t min_speech_ms;         // Shorter bursts (clicks, coughs) never end a turn
+    bool prosody;                   // Shorten the silence after a fading phrase end
+} audio_endpoint_config_t;
+
+typedef struct {
+    uint32_t turns;                 // End-of-turn markers produced
+    uint32_t responses;             // Turns that were followed by a response
+    uint32_t last_latency_ms;       // End of speech → first response byte
+    uint32_t avg_latency_ms;
+    uint32_t prosody_ends;          // Turns ended early on the prosody cue
+} audio_endpoint_stats_t;
+
+/**
+ * @brief Load the configuration from NVS and register the capture frame tap
+ */
+void audio_endpoint_init(void);
+
+/**
+ * @brief Apply a new configuration
+ *
+ * @param config New configuration
+ * @param persist true to also store it in NVS
+ */
+void audio_endpoint_set_config(const audio_endpoint_config_t *config, bool persist);
+void audio_endpoint_get_config(audio_endpoint_config_t *config);
+
+/**
+ * @brief Enable detection while the uplink carries live microphone audio
+ *
+ * Disabling clears any utterance in progress. Call from the uplink chunk callback.
+ */
+void audio_endpoint_set_enabled(bool enabled);
+
+/**
+ * @brief Consume a pending end-of-turn (call from the uplink chunk callback)
+ *
+ * @param[out] end_of_speech_us Time the last speech frame ended (can be NULL)
+ * @return true once per detected end of utterance
+ */
+bool audio_endpoint_take_end(int64_t *end_of_speech_us);
+
+/**
+ * @brief Note downlink audio; the first chunk after an end-of-turn is timed
+ */
+void audio_endpoint_mark_response(void);
+
+/**
+ * @brief Snapshot endpointing statistics
+ */
+void audio_endpoint_get_stats(audio_endpoint_stats_t *stats);
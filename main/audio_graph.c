@@ -0,0 +1,367 @@
+#include "audio_graph.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_cpu.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+
+#define GRAPH_DEFAULT_LINK_DEPTH    8
+#define GRAPH_DEFAULT_STACK         4096
+#define GRAPH_LOG_INTERVAL          2000    // Blocks out of the graph between stats log lines
+
+static const char *TAG = "audio_graph";
+
+// Single-producer/single-consumer block queue. The producer only writes head,
+// the consumer only writes tail; a slot belongs to the consumer from the moment
+// head moves past it until tail does, so it can be processed in place.
+typedef struct {
+    int16_t *blocks;
+    size_t *lengths;
+    int64_t *entered_us;
+    size_t depth;
+    atomic_size_t head;
+    atomic_size_t tail;
+    uint32_t dropped;               // Written by the producer only, like head
+    uint32_t max_depth;
+} graph_link_t;
+
+typedef struct {
+    audio_graph_t *graph;
+    size_t index;
+    size_t first_node;
+    size_t num_nodes;
+    bool inline_segment;
+    TaskHandle_t task;
+} graph_segment_t;
+
+struct audio_graph {
+    const char *name;
+    uint32_t sample_rate;
+    size_t block_samples;
+    size_t num_nodes;
+    audio_graph_node_config_t nodes[AUDIO_GRAPH_MAX_NODES];
+    audio_graph_node_stats_t node_stats[AUDIO_GRAPH_MAX_NODES];
+    size_t num_segments;
+    graph_segment_t segments[AUDIO_GRAPH_MAX_NODES];
+    graph_link_t links[AUDIO_GRAPH_MAX_NODES];  // links[i] feeds segments[i]
+    uint32_t blocks_in;             // Written by the pushing task only
+    uint32_t blocks_out;
+};
+
+static bool link_init(graph_link_t *link, size_t depth, size_t block_samples)
+{
+    link->depth = depth;
+    link->blocks = heap_caps_malloc(depth * block_samples * sizeof(int16_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    link->lengths = calloc(depth, sizeof(size_t));
+    link->entered_us = calloc(depth, sizeof(int64_t));
+    atomic_init(&link->head, 0);
+    atomic_init(&link->tail, 0);
+    return link->blocks && link->lengths && link->entered_us;
+}
+
+static void link_free(graph_link_t *link)
+{
+    heap_caps_free(link->blocks);
+    free(link->lengths);
+    free(link->entered_us);
+}
+
+static bool link_push(audio_graph_t *graph, size_t segment, const int16_t *block, size_t n, int64_t entered_us)
+{
+    graph_link_t *link = &graph->links[segment];
+    size_t head = atomic_load_explicit(&link->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&link->tail, memory_order_acquire);
+    size_t used = head - tail;
+
+    if (used >= link->depth) {
+        link->dropped++;
+        return false;
+    }
+    if (used + 1 > link->max_depth) {
+        link->max_depth = used + 1;
+    }
+
+    size_t slot = head % link->depth;
+    memcpy(link->blocks + slot * graph->block_samples, block, n * sizeof(int16_t));
+    link->lengths[slot] = n;
+    link->entered_us[slot] = entered_us;
+    atomic_store_explicit(&link->head, head + 1, memory_order_release);
+
+    xTaskNotifyGive(graph->segments[segment].task);
+    return true;
+}
+
+// Run a segment's nodes on a block and hand it on; false if the next queue was full
+static bool run_segment(audio_graph_t *graph, const graph_segment_t *seg, int16_t *block, size_t n, int64_t entered_us)
+{
+    int core = xPortGetCoreID();
+
+    for (size_t i = seg->first_node; i < seg->first_node + seg->num_nodes; i++) {
+        const audio_graph_node_config_t *node = &graph->nodes[i];
+        audio_graph_node_stats_t *st = &graph->node_stats[i];
+
+        uint32_t start = esp_cpu_get_cycle_count();
+        node->process(block, n, node->ctx);
+        uint32_t cycles = esp_cpu_get_cycle_count() - start;
+        uint32_t latency_us = (uint32_t)(esp_timer_get_time() - entered_us);
+
+        st->core = core;
+        st->calls++;
+        st->cycles += cycles;
+        if (cycles > st->max_cycles) {
+            st->max_cycles = cycles;
+        }
+        st->total_latency_us += latency_us;
+        if (latency_us > st->max_latency_us) {
+            st->max_latency_us = latency_us;
+        }
+    }
+
+    if (seg->index + 1 < graph->num_segments) {
+        return link_push(graph, seg->index + 1, block, n, entered_us);
+    }
+    if (++graph->blocks_out % GRAPH_LOG_INTERVAL == 0) {
+        audio_graph_log_stats(graph);
+    }
+    return true;
+}
+
+static void segment_task(void *arg)
+{
+    graph_segment_t *seg = (graph_segment_t *)arg;
+    audio_graph_t *graph = seg->graph;
+    graph_link_t *link = &graph->links[seg->index];
+
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        size_t tail = atomic_load_explicit(&link->tail, memory_order_relaxed);
+        while (tail != atomic_load_explicit(&link->head, memory_order_acquire)) {
+            size_t slot = tail % link->depth;
+            run_segment(graph, seg, link->blocks + slot * graph->block_samples,
+                        link->lengths[slot], link->entered_us[slot]);
+            atomic_store_explicit(&link->tail, ++tail, memory_order_release);
+        }
+    }
+}
+
+audio_graph_t *audio_graph_create(const audio_graph_config_t *config)
+{
+    if (!config || !config->nodes || config->num_nodes == 0 || config->num_nodes > AUDIO_GRAPH_MAX_NODES ||
+        config->block_samples == 0) {
+        ESP_LOGE(TAG, "Invalid graph config");
+        return NULL;
+    }
+
+    audio_graph_t *graph = calloc(1, sizeof(audio_graph_t));
+    if (!graph) {
+        ESP_LOGE(TAG, "Failed to allocate graph");
+        return NULL;
+    }
+
+    graph->name = config->name;
+    graph->sample_rate = config->sample_rate;
+    graph->block_samples = config->block_samples;
+    graph->num_nodes = config->num_nodes;
+    size_t depth = config->link_depth ? config->link_depth : GRAPH_DEFAULT_LINK_DEPTH;
+
+    // Group consecutive nodes with the same placement into segments
+    for (size_t i = 0; i < config->num_nodes; i++) {
+        const audio_graph_node_config_t *node = &config->nodes[i];
+        if (!node->process) {
+            ESP_LOGE(TAG, "%s: node %u has no process function", config->name, (unsigned)i);
+            goto fail;
+        }
+        graph->nodes[i] = *node;
+        graph->node_stats[i].name = node->name;
+        graph->node_stats[i].core = node->core;
+
+        const audio_graph_node_config_t *prev = i > 0 ? &config->nodes[i - 1] : NULL;
+        if (prev && prev->core == node->core && (node->core == AUDIO_GRAPH_INLINE || prev->priority == node->priority)) {
+            graph->segments[graph->num_segments - 1].num_nodes++;
+            continue;
+        }
+        if (node->core == AUDIO_GRAPH_INLINE && i > 0) {
+            ESP_LOGE(TAG, "%s: inline node '%s' must come before queued nodes", config->name, node->name);
+            goto fail;
+        }
+
+        graph_segment_t *seg = &graph->segments[graph->num_segments];
+        seg->graph = graph;
+        seg->index = graph->num_segments;
+        seg->first_node = i;
+        seg->num_nodes = 1;
+        seg->inline_segment = node->core == AUDIO_GRAPH_INLINE;
+        graph->num_segments++;
+    }
+
+    for (size_t s = 0; s < graph->num_segments; s++) {
+        graph_segment_t *seg = &graph->segments[s];
+        if (seg->inline_segment) {
+            continue;
+        }
+
+        const audio_graph_node_config_t *first = &graph->nodes[seg->first_node];
+        if (!link_init(&graph->links[s], depth, graph->block_samples)) {
+            ESP_LOGE(TAG, "%s: failed to allocate queue for '%s'", config->name, first->name);
+            goto fail;
+        }
+        if (xTaskCreatePinnedToCore(segment_task, first->name,
+                                    first->stack_size ? first->stack_size : GRAPH_DEFAULT_STACK,
+                                    seg, first->priority, &seg->task, first->core) != pdPASS) {
+            ESP_LOGE(TAG, "%s: failed to create task for '%s'", config->name, first->name);
+            goto fail;
+        }
+    }
+
+    ESP_LOGI(TAG, "Graph '%s': %u nodes in %u segments, %u-sample blocks",
+             graph->name, (unsigned)graph->num_nodes, (unsigned)graph->num_segments, (unsigned)graph->block_samples);
+    for (size_t s = 0; s < graph->num_segments; s++) {
+        const graph_segment_t *seg = &graph->segments[s];
+        const audio_graph_node_config_t *first = &graph->nodes[seg->first_node];
+        for (size_t i = seg->first_node; i < seg->first_node + seg->num_nodes; i++) {
+            if (seg->inline_segment) {
+                ESP_LOGI(TAG, "  [%u] %-10s inline", (unsigned)s, graph->nodes[i].name);
+            } else {
+                ESP_LOGI(TAG, "  [%u] %-10s core %d prio %u", (unsigned)s, graph->nodes[i].name,
+                         first->core, (unsigned)first->priority);
+            }
+        }
+    }
+    return graph;
+
+fail:
+    for (size_t s = 0; s < graph->num_segments; s++) {
+        if (graph->segments[s].task) {
+            vTaskDelete(graph->segments[s].task);
+        }
+        link_free(&graph->links[s]);
+    }
+    free(graph);
+    return NULL;
+}
+
+bool audio_graph_push(audio_graph_t *graph, int16_t *block, size_t num_samples)
+{
+    if (!graph || !block || num_samples == 0 || num_samples > graph->block_samples) {
+        return false;
+    }
+
+    int64_t entered_us = esp_timer_get_time();
+    graph->blocks_in++;
+
+    const graph_segment_t *head = &graph->segments[0];
+    if (head->inline_segment) {
+        return run_segment(graph, head, block, num_samples, entered_us);
+    }
+    return link_push(graph, 0, block, num_samples, entered_us);
+}
+
+bool audio_graph_wait_idle(audio_graph_t *graph, uint32_t timeout_ms)
+{
+    if (!graph) {
+        return true;
+    }
+
+    TickType_t start = xTaskGetTickCount();
+    while (true) {
+        bool idle = true;
+        for (size_t s = 0; s < graph->num_segments; s++) {
+            graph_link_t *link = &graph->links[s];
+            if (!graph->segments[s].inline_segment &&
+                atomic_load(&link->head) != atomic_load(&link->tail)) {
+                idle = false;
+                break;
+            }
+        }
+        if (idle) {
+            return true;
+        }
+        if ((xTaskGetTickCount() - start) >= pdMS_TO_TICKS(timeout_ms)) {
+            ESP_LOGW(TAG, "%s: still busy after %lu ms", graph->name, (unsigned long)timeout_ms);
+            return false;
+        }
+        vTaskDelay(1);
+    }
+}
+
+void audio_graph_reset(audio_graph_t *graph)
+{
+    if (!graph) {
+        return;
+    }
+    for (size_t i = 0; i < graph->num_nodes; i++) {
+        if (graph->nodes[i].reset) {
+            graph->nodes[i].reset(graph->nodes[i].ctx);
+        }
+    }
+}
+
+size_t audio_graph_num_nodes(const audio_graph_t *graph)
+{
+    return graph ? graph->num_nodes : 0;
+}
+
+// Each link's counters have one writer (its producer), so they are summed here rather than shared
+static void collect_stats(const audio_graph_t *graph, audio_graph_stats_t *stats)
+{
+    stats->blocks_in = graph->blocks_in;
+    stats->dropped = 0;
+    stats->max_queue_depth = 0;
+    for (size_t s = 0; s < graph->num_segments; s++) {
+        const graph_link_t *link = &graph->links[s];
+        stats->dropped += link->dropped;
+        if (link->max_depth > stats->max_queue_depth) {
+            stats->max_queue_depth = link->max_depth;
+        }
+    }
+}
+
+void audio_graph_get_stats(const audio_graph_t *graph, audio_graph_stats_t *stats,
+                           audio_graph_node_stats_t *node_stats)
+{
+    if (!graph) {
+        return;
+    }
+    if (stats) {
+        collect_stats(graph, stats);
+    }
+    if (node_stats) {
+        memcpy(node_stats, graph->node_stats, graph->num_nodes * sizeof(audio_graph_node_stats_t));
+    }
+}
+
+void audio_graph_log_stats(const audio_graph_t *graph)
+{
+    if (!graph) {
+        return;
+    }
+
+    // Cycles available per block at the configured CPU clock
+    uint64_t block_cycles = (uint64_t)graph->block_samples * CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ * 1000000ULL /
+                            graph->sample_rate;
+
+    audio_graph_stats_t stats;
+    collect_stats(graph, &stats);
+    ESP_LOGI(TAG, "%s: %lu blocks in, %lu dropped, max queue depth %lu", graph->name,
+             (unsigned long)stats.blocks_in, (unsigned long)stats.dropped,
+             (unsigned long)stats.max_queue_depth);
+    for (size_t i = 0; i < graph->num_nodes; i++) {
+        const audio_graph_node_stats_t *st = &graph->node_stats[i];
+        if (st->calls == 0) {
+            continue;
+        }
+        uint32_t avg_cycles = (uint32_t)(st->cycles / st->calls);
+        ESP_LOGI(TAG, "  %-10s core %d: %lu cycles/block (%.2f%% CPU, max %lu), latency avg %lu us, max %lu us",
+                 st->name, st->core, (unsigned long)avg_cycles,
+                 block_cycles ? 100.0 * avg_cycles / (double)block_cycles : 0.0,
+                 (unsigned long)st->max_cycles, (unsigned long)(st->total_latency_us / st->calls),
+                 (unsigned long)st->max_latency_us);
+    }
+}
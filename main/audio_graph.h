@@ -0,0 +1,112 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "freertos/FreeRTOS.h"
+
+/**
+ * @brief Small block-based audio processing graph
+ *
+ * A graph is a chain of nodes that process fixed-size blocks of 16-bit PCM in
+ * place. Each node is placed either inline (it runs in the task that calls
+ * audio_graph_push()) or on its own core/priority. Consecutive nodes with the
+ * same placement form a segment served by one task; segments are joined by
+ * single-producer/single-consumer lock-free block queues, so a slow stage
+ * never blocks the stage feeding it (a full queue drops the block and counts
+ * it instead).
+ *
+ * Every node call is timed in CPU cycles, and every block carries the time it
+ * entered the graph so per-node latency (entry → node done) is tracked too.
+ * Chains are described by a const table of audio_graph_node_config_t.
+ */
+
+#define AUDIO_GRAPH_MAX_NODES       8
+#define AUDIO_GRAPH_INLINE          (-1)    // Run in the caller of audio_graph_push()
+
+typedef struct audio_graph audio_graph_t;
+
+typedef void (*audio_graph_process_fn_t)(int16_t *block, size_t num_samples, void *ctx);
+typedef void (*audio_graph_reset_fn_t)(void *ctx);
+
+typedef struct {
+    const char *name;
+    audio_graph_process_fn_t process;
+    audio_graph_reset_fn_t reset;   // Optional, called by audio_graph_reset()
+    void *ctx;
+    int core;                       // AUDIO_GRAPH_INLINE, 0 or 1
+    UBaseType_t priority;           // Segment task priority (not used inline)
+    uint32_t stack_size;            // Segment task stack (0 = default, not used inline)
+} audio_graph_node_config_t;
+
+typedef struct {
+    const char *name;
+    uint32_t sample_rate;
+    size_t block_samples;           // Maximum samples per block
+    size_t link_depth;              // Blocks per inter-segment queue (0 = default)
+    const audio_graph_node_config_t *nodes;
+    size_t num_nodes;
+} audio_graph_config_t;
+
+typedef struct {
+    const char *name;
+    int core;                       // Core the node last ran on
+    uint32_t calls;
+    uint64_t cycles;
+    uint32_t max_cycles;
+    uint64_t total_latency_us;      // Sum of (node done - block entered graph)
+    uint32_t max_latency_us;
+} audio_graph_node_stats_t;
+
+typedef struct {
+    uint32_t blocks_in;             // Blocks pushed into the graph
+    uint32_t dropped;               // Blocks dropped on full queues
+    uint32_t max_queue_depth;       // Deepest any queue has been
+} audio_graph_stats_t;
+
+/**
+ * @brief Build a graph from a node table and start its segment tasks
+ *
+ * @return Graph handle, or NULL on error (invalid table or out of memory)
+ */
+audio_graph_t *audio_graph_create(const audio_graph_config_t *config);
+
+/**
+ * @brief Feed one block into the graph
+ *
+ * Inline nodes process the block in place in the calling task before it is
+ * queued for the next segment. Never blocks.
+ *
+ * @param block Samples (modified by inline nodes)
+ * @param num_samples Number of samples, at most block_samples
+ * @return false if the block was dropped because a queue was full
+ */
+bool audio_graph_push(audio_graph_t *graph, int16_t *block, size_t num_samples);
+
+/**
+ * @brief Wait until every queued block has been processed
+ *
+ * @return true if the graph went idle within timeout_ms
+ */
+bool audio_graph_wait_idle(audio_graph_t *graph, uint32_t timeout_ms);
+
+/**
+ * @brief Call every node's reset function (graph must be idle)
+ */
+void audio_graph_reset(audio_graph_t *graph);
+
+/**
+ * @brief Snapshot graph and per-node statistics
+ *
+ * @param stats Graph totals (can be NULL)
+ * @param node_stats Array of at least audio_graph_num_nodes() entries (can be NULL)
+ */
+void audio_graph_get_stats(const audio_graph_t *graph, audio_graph_stats_t *stats,
+                           audio_graph_node_stats_t *node_stats);
+size_t audio_graph_num_nodes(const audio_graph_t *graph);
+
+/**
+ * @brief Log per-node CPU and latency figures
+ */
+void audio_graph_log_stats(const audio_graph_t *graph);
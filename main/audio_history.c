@@ -0,0 +1,327 @@
+#include "audio_history.h"
+#include "audio_playback.h"
+#include "psram_bench.h"
+
+#include <string.h>
+
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#define HISTORY_SAMPLE_RATE      24000  // Downlink PCM rate (matches PLAYBACK_SAMPLE_RATE)
+#define HISTORY_SECONDS          30
+#define HISTORY_ARENA_BYTES      (HISTORY_SAMPLE_RATE * 2 * HISTORY_SECONDS)  // 1.44MB in PSRAM
+#define HISTORY_MAX_RESPONSES    8
+
+static const char *TAG = "audio_history";
+
+typedef struct {
+    uint32_t id;
+    uint64_t start;   // Absolute arena write position of first byte
+    size_t length;
+} history_entry_t;
+
+// Arena is addressed with monotonically increasing absolute positions; the byte at
+// position p lives at s_arena[p % HISTORY_ARENA_BYTES]. An entry is intact while
+// its first byte is still within the last HISTORY_ARENA_BYTES written.
+static uint8_t *s_arena = NULL;
+static uint64_t s_write_pos = 0;
+static history_entry_t s_entries[HISTORY_MAX_RESPONSES];
+static size_t s_entry_head = 0;   // Index of current (newest) entry
+static size_t s_entry_count = 0;
+static uint32_t s_next_id = 1;
+static SemaphoreHandle_t s_mutex = NULL;
+
+// Replay is a playback source reading the arena; only one runs at a time
+static volatile bool s_replaying = false;
+static volatile bool s_stop_replay = false;
+static uint32_t s_replay_id = 0;
+static size_t s_replay_position = 0;
+
+static bool entry_intact(const history_entry_t *entry)
+{
+    return entry->length > 0 && s_write_pos - entry->start <= HISTORY_ARENA_BYTES;
+}
+
+// Drop entries (oldest first) whose data has been overwritten. Caller holds s_mutex.
+static void evict_overwritten(void)
+{
+    while (s_entry_count > 1) {
+        size_t oldest = (s_entry_head + HISTORY_MAX_RESPONSES - (s_entry_count - 1)) % HISTORY_MAX_RESPONSES;
+        if (entry_intact(&s_entries[oldest])) {
+            break;
+        }
+        ESP_LOGD(TAG, "Evicting response #%lu", (unsigned long)s_entries[oldest].id);
+        s_entry_count--;
+    }
+}
+
+// Find an entry by id. Caller holds s_mutex.
+static history_entry_t *find_entry(uint32_t response_id)
+{
+    for (size_t i = 0; i < s_entry_count; i++) {
+        history_entry_t *entry = &s_entries[(s_entry_head + HISTORY_MAX_RESPONSES - i) % HISTORY_MAX_RESPONSES];
+        if (entry->id == response_id) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+// Playback's stream store: each received chunk is copied into the arena once,
+// here, and the current response keeps a reference to it (network writer task)
+static void store_write(uint64_t position, const uint8_t *data, size_t length_bytes, void *ctx)
+{
+    (void)ctx;
+    if (s_entry_count == 0) {
+        audio_history_begin_response();
+    }
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+
+    size_t offset = position % HISTORY_ARENA_BYTES;
+    size_t first = HISTORY_ARENA_BYTES - offset;
+    if (first > length_bytes) {
+        first = length_bytes;
+    }
+    memcpy(s_arena + offset, data, first);
+    memcpy(s_arena, data + first, length_bytes - first);
+    s_write_pos = position + length_bytes;
+
+    history_entry_t *entry = &s_entries[s_entry_head];
+    if (entry->length == 0) {
+        entry->start = position;
+    }
+    // A response longer than the arena keeps its newest HISTORY_SECONDS
+    size_t previous = entry->length;
+    entry->length = (size_t)(s_write_pos - entry->start);
+    if (entry->length > HISTORY_ARENA_BYTES) {
+        if (previous <= HISTORY_ARENA_BYTES) {
+            ESP_LOGW(TAG, "Response #%lu exceeds %d s history, keeping its end",
+                     (unsigned long)entry->id, HISTORY_SECONDS);
+        }
+        entry->start = s_write_pos - HISTORY_ARENA_BYTES;
+        entry->length = HISTORY_ARENA_BYTES;
+    }
+    evict_overwritten();
+
+    xSemaphoreGive(s_mutex);
+}
+
+void audio_history_init(void)
+{
+    if (s_arena) {
+        return;
+    }
+
+    s_mutex = xSemaphoreCreateMutex();
+    if (!s_mutex) {
+        ESP_LOGE(TAG, "Failed to create history mutex");
+        return;
+    }
+
+    s_arena = heap_caps_malloc(HISTORY_ARENA_BYTES, MALLOC_CAP_SPIRAM);
+    if (!s_arena) {
+        ESP_LOGE(TAG, "Failed to allocate %d byte history arena from PSRAM", HISTORY_ARENA_BYTES);
+        vSemaphoreDelete(s_mutex);
+        s_mutex = NULL;
+        return;
+    }
+
+    // The arena doubles as the playback stream ring, so ingest copies each chunk once
+    const audio_playback_store_t store = {
+        .base = s_arena,
+        .size = HISTORY_ARENA_BYTES,
+        .write = store_write,
+    };
+    if (!audio_playback_set_stream_store(&store)) {
+        ESP_LOGE(TAG, "Playback did not take the history arena, history disabled");
+        heap_caps_free(s_arena);
+        s_arena = NULL;
+        vSemaphoreDelete(s_mutex);
+        s_mutex = NULL;
+        return;
+    }
+    psram_bench_track_buffer("history_arena", s_arena, HISTORY_ARENA_BYTES, HISTORY_SAMPLE_RATE * 2, 0);
+
+    ESP_LOGI(TAG, "Response history initialised (%d s, up to %d responses)",
+             HISTORY_SECONDS, HISTORY_MAX_RESPONSES);
+}
+
+uint32_t audio_history_begin_response(void)
+{
+    if (!s_arena) {
+        return 0;
+    }
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+
+    if (s_entry_count > 0 && s_entries[s_entry_head].length == 0) {
+        // Current segment never received audio - reuse it
+        uint32_t id = s_entries[s_entry_head].id;
+        xSemaphoreGive(s_mutex);
+        return id;
+    }
+
+    if (s_entry_count > 0) {
+        s_entry_head = (s_entry_head + 1) % HISTORY_MAX_RESPONSES;
+    }
+    if (s_entry_count < HISTORY_MAX_RESPONSES) {
+        s_entry_count++;
+    }
+
+    history_entry_t *entry = &s_entries[s_entry_head];
+    entry->id = s_next_id++;
+    entry->start = s_write_pos;
+    entry->length = 0;
+    uint32_t id = entry->id;
+
+    xSemaphoreGive(s_mutex);
+
+    ESP_LOGD(TAG, "Recording response #%lu", (unsigned long)id);
+    return id;
+}
+
+size_t audio_history_count(void)
+{
+    if (!s_arena) {
+        return 0;
+    }
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    size_t count = 0;
+    for (size_t i = 0; i < s_entry_count; i++) {
+        if (entry_intact(&s_entries[(s_entry_head + HISTORY_MAX_RESPONSES - i) % HISTORY_MAX_RESPONSES])) {
+            count++;
+        }
+    }
+    xSemaphoreGive(s_mutex);
+    return count;
+}
+
+uint32_t audio_history_latest_id(void)
+{
+    if (!s_arena) {
+        return 0;
+    }
+
+    uint32_t id = 0;
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    for (size_t i = 0; i < s_entry_count; i++) {
+        const history_entry_t *entry = &s_entries[(s_entry_head + HISTORY_MAX_RESPONSES - i) % HISTORY_MAX_RESPONSES];
+        if (entry_intact(entry)) {
+            id = entry->id;
+            break;
+        }
+    }
+    xSemaphoreGive(s_mutex);
+    return id;
+}
+
+// Copy the next chunk of a response out of the arena. Returns 0 when the response
+// is finished or has been evicted since replay started.
+static size_t read_chunk(uint32_t response_id, size_t position, uint8_t *out, size_t max_len)
+{
+    size_t copied = 0;
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    history_entry_t *entry = find_entry(response_id);
+    if (entry && entry_intact(entry) && position < entry->length) {
+        copied = entry->length - position;
+        if (copied > max_len) {
+            copied = max_len;
+        }
+        size_t offset = (entry->start + position) % HISTORY_ARENA_BYTES;
+        size_t first = HISTORY_ARENA_BYTES - offset;
+        if (first > copied) {
+            first = copied;
+        }
+        memcpy(out, s_arena + offset, first);
+        memcpy(out + first, s_arena, copied - first);
+    }
+    xSemaphoreGive(s_mutex);
+
+    return copied;
+}
+
+// Playback source: pulled by the playback task straight from the arena into its block
+static int replay_read(void *ctx, int16_t *block, size_t max_samples, uint32_t wait_ms)
+{
+    (void)ctx;
+    (void)wait_ms;
+    if (s_stop_replay) {
+        return AUDIO_PLAYBACK_SOURCE_END;
+    }
+
+    size_t copied = read_chunk(s_replay_id, s_replay_position, (uint8_t *)block, max_samples * sizeof(int16_t));
+    if (copied == 0) {
+        return AUDIO_PLAYBACK_SOURCE_END;
+    }
+    s_replay_position += copied;
+    return (int)(copied / sizeof(int16_t));
+}
+
+static void replay_release(void *ctx)
+{
+    (void)ctx;
+    ESP_LOGI(TAG, "Replay of response #%lu finished (%zu bytes)", (unsigned long)s_replay_id, s_replay_position);
+    s_replaying = false;
+}
+
+bool audio_history_replay(uint32_t response_id)
+{
+    if (!s_arena || response_id == 0) {
+        ESP_LOGW(TAG, "Nothing to replay");
+        return false;
+    }
+    if (s_replaying) {
+        ESP_LOGW(TAG, "Replay already in progress");
+        return false;
+    }
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    history_entry_t *entry = find_entry(response_id);
+    bool available = entry && entry_intact(entry);
+    xSemaphoreGive(s_mutex);
+
+    if (!available) {
+        ESP_LOGW(TAG, "Response #%lu no longer in history", (unsigned long)response_id);
+        return false;
+    }
+
+    s_replay_id = response_id;
+    s_replay_position = 0;
+    s_stop_replay = false;
+    s_replaying = true;
+
+    // Mixed over the session stream if one is open; release clears s_replaying
+    const audio_playback_source_t source = {
+        .read = replay_read,
+        .release = replay_release,
+    };
+    if (!audio_playback_play_source(&source)) {
+        ESP_LOGE(TAG, "Failed to start replay of response #%lu", (unsigned long)response_id);
+        return false;
+    }
+
+    ESP_LOGI(TAG, "Replaying response #%lu", (unsigned long)response_id);
+    return true;
+}
+
+bool audio_history_replay_latest(void)
+{
+    return audio_history_replay(audio_history_latest_id());
+}
+
+void audio_history_stop_replay(void)
+{
+    if (s_replaying) {
+        s_stop_replay = true;
+    }
+}
+
+bool audio_history_is_replaying(void)
+{
+    return s_replaying;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * @brief Bounded PSRAM history of recent assistant responses
+ *
+ * The fixed-size PSRAM arena is also the playback stream ring: downlink PCM
+ * (24kHz 16-bit mono) is copied into it once as it arrives from the proxy,
+ * playback reads it from there, and the bytes stay after they are played. Each
+ * response is a reference (start position and length) into the arena; the
+ * oldest responses are evicted once their bytes are overwritten. A response can
+ * be replayed locally without a server round trip: playback pulls it straight
+ * from the arena.
+ */
+
+/**
+ * @brief Allocate the history arena and hand it to playback as the stream store
+ *
+ * Call once at startup, after audio_playback_init() and before the first stream.
+ */
+void audio_history_init(void);
+
+/**
+ * @brief Start a new response segment
+ *
+ * If the current segment is still empty it is reused, so callers may signal the
+ * same response boundary from several sources (speech events, audio gaps).
+ *
+ * @return Id of the segment that subsequent appends go to (0 if unavailable)
+ */
+uint32_t audio_history_begin_response(void);
+
+/**
+ * @brief Number of responses currently held in the history
+ */
+size_t audio_history_count(void);
+
+/**
+ * @brief Id of the most recent non-empty response (0 if history is empty)
+ */
+uint32_t audio_history_latest_id(void);
+
+/**
+ * @brief Replay a stored response through the speaker (asynchronous)
+ *
+ * @param response_id Id returned by audio_history_begin_response()
+ * @return true if replay was started
+ */
+bool audio_history_replay(uint32_t response_id);
+
+/**
+ * @brief Replay the most recent response (asynchronous)
+ *
+ * @return true if replay was started
+ */
+bool audio_history_replay_latest(void);
+
+/**
+ * @brief Stop a running replay at the next playback block
+ */
+void audio_history_stop_replay(void);
+
+/**
+ * @brief Check whether a replay is currently feeding the speaker
+ */
+bool audio_history_is_replaying(void);
@@ -0,0 +1,423 @@
+#include "audio_kws.h"
+#include "dsp_kernels.h"
+
+#include <math.h>
+#include <string.h>
+
+#define KWS_SAMPLE_RATE             16000
+#define KWS_FFT_SIZE                (2 * AUDIO_KWS_FRAME_SAMPLES)   // 32 ms window
+#define KWS_NUM_BINS                (KWS_FFT_SIZE / 2 + 1)
+#define KWS_NUM_MEL                 24
+#define KWS_MEL_LOW_HZ              100.0f
+#define KWS_MEL_HIGH_HZ             7000.0f
+#define KWS_PREEMPH_Q15             31785   // 0.97
+#define KWS_FFT_HEADROOM            16383   // Window peak is scaled to ~14 bits before the FFT
+#define KWS_CEPS_SHIFT              6       // Q8 log2 → Q2 (0.25 log2 = 0.75 dB steps)
+#define KWS_LOG_RANGE_Q8            (6 * 256)   // Bands are floored 36 dB below the loudest one
+
+#define KWS_GATE_HANGOVER_FRAMES    25      // Keep matching 400 ms past the last speech frame
+#define KWS_REFRACTORY_FRAMES       62      // ~1 s between detections
+#define KWS_RECORD_END_FRAMES       19      // 300 ms of silence ends an enrollment utterance
+#define KWS_THRESHOLD_MARGIN_PCT    125     // Threshold above the worst template-to-template distance
+#define KWS_MIN_THRESHOLD           40
+#define KWS_MAX_THRESHOLD           120
+
+#define KWS_COST_INF                UINT32_MAX
+#define KWS_NO_SCORE                UINT16_MAX
+
+// Shared tables, built once
+static int16_t s_hann[KWS_FFT_SIZE];
+static uint8_t s_mel_band[KWS_NUM_BINS];      // Filter whose rising edge holds the bin (0xFF: outside)
+static int16_t s_mel_rise[KWS_NUM_BINS];      // Q15 weight on that edge; 1 - weight goes to the band below
+static int16_t s_dct[AUDIO_KWS_NUM_CEPS][KWS_NUM_MEL];
+static bool s_tables_ready = false;
+
+static float hz_to_mel(float hz)
+{
+    return 2595.0f * log10f(1.0f + hz / 700.0f);
+}
+
+static float mel_to_hz(float mel)
+{
+    return 700.0f * (powf(10.0f, mel / 2595.0f) - 1.0f);
+}
+
+static void build_tables(void)
+{
+    if (s_tables_ready) {
+        return;
+    }
+
+    for (size_t i = 0; i < KWS_FFT_SIZE; i++) {
+        float w = 0.5f - 0.5f * cosf(2.0f * (float)M_PI * (float)i / (float)KWS_FFT_SIZE);
+        s_hann[i] = (int16_t)lrintf(w * 32767.0f);
+    }
+
+    // KWS_NUM_MEL triangles over KWS_NUM_MEL + 2 edge points evenly spaced in mel, in bins
+    float edges[KWS_NUM_MEL + 2];
+    float mel_low = hz_to_mel(KWS_MEL_LOW_HZ);
+    float mel_step = (hz_to_mel(KWS_MEL_HIGH_HZ) - mel_low) / (KWS_NUM_MEL + 1);
+    for (size_t j = 0; j < KWS_NUM_MEL + 2; j++) {
+        edges[j] = mel_to_hz(mel_low + mel_step * j) * KWS_FFT_SIZE / KWS_SAMPLE_RATE;
+    }
+    for (size_t k = 0; k < KWS_NUM_BINS; k++) {
+        s_mel_band[k] = 0xFF;
+        for (size_t j = 0; j + 1 < KWS_NUM_MEL + 2; j++) {
+            if ((float)k >= edges[j] && (float)k < edges[j + 1]) {
+                s_mel_band[k] = (uint8_t)j;
+                s_mel_rise[k] = (int16_t)lrintf(32767.0f * ((float)k - edges[j]) / (edges[j + 1] - edges[j]));
+                break;
+            }
+        }
+    }
+
+    // Orthonormal DCT-II rows 1..AUDIO_KWS_NUM_CEPS
+    for (size_t i = 0; i < AUDIO_KWS_NUM_CEPS; i++) {
+        for (size_t m = 0; m < KWS_NUM_MEL; m++) {
+            float c = sqrtf(2.0f / KWS_NUM_MEL) * cosf((float)M_PI * (i + 1) * (m + 0.5f) / KWS_NUM_MEL);
+            s_dct[i][m] = (int16_t)lrintf(c * 32767.0f);
+        }
+    }
+
+    dsp_fft_init();
+    s_tables_ready = true;
+}
+
+// log2(v) in Q8; mantissa via log2(1 + f) ~= f + 0.3466 f (1 - f)
+static int32_t log2_q8(uint64_t v)
+{
+    if (v == 0) {
+        return 0;
+    }
+    int msb = 63 - __builtin_clzll(v);
+    uint32_t f = msb >= 8 ? (uint32_t)(v >> (msb - 8)) & 0xFF : (uint32_t)(v << (8 - msb)) & 0xFF;
+    return msb * 256 + (int32_t)(f + ((89 * f * (256 - f)) >> 16));
+}
+
+void audio_kws_features(const int16_t *prev, int16_t before_prev, const int16_t *frame,
+                        audio_kws_feature_t *out)
+{
+    int32_t window[KWS_FFT_SIZE];
+    int16_t spectrum[KWS_FFT_SIZE + 2];
+    int32_t last = before_prev;
+    int32_t peak = 0;
+
+    build_tables();
+
+    for (size_t i = 0; i < KWS_FFT_SIZE; i++) {
+        int32_t x = i < AUDIO_KWS_FRAME_SAMPLES ? prev[i] : frame[i - AUDIO_KWS_FRAME_SAMPLES];
+        int32_t y = x - ((KWS_PREEMPH_Q15 * last) >> 15);
+        last = x;
+        y = (y * s_hann[i]) >> 15;
+        window[i] = y;
+        if (y < 0 ? -y > peak : y > peak) {
+            peak = y < 0 ? -y : y;
+        }
+    }
+
+    // Block floating point: the cepstra below c0 do not depend on the scale,
+    // so the shift is simply dropped afterwards
+    int shift = 0;
+    while (peak > 0 && shift < 15 && (peak << (shift + 1)) <= KWS_FFT_HEADROOM) {
+        shift++;
+    }
+    while ((peak >> -shift) > KWS_FFT_HEADROOM) {
+        shift--;
+    }
+    for (size_t i = 0; i < KWS_FFT_SIZE; i++) {
+        spectrum[i] = (int16_t)(shift >= 0 ? window[i] << shift : window[i] >> -shift);
+    }
+    dsp_rfft_s16(spectrum, spectrum, KWS_FFT_SIZE);
+
+    uint64_t mel[KWS_NUM_MEL] = { 0 };
+    for (size_t k = 1; k < KWS_NUM_BINS - 1; k++) {
+        uint8_t band = s_mel_band[k];
+        if (band == 0xFF) {
+            continue;
+        }
+        int32_t re = spectrum[2 * k], im = spectrum[2 * k + 1];
+        uint64_t power = (uint64_t)(re * re) + (uint64_t)(im * im);
+        if (band < KWS_NUM_MEL) {
+            mel[band] += power * (uint32_t)s_mel_rise[k];
+        }
+        if (band > 0) {
+            mel[band - 1] += power * (uint32_t)(32768 - s_mel_rise[k]);
+        }
+    }
+
+    // Limit the dynamic range so empty bands (room noise) do not dominate the cepstra
+    int32_t log_mel[KWS_NUM_MEL];
+    int32_t log_peak = 0;
+    for (size_t m = 0; m < KWS_NUM_MEL; m++) {
+        log_mel[m] = log2_q8(mel[m] + 1);
+        if (log_mel[m] > log_peak) {
+            log_peak = log_mel[m];
+        }
+    }
+    for (size_t m = 0; m < KWS_NUM_MEL; m++) {
+        if (log_mel[m] < log_peak - KWS_LOG_RANGE_Q8) {
+            log_mel[m] = log_peak - KWS_LOG_RANGE_Q8;
+        }
+    }
+
+    for (size_t i = 0; i < AUDIO_KWS_NUM_CEPS; i++) {
+        int64_t acc = 0;
+        for (size_t m = 0; m < KWS_NUM_MEL; m++) {
+            acc += (int64_t)log_mel[m] * s_dct[i][m];
+        }
+        int32_t c = (int32_t)(acc >> (15 + KWS_CEPS_SHIFT));
+        out->c[i] = (int8_t)(c > 127 ? 127 : c < -127 ? -127 : c);
+    }
+}
+
+static uint32_t frame_distance(const audio_kws_feature_t *a, const audio_kws_feature_t *b)
+{
+    uint32_t d = 0;
+    for (size_t i = 0; i < AUDIO_KWS_NUM_CEPS; i++) {
+        int32_t diff = (int32_t)a->c[i] - b->c[i];
+        d += (uint32_t)(diff < 0 ? -diff : diff);
+    }
+    return d;
+}
+
+static void clear_column(uint32_t *cost, uint16_t *length)
+{
+    for (size_t j = 0; j < AUDIO_KWS_MAX_FRAMES; j++) {
+        cost[j] = KWS_COST_INF;
+        length[j] = 0;
+    }
+}
+
+// Advance one template column by one input frame. Every step consumes one input
+// frame and comes from template frame j (repeat), j-1 (step) or j-2 (skip) at
+// the previous frame, whichever has the lowest mean cost. Updated in place from
+// the end so the previous values are still there when they are read.
+static void dtw_column(uint32_t *cost, uint16_t *length, const audio_kws_template_t *tpl,
+                       const audio_kws_feature_t *feature, bool open_start)
+{
+    const uint16_t max_length = 2 * tpl->num_frames;
+
+    for (size_t j = tpl->num_frames; j-- > 0;) {
+        uint32_t best_cost = KWS_COST_INF;
+        uint16_t best_length = 0;
+
+        if (j == 0 && open_start) {
+            best_cost = 0;  // A fresh path costs nothing so far
+        } else {
+            for (size_t back = 0; back <= 2 && back <= j; back++) {
+                uint32_t c = cost[j - back];
+                uint16_t l = length[j - back];
+                if (c == KWS_COST_INF || l >= max_length) {
+                    continue;
+                }
+                if (best_cost == KWS_COST_INF || (uint64_t)c * best_length < (uint64_t)best_cost * l) {
+                    best_cost = c;
+                    best_length = l;
+                }
+            }
+        }
+
+        if (best_cost == KWS_COST_INF) {
+            cost[j] = KWS_COST_INF;
+            length[j] = 0;
+            continue;
+        }
+        cost[j] = best_cost + frame_distance(feature, &tpl->frames[j]);
+        length[j] = best_length + 1;
+    }
+}
+
+static uint16_t path_score(const uint32_t *cost, const uint16_t *length, const audio_kws_template_t *tpl)
+{
+    size_t end = tpl->num_frames - 1;
+    if (cost[end] == KWS_COST_INF || length[end] < tpl->num_frames / 2) {
+        return KWS_NO_SCORE;
+    }
+    uint32_t score = cost[end] / length[end];
+    return score < KWS_NO_SCORE ? (uint16_t)score : KWS_NO_SCORE - 1;
+}
+
+static void clear_paths(audio_kws_t *kws)
+{
+    for (size_t t = 0; t < AUDIO_KWS_MAX_TEMPLATES; t++) {
+        clear_column(kws->cost[t], kws->length[t]);
+    }
+}
+
+static audio_kws_result_t match_frame(audio_kws_t *kws, const audio_kws_feature_t *feature)
+{
+    uint16_t best = KWS_NO_SCORE;
+    uint16_t best_length = 0;
+
+    for (size_t t = 0; t < kws->num_templates; t++) {
+        const audio_kws_template_t *tpl = &kws->templates[t];
+        dtw_column(kws->cost[t], kws->length[t], tpl, feature, true);
+        uint16_t score = path_score(kws->cost[t], kws->length[t], tpl);
+        if (score < best) {
+            best = score;
+            best_length = kws->length[t][tpl->num_frames - 1];
+        }
+    }
+
+    kws->last_score = best;
+    if (best < kws->best_score) {
+        kws->best_score = best;
+    }
+    if (best > kws->threshold || kws->refractory > 0) {
+        return AUDIO_KWS_NONE;
+    }
+
+    kws->match_frames = best_length;
+    kws->refractory = KWS_REFRACTORY_FRAMES;
+    kws->detections++;
+    clear_paths(kws);
+    return AUDIO_KWS_DETECTED;
+}
+
+static audio_kws_result_t record_frame(audio_kws_t *kws, const audio_kws_feature_t *feature, bool speech)
+{
+    audio_kws_template_t *tpl = kws->recording;
+
+    if (kws->record_frames == 0 && !speech) {
+        return AUDIO_KWS_NONE;  // Waiting for the utterance to start
+    }
+    if (kws->record_frames < AUDIO_KWS_MAX_FRAMES) {
+        tpl->frames[kws->record_frames] = *feature;
+    }
+    kws->record_frames++;
+    kws->trailing_silence = speech ? 0 : kws->trailing_silence + 1;
+
+    if (kws->trailing_silence < KWS_RECORD_END_FRAMES) {
+        return AUDIO_KWS_NONE;
+    }
+
+    size_t num_frames = kws->record_frames - kws->trailing_silence;
+    kws->record_frames = 0;
+    kws->trailing_silence = 0;
+    if (num_frames < AUDIO_KWS_MIN_FRAMES || num_frames > AUDIO_KWS_MAX_FRAMES) {
+        tpl->num_frames = 0;
+        return AUDIO_KWS_REJECTED;
+    }
+
+    tpl->num_frames = (uint8_t)num_frames;
+    kws->recording = NULL;
+    return AUDIO_KWS_RECORDED;
+}
+
+void audio_kws_init(audio_kws_t *kws, const audio_kws_template_t *templates, size_t num_templates,
+                    uint16_t threshold)
+{
+    build_tables();
+
+    memset(kws, 0, sizeof(*kws));
+    audio_vad_init(&kws->vad);
+    kws->templates = templates;
+    kws->num_templates = num_templates < AUDIO_KWS_MAX_TEMPLATES ? num_templates : AUDIO_KWS_MAX_TEMPLATES;
+    kws->threshold = threshold;
+    audio_kws_reset(kws);
+}
+
+void audio_kws_reset(audio_kws_t *kws)
+{
+    clear_paths(kws);
+    kws->gate_frames = 0;
+    kws->refractory = 0;
+    kws->record_frames = 0;
+    kws->trailing_silence = 0;
+    kws->last_score = KWS_NO_SCORE;
+    kws->best_score = KWS_NO_SCORE;
+    kws->match_frames = 0;
+    kws->frames = 0;
+    kws->active_frames = 0;
+    kws->detections = 0;
+}
+
+void audio_kws_record(audio_kws_t *kws, audio_kws_template_t *tpl)
+{
+    kws->recording = tpl;
+    kws->record_frames = 0;
+    kws->trailing_silence = 0;
+    if (tpl) {
+        tpl->num_frames = 0;
+    }
+}
+
+audio_kws_result_t audio_kws_process(audio_kws_t *kws, const int16_t *frame)
+{
+    audio_kws_result_t result = AUDIO_KWS_NONE;
+
+    kws->frames++;
+    if (kws->refractory > 0) {
+        kws->refractory--;
+    }
+
+    bool speech = audio_vad_process(&kws->vad, frame, AUDIO_KWS_FRAME_SAMPLES);
+    if (speech) {
+        kws->gate_frames = KWS_GATE_HANGOVER_FRAMES;
+    }
+
+    if (kws->gate_frames > 0) {
+        kws->active_frames++;
+        audio_kws_feature_t feature;
+        audio_kws_features(kws->prev, kws->before_prev, frame, &feature);
+
+        if (kws->recording) {
+            result = record_frame(kws, &feature, speech);
+        } else if (kws->num_templates > 0) {
+            result = match_frame(kws, &feature);
+        }
+
+        if (--kws->gate_frames == 0) {
+            clear_paths(kws);  // Paths never bridge a silent gap
+        }
+    }
+
+    kws->before_prev = kws->prev[AUDIO_KWS_FRAME_SAMPLES - 1];
+    memcpy(kws->prev, frame, sizeof(kws->prev));
+    return result;
+}
+
+uint16_t audio_kws_template_distance(const audio_kws_template_t *a, const audio_kws_template_t *b)
+{
+    uint32_t cost[AUDIO_KWS_MAX_FRAMES];
+    uint16_t length[AUDIO_KWS_MAX_FRAMES];
+
+    if (a->num_frames == 0 || b->num_frames == 0) {
+        return KWS_NO_SCORE;
+    }
+
+    clear_column(cost, length);
+    for (size_t t = 0; t < b->num_frames; t++) {
+        dtw_column(cost, length, a, &b->frames[t], t == 0);
+    }
+    return path_score(cost, length, a);
+}
+
+uint16_t audio_kws_threshold_from_templates(const audio_kws_template_t *templates, size_t num_templates)
+{
+    if (num_templates < 2) {
+        return AUDIO_KWS_DEFAULT_THRESHOLD;
+    }
+
+    uint32_t worst = 0;
+    for (size_t i = 0; i < num_templates; i++) {
+        for (size_t j = 0; j < num_templates; j++) {
+            if (i == j) {
+                continue;
+            }
+            uint32_t d = audio_kws_template_distance(&templates[i], &templates[j]);
+            if (d != KWS_NO_SCORE && d > worst) {
+                worst = d;
+            }
+        }
+    }
+
+    uint32_t threshold = worst * KWS_THRESHOLD_MARGIN_PCT / 100;
+    if (threshold < KWS_MIN_THRESHOLD) {
+        threshold = KWS_MIN_THRESHOLD;
+    }
+    if (threshold > KWS_MAX_THRESHOLD) {
+        threshold = KWS_MAX_THRESHOLD;
+    }
+    return (uint16_t)threshold;
+}
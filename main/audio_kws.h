@@ -0,0 +1,125 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "audio_vad.h"
+
+/**
+ * @brief Template-matching keyword spotter for the 16kHz capture path
+ *
+ * Front-end: every 16 ms hop a 32 ms pre-emphasised Hann window goes through
+ * the fixed-point real FFT (dsp_kernels.h), a 24-band mel filterbank, a Q8
+ * log2 and a DCT. Cepstra c1..c12 are quantised to int8 (0.25 log2 steps); c0
+ * is dropped so the features do not depend on level.
+ *
+ * Matcher: streaming subsequence DTW of the feature stream against up to
+ * AUDIO_KWS_MAX_TEMPLATES enrolled templates (open start, one input frame per
+ * step, template frames may be repeated or skipped). The score is the mean L1
+ * distance per frame along the best path ending at the current frame.
+ *
+ * The front-end and matcher only run while the frame VAD hears something (plus
+ * a hangover), so a quiet room costs one mean-square per frame.
+ *
+ * Pure C on top of dsp_kernels and audio_vad, so the same code runs on the
+ * device and in tools/kws_eval.c on Linux.
+ */
+
+#define AUDIO_KWS_FRAME_SAMPLES     256     // 16 ms hop at 16 kHz
+#define AUDIO_KWS_NUM_CEPS          12
+#define AUDIO_KWS_MAX_TEMPLATES     3
+#define AUDIO_KWS_MAX_FRAMES        80      // 1.28 s
+#define AUDIO_KWS_MIN_FRAMES        20      // 320 ms
+#define AUDIO_KWS_DEFAULT_THRESHOLD 60      // Mean L1 distance per frame
+
+typedef struct {
+    int8_t c[AUDIO_KWS_NUM_CEPS];
+} audio_kws_feature_t;
+
+// Stored verbatim as an NVS blob; the layout is shared with tools/kws_eval.c
+typedef struct {
+    uint8_t num_frames;
+    audio_kws_feature_t frames[AUDIO_KWS_MAX_FRAMES];
+} audio_kws_template_t;
+
+typedef enum {
+    AUDIO_KWS_NONE = 0,
+    AUDIO_KWS_DETECTED,         // Keyword matched (detect mode)
+    AUDIO_KWS_RECORDED,         // Utterance captured into the template (record mode)
+    AUDIO_KWS_REJECTED,         // Utterance too short or too long (record mode, keeps listening)
+} audio_kws_result_t;
+
+typedef struct {
+    // Front-end
+    int16_t prev[AUDIO_KWS_FRAME_SAMPLES];  // Previous hop, first half of the window
+    int16_t before_prev;                    // Sample before it, for pre-emphasis
+    audio_vad_t vad;
+    uint16_t gate_frames;                   // Hangover left with the front-end running
+
+    // Matcher
+    const audio_kws_template_t *templates;
+    size_t num_templates;
+    uint16_t threshold;
+    uint32_t cost[AUDIO_KWS_MAX_TEMPLATES][AUDIO_KWS_MAX_FRAMES];
+    uint16_t length[AUDIO_KWS_MAX_TEMPLATES][AUDIO_KWS_MAX_FRAMES];
+    uint16_t refractory;
+
+    // Record mode
+    audio_kws_template_t *recording;
+    uint16_t record_frames;                 // Frames since the utterance started
+    uint16_t trailing_silence;
+
+    // Results and counters
+    uint16_t last_score;                    // Best score of the last active frame
+    uint16_t best_score;                    // Lowest score since audio_kws_reset()
+    uint16_t match_frames;                  // Input frames spanned by the last detection
+    uint32_t frames;
+    uint32_t active_frames;                 // Frames that ran the front-end
+    uint32_t detections;
+} audio_kws_t;
+
+/**
+ * @brief Initialise an instance in detect mode
+ *
+ * @param templates Enrolled templates (kept by reference, may be NULL if num_templates is 0)
+ * @param threshold Detection threshold (see audio_kws_threshold_from_templates())
+ */
+void audio_kws_init(audio_kws_t *kws, const audio_kws_template_t *templates, size_t num_templates,
+                    uint16_t threshold);
+
+/**
+ * @brief Clear matcher paths, gate and counters (templates are kept)
+ */
+void audio_kws_reset(audio_kws_t *kws);
+
+/**
+ * @brief Switch to record mode: the next utterance is stored in tpl
+ *
+ * Returns to detect mode after AUDIO_KWS_RECORDED. Pass NULL to cancel.
+ */
+void audio_kws_record(audio_kws_t *kws, audio_kws_template_t *tpl);
+
+/**
+ * @brief Process one hop of AUDIO_KWS_FRAME_SAMPLES samples
+ */
+audio_kws_result_t audio_kws_process(audio_kws_t *kws, const int16_t *frame);
+
+/**
+ * @brief Compute the features of one 32 ms window (prev hop + frame)
+ */
+void audio_kws_features(const int16_t *prev, int16_t before_prev, const int16_t *frame,
+                        audio_kws_feature_t *out);
+
+/**
+ * @brief DTW distance between two templates (both ends anchored)
+ */
+uint16_t audio_kws_template_distance(const audio_kws_template_t *a, const audio_kws_template_t *b);
+
+/**
+ * @brief Detection threshold from the spread between enrolled templates
+ *
+ * A margin above the largest template-to-template distance, clamped to a sane
+ * range; AUDIO_KWS_DEFAULT_THRESHOLD for a single template.
+ */
+uint16_t audio_kws_threshold_from_templates(const audio_kws_template_t *templates, size_t num_templates);
@@ -1,14 +1,23 @@
 #include "audio_playback.h"
+#include "audio_graph.h"
+#include "audio_playback_dsp.h"
+#include "audio_source.h"
+#include "dsp_kernels.h"
+#include "flash_safety.h"
+#include "latency_hist.h"
+#include "psram_bench.h"
 
 #include <assert.h>
 #include "driver/i2s_std.h"
 #include "driver/gpio.h"
+#include "esp_attr.h"
 #include "esp_check.h"
 #include "esp_heap_caps.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include "freertos/task.h"
-#include "freertos/ringbuf.h"
 
 #define PLAYBACK_I2S_PORT      I2S_NUM_0
 #define PLAYBACK_SAMPLE_RATE   24000  // Match OpenAI Realtime API output
@@ -23,24 +32,287 @@
 #define STREAM_BUFFER_SIZE     (96000)  // 2 seconds at 24kHz 16-bit = 96KB
 #define PREBUFFER_MS           500      // Wait for 500ms before starting playback
 #define PREBUFFER_BYTES        (PLAYBACK_SAMPLE_RATE * 2 * PREBUFFER_MS / 1000)  // 24KB
+#define PLAYBACK_BLOCK_BYTES   1920     // 40ms per I2S write, bounds how late a flush can land
+#define PLAYBACK_DMA_DESC_NUM  8        // 8 x 10ms of DMA carries playback across a flash write
+#define PLAYBACK_DMA_FRAME_NUM 240
+#define PLAYBACK_BLOCK_SAMPLES (PLAYBACK_BLOCK_BYTES / sizeof(int16_t))
+#define STREAM_READ_WAIT_MS    100      // Stream alone: block this long for network audio
+#define SOURCE_READ_WAIT_MS    10       // One-shot source alone
+#define SOURCE_MIX_GAIN_Q15    INT16_MAX  // A one-shot source mixes over the stream at full level
+#define STREAM_END_FLUSH_MS    500      // After a drain timeout, time allowed to drop the rest
+
+// 1: the I2S on_sent callback refills each DMA buffer as it is sent, from blocks
+// the playback task processed ahead into an internal-RAM feed queue. The task
+// still runs the playback graph (DSP included) for every block; the callback
+// never reads the PSRAM stream ring. 0: the task writes with i2s_channel_write().
+#ifndef PLAYBACK_DMA_FEED
+#define PLAYBACK_DMA_FEED      0
+#endif
+#define PLAYBACK_FEED_SAMPLES  (PLAYBACK_BLOCK_SAMPLES + 2 * PLAYBACK_DMA_FRAME_NUM)  // A block + 20ms to make the next
+#define PLAYBACK_FEED_WAIT_MS  50       // Task waits this long at most for room in the feed queue
 
 static const char *TAG = "audio_playback";
 static i2s_chan_handle_t s_tx_chan = NULL;
-static TaskHandle_t s_playback_task = NULL;
+static TaskHandle_t s_playback_task = NULL;    // Runs for the life of the device
 static audio_playback_callback_t s_callback = NULL;
 static void *s_callback_ctx = NULL;
 static uint8_t s_volume = 100;  // Default volume 100%
 static bool s_streaming_active = false;
 
-// Buffered streaming playback
-static RingbufHandle_t s_stream_buffer = NULL;
-static TaskHandle_t s_buffered_playback_task = NULL;
+// Buffered streaming playback: the network ring, read by the playback task while
+// attached. Addressed with absolute positions; the byte at position p is at
+// s_store.base[p % s_store.size]. The writer waits while STREAM_BUFFER_SIZE bytes
+// are unplayed, so it never overwrites what the playback task has yet to read.
+static audio_playback_store_t s_store;             // External store, or the stream's own ring
+static bool s_store_external = false;
+static uint8_t *s_own_store = NULL;
+static portMUX_TYPE s_store_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint64_t s_store_write_pos = 0;             // Advanced by the network writer
+static uint64_t s_store_read_pos = 0;              // Advanced by the playback task
+static SemaphoreHandle_t s_store_data = NULL;      // Given by the writer after each chunk
+static SemaphoreHandle_t s_store_space = NULL;     // Given by the playback task after each read
+static volatile bool s_stream_attached = false;    // Cleared by the playback task once drained
 static bool s_prebuffer_complete = false;
+static volatile bool s_flush_requested = false;
+static TaskHandle_t s_flush_waiter = NULL;
+
+// Latency stamps: set by the network writer, consumed by the playback task
+static bool s_stream_got_byte = false;
+static uint32_t s_stream_first_byte_us = 0;
+static volatile uint32_t s_burst_first_byte_us = 0;
+static volatile bool s_burst_pending = false;      // Audio arrived after a gap and has not reached I2S yet
+
+// One-shot pull source. Callers fill s_source and set s_source_active under the
+// lock; from then on only the playback task touches it, and clears s_source_active
+// after release() has run.
+static portMUX_TYPE s_source_lock = portMUX_INITIALIZER_UNLOCKED;
+static audio_playback_source_t s_source;
+static volatile bool s_source_active = false;
+static volatile bool s_source_stop = false;
+static bool s_block_dsp_bypass = false;             // Current block comes only from a dsp_bypass source
+static bool s_dsp_tail = false;                     // Stream audio sits in the limiter look-ahead (playback task only)
+
+static audio_playback_tap_cb_t s_output_tap = NULL;
+static void *s_output_tap_ctx = NULL;
+
+// Playback graph, run inline by the playback task: DSP → I2S → echo reference
+static audio_graph_t *s_playback_graph = NULL;
+static size_t s_total_played = 0;
+
+// Underruns only count while a stream is feeding I2S (an idle channel underruns by design)
+static volatile uint32_t s_underruns = 0;
+static volatile bool s_underrun_armed = false;
+
+// Playback task CPU: wall time since playback started minus time spent blocked
+static int64_t s_active_start_us = 0;
+static int64_t s_blocked_us = 0;
+static uint32_t s_task_waits = 0;
+
+#if PLAYBACK_DMA_FEED
+// Feed queue: processed samples from the playback task (producer, head) to
+// the on_sent callback (consumer, tail). Internal RAM, so the callback keeps
+// playing it out during a flash write.
+static portMUX_TYPE s_feed_lock = portMUX_INITIALIZER_UNLOCKED;
+static int16_t *s_feed = NULL;
+static volatile uint32_t s_feed_head = 0;
+static volatile uint32_t s_feed_tail = 0;
+static volatile bool s_feed_waiting = false;       // Task waits for room; the callback notifies it
+
+static volatile uint32_t s_fed_frames = 0;
+#endif
+
+// I2S ISR: the DMA ran out of written buffers and repeated a cleared one
+static bool IRAM_ATTR underrun_cb(i2s_chan_handle_t handle, i2s_event_data_t *event, void *ctx)
+{
+    (void)handle;
+    (void)event;
+    (void)ctx;
+    if (s_underrun_armed) {
+        s_underruns++;
+    }
+    return false;
+}
+
+// Apply volume scaling in-place to 16-bit PCM samples
+static void apply_volume(int16_t *samples, size_t num_samples, uint8_t volume)
+{
+    if (volume == 100) {
+        return;  // No scaling needed
+    }
+
+    for (size_t i = 0; i < num_samples; i++) {
+        int32_t scaled = ((int32_t)samples[i] * volume) / 100;
+        samples[i] = (int16_t)scaled;
+    }
+}
+
+static void dsp_process(int16_t *block, size_t num_samples, void *ctx)
+{
+    (void)ctx;
+    if (s_block_dsp_bypass) {
+        apply_volume(block, num_samples, s_volume);
+        return;
+    }
+    // High-pass, EQ, compressor, loudness, volume and limiter share 32-bit
+    // intermediates, so they stay one node with their own per-stage counters
+    audio_playback_dsp_process(block, num_samples, s_volume);
+}
+
+static void dsp_reset(void *ctx)
+{
+    (void)ctx;
+    audio_playback_dsp_reset();
+}
+
+// Time a call that may block the playback task (playback task only)
+static inline int64_t blocked_begin(void)
+{
+    return esp_timer_get_time();
+}
+
+static inline void blocked_end(int64_t start_us)
+{
+    s_blocked_us += esp_timer_get_time() - start_us;
+    s_task_waits++;
+}
+
+// Unplayed bytes in the stream ring
+static size_t stream_buffered(void)
+{
+    portENTER_CRITICAL(&s_store_lock);
+    size_t buffered = (size_t)(s_store_write_pos - s_store_read_pos);
+    portEXIT_CRITICAL(&s_store_lock);
+    return buffered;
+}
+
+// write() of the stream's own ring
+static void own_store_write(uint64_t position, const uint8_t *data, size_t length, void *ctx)
+{
+    (void)ctx;
+    size_t offset = position % STREAM_BUFFER_SIZE;
+    size_t first = STREAM_BUFFER_SIZE - offset;
+    if (first > length) {
+        first = length;
+    }
+    memcpy(s_own_store + offset, data, first);
+    memcpy(s_own_store, data + first, length - first);
+}
+
+#if PLAYBACK_DMA_FEED
+// Copy up to max_samples out of the feed queue (on_sent callback)
+static size_t IRAM_ATTR feed_pop(int16_t *out, size_t max_samples)
+{
+    portENTER_CRITICAL_ISR(&s_feed_lock);
+    size_t n = s_feed_head - s_feed_tail;
+    if (n > max_samples) {
+        n = max_samples;
+    }
+    size_t pos = s_feed_tail % PLAYBACK_FEED_SAMPLES;
+    size_t first = PLAYBACK_FEED_SAMPLES - pos;
+    if (first > n) {
+        first = n;
+    }
+    memcpy(out, s_feed + pos, first * sizeof(int16_t));
+    memcpy(out + first, s_feed, (n - first) * sizeof(int16_t));
+    s_feed_tail += n;
+    portEXIT_CRITICAL_ISR(&s_feed_lock);
+    return n;
+}
+
+// Queue a processed block for the on_sent callback, waiting for room (playback task only)
+static void feed_push(const int16_t *block, size_t num_samples)
+{
+    while (PLAYBACK_FEED_SAMPLES - (s_feed_head - s_feed_tail) < num_samples) {
+        s_feed_waiting = true;
+        int64_t start_us = blocked_begin();
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(PLAYBACK_FEED_WAIT_MS));
+        blocked_end(start_us);
+    }
+
+    // Free space is only written here, so the copy needs no lock
+    size_t pos = s_feed_head % PLAYBACK_FEED_SAMPLES;
+    size_t first = PLAYBACK_FEED_SAMPLES - pos;
+    if (first > num_samples) {
+        first = num_samples;
+    }
+    memcpy(s_feed + pos, block, first * sizeof(int16_t));
+    memcpy(s_feed, block + first, (num_samples - first) * sizeof(int16_t));
+    portENTER_CRITICAL(&s_feed_lock);
+    s_feed_head += num_samples;
+    portEXIT_CRITICAL(&s_feed_lock);
+}
 
-typedef struct {
-    uint8_t *data;
-    size_t length;
-} playback_task_params_t;
+// Drop what the callback has not played yet (playback task only)
+static void feed_drop(void)
+{
+    portENTER_CRITICAL(&s_feed_lock);
+    s_feed_head = s_feed_tail;
+    portEXIT_CRITICAL(&s_feed_lock);
+}
+
+// I2S ISR: refill the DMA buffer that just went out (cleared by the driver
+// first, so whatever is not refilled plays as silence). It plays again after
+// the rest of the ring, so output latency is the DMA ring plus the feed queue.
+static bool IRAM_ATTR dma_sent_cb(i2s_chan_handle_t handle, i2s_event_data_t *event, void *ctx)
+{
+    (void)handle;
+    (void)ctx;
+    int16_t *out = (int16_t *)event->dma_buf;
+    size_t num_samples = event->size / sizeof(int16_t);
+    BaseType_t woken = pdFALSE;
+
+    size_t got = feed_pop(out, num_samples);
+    if (got > 0) {
+        s_fed_frames++;
+        s_total_played += got * sizeof(int16_t);
+        if (s_feed_waiting) {
+            s_feed_waiting = false;
+            vTaskNotifyGiveFromISR(s_playback_task, &woken);
+        }
+    }
+
+    if (got < num_samples && s_underrun_armed) {
+        s_underruns++;
+    }
+    return woken == pdTRUE;
+}
+#endif
+
+static void i2s_out_process(int16_t *block, size_t num_samples, void *ctx)
+{
+    (void)ctx;
+#if PLAYBACK_DMA_FEED
+    feed_push(block, num_samples);
+#else
+    size_t bytes_written = 0;
+    int64_t start_us = blocked_begin();
+    esp_err_t err = i2s_channel_write(s_tx_chan, block, num_samples * sizeof(int16_t), &bytes_written, portMAX_DELAY);
+    blocked_end(start_us);
+
+    if (err == ESP_OK) {
+        s_total_played += bytes_written;
+    } else {
+        ESP_LOGE(TAG, "I2S write error: %s", esp_err_to_name(err));
+    }
+#endif
+}
+
+static void echo_ref_process(int16_t *block, size_t num_samples, void *ctx)
+{
+    (void)ctx;
+    audio_playback_tap_cb_t tap = s_output_tap;
+    if (tap) {
+        tap(block, num_samples, s_output_tap_ctx);
+    }
+}
+
+static const audio_graph_node_config_t s_playback_nodes[] = {
+    { .name = "dsp", .process = dsp_process, .reset = dsp_reset, .core = AUDIO_GRAPH_INLINE },
+    { .name = "i2s_out", .process = i2s_out_process, .core = AUDIO_GRAPH_INLINE },
+    { .name = "echo_ref", .process = echo_ref_process, .core = AUDIO_GRAPH_INLINE },
+};
+
+static void playback_task(void *arg);
 
 void audio_playback_init(void)
 {
@@ -48,8 +320,29 @@ void audio_playback_init(void)
         return;
     }
 
+#if PLAYBACK_DMA_FEED
+    s_feed = heap_caps_malloc(PLAYBACK_FEED_SAMPLES * sizeof(int16_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (!s_feed) {
+        ESP_LOGE(TAG, "Failed to allocate the DMA feed queue");
+        return;
+    }
+#endif
+
+    s_store_data = xSemaphoreCreateBinary();
+    s_store_space = xSemaphoreCreateBinary();
+    if (!s_store_data || !s_store_space) {
+        ESP_LOGE(TAG, "Failed to create stream ring semaphores");
+        return;
+    }
+
     i2s_chan_config_t chan_cfg = I2S_CHANNEL_DEFAULT_CONFIG(PLAYBACK_I2S_PORT, I2S_ROLE_MASTER);
+#if PLAYBACK_DMA_FEED
+    chan_cfg.auto_clear_before_cb = true;  // dma_sent_cb refills the cleared buffer
+#else
     chan_cfg.auto_clear = true;
+#endif
+    chan_cfg.dma_desc_num = PLAYBACK_DMA_DESC_NUM;
+    chan_cfg.dma_frame_num = PLAYBACK_DMA_FRAME_NUM;
     ESP_ERROR_CHECK(i2s_new_channel(&chan_cfg, &s_tx_chan, NULL));
 
     i2s_std_config_t std_cfg = {
@@ -71,9 +364,49 @@ void audio_playback_init(void)
     // Don't set slot_mask - use default (both channels) for mono playback
 
     ESP_ERROR_CHECK(i2s_channel_init_std_mode(s_tx_chan, &std_cfg));
+#if PLAYBACK_DMA_FEED
+    // Nothing reads the driver's queue of sent buffers, so underruns are counted in dma_sent_cb
+    const i2s_event_callbacks_t callbacks = { .on_sent = dma_sent_cb };
+#else
+    const i2s_event_callbacks_t callbacks = { .on_send_q_ovf = underrun_cb };
+#endif
+    ESP_ERROR_CHECK(i2s_channel_register_event_callback(s_tx_chan, &callbacks, NULL));
     ESP_ERROR_CHECK(i2s_channel_enable(s_tx_chan));
 
-    ESP_LOGI(TAG, "Playback pipeline initialised");
+    audio_playback_dsp_init(PLAYBACK_SAMPLE_RATE);
+
+    const audio_graph_config_t graph_cfg = {
+        .name = "playback",
+        .sample_rate = PLAYBACK_SAMPLE_RATE,
+        .block_samples = PLAYBACK_BLOCK_BYTES / sizeof(int16_t),
+        .nodes = s_playback_nodes,
+        .num_nodes = sizeof(s_playback_nodes) / sizeof(s_playback_nodes[0]),
+    };
+    s_playback_graph = audio_graph_create(&graph_cfg);
+    if (!s_playback_graph) {
+        ESP_LOGE(TAG, "Failed to create playback graph");
+    } else if (xTaskCreatePinnedToCore(playback_task, "audio_playback", 8192, NULL,
+                                       6,  // Higher priority than HTTP reader (priority 4)
+                                       &s_playback_task,
+                                       1   // Core 1 (separate from HTTP/WiFi on core 0)
+                                       ) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create playback task");
+        s_playback_task = NULL;
+    }
+
+    // Only the I2S callbacks run during a flash write. The playback task (DSP,
+    // stream ring in PSRAM) waits it out while the DMA ring keeps the speaker fed.
+    const flash_safety_entry_t hot_paths[] = {
+        FLASH_SAFETY_CODE(underrun_cb),
+#if PLAYBACK_DMA_FEED
+        FLASH_SAFETY_CODE(dma_sent_cb),
+        FLASH_SAFETY_CODE(feed_pop),
+        FLASH_SAFETY_DATA(s_feed),
+#endif
+    };
+    flash_safety_verify(TAG, hot_paths, sizeof(hot_paths) / sizeof(hot_paths[0]));
+
+    ESP_LOGI(TAG, "Playback pipeline initialised (%s)", PLAYBACK_DMA_FEED ? "fed from the I2S callback" : "task writes");
 }
 
 void audio_playback_set_callback(audio_playback_callback_t callback, void *user_ctx)
@@ -96,257 +429,354 @@ uint8_t audio_playback_get_volume(void)
     return s_volume;
 }
 
-// Apply volume scaling in-place to 16-bit PCM samples
-static void apply_volume(int16_t *samples, size_t num_samples, uint8_t volume)
-{
-    if (volume == 100) {
-        return;  // No scaling needed
-    }
-
-    for (size_t i = 0; i < num_samples; i++) {
-        int32_t scaled = ((int32_t)samples[i] * volume) / 100;
-        samples[i] = (int16_t)scaled;
-    }
-}
-
-static void playback_task(void *arg)
-{
-    playback_task_params_t *params = (playback_task_params_t *)arg;
-
-    // Notify started
-    if (s_callback) {
-        s_callback(AUDIO_PLAYBACK_EVENT_STARTED, s_callback_ctx);
-    }
-
-    // Apply volume scaling in-place (only if volume != 100%)
-    if (s_volume != 100) {
-        size_t num_samples = params->length / sizeof(int16_t);
-        apply_volume((int16_t *)params->data, num_samples, s_volume);
-    }
-
-    size_t bytes_written = 0;
-    esp_err_t err = i2s_channel_write(s_tx_chan, params->data, params->length, &bytes_written, portMAX_DELAY);
-
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "I2S write failed: %s", esp_err_to_name(err));
-        if (s_callback) {
-            s_callback(AUDIO_PLAYBACK_EVENT_ERROR, s_callback_ctx);
-        }
-    } else {
-        ESP_LOGI(TAG, "Played %u/%u bytes of PCM data (volume: %u%%)",
-                 (unsigned int)bytes_written, (unsigned int)params->length, s_volume);
-        if (s_callback) {
-            s_callback(AUDIO_PLAYBACK_EVENT_COMPLETED, s_callback_ctx);
-        }
-    }
-
-    // Cleanup
-    free(params->data);
-    free(params);
-    s_playback_task = NULL;
-    vTaskDelete(NULL);
-}
-
 void audio_playback_play_pcm(const uint8_t *data, size_t length_bytes)
 {
-    if (!s_tx_chan) {
-        ESP_LOGW(TAG, "Playback channel not initialised");
+    if (!s_playback_task) {
+        ESP_LOGW(TAG, "Playback not initialised");
         return;
     }
     if (!data || length_bytes == 0) {
         ESP_LOGW(TAG, "No PCM payload to play");
         return;
     }
-    if (s_playback_task) {
-        ESP_LOGW(TAG, "Playback already in progress");
-        return;
-    }
 
-    // Allocate memory for task parameters and audio data
-    playback_task_params_t *params = malloc(sizeof(playback_task_params_t));
-    assert(params != NULL && "Critical: Failed to allocate task params");
-    if (!params) {
-        ESP_LOGE(TAG, "Failed to allocate task params");
+    // Large audio buffer - must use SPIRAM
+    int16_t *copy = heap_caps_malloc(length_bytes, MALLOC_CAP_SPIRAM);
+    assert(copy != NULL && "Critical: Failed to allocate audio buffer from SPIRAM");
+    if (!copy) {
+        ESP_LOGE(TAG, "Failed to allocate %u bytes from SPIRAM for audio buffer", (unsigned int)length_bytes);
         if (s_callback) {
             s_callback(AUDIO_PLAYBACK_EVENT_ERROR, s_callback_ctx);
         }
         return;
     }
+    memcpy(copy, data, length_bytes);
 
-    // Large audio buffer - must use SPIRAM
-    params->data = heap_caps_malloc(length_bytes, MALLOC_CAP_SPIRAM);
-    assert(params->data != NULL && "Critical: Failed to allocate audio buffer from SPIRAM");
-    if (!params->data) {
-        ESP_LOGE(TAG, "Failed to allocate %u bytes from SPIRAM for audio buffer", (unsigned int)length_bytes);
-        free(params);
+    // Volume only, as this call has always played
+    audio_playback_source_t source;
+    if (!audio_source_buffer(copy, length_bytes / sizeof(int16_t), heap_caps_free, &source)) {
         if (s_callback) {
             s_callback(AUDIO_PLAYBACK_EVENT_ERROR, s_callback_ctx);
         }
         return;
     }
-    ESP_LOGI(TAG, "Allocated %u bytes for playback", (unsigned int)length_bytes);
-
-    memcpy(params->data, data, length_bytes);
-    params->length = length_bytes;
+    source.dsp_bypass = true;
+    audio_playback_play_source(&source);
+}
 
-    // Create playback task pinned to core 1 (following demo best practice)
-    BaseType_t result = xTaskCreatePinnedToCore(
-        playback_task,
-        "audio_playback",
-        4096,
-        params,
-        5,
-        &s_playback_task,
-        1  // Pin to core 1
-    );
+bool audio_playback_play_source(const audio_playback_source_t *source)
+{
+    bool accepted = false;
+    if (s_playback_task && source && source->read) {
+        portENTER_CRITICAL(&s_source_lock);
+        if (!s_source_active) {
+            s_source = *source;
+            s_source_stop = false;
+            s_source_active = true;
+            accepted = true;
+        }
+        portEXIT_CRITICAL(&s_source_lock);
+    }
 
-    if (result != pdPASS) {
-        ESP_LOGE(TAG, "Failed to create playback task");
-        free(params->data);
-        free(params);
-        if (s_callback) {
-            s_callback(AUDIO_PLAYBACK_EVENT_ERROR, s_callback_ctx);
+    if (!accepted) {
+        if (s_playback_task) {
+            ESP_LOGW(TAG, "Playback already in progress");
+        } else {
+            ESP_LOGW(TAG, "Playback not initialised");
+        }
+        if (source && source->release) {
+            source->release(source->ctx);
         }
+        return false;
     }
+
+    xTaskNotifyGive(s_playback_task);
+    return true;
 }
 
-void audio_playback_stop(void)
+void audio_playback_stop_source(void)
 {
-    if (s_playback_task) {
-        vTaskDelete(s_playback_task);
-        s_playback_task = NULL;
+    if (s_source_active) {
+        s_source_stop = true;
         ESP_LOGI(TAG, "Playback stopped");
     }
+}
+
+bool audio_playback_source_is_active(void)
+{
+    return s_source_active;
+}
+
+void audio_playback_stop(void)
+{
+    audio_playback_stop_source();
     s_streaming_active = false;
 }
 
-// Buffered playback task - reads from ring buffer and writes to I2S
-static void buffered_playback_task(void *arg)
+// Drop everything in the ring and acknowledge the flush (playback task only)
+static void discard_buffered_audio(void)
 {
-    (void)arg;
-    ESP_LOGI(TAG, "Buffered playback task started on core %d", xPortGetCoreID());
+    portENTER_CRITICAL(&s_store_lock);
+    size_t discarded = (size_t)(s_store_write_pos - s_store_read_pos);
+    s_store_read_pos = s_store_write_pos;
+    portEXIT_CRITICAL(&s_store_lock);
+    xSemaphoreGive(s_store_space);
+    audio_graph_reset(s_playback_graph);
+#if PLAYBACK_DMA_FEED
+    feed_drop();
+#endif
+
+    s_burst_pending = false;
+    s_flush_requested = false;
+    TaskHandle_t waiter = s_flush_waiter;
+    if (waiter) {
+        xTaskNotifyGive(waiter);
+    }
+    ESP_LOGI(TAG, "Flushed %zu buffered bytes", discarded);
+}
+
+// The network ring as a pull source: nothing until pre-buffered, ends once
+// the stream is closed and drained (playback task only)
+static int stream_read(int16_t *block, size_t max_samples, uint32_t wait_ms)
+{
+    if (s_streaming_active && !s_prebuffer_complete) {
+        if (wait_ms) {
+            // The writer notifies when the pre-buffer fills
+            int64_t start_us = blocked_begin();
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(wait_ms));
+            blocked_end(start_us);
+        }
+        return 0;
+    }
+
+    // Short timeout when draining
+    TickType_t timeout = pdMS_TO_TICKS((s_streaming_active || wait_ms < 10) ? wait_ms : 10);
+    size_t buffered = stream_buffered();
+    if (buffered < sizeof(int16_t) && timeout) {
+        int64_t start_us = blocked_begin();
+        xSemaphoreTake(s_store_data, timeout);
+        blocked_end(start_us);
+        buffered = stream_buffered();
+    }
+    size_t length = buffered < max_samples * sizeof(int16_t) ? buffered : max_samples * sizeof(int16_t);
+    length &= ~(size_t)(sizeof(int16_t) - 1);
+    if (length == 0) {
+        return s_streaming_active ? 0 : AUDIO_PLAYBACK_SOURCE_END;
+    }
+
+    // Copy out of the ring so it can refill while we process and write
+    size_t offset = s_store_read_pos % s_store.size;
+    size_t first = s_store.size - offset;
+    if (first > length) {
+        first = length;
+    }
+    memcpy(block, s_store.base + offset, first);
+    memcpy((uint8_t *)block + first, s_store.base, length - first);
+
+    portENTER_CRITICAL(&s_store_lock);
+    s_store_read_pos += length;
+    portEXIT_CRITICAL(&s_store_lock);
+    xSemaphoreGive(s_store_space);
+    return (int)(length / sizeof(int16_t));
+}
 
-    uint8_t *read_buffer = malloc(4096);
-    if (!read_buffer) {
-        ESP_LOGE(TAG, "Failed to allocate read buffer for playback task");
-        s_buffered_playback_task = NULL;
+// Hand the one-shot source back to its owner (playback task only)
+static void release_source(void)
+{
+    if (s_source.release) {
+        s_source.release(s_source.ctx);
+    }
+    portENTER_CRITICAL(&s_source_lock);
+    s_source_active = false;
+    s_source_stop = false;
+    portEXIT_CRITICAL(&s_source_lock);
+}
+
+// Pulls a block from the stream ring and the one-shot source, mixes them and
+// runs the playback graph. Sleeps while neither is playing.
+static void playback_task(void *arg)
+{
+    (void)arg;
+    ESP_LOGI(TAG, "Playback task started on core %d", xPortGetCoreID());
+
+    int16_t *block = heap_caps_malloc(PLAYBACK_BLOCK_BYTES, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    int16_t *mix = heap_caps_malloc(PLAYBACK_BLOCK_BYTES, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (!block || !mix) {
+        ESP_LOGE(TAG, "Failed to allocate playback blocks");
+        free(block);
+        free(mix);
+        s_playback_task = NULL;
         vTaskDelete(NULL);
         return;
     }
 
-    size_t total_played = 0;
+    bool idle = true;
+    while (true) {
+        bool stream = s_stream_attached;
+        bool source = s_source_active;
+
+        if (!stream && !source) {
+            if (!idle) {
+                int64_t elapsed_us = esp_timer_get_time() - s_active_start_us;
+#if PLAYBACK_DMA_FEED
+                uint32_t fed_frames = s_fed_frames;
+#else
+                uint32_t fed_frames = 0;
+#endif
+                ESP_LOGI(TAG, "Playback idle, played %zu bytes, task busy %.2f%% (%lu waits), "
+                         "%lu DMA frames fed by the callback",
+                         s_total_played, elapsed_us > 0 ? 100.0 * (elapsed_us - s_blocked_us) / elapsed_us : 0.0,
+                         (unsigned long)s_task_waits, (unsigned long)fed_frames);
+                idle = true;
+            }
+            s_underrun_armed = false;
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+        if (idle) {
+            idle = false;
+            s_total_played = 0;
+            s_active_start_us = esp_timer_get_time();
+            s_blocked_us = 0;
+            s_task_waits = 0;
+#if PLAYBACK_DMA_FEED
+            s_fed_frames = 0;
+#endif
+            audio_graph_reset(s_playback_graph);
+        }
 
-    // Wait for pre-buffering to complete
-    while (s_streaming_active && !s_prebuffer_complete) {
-        vTaskDelay(pdMS_TO_TICKS(10));
-    }
-    ESP_LOGI(TAG, "Pre-buffering complete, starting I2S playback");
+        size_t num_samples = 0;
+        bool from_stream = false;
 
-    while (true) {
-        // Read from ring buffer (blocks if empty while streaming, short timeout when draining)
-        TickType_t timeout = s_streaming_active ? pdMS_TO_TICKS(100) : pdMS_TO_TICKS(10);
-        size_t item_size = 0;
-        uint8_t *item = xRingbufferReceiveUpTo(s_stream_buffer, &item_size, timeout, 4096);
+        if (stream) {
+            if (s_flush_requested) {
+                discard_buffered_audio();
+            }
+            // Nothing buffered: a gap from here on is the stream's, not a playback glitch
+            if (!source && stream_buffered() == 0) {
+                s_underrun_armed = false;
+            }
 
-        if (!item) {
-            // No data available - if streaming ended, we're done draining
-            if (!s_streaming_active) {
+            // The source keeps I2S fed, so only block on the network when playing alone
+            int n = stream_read(block, PLAYBACK_BLOCK_SAMPLES, source ? 0 : STREAM_READ_WAIT_MS);
+            if (n == AUDIO_PLAYBACK_SOURCE_END) {
                 ESP_LOGI(TAG, "Buffer drained, ending playback");
-                break;
+                s_stream_attached = false;
+            } else {
+                num_samples = (size_t)n;
+                from_stream = n > 0;
+            }
+            // Ran dry at the end of a response or of the stream: drop its tail from
+            // the DSP so it does not open the next response
+            if (s_dsp_tail && (n == AUDIO_PLAYBACK_SOURCE_END || (n == 0 && !source && s_prebuffer_complete))) {
+                audio_playback_dsp_flush();
+                s_dsp_tail = false;
             }
-            // Streaming still active, just timeout - continue waiting
-            continue;
         }
 
-        // Apply volume if needed
-        if (s_volume != 100) {
-            memcpy(read_buffer, item, item_size);
-            size_t sample_count = item_size / sizeof(int16_t);
-            apply_volume((int16_t *)read_buffer, sample_count, s_volume);
-            vRingbufferReturnItem(s_stream_buffer, item);
-            item = read_buffer;
+        if (source) {
+            int16_t *dst = num_samples ? mix : block;
+            int n = s_source_stop ? AUDIO_PLAYBACK_SOURCE_END
+                                  : s_source.read(s_source.ctx, dst, PLAYBACK_BLOCK_SAMPLES,
+                                                  stream ? 0 : SOURCE_READ_WAIT_MS);
+            if (n == AUDIO_PLAYBACK_SOURCE_END) {
+                release_source();
+            } else if (n > 0 && dst == mix) {
+                if ((size_t)n > num_samples) {
+                    memset(block + num_samples, 0, ((size_t)n - num_samples) * sizeof(int16_t));
+                    num_samples = (size_t)n;
+                }
+                dsp_mix_sat_s16(block, mix, (size_t)n, SOURCE_MIX_GAIN_Q15);
+            } else if (n > 0) {
+                num_samples = (size_t)n;
+            }
         }
 
-        // Write to I2S
-        size_t bytes_written = 0;
-        esp_err_t err = i2s_channel_write(s_tx_chan, item, item_size, &bytes_written, portMAX_DELAY);
-
-        if (s_volume == 100) {
-            vRingbufferReturnItem(s_stream_buffer, item);
+        if (num_samples == 0) {
+            if (s_source_active) {
+                int64_t start_us = blocked_begin();
+                vTaskDelay(1);  // Source not ready yet; the stream read did not block either
+                blocked_end(start_us);
+            }
+            continue;
+        }
+        if (from_stream && s_flush_requested) {
+            continue;  // Drop this block with the rest of the buffer
         }
 
-        if (err == ESP_OK) {
-            total_played += bytes_written;
-        } else {
-            ESP_LOGE(TAG, "I2S write error: %s", esp_err_to_name(err));
+        // DSP, I2S write and echo reference
+        s_block_dsp_bypass = !from_stream && s_source.dsp_bypass;
+        audio_graph_push(s_playback_graph, block, num_samples);
+        s_underrun_armed = true;
+        s_dsp_tail |= from_stream;
+        if (from_stream && s_burst_pending) {
+            s_burst_pending = false;
+            latency_hist_record_since(LATENCY_METRIC_FIRST_BYTE_TO_SAMPLE, s_burst_first_byte_us);
         }
     }
-
-    free(read_buffer);
-    ESP_LOGI(TAG, "Buffered playback task ended, played %zu bytes total", total_played);
-    s_buffered_playback_task = NULL;
-    vTaskDelete(NULL);
 }
 
 // Streaming playback API with buffering for smooth playback
 bool audio_playback_stream_start(void)
 {
-    if (!s_tx_chan) {
+    if (!s_tx_chan || !s_playback_task) {
         ESP_LOGW(TAG, "Playback channel not initialised");
         return false;
     }
-    if (s_playback_task) {
-        ESP_LOGW(TAG, "Buffered playback in progress, cannot start streaming");
-        return false;
-    }
     if (s_streaming_active) {
         ESP_LOGW(TAG, "Streaming playback already active");
         return false;
     }
-
-    // Clean up any existing buffer (safety check)
-    if (s_stream_buffer) {
-        ESP_LOGW(TAG, "Cleaning up existing stream buffer");
-        vRingbufferDelete(s_stream_buffer);
-        s_stream_buffer = NULL;
+    if (s_stream_attached) {
+        ESP_LOGW(TAG, "Previous stream still draining");
+        return false;
     }
 
-    // Log free heap before creating buffer
-    ESP_LOGI(TAG, "Free heap before buffer create: %lu bytes", (unsigned long)esp_get_free_heap_size());
+    if (!s_store_external) {
+        // Clean up any existing buffer (safety check)
+        if (s_own_store) {
+            ESP_LOGW(TAG, "Cleaning up existing stream buffer");
+            heap_caps_free(s_own_store);
+            s_own_store = NULL;
+        }
+
+        // Log free heap before creating buffer
+        ESP_LOGI(TAG, "Free heap before buffer create: %lu bytes", (unsigned long)esp_get_free_heap_size());
 
-    // Create ring buffer for streaming playback from SPIRAM
-    // Use xRingbufferCreateWithCaps to explicitly allocate from SPIRAM
-    // BYTEBUF type required for xRingbufferReceiveUpTo
-    s_stream_buffer = xRingbufferCreateWithCaps(STREAM_BUFFER_SIZE, RINGBUF_TYPE_BYTEBUF, MALLOC_CAP_SPIRAM);
-    if (!s_stream_buffer) {
-        ESP_LOGE(TAG, "Failed to create stream buffer (%d bytes, type=BYTEBUF, from SPIRAM) - free heap: %lu",
-                 STREAM_BUFFER_SIZE, (unsigned long)esp_get_free_heap_size());
-        return false;
+        s_own_store = heap_caps_malloc(STREAM_BUFFER_SIZE, MALLOC_CAP_SPIRAM);
+        if (!s_own_store) {
+            ESP_LOGE(TAG, "Failed to create stream buffer (%d bytes from SPIRAM) - free heap: %lu",
+                     STREAM_BUFFER_SIZE, (unsigned long)esp_get_free_heap_size());
+            return false;
+        }
+        s_store = (audio_playback_store_t){
+            .base = s_own_store,
+            .size = STREAM_BUFFER_SIZE,
+            .write = own_store_write,
+        };
+
+        ESP_LOGI(TAG, "Stream buffer created successfully");
+        // Written by the network task and drained in blocks by the playback task
+        psram_bench_track_buffer("stream_buffer", s_own_store, STREAM_BUFFER_SIZE, PLAYBACK_SAMPLE_RATE * 2 * 2,
+                                 PLAYBACK_BLOCK_BYTES * 1000 / (PLAYBACK_SAMPLE_RATE * 2));
     }
 
-    ESP_LOGI(TAG, "Stream buffer created successfully");
+    // Start empty, at the position the last stream stopped writing
+    portENTER_CRITICAL(&s_store_lock);
+    s_store_read_pos = s_store_write_pos;
+    portEXIT_CRITICAL(&s_store_lock);
+    xSemaphoreTake(s_store_data, 0);
+    xSemaphoreTake(s_store_space, 0);
 
     s_streaming_active = true;
     s_prebuffer_complete = false;
+    s_flush_requested = false;
+    s_stream_got_byte = false;
+    s_burst_pending = false;
 
-    // Create buffered playback task on core 1 with high priority
-    BaseType_t ret = xTaskCreatePinnedToCore(
-        buffered_playback_task,
-        "audio_playback_buffered",
-        8192,
-        NULL,
-        6,  // Higher priority than HTTP reader (priority 4)
-        &s_buffered_playback_task,
-        1   // Core 1 (separate from HTTP/WiFi on core 0)
-    );
-
-    if (ret != pdPASS) {
-        ESP_LOGE(TAG, "Failed to create buffered playback task");
-        vRingbufferDelete(s_stream_buffer);
-        s_stream_buffer = NULL;
-        s_streaming_active = false;
-        return false;
-    }
+    // Hand the ring to the playback task, which mixes it with any one-shot source
+    s_stream_attached = true;
+    xTaskNotifyGive(s_playback_task);
 
     ESP_LOGI(TAG, "Buffered streaming playback started (buffer: %d bytes, prebuffer: %d ms)",
              STREAM_BUFFER_SIZE, PREBUFFER_MS);
@@ -360,7 +790,7 @@ bool audio_playback_stream_start(void)
 
 bool audio_playback_stream_write(const uint8_t *data, size_t length_bytes)
 {
-    if (!s_streaming_active || !s_stream_buffer) {
+    if (!s_streaming_active || !s_store.base) {
         ESP_LOGW(TAG, "Streaming not active, call audio_playback_stream_start() first");
         return false;
     }
@@ -368,22 +798,49 @@ bool audio_playback_stream_write(const uint8_t *data, size_t length_bytes)
         return true;  // Empty chunk, skip
     }
 
-    // Push to ring buffer (blocking - waits if full, provides backpressure)
-    BaseType_t ret = xRingbufferSend(s_stream_buffer, data, length_bytes, portMAX_DELAY);
-    if (ret != pdTRUE) {
-        ESP_LOGE(TAG, "Failed to write to stream buffer (should never happen with portMAX_DELAY)");
-        return false;
+    // Stamp the first byte of the stream, and the first byte after the ring ran dry
+    uint32_t now_us = latency_hist_now_us();
+    if (!s_stream_got_byte) {
+        s_stream_got_byte = true;
+        s_stream_first_byte_us = now_us;
+    }
+    if (!s_burst_pending && stream_buffered() == 0) {
+        s_burst_first_byte_us = now_us;
+        s_burst_pending = true;
+    }
+
+    // Copy into the ring as room frees up (blocking - provides backpressure)
+    while (length_bytes > 0) {
+        size_t room = STREAM_BUFFER_SIZE - stream_buffered();
+        if (room == 0) {
+            if (!s_streaming_active) {
+                ESP_LOGW(TAG, "Stream ended while waiting for room, dropped %zu bytes", length_bytes);
+                return false;
+            }
+            xSemaphoreTake(s_store_space, pdMS_TO_TICKS(STREAM_READ_WAIT_MS));
+            continue;
+        }
+
+        size_t length = length_bytes < room ? length_bytes : room;
+        s_store.write(s_store_write_pos, data, length, s_store.ctx);
+        portENTER_CRITICAL(&s_store_lock);
+        s_store_write_pos += length;
+        portEXIT_CRITICAL(&s_store_lock);
+        xSemaphoreGive(s_store_data);
+        data += length;
+        length_bytes -= length;
     }
 
     // Check pre-buffering
     if (!s_prebuffer_complete) {
-        size_t buffered = xRingbufferGetCurFreeSize(s_stream_buffer);
-        size_t used = STREAM_BUFFER_SIZE - buffered;
+        size_t used = stream_buffered();
 
         if (used >= PREBUFFER_BYTES) {
             s_prebuffer_complete = true;
+            latency_hist_record_since(LATENCY_METRIC_PREBUFFER_WAIT, s_stream_first_byte_us);
             ESP_LOGI(TAG, "Pre-buffer complete (%zu bytes), playback task will start consuming",
                      used);
+            xTaskNotifyGive(s_playback_task);
         }
     }
 
@@ -404,21 +861,27 @@ void audio_playback_stream_end(void)
     // Wait for playback task to finish draining buffer (up to 3 seconds)
     // Buffer holds 2 seconds of audio, so give it time to drain completely
     int wait_count = 0;
-    while (s_buffered_playback_task && wait_count < 300) {
+    while (s_stream_attached && wait_count < 300) {
         vTaskDelay(pdMS_TO_TICKS(10));
         wait_count++;
     }
 
-    if (s_buffered_playback_task) {
-        ESP_LOGW(TAG, "Playback task didn't finish, forcefully deleting");
-        vTaskDelete(s_buffered_playback_task);
-        s_buffered_playback_task = NULL;
+    if (s_stream_attached) {
+        ESP_LOGW(TAG, "Playback didn't drain, dropping the rest");
+        s_flush_requested = true;
+        for (wait_count = 0; s_stream_attached && wait_count < STREAM_END_FLUSH_MS / 10; wait_count++) {
+            vTaskDelay(pdMS_TO_TICKS(10));
+        }
     }
 
-    // Clean up ring buffer
-    if (s_stream_buffer) {
-        vRingbufferDelete(s_stream_buffer);
-        s_stream_buffer = NULL;
+    // Free the stream's own ring (left allocated if the playback task still holds it);
+    // an external store outlives the stream
+    if (s_stream_attached) {
+        ESP_LOGE(TAG, "Playback task still reading the stream buffer, not freeing it");
+    } else if (s_own_store) {
+        heap_caps_free(s_own_store);
+        s_own_store = NULL;
+        s_store.base = NULL;
     }
 
     s_prebuffer_complete = false;
@@ -428,3 +891,51 @@ void audio_playback_stream_end(void)
         s_callback(AUDIO_PLAYBACK_EVENT_COMPLETED, s_callback_ctx);
     }
 }
+
+bool audio_playback_set_stream_store(const audio_playback_store_t *store)
+{
+    if (!store || !store->base || !store->write || store->size < STREAM_BUFFER_SIZE) {
+        ESP_LOGE(TAG, "Stream store must hold at least %d bytes", STREAM_BUFFER_SIZE);
+        return false;
+    }
+    if (s_streaming_active || s_stream_attached || s_own_store) {
+        ESP_LOGW(TAG, "Stream open, keeping its buffer");
+        return false;
+    }
+
+    s_store = *store;
+    s_store_external = true;
+    ESP_LOGI(TAG, "Stream buffered in an external %zu byte store", store->size);
+    return true;
+}
+
+bool audio_playback_stream_is_active(void)
+{
+    return s_streaming_active;
+}
+
+bool audio_playback_stream_flush(uint32_t timeout_ms)
+{
+    if (!s_streaming_active || !s_stream_attached) {
+        return false;
+    }
+
+    s_flush_waiter = xTaskGetCurrentTaskHandle();
+    ulTaskNotifyTake(pdTRUE, 0);  // Clear any stale notification
+    s_flush_requested = true;
+
+    bool acknowledged = ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(timeout_ms)) > 0;
+    s_flush_waiter = NULL;
+    return acknowledged;
+}
+
+void audio_playback_set_output_tap(audio_playback_tap_cb_t tap, void *user_ctx)
+{
+    s_output_tap_ctx = user_ctx;
+    s_output_tap = tap;
+}
+
+uint32_t audio_playback_get_underruns(void)
+{
+    return s_underruns;
+}
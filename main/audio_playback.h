@@ -12,16 +12,72 @@ typedef enum {
 
 typedef void (*audio_playback_callback_t)(audio_playback_event_t event, void *user_ctx);
 
+// Called from the playback task with each processed block right after it is handed to I2S
+typedef void (*audio_playback_tap_cb_t)(const int16_t *samples, size_t num_samples, void *user_ctx);
+
+// Pull source (24kHz 16-bit mono). One playback task asks the source for each
+// block it plays, so audio goes straight from where it lives (flash, PSRAM, a
+// decoder) into the block that is processed and written to I2S: no staging
+// copy and no task per play. audio_source.h builds the common sources; the
+// streaming API below is the network ring source.
+#define AUDIO_PLAYBACK_SOURCE_END   (-1)
+
+typedef struct {
+    // Fill block with up to max_samples. Returns the samples written, 0 if none are
+    // ready yet (asked again shortly), or AUDIO_PLAYBACK_SOURCE_END when finished.
+    // May wait up to wait_ms for audio; 0 while a stream is also playing.
+    int (*read)(void *ctx, int16_t *block, size_t max_samples, uint32_t wait_ms);
+    // Runs once when the source ends, is stopped or is refused; frees what it owns
+    void (*release)(void *ctx);
+    void *ctx;
+    bool dsp_bypass;  // Volume only, no EQ or dynamics (measurement signals)
+} audio_playback_source_t;
+
 void audio_playback_init(void);
 void audio_playback_set_callback(audio_playback_callback_t callback, void *user_ctx);
 
-// Buffered playback (accumulate then play)
+// Buffered playback (accumulate then play). Copies the data; prefer a source from audio_source.h.
 void audio_playback_play_pcm(const uint8_t *data, size_t length_bytes);
 
+// Play a one-shot source, mixed over the stream if one is playing. Ownership moves
+// to the playback engine: release() runs exactly once, on the playback task when the
+// source ends, or before this returns if it is refused (another source is playing).
+bool audio_playback_play_source(const audio_playback_source_t *source);
+
+// Stop the one-shot source at the next block (its release() runs on the playback task)
+void audio_playback_stop_source(void);
+bool audio_playback_source_is_active(void);
+
+// Backing memory for the network stream. By default each stream gets a 2 s ring
+// of its own. With a store, stream_write() hands each chunk to write(), which
+// copies it to base[position % size] once; playback reads it back from there and
+// the bytes stay after they are played, so the owner can keep references
+// (positions) to them. Positions only grow. write() runs on the writer's task.
+typedef struct {
+    const uint8_t *base;
+    size_t size;      // At least the 2 s a stream may buffer
+    void (*write)(uint64_t position, const uint8_t *data, size_t length, void *ctx);
+    void *ctx;
+} audio_playback_store_t;
+
+// Use store for every later stream. Fails while a stream is open or if it is too small.
+bool audio_playback_set_stream_store(const audio_playback_store_t *store);
+
 // Streaming playback (immediate, low latency)
 bool audio_playback_stream_start(void);
 bool audio_playback_stream_write(const uint8_t *data, size_t length_bytes);
 void audio_playback_stream_end(void);
+bool audio_playback_stream_is_active(void);
+
+// Discard everything buffered for the stream (stream stays open). Blocks until the
+// playback task has dropped the audio or timeout_ms passes; true if acknowledged.
+bool audio_playback_stream_flush(uint32_t timeout_ms);
+
+// Output tap for the echo reference (one tap, NULL to remove)
+void audio_playback_set_output_tap(audio_playback_tap_cb_t tap, void *user_ctx);
+
+// I2S underruns since boot while a stream was playing (the speaker repeated silence)
+uint32_t audio_playback_get_underruns(void);
 
 void audio_playback_stop(void);
 void audio_playback_set_volume(uint8_t volume);  // 0-100
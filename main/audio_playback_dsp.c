@@ -0,0 +1,666 @@
+#include "audio_playback_dsp.h"
+#include "dsp_kernels.h"
+
+#include <math.h>
+#include <string.h>
+
+#ifdef ESP_PLATFORM
+#include "esp_cpu.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "nvs.h"
+#include "sdkconfig.h"
+#else
+// Host build (tools/playback_dsp_eval.c): default parameters, stdio logging, wall-clock "cycles"
+#include <stdio.h>
+#include <time.h>
+#define ESP_LOGI(tag, fmt, ...)     printf("%s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...)     printf("%s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGE(tag, fmt, ...)     fprintf(stderr, "%s: " fmt "\n", tag, ##__VA_ARGS__)
+#define CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ 1000  // Host "cycles" are nanoseconds
+typedef int portMUX_TYPE;                      // Single-threaded
+#define portMUX_INITIALIZER_UNLOCKED 0
+#define portENTER_CRITICAL(mux)     ((void)(mux))
+#define portEXIT_CRITICAL(mux)      ((void)(mux))
+static inline uint32_t esp_cpu_get_cycle_count(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+#endif
+
+// Speaker-protection high-pass
+#define HPF_CUTOFF_HZ              180
+#define HPF_Q                      0.7071f
+
+// Compressor control rate and envelope
+#define COMP_CHUNK_MS_X10          10               // 1 ms control chunks
+
+// Loudness normalization (RMS based, short-term window)
+#define LOUDNESS_TARGET_RMS        3277             // -20 dBFS
+#define LOUDNESS_GATE_RMS          164              // -46 dBFS: quieter blocks hold the gain
+#define LOUDNESS_WINDOW_MS         400
+#define LOUDNESS_MAX_GAIN_Q16      (4 << 16)        // +12 dB
+#define LOUDNESS_MIN_GAIN_Q16      (1 << 14)        // -12 dB
+#define LOUDNESS_SLEW_SHIFT        2                // Gain moves 1/4 of the way per sub-block
+
+// Look-ahead limiter
+#define LIMITER_THRESHOLD          29205            // -1 dBFS
+#define LIMITER_LOOKAHEAD_MS       2
+#define LIMITER_RELEASE_MS         60
+
+// Sub-block is the control rate for loudness (10 ms)
+#define DSP_SUBBLOCK_MS            10
+#define DSP_MAX_SAMPLE_RATE        48000
+#define DSP_MAX_SUBBLOCK           (DSP_MAX_SAMPLE_RATE * DSP_SUBBLOCK_MS / 1000)
+#define DSP_MAX_LOOKAHEAD          (DSP_MAX_SAMPLE_RATE * LIMITER_LOOKAHEAD_MS / 1000)
+
+// CPU budget check (percent of one core per block of real time)
+#define PLAYBACK_DSP_BUDGET_PCT    10
+#define PLAYBACK_DSP_LOG_INTERVAL  256              // Blocks between CPU usage log lines
+#define CPU_HZ                     ((uint64_t)CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ * 1000000ULL)
+
+// NVS storage for EQ/compressor parameters
+#define NVS_NAMESPACE              "playback_dsp"
+#define NVS_PARAMS_KEY             "params"
+
+#define Q16_ONE                    (1 << 16)
+
+static const char *TAG = "playback_dsp";
+
+typedef struct {
+    int32_t attack_q16;     // Per-chunk envelope coefficients
+    int32_t release_q16;
+    float threshold_db;
+    float slope;            // 1 - 1/ratio
+    float makeup_db;
+    int32_t envelope;
+    int32_t gain_q16;
+} comp_band_t;
+
+// Defaults until a unit is measured: gentle presence lift, 3-band compression
+static const audio_playback_dsp_params_t s_default_params = {
+    .version = AUDIO_PLAYBACK_DSP_PARAMS_VERSION,
+    .num_eq_bands = 1,
+    .num_comp_bands = 3,
+    .eq = {
+        { .type = AUDIO_EQ_PEAK, .freq_hz = 3000, .gain_cdb = 300, .q_milli = 1000 },
+    },
+    .crossover_hz = { 400, 3000 },
+    .comp = {
+        { .threshold_cdb = -2400, .ratio_x100 = 200, .attack_ms = 10, .release_ms = 150, .makeup_cdb = 0 },
+        { .threshold_cdb = -2000, .ratio_x100 = 250, .attack_ms = 5,  .release_ms = 100, .makeup_cdb = 200 },
+        { .threshold_cdb = -2200, .ratio_x100 = 250, .attack_ms = 2,  .release_ms = 80,  .makeup_cdb = 100 },
+    },
+};
+
+// Coefficients for one parameter set, designed off the audio path
+typedef struct {
+    audio_playback_dsp_params_t params;
+    dsp_biquad_t eq[AUDIO_PLAYBACK_DSP_MAX_EQ_BANDS];
+    dsp_biquad_t xover[AUDIO_PLAYBACK_DSP_MAX_COMP_BANDS - 1][2];
+    comp_band_t comp[AUDIO_PLAYBACK_DSP_MAX_COMP_BANDS];
+} dsp_design_t;
+
+static bool s_enabled = true;
+static uint32_t s_sample_rate = 24000;
+static size_t s_subblock = 240;
+static size_t s_lookahead = 48;
+static size_t s_comp_chunk = 24;
+
+static audio_playback_dsp_params_t s_params;
+static dsp_biquad_t s_hpf;
+static dsp_biquad_t s_eq[AUDIO_PLAYBACK_DSP_MAX_EQ_BANDS];
+
+// Crossovers: each split is a 4th order (two cascaded Butterworth) low-pass; the
+// upper band is the complement (input minus low band) so the bands sum back exactly.
+static dsp_biquad_t s_xover[AUDIO_PLAYBACK_DSP_MAX_COMP_BANDS - 1][2];
+static comp_band_t s_comp[AUDIO_PLAYBACK_DSP_MAX_COMP_BANDS];
+
+// Loudness
+static uint64_t s_ms_smooth = 0;     // Smoothed mean square
+static bool s_ms_primed = false;
+static uint32_t s_ms_smooth_blocks = 40;
+static int32_t s_loud_gain = Q16_ONE;
+
+// Limiter
+static int32_t s_lim_delay[DSP_MAX_LOOKAHEAD];
+static size_t s_lim_idx = 0;
+static int32_t s_lim_gain = Q16_ONE;
+static int32_t s_lim_target = Q16_ONE;
+static int32_t s_lim_attack_step = 0;
+static int32_t s_lim_release_step = 1;
+static size_t s_lim_hold = 0;
+
+// Changes from other tasks are staged here and taken by audio_playback_dsp_process()
+// at the start of its next block, so a block never runs on half-written state
+static portMUX_TYPE s_staged_lock = portMUX_INITIALIZER_UNLOCKED;
+static dsp_design_t s_staged;
+static volatile bool s_staged_ready = false;
+static volatile bool s_enable_request = true;
+
+static int32_t s_scratch[DSP_MAX_SUBBLOCK];
+static int32_t s_bands[AUDIO_PLAYBACK_DSP_MAX_COMP_BANDS][DSP_MAX_SUBBLOCK];
+static audio_playback_dsp_stats_t s_stats;
+
+static int32_t time_constant_q16(uint16_t ms)
+{
+    if (ms == 0) {
+        return 0;
+    }
+    float chunks = (float)ms * (float)s_sample_rate / 1000.0f / (float)s_comp_chunk;
+    return (int32_t)lrintf(expf(-1.0f / chunks) * Q16_ONE);
+}
+
+static bool params_valid(const audio_playback_dsp_params_t *params)
+{
+    if (params->version != AUDIO_PLAYBACK_DSP_PARAMS_VERSION ||
+        params->num_eq_bands > AUDIO_PLAYBACK_DSP_MAX_EQ_BANDS ||
+        params->num_comp_bands > AUDIO_PLAYBACK_DSP_MAX_COMP_BANDS) {
+        return false;
+    }
+
+    const uint32_t max_freq = s_sample_rate * 45 / 100;
+    for (uint8_t i = 0; i < params->num_eq_bands; i++) {
+        const audio_eq_band_params_t *band = &params->eq[i];
+        if (band->type > AUDIO_EQ_HIGH_SHELF || band->freq_hz < 20 || band->freq_hz > max_freq ||
+            band->gain_cdb < -1500 || band->gain_cdb > 1500 ||
+            band->q_milli < 300 || band->q_milli > 10000) {
+            return false;
+        }
+    }
+
+    for (uint8_t i = 0; i + 1 < params->num_comp_bands; i++) {
+        if (params->crossover_hz[i] < 50 || params->crossover_hz[i] > max_freq ||
+            (i > 0 && params->crossover_hz[i] <= params->crossover_hz[i - 1])) {
+            return false;
+        }
+    }
+    for (uint8_t i = 0; i < params->num_comp_bands; i++) {
+        if (params->comp[i].ratio_x100 < 100) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void design_params(const audio_playback_dsp_params_t *params, dsp_design_t *design)
+{
+    design->params = *params;
+
+    for (uint8_t i = 0; i < params->num_eq_bands; i++) {
+        const audio_eq_band_params_t *band = &params->eq[i];
+        dsp_biquad_type_t type = band->type == AUDIO_EQ_LOW_SHELF  ? DSP_BIQUAD_LOW_SHELF
+                               : band->type == AUDIO_EQ_HIGH_SHELF ? DSP_BIQUAD_HIGH_SHELF
+                               : DSP_BIQUAD_PEAK;
+        dsp_biquad_design(&design->eq[i], type, s_sample_rate, band->freq_hz,
+                          band->q_milli / 1000.0f, band->gain_cdb / 100.0f);
+    }
+
+    for (uint8_t i = 0; i + 1 < params->num_comp_bands; i++) {
+        dsp_biquad_design(&design->xover[i][0], DSP_BIQUAD_LOWPASS, s_sample_rate, params->crossover_hz[i], 0.7071f, 0.0f);
+        dsp_biquad_design(&design->xover[i][1], DSP_BIQUAD_LOWPASS, s_sample_rate, params->crossover_hz[i], 0.7071f, 0.0f);
+    }
+
+    for (uint8_t i = 0; i < params->num_comp_bands; i++) {
+        const audio_comp_band_params_t *cfg = &params->comp[i];
+        comp_band_t *band = &design->comp[i];
+        band->attack_q16 = time_constant_q16(cfg->attack_ms);
+        band->release_q16 = time_constant_q16(cfg->release_ms);
+        band->threshold_db = cfg->threshold_cdb / 100.0f;
+        band->slope = 1.0f - 100.0f / (float)cfg->ratio_x100;
+        band->makeup_db = cfg->makeup_cdb / 100.0f;
+    }
+}
+
+// Make a design live and start its filters from silence (playback task, or before it runs)
+static void install_design(const dsp_design_t *design)
+{
+    s_params = design->params;
+    memcpy(s_eq, design->eq, sizeof(s_eq));
+    memcpy(s_xover, design->xover, sizeof(s_xover));
+    memcpy(s_comp, design->comp, sizeof(s_comp));
+    audio_playback_dsp_reset();
+}
+
+static void apply_params(const audio_playback_dsp_params_t *params)
+{
+    dsp_design_t design;
+    design_params(params, &design);
+    install_design(&design);
+    ESP_LOGI(TAG, "EQ: %u bands, compressor: %u bands", s_params.num_eq_bands, s_params.num_comp_bands);
+}
+
+static void load_params(void)
+{
+#ifdef ESP_PLATFORM
+    audio_playback_dsp_params_t params;
+    size_t len = sizeof(params);
+    nvs_handle_t nvs_handle;
+
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs_handle);
+    if (err == ESP_OK) {
+        err = nvs_get_blob(nvs_handle, NVS_PARAMS_KEY, &params, &len);
+        nvs_close(nvs_handle);
+    }
+
+    if (err == ESP_OK && len == sizeof(params) && params_valid(&params)) {
+        ESP_LOGI(TAG, "Loaded speaker EQ/compressor parameters from NVS");
+        apply_params(&params);
+        return;
+    }
+
+    if (err == ESP_OK) {
+        ESP_LOGW(TAG, "Ignoring invalid parameters in NVS (%zu bytes)", len);
+    }
+#endif
+    apply_params(&s_default_params);
+}
+
+void audio_playback_dsp_init(uint32_t sample_rate_hz)
+{
+    if (sample_rate_hz == 0 || sample_rate_hz > DSP_MAX_SAMPLE_RATE) {
+        ESP_LOGE(TAG, "Unsupported sample rate %lu", (unsigned long)sample_rate_hz);
+        s_enabled = false;
+        s_enable_request = false;
+        return;
+    }
+
+    s_sample_rate = sample_rate_hz;
+    s_subblock = sample_rate_hz * DSP_SUBBLOCK_MS / 1000;
+    s_lookahead = sample_rate_hz * LIMITER_LOOKAHEAD_MS / 1000;
+    s_comp_chunk = sample_rate_hz * COMP_CHUNK_MS_X10 / 10000;
+    s_ms_smooth_blocks = LOUDNESS_WINDOW_MS / DSP_SUBBLOCK_MS;
+    s_lim_release_step = Q16_ONE / (int32_t)(sample_rate_hz * LIMITER_RELEASE_MS / 1000);
+    if (s_lim_release_step < 1) {
+        s_lim_release_step = 1;
+    }
+
+    dsp_biquad_design(&s_hpf, DSP_BIQUAD_HIGHPASS, s_sample_rate, HPF_CUTOFF_HZ, HPF_Q, 0.0f);
+
+    memset(&s_stats, 0, sizeof(s_stats));
+    load_params();
+
+    ESP_LOGI(TAG, "Playback DSP initialised (%lu Hz, HPF %d Hz, target %d RMS, limiter %d ms look-ahead)",
+             (unsigned long)sample_rate_hz, HPF_CUTOFF_HZ, LOUDNESS_TARGET_RMS, LIMITER_LOOKAHEAD_MS);
+}
+
+void audio_playback_dsp_reset(void)
+{
+    for (size_t i = 0; i < AUDIO_PLAYBACK_DSP_MAX_COMP_BANDS; i++) {
+        s_comp[i].envelope = 0;
+        s_comp[i].gain_q16 = Q16_ONE;
+    }
+
+    s_ms_smooth = 0;
+    s_ms_primed = false;
+    s_loud_gain = Q16_ONE;
+
+    audio_playback_dsp_flush();
+}
+
+void audio_playback_dsp_flush(void)
+{
+    dsp_biquad_clear(&s_hpf);
+    for (size_t i = 0; i < AUDIO_PLAYBACK_DSP_MAX_EQ_BANDS; i++) {
+        dsp_biquad_clear(&s_eq[i]);
+    }
+    for (size_t i = 0; i + 1 < AUDIO_PLAYBACK_DSP_MAX_COMP_BANDS; i++) {
+        dsp_biquad_clear(&s_xover[i][0]);
+        dsp_biquad_clear(&s_xover[i][1]);
+    }
+
+    memset(s_lim_delay, 0, sizeof(s_lim_delay));
+    s_lim_idx = 0;
+    s_lim_gain = Q16_ONE;
+    s_lim_target = Q16_ONE;
+    s_lim_attack_step = 0;
+    s_lim_hold = 0;
+}
+
+void audio_playback_dsp_set_enabled(bool enabled)
+{
+    if (s_enable_request != enabled) {
+        s_enable_request = enabled;
+        ESP_LOGI(TAG, "Playback DSP %s", enabled ? "enabled" : "disabled");
+    }
+}
+
+bool audio_playback_dsp_is_enabled(void)
+{
+    return s_enable_request;
+}
+
+esp_err_t audio_playback_dsp_set_params(const audio_playback_dsp_params_t *params, bool persist)
+{
+    if (!params || !params_valid(params)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // Design outside the lock; the playback task only copies the result
+    dsp_design_t design;
+    design_params(params, &design);
+    portENTER_CRITICAL(&s_staged_lock);
+    s_staged = design;
+    s_staged_ready = true;
+    portEXIT_CRITICAL(&s_staged_lock);
+    ESP_LOGI(TAG, "EQ: %u bands, compressor: %u bands (from the next block)", params->num_eq_bands,
+             params->num_comp_bands);
+
+    if (!persist) {
+        return ESP_OK;
+    }
+
+#ifdef ESP_PLATFORM
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to open NVS namespace: %s", esp_err_to_name(err));
+        return err;
+    }
+    err = nvs_set_blob(nvs_handle, NVS_PARAMS_KEY, params, sizeof(*params));
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs_handle);
+    }
+    nvs_close(nvs_handle);
+
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to save parameters to NVS: %s", esp_err_to_name(err));
+    }
+    return err;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+void audio_playback_dsp_get_params(audio_playback_dsp_params_t *params)
+{
+    if (!params) {
+        return;
+    }
+    portENTER_CRITICAL(&s_staged_lock);
+    *params = s_staged_ready ? s_staged.params : s_params;
+    portEXIT_CRITICAL(&s_staged_lock);
+}
+
+// Take what other tasks staged since the last block
+static void take_staged(void)
+{
+    if (s_staged_ready) {
+        portENTER_CRITICAL(&s_staged_lock);
+        install_design(&s_staged);
+        s_staged_ready = false;
+        portEXIT_CRITICAL(&s_staged_lock);
+    }
+    bool enabled = s_enable_request;
+    if (s_enabled != enabled) {
+        audio_playback_dsp_reset();
+        s_enabled = enabled;
+    }
+}
+
+// Per-band gain computer at chunk rate (float is fine at ~1k evaluations/s/band)
+static int32_t comp_gain(const comp_band_t *band)
+{
+    float level_db = band->envelope > 0 ? 20.0f * log10f((float)band->envelope / 32768.0f) : -120.0f;
+    float gain_db = band->makeup_db;
+    if (level_db > band->threshold_db) {
+        gain_db -= (level_db - band->threshold_db) * band->slope;
+    }
+    return (int32_t)lrintf(powf(10.0f, gain_db / 20.0f) * Q16_ONE);
+}
+
+static void comp_band_process(comp_band_t *band, int32_t *buf, size_t n)
+{
+    for (size_t offset = 0; offset < n; offset += s_comp_chunk) {
+        size_t len = n - offset;
+        if (len > s_comp_chunk) {
+            len = s_comp_chunk;
+        }
+        int32_t *chunk = buf + offset;
+
+        int32_t peak = 0;
+        for (size_t i = 0; i < len; i++) {
+            int32_t mag = chunk[i] < 0 ? -chunk[i] : chunk[i];
+            if (mag > peak) {
+                peak = mag;
+            }
+        }
+
+        int32_t coeff = peak > band->envelope ? band->attack_q16 : band->release_q16;
+        band->envelope = peak + (int32_t)(((int64_t)(band->envelope - peak) * coeff) >> 16);
+
+        int32_t gain_start = band->gain_q16;
+        int32_t gain_end = comp_gain(band);
+        int32_t gain_step = (gain_end - gain_start) / (int32_t)len;
+        int32_t gain = gain_start;
+        for (size_t i = 0; i < len; i++) {
+            chunk[i] = (int32_t)(((int64_t)chunk[i] * gain) >> 16);
+            gain += gain_step;
+        }
+        band->gain_q16 = gain_end;
+    }
+}
+
+// Split s_scratch into bands, compress each, and sum back into s_scratch
+static void multiband_process(size_t n)
+{
+    uint8_t num_bands = s_params.num_comp_bands;
+    int32_t *rest = s_scratch;
+
+    for (uint8_t b = 0; b + 1 < num_bands; b++) {
+        int32_t *low = s_bands[b];
+        dsp_biquad_process_s32(&s_xover[b][0], rest, low, n);
+        dsp_biquad_process_s32(&s_xover[b][1], low, low, n);
+
+        int32_t *upper = s_bands[b + 1];
+        for (size_t i = 0; i < n; i++) {
+            upper[i] = rest[i] - low[i];
+        }
+        rest = upper;
+    }
+    if (num_bands == 1) {
+        memcpy(s_bands[0], s_scratch, n * sizeof(int32_t));
+    }
+
+    for (uint8_t b = 0; b < num_bands; b++) {
+        comp_band_process(&s_comp[b], s_bands[b], n);
+    }
+
+    memcpy(s_scratch, s_bands[0], n * sizeof(int32_t));
+    for (uint8_t b = 1; b < num_bands; b++) {
+        const int32_t *band = s_bands[b];
+        for (size_t i = 0; i < n; i++) {
+            s_scratch[i] += band[i];
+        }
+    }
+}
+
+// Update the normalization gain from one sub-block's energy; returns the new gain
+static int32_t loudness_update(size_t n)
+{
+    uint64_t sum_sq = 0;
+    for (size_t i = 0; i < n; i++) {
+        sum_sq += (uint64_t)((int64_t)s_scratch[i] * s_scratch[i]);
+    }
+
+    uint64_t ms = sum_sq / n;
+    const uint64_t gate_ms = (uint64_t)LOUDNESS_GATE_RMS * LOUDNESS_GATE_RMS;
+
+    if (ms < gate_ms) {
+        return s_loud_gain;  // Silence/pauses: hold gain so noise is not pumped up
+    }
+
+    if (!s_ms_primed) {
+        s_ms_smooth = ms;
+        s_ms_primed = true;
+    } else if (ms > s_ms_smooth) {
+        s_ms_smooth += (ms - s_ms_smooth) / s_ms_smooth_blocks;
+    } else {
+        s_ms_smooth -= (s_ms_smooth - ms) / s_ms_smooth_blocks;
+    }
+
+    uint32_t rms = dsp_isqrt64(s_ms_smooth);
+    int32_t target = rms ? (int32_t)(((uint64_t)LOUDNESS_TARGET_RMS << 16) / rms) : LOUDNESS_MAX_GAIN_Q16;
+    if (target > LOUDNESS_MAX_GAIN_Q16) {
+        target = LOUDNESS_MAX_GAIN_Q16;
+    } else if (target < LOUDNESS_MIN_GAIN_Q16) {
+        target = LOUDNESS_MIN_GAIN_Q16;
+    }
+
+    return s_loud_gain + ((target - s_loud_gain) >> LOUDNESS_SLEW_SHIFT);
+}
+
+// Look-ahead limiter: the gain reaches any required reduction before the sample
+// that needs it leaves the delay line, so the output never exceeds the threshold.
+static inline int16_t limiter_step(int32_t in)
+{
+    uint32_t mag = (uint32_t)(in < 0 ? -in : in);
+
+    if (mag > LIMITER_THRESHOLD) {
+        int32_t required = (int32_t)(((uint64_t)LIMITER_THRESHOLD << 16) / mag);
+        if (required < s_lim_target) {
+            s_lim_target = required;
+            int32_t step = (s_lim_gain - required + (int32_t)s_lookahead - 1) / (int32_t)s_lookahead;
+            if (step > s_lim_attack_step) {
+                s_lim_attack_step = step;
+            }
+        }
+        s_lim_hold = s_lookahead + 1;
+    }
+
+    if (s_lim_gain > s_lim_target) {
+        s_lim_gain -= s_lim_attack_step;
+        if (s_lim_gain <= s_lim_target) {
+            s_lim_gain = s_lim_target;
+            s_lim_attack_step = 0;
+        }
+    } else if (s_lim_hold > 0) {
+        s_lim_hold--;
+    } else if (s_lim_gain < Q16_ONE) {
+        s_lim_target = Q16_ONE;
+        s_lim_gain += s_lim_release_step;
+        if (s_lim_gain > Q16_ONE) {
+            s_lim_gain = Q16_ONE;
+        }
+    }
+
+    int32_t delayed = s_lim_delay[s_lim_idx];
+    s_lim_delay[s_lim_idx] = in;
+    if (++s_lim_idx >= s_lookahead) {
+        s_lim_idx = 0;
+    }
+
+    if (s_lim_gain < Q16_ONE) {
+        s_stats.limited_samples++;
+    }
+    return dsp_sat16((int32_t)(((int64_t)delayed * s_lim_gain) >> 16));
+}
+
+static inline void stage_done(audio_playback_dsp_stage_t stage, uint32_t *mark)
+{
+    uint32_t now = esp_cpu_get_cycle_count();
+    s_stats.stage_cycles[stage] += now - *mark;
+    *mark = now;
+}
+
+void audio_playback_dsp_process(int16_t *samples, size_t num_samples, uint8_t volume)
+{
+    if (!samples || num_samples == 0) {
+        return;
+    }
+
+    take_staged();
+
+    uint32_t start_cycles = esp_cpu_get_cycle_count();
+    int32_t volume_q16 = ((int32_t)volume << 16) / 100;
+
+    if (!s_enabled) {
+        if (volume < 100) {
+            for (size_t i = 0; i < num_samples; i++) {
+                samples[i] = (int16_t)(((int32_t)samples[i] * volume_q16) >> 16);
+            }
+        }
+    } else {
+        uint32_t mark = start_cycles;
+
+        for (size_t offset = 0; offset < num_samples; offset += s_subblock) {
+            size_t n = num_samples - offset;
+            if (n > s_subblock) {
+                n = s_subblock;
+            }
+            int16_t *block = samples + offset;
+
+            for (size_t i = 0; i < n; i++) {
+                s_scratch[i] = block[i];
+            }
+            dsp_biquad_process_s32(&s_hpf, s_scratch, s_scratch, n);
+            stage_done(AUDIO_PLAYBACK_DSP_STAGE_HPF, &mark);
+
+            dsp_biquad_cascade_s32(s_eq, s_params.num_eq_bands, s_scratch, n);
+            stage_done(AUDIO_PLAYBACK_DSP_STAGE_EQ, &mark);
+
+            if (s_params.num_comp_bands > 0) {
+                multiband_process(n);
+            }
+            stage_done(AUDIO_PLAYBACK_DSP_STAGE_COMP, &mark);
+
+            // Ramp the normalization gain across the sub-block to avoid zipper noise
+            int32_t gain_start = s_loud_gain;
+            int32_t gain_end = loudness_update(n);
+            int32_t gain_step = (gain_end - gain_start) / (int32_t)n;
+            int32_t gain = gain_start;
+            for (size_t i = 0; i < n; i++) {
+                int32_t total_gain = (int32_t)(((int64_t)gain * volume_q16) >> 16);
+                s_scratch[i] = (int32_t)(((int64_t)s_scratch[i] * total_gain) >> 16);
+                gain += gain_step;
+            }
+            s_loud_gain = gain_end;
+            stage_done(AUDIO_PLAYBACK_DSP_STAGE_LOUDNESS, &mark);
+
+            for (size_t i = 0; i < n; i++) {
+                block[i] = limiter_step(s_scratch[i]);
+            }
+            stage_done(AUDIO_PLAYBACK_DSP_STAGE_LIMITER, &mark);
+        }
+    }
+
+    uint32_t cycles = esp_cpu_get_cycle_count() - start_cycles;
+    uint64_t block_budget = (uint64_t)num_samples * CPU_HZ / s_sample_rate * PLAYBACK_DSP_BUDGET_PCT / 100;
+
+    s_stats.blocks++;
+    s_stats.samples += num_samples;
+    s_stats.cycles += cycles;
+    s_stats.loudness_gain_q16 = s_loud_gain;
+    for (size_t b = 0; b < AUDIO_PLAYBACK_DSP_MAX_COMP_BANDS; b++) {
+        s_stats.comp_gain_q16[b] = s_comp[b].gain_q16;
+    }
+    if (cycles > s_stats.max_block_cycles) {
+        s_stats.max_block_cycles = cycles;
+    }
+    if (cycles > block_budget) {
+        s_stats.budget_overruns++;
+    }
+
+    if (s_stats.blocks % PLAYBACK_DSP_LOG_INTERVAL == 0) {
+        uint64_t audio_cycles = s_stats.samples * CPU_HZ / s_sample_rate;
+        ESP_LOGI(TAG, "CPU %.2f%% (max block %lu cycles, %lu overruns), gain %.2fx, limited %lu samples",
+                 audio_cycles ? 100.0 * (double)s_stats.cycles / (double)audio_cycles : 0.0,
+                 (unsigned long)s_stats.max_block_cycles, (unsigned long)s_stats.budget_overruns,
+                 s_loud_gain / 65536.0, (unsigned long)s_stats.limited_samples);
+        ESP_LOGI(TAG, "Cycles/block: hpf=%lu eq=%lu comp=%lu loudness=%lu limiter=%lu",
+                 (unsigned long)(s_stats.stage_cycles[AUDIO_PLAYBACK_DSP_STAGE_HPF] / s_stats.blocks),
+                 (unsigned long)(s_stats.stage_cycles[AUDIO_PLAYBACK_DSP_STAGE_EQ] / s_stats.blocks),
+                 (unsigned long)(s_stats.stage_cycles[AUDIO_PLAYBACK_DSP_STAGE_COMP] / s_stats.blocks),
+                 (unsigned long)(s_stats.stage_cycles[AUDIO_PLAYBACK_DSP_STAGE_LOUDNESS] / s_stats.blocks),
+                 (unsigned long)(s_stats.stage_cycles[AUDIO_PLAYBACK_DSP_STAGE_LIMITER] / s_stats.blocks));
+    }
+}
+
+void audio_playback_dsp_get_stats(audio_playback_dsp_stats_t *stats)
+{
+    if (stats) {
+        *stats = s_stats;
+    }
+}
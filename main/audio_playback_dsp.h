@@ -0,0 +1,156 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef ESP_PLATFORM
+#include "esp_err.h"
+#else
+// Host build (tools/playback_dsp_eval.c)
+typedef int esp_err_t;
+#define ESP_OK                  0
+#define ESP_ERR_INVALID_ARG     0x102
+#define ESP_ERR_NOT_SUPPORTED   0x106
+#endif
+
+/**
+ * @brief Fixed-point downlink processing chain run by the playback consumer
+ *
+ * Stages, in order:
+ *   1. Speaker-protection high-pass (2nd order Butterworth)
+ *   2. Parametric speaker EQ (cascade of up to AUDIO_PLAYBACK_DSP_MAX_EQ_BANDS biquads)
+ *   3. Multiband compressor (1-3 bands, complementary crossover)
+ *   4. Short-term loudness normalization (~400 ms window, gated on silence)
+ *   5. User volume
+ *   6. Look-ahead peak limiter (2 ms look-ahead, output never clips)
+ *
+ * Each stage runs over a whole sub-block before the next one starts, so the
+ * inner loops are plain MAC loops over contiguous int32 buffers.
+ *
+ * EQ and compressor parameters are loaded from NVS (namespace "playback_dsp",
+ * blob "params") and turned into coefficients once. The limiter delays the
+ * signal by its look-ahead. All state is module-global because there is a single
+ * playback path; call audio_playback_dsp_reset() at the start of every stream and
+ * audio_playback_dsp_flush() whenever the stream runs dry.
+ */
+
+#define AUDIO_PLAYBACK_DSP_MAX_EQ_BANDS     6
+#define AUDIO_PLAYBACK_DSP_MAX_COMP_BANDS   3
+#define AUDIO_PLAYBACK_DSP_PARAMS_VERSION   1
+
+typedef enum {
+    AUDIO_EQ_PEAK = 0,
+    AUDIO_EQ_LOW_SHELF,
+    AUDIO_EQ_HIGH_SHELF,
+} audio_eq_type_t;
+
+typedef struct {
+    uint8_t type;           // audio_eq_type_t
+    uint8_t reserved;
+    uint16_t freq_hz;
+    int16_t gain_cdb;       // Gain in 0.01 dB
+    uint16_t q_milli;       // Q * 1000
+} audio_eq_band_params_t;
+
+typedef struct {
+    int16_t threshold_cdb;  // Threshold in 0.01 dBFS
+    uint16_t ratio_x100;    // Ratio * 100 (e.g. 300 = 3:1)
+    uint16_t attack_ms;
+    uint16_t release_ms;
+    int16_t makeup_cdb;     // Makeup gain in 0.01 dB
+    uint16_t reserved;
+} audio_comp_band_params_t;
+
+// Stored verbatim as the NVS blob; the layout is shared with tools/fit_speaker_eq.py
+typedef struct {
+    uint8_t version;        // AUDIO_PLAYBACK_DSP_PARAMS_VERSION
+    uint8_t num_eq_bands;
+    uint8_t num_comp_bands; // 0 disables the compressor
+    uint8_t reserved;
+    audio_eq_band_params_t eq[AUDIO_PLAYBACK_DSP_MAX_EQ_BANDS];
+    uint16_t crossover_hz[AUDIO_PLAYBACK_DSP_MAX_COMP_BANDS - 1];
+    audio_comp_band_params_t comp[AUDIO_PLAYBACK_DSP_MAX_COMP_BANDS];
+} audio_playback_dsp_params_t;
+
+typedef enum {
+    AUDIO_PLAYBACK_DSP_STAGE_HPF = 0,
+    AUDIO_PLAYBACK_DSP_STAGE_EQ,
+    AUDIO_PLAYBACK_DSP_STAGE_COMP,
+    AUDIO_PLAYBACK_DSP_STAGE_LOUDNESS,
+    AUDIO_PLAYBACK_DSP_STAGE_LIMITER,
+    AUDIO_PLAYBACK_DSP_STAGE_COUNT,
+} audio_playback_dsp_stage_t;
+
+typedef struct {
+    uint32_t blocks;              // Blocks processed since init
+    uint64_t samples;             // Samples processed since init
+    uint64_t cycles;              // CPU cycles spent in audio_playback_dsp_process()
+    uint64_t stage_cycles[AUDIO_PLAYBACK_DSP_STAGE_COUNT];
+    uint32_t max_block_cycles;    // Worst single block
+    uint32_t budget_overruns;     // Blocks that exceeded PLAYBACK_DSP_BUDGET_PCT
+    uint32_t limited_samples;     // Samples attenuated by the limiter
+    int32_t loudness_gain_q16;    // Current normalization gain (1.0 = 65536)
+    int32_t comp_gain_q16[AUDIO_PLAYBACK_DSP_MAX_COMP_BANDS];  // Current per-band compressor gain
+} audio_playback_dsp_stats_t;
+
+/**
+ * @brief Load parameters from NVS and compute coefficients for the sample rate
+ *
+ * @param sample_rate_hz Playback sample rate (Hz)
+ */
+void audio_playback_dsp_init(uint32_t sample_rate_hz);
+
+/**
+ * @brief Clear filter, compressor, loudness and limiter state (call at stream start)
+ */
+void audio_playback_dsp_reset(void);
+
+/**
+ * @brief Drop what the filters and the limiter hold once the stream runs dry
+ *
+ * The last LIMITER_LOOKAHEAD_MS of a response stay in the limiter's delay line,
+ * and the filters keep ringing from its last samples, until more audio pushes
+ * them out: in front of the next response. Compressor and loudness state carry
+ * over, so the level stays even across responses.
+ */
+void audio_playback_dsp_flush(void);
+
+/**
+ * @brief Enable or disable the processing stages (volume is always applied)
+ *
+ * Takes effect, with the state cleared, at the start of the next block.
+ */
+void audio_playback_dsp_set_enabled(bool enabled);
+bool audio_playback_dsp_is_enabled(void);
+
+/**
+ * @brief Apply new EQ/compressor parameters (recomputes coefficients, resets state)
+ *
+ * Safe while playing: the coefficients are designed in the caller's task and
+ * audio_playback_dsp_process() takes them at the start of its next block.
+ *
+ * @param params Parameters to apply
+ * @param persist true to also store them in NVS
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG if the parameters are out of range
+ */
+esp_err_t audio_playback_dsp_set_params(const audio_playback_dsp_params_t *params, bool persist);
+
+/**
+ * @brief Get the parameters currently in use
+ */
+void audio_playback_dsp_get_params(audio_playback_dsp_params_t *params);
+
+/**
+ * @brief Process a block of 16-bit PCM in place
+ *
+ * @param samples PCM samples (modified in place)
+ * @param num_samples Number of samples in the block
+ * @param volume User volume 0-100
+ */
+void audio_playback_dsp_process(int16_t *samples, size_t num_samples, uint8_t volume);
+
+/**
+ * @brief Snapshot processing statistics
+ */
+void audio_playback_dsp_get_stats(audio_playback_dsp_stats_t *stats);
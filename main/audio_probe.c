@@ -0,0 +1,63 @@
+#include "audio_probe.h"
+#include "dsp_kernels.h"
+
+#include <math.h>
+
+#define PROBE_F0_HZ              400.0f
+#define PROBE_F1_HZ              4000.0f
+#define PROBE_AMPLITUDE          10000  // ~-10 dBFS
+#define PROBE_FADE_MS            10
+
+void audio_probe_chirp(int16_t *out, uint32_t rate)
+{
+    const size_t n = AUDIO_PROBE_SAMPLES(rate);
+    const size_t fade = rate * PROBE_FADE_MS / 1000;
+    const float duration = AUDIO_PROBE_CHIRP_MS / 1000.0f;
+    const float sweep = (PROBE_F1_HZ - PROBE_F0_HZ) / (2.0f * duration);
+
+    for (size_t i = 0; i < n; i++) {
+        float t = (float)i / (float)rate;
+        float phase = 2.0f * (float)M_PI * (PROBE_F0_HZ * t + sweep * t * t);
+        float env = 1.0f;
+        if (i < fade) {
+            env = (float)i / (float)fade;
+        } else if (i >= n - fade) {
+            env = (float)(n - 1 - i) / (float)fade;
+        }
+        out[i] = (int16_t)lrintf(PROBE_AMPLITUDE * env * sinf(phase));
+    }
+}
+
+size_t audio_probe_find(const int16_t *capture, size_t capture_len, const int16_t *ref, size_t ref_len,
+                        size_t first_lag, size_t last_lag, float *best_corr)
+{
+    *best_corr = 0.0f;
+    if (first_lag + ref_len > capture_len) {
+        return first_lag;
+    }
+
+    double ref_energy = (double)dsp_energy_s16(ref, ref_len);
+
+    // Running window energy of the capture for normalization
+    double win_energy = (double)dsp_energy_s16(capture + first_lag, ref_len);
+
+    size_t best_lag = first_lag;
+
+    for (size_t lag = first_lag; lag <= last_lag && lag + ref_len <= capture_len; lag++) {
+        const int16_t *window = capture + lag;
+        double acc = (double)dsp_dot_s16(window, ref, ref_len);
+
+        double denom = sqrt(ref_energy * win_energy);
+        float corr = denom > 0.0 ? (float)(acc / denom) : 0.0f;
+        if (corr > *best_corr) {
+            *best_corr = corr;
+            best_lag = lag;
+        }
+
+        if (lag + ref_len < capture_len) {
+            win_energy += (double)window[ref_len] * window[ref_len] - (double)window[0] * window[0];
+        }
+    }
+
+    return best_lag;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Calibration probe: a linear chirp and its matched-filter search
+ *
+ * Plain C on top of dsp_kernels, so the same code runs on the device
+ * (audio_calibration.c) and on synthetic recordings on the host
+ * (tools/probe_delay_check.c).
+ */
+
+#define AUDIO_PROBE_CHIRP_MS            300
+#define AUDIO_PROBE_SAMPLES(rate)       ((rate) * AUDIO_PROBE_CHIRP_MS / 1000)
+#define AUDIO_PROBE_MIN_CORRELATION     0.3f    // Below this the probe was not heard
+
+/**
+ * @brief Generate the chirp (400 Hz to 4 kHz, ~-10 dBFS, 10 ms fades)
+ *
+ * @param out AUDIO_PROBE_SAMPLES(rate) samples
+ * @param rate Sample rate (Hz)
+ */
+void audio_probe_chirp(int16_t *out, uint32_t rate);
+
+/**
+ * @brief Find the chirp in a recording by normalized cross-correlation
+ *
+ * Tries every lag from first_lag to last_lag (clipped to the recording) and
+ * returns the one where ref lines up best.
+ *
+ * @param best_corr Set to the normalized correlation at that lag (0 to 1)
+ * @return Lag in samples
+ */
+size_t audio_probe_find(const int16_t *capture, size_t capture_len, const int16_t *ref, size_t ref_len,
+                        size_t first_lag, size_t last_lag, float *best_corr);
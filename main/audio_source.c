@@ -0,0 +1,199 @@
+#include "audio_source.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+
+static const char *TAG = "audio_source";
+
+typedef struct {
+    const int16_t *samples;
+    size_t num_samples;
+    size_t position;
+    audio_source_free_t free_fn;
+} buffer_source_t;
+
+// The decoded block is only kept when it does not fit the playback block whole
+typedef struct {
+    audio_codec_t codec;
+    uint16_t block_samples;
+    const uint8_t *data;
+    size_t len;
+    size_t position;
+    audio_source_free_t free_fn;
+    uint16_t num_pcm;
+    uint16_t pcm_position;
+    int16_t pcm[AUDIO_CODEC_MAX_BLOCK_SAMPLES];
+} decoder_source_t;
+
+static int buffer_read(void *ctx, int16_t *block, size_t max_samples, uint32_t wait_ms)
+{
+    (void)wait_ms;
+    buffer_source_t *src = ctx;
+
+    size_t n = src->num_samples - src->position;
+    if (n == 0) {
+        return AUDIO_PLAYBACK_SOURCE_END;
+    }
+    if (n > max_samples) {
+        n = max_samples;
+    }
+    memcpy(block, src->samples + src->position, n * sizeof(int16_t));
+    src->position += n;
+    return (int)n;
+}
+
+static void buffer_release(void *ctx)
+{
+    buffer_source_t *src = ctx;
+    if (src->free_fn) {
+        src->free_fn((void *)src->samples);
+    }
+    free(src);
+}
+
+bool audio_source_clip(const int16_t *samples, size_t num_samples, audio_playback_source_t *source)
+{
+    return audio_source_buffer((int16_t *)samples, num_samples, NULL, source);
+}
+
+bool audio_source_buffer(int16_t *samples, size_t num_samples, audio_source_free_t free_fn,
+                         audio_playback_source_t *source)
+{
+    buffer_source_t *src = malloc(sizeof(buffer_source_t));
+    if (!src) {
+        ESP_LOGE(TAG, "Failed to allocate buffer source");
+        if (free_fn) {
+            free_fn(samples);
+        }
+        return false;
+    }
+
+    *src = (buffer_source_t){
+        .samples = samples,
+        .num_samples = num_samples,
+        .free_fn = free_fn,
+    };
+    *source = (audio_playback_source_t){
+        .read = buffer_read,
+        .release = buffer_release,
+        .ctx = src,
+    };
+    return true;
+}
+
+static size_t copy_pending(decoder_source_t *src, int16_t *out, size_t max_samples)
+{
+    size_t n = src->num_pcm - src->pcm_position;
+    if (n > max_samples) {
+        n = max_samples;
+    }
+    memcpy(out, src->pcm + src->pcm_position, n * sizeof(int16_t));
+    src->pcm_position += n;
+    return n;
+}
+
+static int decoder_read(void *ctx, int16_t *block, size_t max_samples, uint32_t wait_ms)
+{
+    (void)wait_ms;
+    decoder_source_t *src = ctx;
+    size_t out = 0;
+
+    while (out < max_samples) {
+        if (src->pcm_position < src->num_pcm) {
+            out += copy_pending(src, block + out, max_samples - out);
+            continue;
+        }
+
+        const uint8_t *in = src->data + src->position;
+        size_t remaining = src->len - src->position;
+        size_t n;
+
+        if (src->codec == AUDIO_CODEC_IMA_ADPCM) {
+            size_t block_bytes = AUDIO_CODEC_ADPCM_BLOCK_BYTES(src->block_samples);
+            if (remaining < block_bytes) {
+                break;
+            }
+            src->position += block_bytes;
+            if (max_samples - out >= src->block_samples) {
+                audio_codec_adpcm_decode_block(in, src->block_samples, block + out);
+                out += src->block_samples;
+            } else {
+                audio_codec_adpcm_decode_block(in, src->block_samples, src->pcm);
+                src->num_pcm = src->block_samples;
+                src->pcm_position = 0;
+            }
+        } else if (src->codec == AUDIO_CODEC_ULAW) {
+            n = remaining < max_samples - out ? remaining : max_samples - out;
+            if (n == 0) {
+                break;
+            }
+            audio_codec_ulaw_decode(in, block + out, n);
+            src->position += n;
+            out += n;
+        } else {
+            n = remaining / sizeof(int16_t);
+            if (n > max_samples - out) {
+                n = max_samples - out;
+            }
+            if (n == 0) {
+                break;
+            }
+            memcpy(block + out, in, n * sizeof(int16_t));  // Little-endian, like the target
+            src->position += n * sizeof(int16_t);
+            out += n;
+        }
+    }
+
+    return out ? (int)out : AUDIO_PLAYBACK_SOURCE_END;
+}
+
+static void decoder_release(void *ctx)
+{
+    decoder_source_t *src = ctx;
+    if (src->free_fn) {
+        src->free_fn((void *)src->data);
+    }
+    heap_caps_free(src);
+}
+
+bool audio_source_decoder(audio_codec_t codec, uint16_t block_samples, const uint8_t *data, size_t len,
+                          audio_source_free_t free_fn, audio_playback_source_t *source)
+{
+    bool valid = codec != AUDIO_CODEC_IMA_ADPCM ||
+                 (block_samples % 2 == 0 && block_samples >= AUDIO_CODEC_MIN_BLOCK_SAMPLES &&
+                  block_samples <= AUDIO_CODEC_MAX_BLOCK_SAMPLES);
+    decoder_source_t *src = NULL;
+    if (valid) {
+        // Keeps the 2KB PCM scratch out of internal RAM; touched once per block at most
+        src = heap_caps_malloc(sizeof(decoder_source_t), MALLOC_CAP_SPIRAM);
+        if (!src) {
+            ESP_LOGE(TAG, "Failed to allocate decoder source");
+        }
+    } else {
+        ESP_LOGE(TAG, "Invalid ADPCM block length %u", block_samples);
+    }
+    if (!src) {
+        if (free_fn) {
+            free_fn((void *)data);
+        }
+        return false;
+    }
+
+    src->codec = codec;
+    src->block_samples = block_samples;
+    src->data = data;
+    src->len = len;
+    src->position = 0;
+    src->free_fn = free_fn;
+    src->num_pcm = 0;
+    src->pcm_position = 0;
+    *source = (audio_playback_source_t){
+        .read = decoder_read,
+        .release = decoder_release,
+        .ctx = src,
+    };
+    return true;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "audio_codec.h"
+#include "audio_playback.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Ready-made pull sources for audio_playback_play_source()
+ *
+ * Each source reads straight from the caller's audio into the playback block;
+ * nothing is copied up front. A source that owns its data frees it through
+ * free_fn when playback releases it. Ownership passes on every path: if
+ * building the source fails, the data is freed right away, so the caller
+ * never frees a buffer it has handed over.
+ *
+ * All audio is 24kHz mono (the playback rate).
+ */
+
+/**
+ * @brief Frees data a source owns (e.g. heap_caps_free, free)
+ */
+typedef void (*audio_source_free_t)(void *data);
+
+/**
+ * @brief Play PCM that outlives playback (a clip in flash or a static table)
+ *
+ * @return false if out of memory
+ */
+bool audio_source_clip(const int16_t *samples, size_t num_samples, audio_playback_source_t *source);
+
+/**
+ * @brief Play a PCM buffer (usually PSRAM) and free it with free_fn afterwards
+ *
+ * @param free_fn Called with samples once playback is done (NULL: caller keeps ownership)
+ * @return false if out of memory (samples already freed)
+ */
+bool audio_source_buffer(int16_t *samples, size_t num_samples, audio_source_free_t free_fn,
+                         audio_playback_source_t *source);
+
+/**
+ * @brief Play encoded audio, decoding one block at a time as playback pulls it
+ *
+ * A trailing partial ADPCM block is not played.
+ *
+ * @param block_samples IMA-ADPCM block length (ignored for other codecs)
+ * @param free_fn Called with data once playback is done (NULL: caller keeps ownership)
+ * @return false if out of memory or the block length is invalid (data already freed)
+ */
+bool audio_source_decoder(audio_codec_t codec, uint16_t block_samples, const uint8_t *data, size_t len,
+                          audio_source_free_t free_fn, audio_playback_source_t *source);
@@ -0,0 +1,51 @@
+#include "audio_vad.h"
+#include "dsp_kernels.h"
+
+#define VAD_INITIAL_FLOOR        (100 * 100)  // Mean square
+#define VAD_MIN_FLOOR            (20 * 20)
+#define VAD_MIN_SPEECH_ENERGY    (150 * 150)
+#define VAD_SPEECH_RATIO         6            // ~8 dB above the noise floor
+#define VAD_FLOOR_RISE_SHIFT     6            // Slow rise: 1/64 of the difference per frame
+#define VAD_FLOOR_FALL_SHIFT     2            // Fast fall: 1/4 per frame
+#define VAD_READAPT_SAMPLES      (16000 * 5)  // Continuous "speech" this long is taken for a louder room
+
+void audio_vad_init(audio_vad_t *vad)
+{
+    vad->noise_floor = VAD_INITIAL_FLOOR;
+    vad->energy = 0;
+    vad->speech = false;
+    vad->speech_samples = 0;
+}
+
+bool audio_vad_process(audio_vad_t *vad, const int16_t *samples, size_t num_samples)
+{
+    if (num_samples == 0) {
+        return vad->speech;
+    }
+
+    uint32_t energy = dsp_mean_square_s16(samples, num_samples);
+    vad->energy = energy;
+
+    vad->speech = energy > VAD_MIN_SPEECH_ENERGY &&
+                  (uint64_t)energy > (uint64_t)vad->noise_floor * VAD_SPEECH_RATIO;
+
+    // Speech has pauses; a level that stays above the threshold without one is
+    // stationary noise (a fan, a running tap), so the floor follows it again
+    if (!vad->speech) {
+        vad->speech_samples = 0;
+    } else if (vad->speech_samples < VAD_READAPT_SAMPLES) {
+        vad->speech_samples += num_samples;
+    }
+    bool readapt = vad->speech_samples >= VAD_READAPT_SAMPLES;
+
+    if (energy < vad->noise_floor) {
+        vad->noise_floor -= (vad->noise_floor - energy) >> VAD_FLOOR_FALL_SHIFT;
+    } else if (!vad->speech || readapt) {
+        vad->noise_floor += (energy - vad->noise_floor) >> VAD_FLOOR_RISE_SHIFT;
+    }
+    if (vad->noise_floor < VAD_MIN_FLOOR) {
+        vad->noise_floor = VAD_MIN_FLOOR;
+    }
+
+    return vad->speech;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * @brief Frame-level energy VAD for the 16kHz capture path
+ *
+ * Compares each frame's mean-square energy with an adaptive noise floor that
+ * follows the room quickly downwards and slowly upwards (while no speech is
+ * detected, or once "speech" has gone on for 5 s without a pause, which is a
+ * noise source that started after the floor settled). Pure C with no IDF
+ * dependencies; one audio_vad_t per consumer.
+ */
+
+typedef struct {
+    uint32_t noise_floor;      // Mean square
+    uint32_t energy;           // Energy of the last frame
+    bool speech;               // Decision for the last frame
+    uint32_t speech_samples;   // Samples in the current run of speech frames
+} audio_vad_t;
+
+/**
+ * @brief Reset a VAD instance to its initial noise floor
+ */
+void audio_vad_init(audio_vad_t *vad);
+
+/**
+ * @brief Classify one frame of 16-bit PCM
+ *
+ * @return true if the frame contains speech
+ */
+bool audio_vad_process(audio_vad_t *vad, const int16_t *samples, size_t num_samples);
@@ -0,0 +1,317 @@
+#include "audio_wakeword.h"
+#include "audio_controller.h"
+#include "audio_kws.h"
+#include "executor.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_cpu.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+
+#define FRAME_US                    16000   // AUDIO_KWS_FRAME_SAMPLES at 16 kHz
+#define ENROLL_TIMEOUT_FRAMES       500     // 8 s per utterance
+#define REPORT_INTERVAL_FRAMES      3750    // Log the detector load once a minute
+
+#define NVS_NAMESPACE               "wakeword"
+#define NVS_COUNT_KEY               "count"
+#define NVS_THRESHOLD_KEY           "threshold"
+#define NVS_TEMPLATE_KEY_FMT        "tpl%u"
+
+static const char *TAG = "wakeword";
+
+typedef enum {
+    MODE_LISTEN,
+    MODE_ENROLL,
+    MODE_FINISHING,     // Enrollment job owns the templates and the spotter
+} wakeword_mode_t;
+
+static audio_wakeword_callback_t s_callback = NULL;
+static void *s_callback_ctx = NULL;
+static volatile bool s_enabled = false;
+static volatile bool s_enroll_request = false;
+static volatile wakeword_mode_t s_mode = MODE_LISTEN;
+
+// Spotter state (detector task, or the enrollment job in MODE_FINISHING)
+static audio_kws_t s_kws;
+static audio_kws_template_t s_templates[AUDIO_KWS_MAX_TEMPLATES];
+static audio_kws_template_t s_enroll_templates[AUDIO_WAKEWORD_ENROLL_COUNT];
+static volatile uint8_t s_num_templates = 0;
+static uint16_t s_threshold = AUDIO_KWS_DEFAULT_THRESHOLD;
+static size_t s_enroll_index = 0;
+static uint32_t s_enroll_frames = 0;
+static bool s_was_running = false;
+
+// Load measurement (detector task)
+static uint64_t s_window_cycles = 0;
+static uint32_t s_window_frames = 0;
+static uint32_t s_window_active = 0;
+static uint32_t s_last_active_frames = 0;
+
+static audio_wakeword_stats_t s_stats = { 0 };
+
+static void emit(audio_wakeword_event_t event)
+{
+    if (s_callback) {
+        s_callback(event, s_callback_ctx);
+    }
+}
+
+static bool load_templates(void)
+{
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs_handle);
+    if (err != ESP_OK) {
+        return false;
+    }
+
+    uint8_t count = 0;
+    uint16_t threshold = AUDIO_KWS_DEFAULT_THRESHOLD;
+    err = nvs_get_u8(nvs_handle, NVS_COUNT_KEY, &count);
+    if (err == ESP_OK) {
+        err = nvs_get_u16(nvs_handle, NVS_THRESHOLD_KEY, &threshold);
+    }
+    for (uint8_t i = 0; err == ESP_OK && i < count && i < AUDIO_KWS_MAX_TEMPLATES; i++) {
+        char key[8];
+        size_t len = sizeof(s_templates[i]);
+        snprintf(key, sizeof(key), NVS_TEMPLATE_KEY_FMT, (unsigned)i);
+        err = nvs_get_blob(nvs_handle, key, &s_templates[i], &len);
+        if (err == ESP_OK && (len != sizeof(s_templates[i]) || s_templates[i].num_frames < AUDIO_KWS_MIN_FRAMES ||
+                              s_templates[i].num_frames > AUDIO_KWS_MAX_FRAMES)) {
+            err = ESP_ERR_INVALID_SIZE;
+        }
+    }
+    nvs_close(nvs_handle);
+
+    if (err != ESP_OK || count == 0) {
+        ESP_LOGW(TAG, "No usable keyword in NVS (%s)", esp_err_to_name(err));
+        return false;
+    }
+
+    s_num_templates = count < AUDIO_KWS_MAX_TEMPLATES ? count : AUDIO_KWS_MAX_TEMPLATES;
+    s_threshold = threshold;
+    ESP_LOGI(TAG, "Loaded %u keyword templates (threshold %u)", (unsigned)s_num_templates, (unsigned)s_threshold);
+    return true;
+}
+
+static void save_templates(const audio_kws_template_t *templates, uint8_t count, uint16_t threshold)
+{
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to open NVS namespace: %s", esp_err_to_name(err));
+        return;
+    }
+
+    for (uint8_t i = 0; err == ESP_OK && i < count; i++) {
+        char key[8];
+        snprintf(key, sizeof(key), NVS_TEMPLATE_KEY_FMT, (unsigned)i);
+        err = nvs_set_blob(nvs_handle, key, &templates[i], sizeof(templates[i]));
+    }
+    if (err == ESP_OK) {
+        err = nvs_set_u16(nvs_handle, NVS_THRESHOLD_KEY, threshold);
+    }
+    if (err == ESP_OK) {
+        err = nvs_set_u8(nvs_handle, NVS_COUNT_KEY, count);
+    }
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs_handle);
+    }
+    nvs_close(nvs_handle);
+
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "Saved %u keyword templates to NVS", (unsigned)count);
+    } else {
+        ESP_LOGW(TAG, "Failed to save keyword to NVS: %s", esp_err_to_name(err));
+    }
+}
+
+// The microphone is needed while listening for an enrolled keyword or enrolling one
+static void update_capture(void)
+{
+    bool listening = s_enabled && s_num_templates > 0;
+    audio_set_idle_capture(listening || s_enroll_request || s_mode != MODE_LISTEN);
+}
+
+// Finishes an enrollment away from the detector task (NVS writes, capture changes)
+static esp_err_t enroll_job(void *arg)
+{
+    bool recorded = arg != NULL;
+
+    if (recorded) {
+        uint16_t threshold = audio_kws_threshold_from_templates(s_enroll_templates, AUDIO_WAKEWORD_ENROLL_COUNT);
+        save_templates(s_enroll_templates, AUDIO_WAKEWORD_ENROLL_COUNT, threshold);
+
+        memcpy(s_templates, s_enroll_templates, sizeof(s_enroll_templates));
+        s_num_templates = AUDIO_WAKEWORD_ENROLL_COUNT;
+        s_threshold = threshold;
+        ESP_LOGI(TAG, "Keyword enrolled: %u/%u/%u frames, threshold %u", s_templates[0].num_frames,
+                 s_templates[1].num_frames, s_templates[2].num_frames, (unsigned)threshold);
+    } else {
+        ESP_LOGW(TAG, "Enrollment timed out, keeping the previous keyword");
+    }
+
+    audio_kws_init(&s_kws, s_templates, s_num_templates, s_threshold);
+    s_was_running = false;
+    s_mode = MODE_LISTEN;
+    update_capture();
+    emit(recorded ? AUDIO_WAKEWORD_EVENT_ENROLL_DONE : AUDIO_WAKEWORD_EVENT_ENROLL_FAILED);
+    return recorded ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+static void finish_enrollment(bool recorded)
+{
+    audio_kws_record(&s_kws, NULL);
+    s_mode = MODE_FINISHING;
+    if (!executor_submit(EXECUTOR_CORE_AUDIO, EXECUTOR_PRIORITY_NORMAL, enroll_job, recorded ? (void *)1 : NULL,
+                         NULL, NULL)) {
+        ESP_LOGE(TAG, "Failed to queue enrollment");
+        s_mode = MODE_LISTEN;
+    }
+}
+
+static void report_load(void)
+{
+    uint64_t window_cycles = (uint64_t)s_window_frames * FRAME_US * CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ;
+    s_stats.load_permille = (uint32_t)(s_window_cycles * 1000 / window_cycles);
+    s_stats.active_permille = s_window_active * 1000 / s_window_frames;
+    ESP_LOGI(TAG, "Detector load %lu.%lu%% of one core (front-end active %lu.%lu%% of frames), %lu detections",
+             (unsigned long)(s_stats.load_permille / 10), (unsigned long)(s_stats.load_permille % 10),
+             (unsigned long)(s_stats.active_permille / 10), (unsigned long)(s_stats.active_permille % 10),
+             (unsigned long)s_stats.detections);
+
+    s_window_cycles = 0;
+    s_window_frames = 0;
+    s_window_active = 0;
+}
+
+static void handle_result(audio_kws_result_t result)
+{
+    switch (result) {
+    case AUDIO_KWS_DETECTED:
+        s_stats.detections++;
+        s_stats.keyword_ms = (uint32_t)s_kws.match_frames * FRAME_US / 1000;
+        s_stats.last_score = s_kws.last_score;
+        ESP_LOGI(TAG, "Wake word detected (score %u, threshold %u, %lu ms)", (unsigned)s_kws.last_score,
+                 (unsigned)s_threshold, (unsigned long)s_stats.keyword_ms);
+        emit(AUDIO_WAKEWORD_EVENT_DETECTED);
+        break;
+
+    case AUDIO_KWS_RECORDED:
+        ESP_LOGI(TAG, "Enrollment utterance %u/%d: %u frames", (unsigned)(s_enroll_index + 1),
+                 AUDIO_WAKEWORD_ENROLL_COUNT, s_enroll_templates[s_enroll_index].num_frames);
+        s_enroll_frames = 0;
+        if (++s_enroll_index == AUDIO_WAKEWORD_ENROLL_COUNT) {
+            finish_enrollment(true);
+            break;
+        }
+        audio_kws_record(&s_kws, &s_enroll_templates[s_enroll_index]);
+        emit(AUDIO_WAKEWORD_EVENT_ENROLL_NEXT);
+        break;
+
+    case AUDIO_KWS_REJECTED:
+        ESP_LOGW(TAG, "Enrollment utterance rejected (keep it between %d and %d ms)",
+                 AUDIO_KWS_MIN_FRAMES * FRAME_US / 1000, AUDIO_KWS_MAX_FRAMES * FRAME_US / 1000);
+        s_enroll_frames = 0;
+        emit(AUDIO_WAKEWORD_EVENT_ENROLL_NEXT);
+        break;
+
+    case AUDIO_KWS_NONE:
+        break;
+    }
+}
+
+// Capture worker tap: one 16 ms microphone frame
+static void capture_worker(const int16_t *samples, size_t num_samples, void *ctx)
+{
+    (void)ctx;
+
+    if (num_samples != AUDIO_KWS_FRAME_SAMPLES || s_mode == MODE_FINISHING) {
+        return;
+    }
+
+    if (s_enroll_request && s_mode == MODE_LISTEN) {
+        s_enroll_request = false;
+        s_enroll_index = 0;
+        s_enroll_frames = 0;
+        s_mode = MODE_ENROLL;
+        audio_kws_record(&s_kws, &s_enroll_templates[0]);
+        ESP_LOGI(TAG, "Enrollment started: say the keyword %d times", AUDIO_WAKEWORD_ENROLL_COUNT);
+        emit(AUDIO_WAKEWORD_EVENT_ENROLL_NEXT);
+    }
+
+    bool running = s_mode == MODE_ENROLL || (s_enabled && s_num_templates > 0);
+    if (!running) {
+        s_was_running = false;
+        return;
+    }
+    if (!s_was_running) {
+        audio_kws_reset(&s_kws);  // Paths and gate from an earlier run are stale
+        s_last_active_frames = 0;
+        s_was_running = true;
+    }
+
+    uint32_t start = esp_cpu_get_cycle_count();
+    audio_kws_result_t result = audio_kws_process(&s_kws, samples);
+    s_window_cycles += esp_cpu_get_cycle_count() - start;
+    s_window_active += s_kws.active_frames - s_last_active_frames;
+    s_last_active_frames = s_kws.active_frames;
+    if (++s_window_frames == REPORT_INTERVAL_FRAMES) {
+        report_load();
+    }
+
+    handle_result(result);
+
+    if (s_mode == MODE_ENROLL && ++s_enroll_frames >= ENROLL_TIMEOUT_FRAMES) {
+        finish_enrollment(false);
+    }
+}
+
+void audio_wakeword_init(audio_wakeword_callback_t callback, void *user_ctx)
+{
+    s_callback = callback;
+    s_callback_ctx = user_ctx;
+
+    load_templates();
+    audio_kws_init(&s_kws, s_templates, s_num_templates, s_threshold);
+    audio_add_capture_worker_tap(capture_worker, NULL);
+
+    ESP_LOGI(TAG, "Wake word initialised (%s)", s_num_templates > 0 ? "keyword enrolled" : "no keyword yet");
+}
+
+bool audio_wakeword_is_enrolled(void)
+{
+    return s_num_templates > 0;
+}
+
+void audio_wakeword_set_enabled(bool enabled)
+{
+    if (s_enabled == enabled) {
+        return;
+    }
+    s_enabled = enabled;
+    update_capture();
+}
+
+bool audio_wakeword_enroll_start(void)
+{
+    if (s_enroll_request || s_mode != MODE_LISTEN) {
+        ESP_LOGW(TAG, "Enrollment already running");
+        return false;
+    }
+    s_enroll_request = true;
+    update_capture();
+    return true;
+}
+
+void audio_wakeword_get_stats(audio_wakeword_stats_t *stats)
+{
+    *stats = s_stats;
+    stats->num_templates = s_num_templates;
+    stats->threshold = s_threshold;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * @brief Always-on wake word on top of the keyword spotter (audio_kws.h)
+ *
+ * Runs as a capture worker tap (low-priority task on core 1) whenever it is
+ * enabled, with the microphone kept running through idle capture. The keyword
+ * is enrolled on the device: the user says it AUDIO_WAKEWORD_ENROLL_COUNT
+ * times, the utterances become the matcher templates and the detection
+ * threshold is derived from how much they differ. Templates and threshold are
+ * stored in NVS.
+ *
+ * The detector's CPU share is measured in cycles and logged once a minute.
+ */
+
+#define AUDIO_WAKEWORD_ENROLL_COUNT 3
+
+typedef enum {
+    AUDIO_WAKEWORD_EVENT_DETECTED,          // From the detector task
+    AUDIO_WAKEWORD_EVENT_ENROLL_NEXT,       // From the detector task: say the keyword (again)
+    AUDIO_WAKEWORD_EVENT_ENROLL_DONE,       // From the enrollment job, templates saved
+    AUDIO_WAKEWORD_EVENT_ENROLL_FAILED,     // From the enrollment job (timeout), old templates kept
+} audio_wakeword_event_t;
+
+typedef void (*audio_wakeword_callback_t)(audio_wakeword_event_t event, void *user_ctx);
+
+typedef struct {
+    uint8_t num_templates;
+    uint16_t threshold;
+    uint32_t detections;            // Since init
+    uint32_t keyword_ms;            // Length of the last detected keyword
+    uint16_t last_score;            // Score of the last detection
+    uint32_t load_permille;         // Detector share of one core over the last report window
+    uint32_t active_permille;       // Share of frames that ran the front-end
+} audio_wakeword_stats_t;
+
+/**
+ * @brief Load the templates from NVS and register the capture worker tap
+ *
+ * @param callback Event callback (can be NULL)
+ * @param user_ctx User context passed to the callback
+ */
+void audio_wakeword_init(audio_wakeword_callback_t callback, void *user_ctx);
+
+/**
+ * @brief Check whether a keyword has been enrolled
+ */
+bool audio_wakeword_is_enrolled(void);
+
+/**
+ * @brief Listen for the keyword (no effect until a keyword is enrolled)
+ *
+ * Keeps the microphone on through idle capture while enabled.
+ */
+void audio_wakeword_set_enabled(bool enabled);
+
+/**
+ * @brief Start enrolling a new keyword
+ *
+ * Detection pauses until the enrollment finishes or times out.
+ *
+ * @return false if an enrollment is already running
+ */
+bool audio_wakeword_enroll_start(void);
+
+/**
+ * @brief Snapshot detector statistics
+ */
+void audio_wakeword_get_stats(audio_wakeword_stats_t *stats);
@@ -0,0 +1,319 @@
+#include "deep_sleep.h"
+#include "audio_playback.h"
+#include "executor.h"
+#include "proxy_client.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "CST816.h"
+#include "ST77916.h"
+#include "driver/rtc_io.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_rtc_time.h"
+#include "esp_sleep.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+
+#define DEEP_SLEEP_MAGIC         0x51EEB007
+#define DEEP_SLEEP_WAKE_GPIO     I2C_Touch_INT_IO   // CST816 interrupt, pulled low on a touch
+#define DEEP_SLEEP_LEASE_REUSE_S (30 * 60)          // Well inside any home router's lease time
+#define DEEP_SLEEP_CHECK_MS      1000
+
+static const char *TAG = "deep_sleep";
+
+// Kept in RTC slow memory across deep sleep; initialised again on a cold boot
+typedef struct {
+    uint32_t magic;
+    char session_id[32];
+    uint8_t bssid[6];
+    uint8_t channel;
+    bool has_ip;
+    esp_netif_ip_info_t ip_info;
+    esp_netif_dns_info_t dns;
+    uint64_t lease_start_us;        // esp_rtc_get_time_us() when DHCP granted the address
+    assistant_state_t state;
+    uint8_t volume;
+    uint32_t cold_ready_ms;         // Last cold boot's time to ready
+    uint32_t wakes;                 // Wakes since that cold boot
+} deep_sleep_retained_t;
+
+static RTC_DATA_ATTR deep_sleep_retained_t s_rtc;
+
+static bool s_wake = false;
+static esp_netif_t *s_netif = NULL;
+static bool s_joining = false;               // Hints applied and no address yet
+static volatile bool s_static_ip = false;    // The retained address was set instead of asking DHCP
+static volatile bool s_dhcp_queued = false;  // Switch back to DHCP submitted
+static bool s_got_ip = false;
+static uint64_t s_lease_start_us = 0;
+
+static portMUX_TYPE s_ready_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t s_ready_parts = 0;
+static uint32_t s_ready_ms[2] = { 0 };
+
+// Hands a restored address back to DHCP after the join (executor worker)
+static esp_err_t dhcp_restart_job(void *arg)
+{
+    (void)arg;
+    s_dhcp_queued = false;
+    if (!s_static_ip) {
+        return ESP_OK;  // The join failed meanwhile, DHCP already runs
+    }
+    s_static_ip = false;
+    esp_err_t err = esp_netif_dhcpc_start(s_netif);
+    if (err != ESP_OK && err != ESP_ERR_ESP_NETIF_DHCP_ALREADY_STARTED) {
+        ESP_LOGW(TAG, "Could not restart DHCP (%s), keeping the retained address", esp_err_to_name(err));
+        return err;
+    }
+    ESP_LOGI(TAG, "Retained address handed back to DHCP");
+    return ESP_OK;
+}
+
+static esp_timer_handle_t s_idle_timer = NULL;
+static deep_sleep_idle_fn_t s_is_idle = NULL;
+static uint32_t s_idle_limit_s = 0;
+static uint32_t s_idle_s = 0;
+static volatile bool s_entering = false;
+
+void deep_sleep_init(void)
+{
+    s_wake = esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_EXT0 && s_rtc.magic == DEEP_SLEEP_MAGIC;
+    if (esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_EXT0) {
+        rtc_gpio_deinit(DEEP_SLEEP_WAKE_GPIO);  // Back to a digital pin for the touch driver
+    }
+    if (!s_wake) {
+        memset(&s_rtc, 0, sizeof(s_rtc));
+        return;
+    }
+
+    s_rtc.wakes++;
+    s_lease_start_us = s_rtc.lease_start_us;
+    ESP_LOGI(TAG, "Woken by touch (wake %lu), session %s, AP channel %u",
+             (unsigned long)s_rtc.wakes, s_rtc.session_id, s_rtc.channel);
+}
+
+bool deep_sleep_is_wake(void)
+{
+    return s_wake;
+}
+
+const char *deep_sleep_session_id(void)
+{
+    return s_wake && s_rtc.session_id[0] ? s_rtc.session_id : NULL;
+}
+
+bool deep_sleep_get_ui(assistant_state_t *state, uint8_t *volume)
+{
+    if (!s_wake) {
+        return false;
+    }
+    *state = s_rtc.state;
+    *volume = s_rtc.volume;
+    return true;
+}
+
+void deep_sleep_apply_wifi(wifi_config_t *config, esp_netif_t *netif)
+{
+    s_netif = netif;
+    if (!s_wake || s_rtc.channel == 0) {
+        return;
+    }
+
+    // Only the retained channel is scanned, and only for the retained AP
+    memcpy(config->sta.bssid, s_rtc.bssid, sizeof(config->sta.bssid));
+    config->sta.bssid_set = true;
+    config->sta.channel = s_rtc.channel;
+    s_joining = true;
+
+    uint64_t lease_age_s = (esp_rtc_get_time_us() - s_rtc.lease_start_us) / 1000000;
+    if (!s_rtc.has_ip || lease_age_s >= DEEP_SLEEP_LEASE_REUSE_S) {
+        ESP_LOGI(TAG, "Joining the retained AP, address from DHCP (lease %llu s old)",
+                 (unsigned long long)lease_age_s);
+        return;
+    }
+    esp_netif_dhcpc_stop(netif);
+    if (esp_netif_set_ip_info(netif, &s_rtc.ip_info) != ESP_OK) {
+        esp_netif_dhcpc_start(netif);
+        ESP_LOGW(TAG, "Could not set the retained address, using DHCP");
+        return;
+    }
+    esp_netif_set_dns_info(netif, ESP_NETIF_DNS_MAIN, &s_rtc.dns);
+    s_static_ip = true;
+    ESP_LOGI(TAG, "Joining the retained AP with " IPSTR " (lease %llu s old)", IP2STR(&s_rtc.ip_info.ip),
+             (unsigned long long)lease_age_s);
+}
+
+void deep_sleep_wifi_failed(esp_netif_t *netif)
+{
+    if (!s_joining) {
+        return;
+    }
+    s_joining = false;
+
+    wifi_config_t config;
+    if (esp_wifi_get_config(WIFI_IF_STA, &config) == ESP_OK) {
+        config.sta.bssid_set = false;
+        config.sta.channel = 0;
+        esp_wifi_set_config(WIFI_IF_STA, &config);
+    }
+    if (s_static_ip) {
+        s_static_ip = false;
+        esp_netif_dhcpc_start(netif);
+    }
+    ESP_LOGW(TAG, "Retained AP not joined, falling back to a full scan and DHCP");
+}
+
+void deep_sleep_note_got_ip(void)
+{
+    s_joining = false;
+    s_got_ip = true;
+    // A restored address keeps its original lease time, and the idle timer
+    // hands it back to DHCP (see idle_timer_cb())
+    if (!s_static_ip) {
+        s_lease_start_us = esp_rtc_get_time_us();
+    }
+    deep_sleep_mark_ready(DEEP_SLEEP_READY_IP);
+}
+
+void deep_sleep_mark_ready(deep_sleep_ready_t part)
+{
+    const uint32_t all = DEEP_SLEEP_READY_UI | DEEP_SLEEP_READY_IP;
+    uint32_t now_ms = (uint32_t)(esp_timer_get_time() / 1000);
+
+    // The UI part comes from app_main, the IP part from the event loop
+    portENTER_CRITICAL(&s_ready_lock);
+    bool first = !(s_ready_parts & part);
+    if (first) {
+        s_ready_parts |= part;
+        s_ready_ms[part == DEEP_SLEEP_READY_UI ? 0 : 1] = now_ms;
+    }
+    bool done = first && s_ready_parts == all;
+    portEXIT_CRITICAL(&s_ready_lock);
+    if (!done) {
+        return;
+    }
+
+    uint32_t ready_ms = s_ready_ms[0] > s_ready_ms[1] ? s_ready_ms[0] : s_ready_ms[1];
+    if (s_wake) {
+        ESP_LOGI(TAG, "Wake ready in %lu ms (UI %lu ms, IP %lu ms); last cold boot %lu ms",
+                 (unsigned long)ready_ms, (unsigned long)s_ready_ms[0], (unsigned long)s_ready_ms[1],
+                 (unsigned long)s_rtc.cold_ready_ms);
+    } else {
+        s_rtc.cold_ready_ms = ready_ms;
+        ESP_LOGI(TAG, "Cold boot ready in %lu ms (UI %lu ms, IP %lu ms)",
+                 (unsigned long)ready_ms, (unsigned long)s_ready_ms[0], (unsigned long)s_ready_ms[1]);
+    }
+}
+
+// Fill the RTC copy with what the next wake needs
+static void save_state(void)
+{
+    s_rtc.magic = DEEP_SLEEP_MAGIC;
+    snprintf(s_rtc.session_id, sizeof(s_rtc.session_id), "%s", proxy_get_session_id());
+    s_rtc.state = assistant_get_status().state;
+    s_rtc.volume = audio_playback_get_volume();
+
+    wifi_ap_record_t ap;
+    if (esp_wifi_sta_get_ap_info(&ap) == ESP_OK) {
+        memcpy(s_rtc.bssid, ap.bssid, sizeof(s_rtc.bssid));
+        s_rtc.channel = ap.primary;
+    } else {
+        s_rtc.channel = 0;
+    }
+
+    s_rtc.has_ip = s_got_ip && s_netif && esp_netif_get_ip_info(s_netif, &s_rtc.ip_info) == ESP_OK &&
+                   s_rtc.ip_info.ip.addr != 0 &&
+                   esp_netif_get_dns_info(s_netif, ESP_NETIF_DNS_MAIN, &s_rtc.dns) == ESP_OK;
+    s_rtc.lease_start_us = s_lease_start_us;
+}
+
+static esp_err_t enter_job(void *arg)
+{
+    (void)arg;
+    if (!s_is_idle()) {
+        s_idle_s = 0;
+        s_entering = false;
+        return ESP_OK;  // Something started while the job was queued
+    }
+
+    esp_timer_stop(s_idle_timer);
+    save_state();
+    ESP_LOGI(TAG, "Idle for %lu s - entering deep sleep (tap the screen to wake)", (unsigned long)s_idle_s);
+
+    Set_Backlight(0);
+    esp_wifi_stop();
+
+    // The touch controller stays powered and pulls its interrupt line low on a touch
+    rtc_gpio_pullup_en(DEEP_SLEEP_WAKE_GPIO);
+    rtc_gpio_pulldown_dis(DEEP_SLEEP_WAKE_GPIO);
+    esp_err_t err = esp_sleep_enable_ext0_wakeup(DEEP_SLEEP_WAKE_GPIO, 0);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Cannot wake on touch (%s), staying awake", esp_err_to_name(err));
+        Set_Backlight(LCD_Backlight);
+        esp_wifi_start();
+        s_idle_s = 0;
+        s_entering = false;
+        esp_timer_start_periodic(s_idle_timer, DEEP_SLEEP_CHECK_MS * 1000ULL);
+        return err;
+    }
+    esp_deep_sleep_start();
+    return ESP_OK;
+}
+
+static void idle_timer_cb(void *arg)
+{
+    (void)arg;
+    if (s_entering) {
+        return;
+    }
+    bool idle = s_is_idle();
+
+    // The router never heard about a restored address, so DHCP takes it back
+    // after the join. Starting the client clears the address while it asks,
+    // so that waits for the first idle moment, or happens regardless once the
+    // original lease is as old as the reuse limit.
+    if (s_static_ip && s_got_ip && !s_dhcp_queued &&
+        (idle || esp_rtc_get_time_us() - s_lease_start_us >= DEEP_SLEEP_LEASE_REUSE_S * 1000000ULL)) {
+        s_dhcp_queued = executor_submit(EXECUTOR_CORE_NETWORK, EXECUTOR_PRIORITY_LOW, dhcp_restart_job, NULL,
+                                        NULL, NULL);
+        s_idle_s = 0;
+        return;  // The idle count starts over from the switch
+    }
+
+    if (!idle) {
+        s_idle_s = 0;
+        return;
+    }
+    if (++s_idle_s < s_idle_limit_s) {
+        return;
+    }
+
+    s_entering = true;
+    if (!executor_submit(EXECUTOR_CORE_NETWORK, EXECUTOR_PRIORITY_LOW, enter_job, NULL, NULL, NULL)) {
+        ESP_LOGW(TAG, "Failed to queue deep sleep");
+        s_idle_s = 0;
+        s_entering = false;
+    }
+}
+
+void deep_sleep_start(uint32_t idle_s, deep_sleep_idle_fn_t is_idle)
+{
+    if (idle_s == 0 || !is_idle || s_idle_timer) {
+        return;
+    }
+    s_is_idle = is_idle;
+    s_idle_limit_s = idle_s;
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = idle_timer_cb,
+        .name = "deep_sleep",
+    };
+    if (esp_timer_create(&timer_args, &s_idle_timer) != ESP_OK ||
+        esp_timer_start_periodic(s_idle_timer, DEEP_SLEEP_CHECK_MS * 1000ULL) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start the idle timer, deep sleep disabled");
+        return;
+    }
+    ESP_LOGI(TAG, "Deep sleep after %lu s idle", (unsigned long)idle_s);
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_netif.h"
+#include "esp_wifi.h"
+#include "smart_assistant.h"
+
+/**
+ * @brief Deep sleep between conversations, woken by a touch on the screen
+ *
+ * After a stretch of idle time the device saves what a fast wake needs in
+ * RTC memory, turns the backlight off and enters deep sleep with the touch
+ * controller's interrupt line as the wake source. Kept across the sleep:
+ *
+ *   - the persistent session id (no NVS read on wake)
+ *   - the access point's BSSID and channel (joined without a full scan)
+ *   - the IP address, netmask, gateway and DNS server (set statically while
+ *     the DHCP lease is fresh, so no DHCP exchange is needed)
+ *   - the assistant state shown on the button and the playback volume
+ *
+ * RTC memory only survives deep sleep: a reset or power cycle is a cold boot.
+ * Both kinds of boot log the time until the UI is up and the station has an
+ * address; a wake also logs the last cold boot's time for comparison.
+ */
+
+typedef bool (*deep_sleep_idle_fn_t)(void);
+
+/**
+ * @brief Parts of the bring-up that make the device ready for a tap
+ */
+typedef enum {
+    DEEP_SLEEP_READY_UI = 1 << 0,   // Panel, touch and LVGL up
+    DEEP_SLEEP_READY_IP = 1 << 1,   // Station associated with an address
+} deep_sleep_ready_t;
+
+/**
+ * @brief Read the wake cause and the retained state (first thing in app_main)
+ */
+void deep_sleep_init(void);
+
+/**
+ * @brief True if this boot is a touch wake with retained state
+ */
+bool deep_sleep_is_wake(void);
+
+/**
+ * @brief Retained session id, or NULL on a cold boot
+ */
+const char *deep_sleep_session_id(void);
+
+/**
+ * @brief Retained UI state (false on a cold boot)
+ */
+bool deep_sleep_get_ui(assistant_state_t *state, uint8_t *volume);
+
+/**
+ * @brief Apply the retained Wi-Fi hints (before esp_wifi_set_config())
+ *
+ * On a wake, joins the retained BSSID on its channel and, if the address was
+ * leased less than DEEP_SLEEP_LEASE_REUSE_S ago, sets it statically on netif.
+ * Once joined, the idle timer hands that address back to DHCP at the first
+ * idle moment, or when the lease reaches the reuse limit. No-op on a cold boot.
+ */
+void deep_sleep_apply_wifi(wifi_config_t *config, esp_netif_t *netif);
+
+/**
+ * @brief Drop the hints after a failed join (from the STA disconnect handler)
+ *
+ * Goes back to a full scan and DHCP for the next attempt. No-op once the
+ * station has had an address.
+ */
+void deep_sleep_wifi_failed(esp_netif_t *netif);
+
+/**
+ * @brief Note that the station got an address (from the got-IP handler)
+ */
+void deep_sleep_note_got_ip(void);
+
+/**
+ * @brief Mark part of the bring-up done; logs the boot time once all are
+ */
+void deep_sleep_mark_ready(deep_sleep_ready_t part);
+
+/**
+ * @brief Sleep after idle_s seconds in which is_idle() held every time (0: never)
+ *
+ * is_idle() is polled once a second from the timer task; it must not block.
+ */
+void deep_sleep_start(uint32_t idle_s, deep_sleep_idle_fn_t is_idle);
@@ -0,0 +1,730 @@
+#include "dsp_kernels.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef ESP_PLATFORM
+#include "esp_cpu.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+#else
+// Host build (tools/kws_eval.c): reference kernels, stdio logging, wall-clock "cycles"
+#include <stdio.h>
+#include <time.h>
+#define ESP_LOGI(tag, fmt, ...)     printf("%s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...)     printf("%s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGE(tag, fmt, ...)     fprintf(stderr, "%s: " fmt "\n", tag, ##__VA_ARGS__)
+#define MALLOC_CAP_INTERNAL         0
+#define MALLOC_CAP_8BIT             0
+#define CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ 1000  // Host "cycles" are nanoseconds
+static inline void *heap_caps_aligned_alloc(size_t align, size_t size, uint32_t caps)
+{
+    (void)caps;
+    return aligned_alloc(align, (size + align - 1) / align * align);
+}
+static inline void heap_caps_free(void *ptr)
+{
+    free(ptr);
+}
+static inline uint32_t esp_cpu_get_cycle_count(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+#endif
+
+// Build-time kernel selection: esp-dsp's S3 assembly where it matches the reference semantics
+#if CONFIG_IDF_TARGET_ESP32S3 && !defined(DSP_KERNELS_FORCE_REFERENCE)
+#define DSP_USE_ESP_DSP             1
+#include "dsps_dotprod.h"
+#include "dsps_fft2r.h"
+#else
+#define DSP_USE_ESP_DSP             0
+#endif
+
+#define DSP_ALIGN                   16      // esp-dsp S3 kernels take the fast path on 16-byte aligned data
+#define DSP_BUFFER_CAPS             (MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT)
+
+// Self-test: tolerances in LSB (esp-dsp rounds differently from the references)
+#define SELFTEST_DOT_TOLERANCE      1
+#define SELFTEST_FFT_TOLERANCE      4
+#define SELFTEST_DFT_TOLERANCE      8       // Reference FFT against a float DFT
+#define SELFTEST_SEED               0x2545F491u
+#define SELFTEST_FIR_TAPS           32
+#define SELFTEST_FIR_BLOCK          80
+
+// Benchmark
+#define BENCH_ITERATIONS            32
+#define BENCH_BUFFER_SAMPLES        4800    // Longest case: calibration-sized correlation window
+#define BENCH_S32_SAMPLES           256
+#define BENCH_FIR_TAPS              32
+#define BENCH_BIQUAD_SECTIONS       6
+
+static const char *TAG = "dsp";
+
+// cos/sin pairs for angles 2*pi*i/DSP_FFT_MAX_POINTS, i < DSP_FFT_MAX_POINTS/2 (Q15)
+static int16_t s_twiddle[DSP_FFT_MAX_POINTS];
+static bool s_fft_ready = false;
+static bool s_fallback = false;  // Self-test failed: use the references everywhere
+
+typedef int16_t (*dot_q15_fn_t)(const int16_t *a, const int16_t *b, size_t n);
+typedef void (*fft_fn_t)(int16_t *data, size_t n);
+
+uint32_t dsp_isqrt64(uint64_t v)
+{
+    uint64_t result = 0;
+    uint64_t bit = 1ULL << 62;
+
+    while (bit > v) {
+        bit >>= 2;
+    }
+    while (bit != 0) {
+        if (v >= result + bit) {
+            v -= result + bit;
+            result = (result >> 1) + bit;
+        } else {
+            result >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint32_t)result;
+}
+
+uint64_t dsp_energy_s16(const int16_t *x, size_t n)
+{
+    uint64_t sum = 0;
+    for (size_t i = 0; i < n; i++) {
+        sum += (uint32_t)((int32_t)x[i] * x[i]);
+    }
+    return sum;
+}
+
+uint32_t dsp_mean_square_s16(const int16_t *x, size_t n)
+{
+    return n ? (uint32_t)(dsp_energy_s16(x, n) / n) : 0;
+}
+
+uint32_t dsp_rms_s16(const int16_t *x, size_t n)
+{
+    return n ? dsp_isqrt64(dsp_energy_s16(x, n) / n) : 0;
+}
+
+uint32_t dsp_peak_s16(const int16_t *x, size_t n)
+{
+    uint32_t peak = 0;
+    for (size_t i = 0; i < n; i++) {
+        uint32_t mag = (uint32_t)abs((int32_t)x[i]);
+        if (mag > peak) {
+            peak = mag;
+        }
+    }
+    return peak;
+}
+
+int64_t dsp_dot_s16(const int16_t *a, const int16_t *b, size_t n)
+{
+    int64_t acc = 0;
+    for (size_t i = 0; i < n; i++) {
+        acc += (int32_t)a[i] * b[i];
+    }
+    return acc;
+}
+
+static int16_t ref_dot_q15(const int16_t *a, const int16_t *b, size_t n)
+{
+    int64_t result = (dsp_dot_s16(a, b, n) + (1 << 14)) >> 15;
+    if (result > INT16_MAX) {
+        return INT16_MAX;
+    }
+    if (result < INT16_MIN) {
+        return INT16_MIN;
+    }
+    return (int16_t)result;
+}
+
+int16_t dsp_dot_q15(const int16_t *a, const int16_t *b, size_t n)
+{
+#if DSP_USE_ESP_DSP
+    if (!s_fallback && n > 0) {
+        int16_t result;
+        dsps_dotprod_s16(a, b, &result, (int)n, 0);
+        return result;
+    }
+#endif
+    return ref_dot_q15(a, b, n);
+}
+
+void dsp_mix_sat_s16(int16_t *dst, const int16_t *src, size_t n, int16_t gain_q15)
+{
+    for (size_t i = 0; i < n; i++) {
+        dst[i] = dsp_sat16(dst[i] + (((int32_t)src[i] * gain_q15) >> 15));
+    }
+}
+
+void dsp_gain_sat_s16(int16_t *buf, size_t n, int32_t gain_q16)
+{
+    for (size_t i = 0; i < n; i++) {
+        int64_t v = ((int64_t)buf[i] * gain_q16) >> 16;
+        buf[i] = v > INT16_MAX ? INT16_MAX : v < INT16_MIN ? INT16_MIN : (int16_t)v;
+    }
+}
+
+void dsp_biquad_design(dsp_biquad_t *bq, dsp_biquad_type_t type, uint32_t sample_rate_hz,
+                       float freq_hz, float q, float gain_db)
+{
+    float w0 = 2.0f * (float)M_PI * freq_hz / (float)sample_rate_hz;
+    float cosw = cosf(w0);
+    float alpha = sinf(w0) / (2.0f * q);
+    float a = powf(10.0f, gain_db / 40.0f);
+    float sqa2 = 2.0f * sqrtf(a) * alpha;
+    float b0, b1, b2, a0, a1, a2;
+
+    switch (type) {
+    case DSP_BIQUAD_LOWPASS:
+        b0 = (1.0f - cosw) / 2.0f;
+        b1 = 1.0f - cosw;
+        b2 = b0;
+        a0 = 1.0f + alpha;
+        a1 = -2.0f * cosw;
+        a2 = 1.0f - alpha;
+        break;
+    case DSP_BIQUAD_HIGHPASS:
+        b0 = (1.0f + cosw) / 2.0f;
+        b1 = -(1.0f + cosw);
+        b2 = b0;
+        a0 = 1.0f + alpha;
+        a1 = -2.0f * cosw;
+        a2 = 1.0f - alpha;
+        break;
+    case DSP_BIQUAD_LOW_SHELF:
+        b0 = a * ((a + 1.0f) - (a - 1.0f) * cosw + sqa2);
+        b1 = 2.0f * a * ((a - 1.0f) - (a + 1.0f) * cosw);
+        b2 = a * ((a + 1.0f) - (a - 1.0f) * cosw - sqa2);
+        a0 = (a + 1.0f) + (a - 1.0f) * cosw + sqa2;
+        a1 = -2.0f * ((a - 1.0f) + (a + 1.0f) * cosw);
+        a2 = (a + 1.0f) + (a - 1.0f) * cosw - sqa2;
+        break;
+    case DSP_BIQUAD_HIGH_SHELF:
+        b0 = a * ((a + 1.0f) + (a - 1.0f) * cosw + sqa2);
+        b1 = -2.0f * a * ((a - 1.0f) + (a + 1.0f) * cosw);
+        b2 = a * ((a + 1.0f) + (a - 1.0f) * cosw - sqa2);
+        a0 = (a + 1.0f) - (a - 1.0f) * cosw + sqa2;
+        a1 = 2.0f * ((a - 1.0f) - (a + 1.0f) * cosw);
+        a2 = (a + 1.0f) - (a - 1.0f) * cosw - sqa2;
+        break;
+    case DSP_BIQUAD_PEAK:
+    default:
+        b0 = 1.0f + alpha * a;
+        b1 = -2.0f * cosw;
+        b2 = 1.0f - alpha * a;
+        a0 = 1.0f + alpha / a;
+        a1 = -2.0f * cosw;
+        a2 = 1.0f - alpha / a;
+        break;
+    }
+
+    const float scale = (float)(1 << DSP_BIQUAD_SHIFT) / a0;
+    memset(bq, 0, sizeof(*bq));
+    bq->b0 = (int32_t)lrintf(b0 * scale);
+    bq->b1 = (int32_t)lrintf(b1 * scale);
+    bq->b2 = (int32_t)lrintf(b2 * scale);
+    bq->na1 = (int32_t)lrintf(-a1 * scale);
+    bq->na2 = (int32_t)lrintf(-a2 * scale);
+}
+
+// One biquad over a whole block: state lives in registers for the loop
+void dsp_biquad_process_s32(dsp_biquad_t *bq, const int32_t *in, int32_t *out, size_t n)
+{
+    const int32_t b0 = bq->b0, b1 = bq->b1, b2 = bq->b2, na1 = bq->na1, na2 = bq->na2;
+    int32_t x1 = bq->x1, x2 = bq->x2, y1 = bq->y1, y2 = bq->y2;
+
+    for (size_t i = 0; i < n; i++) {
+        int32_t x0 = in[i];
+        int64_t acc = (int64_t)b0 * x0 + (int64_t)b1 * x1 + (int64_t)b2 * x2
+                    + (int64_t)na1 * y1 + (int64_t)na2 * y2;
+        int32_t y0 = (int32_t)(acc >> DSP_BIQUAD_SHIFT);
+        x2 = x1;
+        x1 = x0;
+        y2 = y1;
+        y1 = y0;
+        out[i] = y0;
+    }
+
+    bq->x1 = x1;
+    bq->x2 = x2;
+    bq->y1 = y1;
+    bq->y2 = y2;
+}
+
+void dsp_biquad_cascade_s32(dsp_biquad_t *sections, size_t num_sections, int32_t *buf, size_t n)
+{
+    for (size_t s = 0; s < num_sections; s++) {
+        dsp_biquad_process_s32(&sections[s], buf, buf, n);
+    }
+}
+
+bool dsp_fir_init(dsp_fir_t *fir, const int16_t *taps, size_t num_taps, size_t max_block)
+{
+    if (!fir || !taps || num_taps == 0 || max_block == 0) {
+        return false;
+    }
+
+    memset(fir, 0, sizeof(*fir));
+    fir->rev_taps = heap_caps_aligned_alloc(DSP_ALIGN, num_taps * sizeof(int16_t), DSP_BUFFER_CAPS);
+    fir->line = heap_caps_aligned_alloc(DSP_ALIGN, (num_taps - 1 + max_block) * sizeof(int16_t), DSP_BUFFER_CAPS);
+    if (!fir->rev_taps || !fir->line) {
+        dsp_fir_deinit(fir);
+        return false;
+    }
+
+    uint32_t tap_sum = 0;
+    for (size_t i = 0; i < num_taps; i++) {
+        fir->rev_taps[i] = taps[num_taps - 1 - i];
+        tap_sum += (uint32_t)abs(taps[i]);
+    }
+    // Sum of |taps| <= 1.0 bounds every output to 16 bits, so the non-saturating kernel is exact
+    fir->bounded = tap_sum <= 32768;
+    fir->num_taps = num_taps;
+    fir->max_block = max_block;
+    dsp_fir_reset(fir);
+    return true;
+}
+
+void dsp_fir_reset(dsp_fir_t *fir)
+{
+    if (fir->line) {
+        memset(fir->line, 0, (fir->num_taps - 1) * sizeof(int16_t));
+    }
+}
+
+void dsp_fir_deinit(dsp_fir_t *fir)
+{
+    heap_caps_free(fir->rev_taps);
+    heap_caps_free(fir->line);
+    memset(fir, 0, sizeof(*fir));
+}
+
+static void fir_run(dsp_fir_t *fir, const int16_t *in, int16_t *out, size_t n, dot_q15_fn_t dot)
+{
+    const size_t history = fir->num_taps - 1;
+
+    while (n > 0) {
+        size_t block = n < fir->max_block ? n : fir->max_block;
+        memcpy(fir->line + history, in, block * sizeof(int16_t));
+        for (size_t i = 0; i < block; i++) {
+            out[i] = dot(fir->rev_taps, fir->line + i, fir->num_taps);
+        }
+        memmove(fir->line, fir->line + block, history * sizeof(int16_t));
+        in += block;
+        out += block;
+        n -= block;
+    }
+}
+
+void dsp_fir_process(dsp_fir_t *fir, const int16_t *in, int16_t *out, size_t n)
+{
+    fir_run(fir, in, out, n, fir->bounded ? dsp_dot_q15 : ref_dot_q15);
+}
+
+bool dsp_fft_init(void)
+{
+    if (s_fft_ready) {
+        return true;
+    }
+
+    for (size_t i = 0; i < DSP_FFT_MAX_POINTS / 2; i++) {
+        float angle = 2.0f * (float)M_PI * (float)i / (float)DSP_FFT_MAX_POINTS;
+        s_twiddle[2 * i] = (int16_t)lrintf(32767.0f * cosf(angle));
+        s_twiddle[2 * i + 1] = (int16_t)lrintf(32767.0f * sinf(angle));
+    }
+
+#if DSP_USE_ESP_DSP
+    if (dsps_fft2r_init_sc16(NULL, DSP_FFT_MAX_POINTS) != ESP_OK) {
+        ESP_LOGW(TAG, "esp-dsp FFT tables unavailable, using the reference FFT");
+        s_fallback = true;
+    }
+#endif
+
+    s_fft_ready = true;
+    return true;
+}
+
+// Iterative radix-2 decimation in time, halving after every stage
+static void ref_fft_s16(int16_t *data, size_t n)
+{
+    for (size_t i = 1, j = 0; i < n; i++) {
+        size_t bit = n >> 1;
+        for (; j & bit; bit >>= 1) {
+            j ^= bit;
+        }
+        j ^= bit;
+        if (i < j) {
+            int16_t re = data[2 * i], im = data[2 * i + 1];
+            data[2 * i] = data[2 * j];
+            data[2 * i + 1] = data[2 * j + 1];
+            data[2 * j] = re;
+            data[2 * j + 1] = im;
+        }
+    }
+
+    for (size_t len = 2; len <= n; len <<= 1) {
+        const size_t half = len >> 1;
+        const size_t stride = DSP_FFT_MAX_POINTS / len;
+        for (size_t i = 0; i < n; i += len) {
+            for (size_t j = 0; j < half; j++) {
+                const int32_t c = s_twiddle[2 * j * stride];
+                const int32_t s = s_twiddle[2 * j * stride + 1];
+                int16_t *u = &data[2 * (i + j)];
+                int16_t *v = &data[2 * (i + j + half)];
+                // t = v * (c - js)
+                int32_t tr = (v[0] * c + v[1] * s) >> 15;
+                int32_t ti = (v[1] * c - v[0] * s) >> 15;
+                int32_t ur = u[0], ui = u[1];
+                u[0] = dsp_sat16((ur + tr) >> 1);
+                u[1] = dsp_sat16((ui + ti) >> 1);
+                v[0] = dsp_sat16((ur - tr) >> 1);
+                v[1] = dsp_sat16((ui - ti) >> 1);
+            }
+        }
+    }
+}
+
+void dsp_fft_s16(int16_t *data, size_t n)
+{
+#if DSP_USE_ESP_DSP
+    if (!s_fallback) {
+        dsps_fft2r_sc16(data, (int)n);
+        dsps_bit_rev_sc16_ansi(data, (int)n);
+        return;
+    }
+#endif
+    ref_fft_s16(data, n);
+}
+
+// n real samples are n/2 complex points (even samples real, odd imaginary); the
+// half-size spectrum Z is then split into the even/odd spectra and recombined:
+//   X[k] = E[k] + W^k O[k],  X[m-k] = conj(E[k] - W^k O[k])
+static void rfft_run(const int16_t *in, int16_t *spectrum, size_t n, fft_fn_t fft)
+{
+    const size_t m = n / 2;
+    const size_t stride = DSP_FFT_MAX_POINTS / n;
+
+    if (in != spectrum) {
+        memcpy(spectrum, in, n * sizeof(int16_t));
+    }
+    fft(spectrum, m);
+
+    int32_t z0r = spectrum[0], z0i = spectrum[1];
+    spectrum[0] = (int16_t)((z0r + z0i) >> 1);
+    spectrum[1] = 0;
+    spectrum[2 * m] = (int16_t)((z0r - z0i) >> 1);
+    spectrum[2 * m + 1] = 0;
+
+    for (size_t k = 1; k <= m / 2; k++) {
+        int16_t *pa = &spectrum[2 * k];
+        int16_t *pb = &spectrum[2 * (m - k)];
+        int32_t ar = pa[0], ai = pa[1], br = pb[0], bi = pb[1];
+
+        int32_t e_re = (ar + br) >> 1, e_im = (ai - bi) >> 1;   // (a + conj b) / 2
+        int32_t o_re = (ai + bi) >> 1, o_im = (br - ar) >> 1;   // (a - conj b) / 2j
+        const int32_t c = s_twiddle[2 * k * stride];
+        const int32_t s = s_twiddle[2 * k * stride + 1];
+        int32_t tr = (o_re * c + o_im * s) >> 15;
+        int32_t ti = (o_im * c - o_re * s) >> 15;
+
+        pa[0] = dsp_sat16((e_re + tr) >> 1);
+        pa[1] = dsp_sat16((e_im + ti) >> 1);
+        pb[0] = dsp_sat16((e_re - tr) >> 1);
+        pb[1] = dsp_sat16((ti - e_im) >> 1);
+    }
+}
+
+void dsp_rfft_s16(const int16_t *in, int16_t *spectrum, size_t n)
+{
+    rfft_run(in, spectrum, n, dsp_fft_s16);
+}
+
+const char *dsp_kernels_variant(void)
+{
+    if (s_fallback) {
+        return "reference (fallback)";
+    }
+    return DSP_USE_ESP_DSP ? "esp-dsp" : "reference";
+}
+
+static uint32_t xorshift32(uint32_t *state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+// Deterministic test signal in [-amplitude, amplitude]
+static void fill_random(int16_t *buf, size_t n, int16_t amplitude, uint32_t *state)
+{
+    for (size_t i = 0; i < n; i++) {
+        buf[i] = (int16_t)((int32_t)(xorshift32(state) % (2u * amplitude + 1)) - amplitude);
+    }
+}
+
+static int32_t max_abs_diff(const int16_t *a, const int16_t *b, size_t n)
+{
+    int32_t worst = 0;
+    for (size_t i = 0; i < n; i++) {
+        int32_t d = abs((int32_t)a[i] - b[i]);
+        if (d > worst) {
+            worst = d;
+        }
+    }
+    return worst;
+}
+
+static bool check(const char *kernel, size_t size, int32_t diff, int32_t tolerance)
+{
+    if (diff > tolerance) {
+        ESP_LOGE(TAG, "Self-test: %s (%zu) differs by %ld LSB (tolerance %ld)",
+                 kernel, size, (long)diff, (long)tolerance);
+        return false;
+    }
+    return true;
+}
+
+// Reference FFT against a direct float DFT (scaled by 1/n like the FFT)
+static int32_t dft_error(const int16_t *input, const int16_t *output, size_t n)
+{
+    int32_t worst = 0;
+    for (size_t k = 0; k < n; k++) {
+        float re = 0.0f, im = 0.0f;
+        for (size_t t = 0; t < n; t++) {
+            float angle = -2.0f * (float)M_PI * (float)((k * t) % n) / (float)n;
+            float c = cosf(angle), s = sinf(angle);
+            re += input[2 * t] * c - input[2 * t + 1] * s;
+            im += input[2 * t] * s + input[2 * t + 1] * c;
+        }
+        int32_t dr = abs((int32_t)lrintf(re / (float)n) - output[2 * k]);
+        int32_t di = abs((int32_t)lrintf(im / (float)n) - output[2 * k + 1]);
+        worst = dr > worst ? dr : worst;
+        worst = di > worst ? di : worst;
+    }
+    return worst;
+}
+
+bool dsp_kernels_selftest(void)
+{
+    static const size_t dot_sizes[] = { 1, 7, 8, 31, 64 };
+    static const size_t fft_sizes[] = { 16, 256, DSP_FFT_MAX_POINTS };
+    const size_t buf_samples = DSP_FFT_MAX_POINTS * 2 + 2;
+
+    dsp_fft_init();
+
+    int16_t *a = heap_caps_aligned_alloc(DSP_ALIGN, buf_samples * sizeof(int16_t), DSP_BUFFER_CAPS);
+    int16_t *b = heap_caps_aligned_alloc(DSP_ALIGN, buf_samples * sizeof(int16_t), DSP_BUFFER_CAPS);
+    int16_t *c = heap_caps_aligned_alloc(DSP_ALIGN, buf_samples * sizeof(int16_t), DSP_BUFFER_CAPS);
+    if (!a || !b || !c) {
+        ESP_LOGW(TAG, "Self-test skipped: out of memory");
+        heap_caps_free(a);
+        heap_caps_free(b);
+        heap_caps_free(c);
+        return false;
+    }
+
+    uint32_t seed = SELFTEST_SEED;
+    bool ok = true;
+
+    // Q15 dot product: taps-sized weights against full-range data, so the result fits 16 bits
+    for (size_t i = 0; i < sizeof(dot_sizes) / sizeof(dot_sizes[0]); i++) {
+        size_t n = dot_sizes[i];
+        fill_random(a, n, 512, &seed);
+        fill_random(b, n, 16384, &seed);
+        int16_t expected = ref_dot_q15(a, b, n);
+        int16_t actual = dsp_dot_q15(a, b, n);
+        ok &= check("dot_q15", n, abs((int32_t)expected - actual), SELFTEST_DOT_TOLERANCE);
+    }
+
+    // FIR over two consecutive blocks so the history carries over
+    int16_t taps[SELFTEST_FIR_TAPS];
+    fill_random(taps, SELFTEST_FIR_TAPS, 1000, &seed);
+    dsp_fir_t fir_ref = { 0 }, fir_sel = { 0 };
+    if (dsp_fir_init(&fir_ref, taps, SELFTEST_FIR_TAPS, SELFTEST_FIR_BLOCK) &&
+        dsp_fir_init(&fir_sel, taps, SELFTEST_FIR_TAPS, SELFTEST_FIR_BLOCK)) {
+        fill_random(a, 2 * SELFTEST_FIR_BLOCK, 30000, &seed);
+        fir_run(&fir_ref, a, b, 2 * SELFTEST_FIR_BLOCK, ref_dot_q15);
+        dsp_fir_process(&fir_sel, a, c, SELFTEST_FIR_BLOCK);
+        dsp_fir_process(&fir_sel, a + SELFTEST_FIR_BLOCK, c + SELFTEST_FIR_BLOCK, SELFTEST_FIR_BLOCK);
+        ok &= check("fir_q15", SELFTEST_FIR_TAPS, max_abs_diff(b, c, 2 * SELFTEST_FIR_BLOCK), SELFTEST_DOT_TOLERANCE);
+    } else {
+        ESP_LOGW(TAG, "Self-test: FIR skipped (out of memory)");
+    }
+    dsp_fir_deinit(&fir_ref);
+    dsp_fir_deinit(&fir_sel);
+
+    // Taps with gain above 1.0 on full-scale input: outputs must saturate as in the reference
+    fill_random(taps, SELFTEST_FIR_TAPS, 8000, &seed);
+    if (dsp_fir_init(&fir_ref, taps, SELFTEST_FIR_TAPS, SELFTEST_FIR_BLOCK) &&
+        dsp_fir_init(&fir_sel, taps, SELFTEST_FIR_TAPS, SELFTEST_FIR_BLOCK)) {
+        fill_random(a, SELFTEST_FIR_BLOCK, 32767, &seed);
+        fir_run(&fir_ref, a, b, SELFTEST_FIR_BLOCK, ref_dot_q15);
+        dsp_fir_process(&fir_sel, a, c, SELFTEST_FIR_BLOCK);
+        ok &= check("fir_q15 saturating", SELFTEST_FIR_TAPS, max_abs_diff(b, c, SELFTEST_FIR_BLOCK), 0);
+    }
+    dsp_fir_deinit(&fir_ref);
+    dsp_fir_deinit(&fir_sel);
+
+    // Reference FFT is checked against the DFT once, the selected FFT against the reference
+    fill_random(a, 2 * 16, 8192, &seed);
+    memcpy(b, a, 2 * 16 * sizeof(int16_t));
+    ref_fft_s16(b, 16);
+    ok &= check("fft_s16 vs DFT", 16, dft_error(a, b, 16), SELFTEST_DFT_TOLERANCE);
+
+    for (size_t i = 0; i < sizeof(fft_sizes) / sizeof(fft_sizes[0]); i++) {
+        size_t n = fft_sizes[i];
+        fill_random(a, 2 * n, 8192, &seed);
+        memcpy(b, a, 2 * n * sizeof(int16_t));
+        memcpy(c, a, 2 * n * sizeof(int16_t));
+        ref_fft_s16(b, n);
+        dsp_fft_s16(c, n);
+        ok &= check("fft_s16", n, max_abs_diff(b, c, 2 * n), SELFTEST_FFT_TOLERANCE);
+
+        fill_random(a, n, 16384, &seed);
+        rfft_run(a, b, n, ref_fft_s16);
+        dsp_rfft_s16(a, c, n);
+        ok &= check("rfft_s16", n, max_abs_diff(b, c, n + 2), SELFTEST_FFT_TOLERANCE);
+    }
+
+    // Real FFT against the complex FFT of the same signal
+    fill_random(a, 32, 16384, &seed);
+    for (size_t i = 0; i < 32; i++) {
+        c[2 * i] = a[i];
+        c[2 * i + 1] = 0;
+    }
+    ref_fft_s16(c, 32);
+    rfft_run(a, b, 32, ref_fft_s16);
+    ok &= check("rfft_s16 vs fft_s16", 32, max_abs_diff(b, c, 32 + 2), SELFTEST_DFT_TOLERANCE);
+
+    heap_caps_free(a);
+    heap_caps_free(b);
+    heap_caps_free(c);
+
+    if (ok) {
+        ESP_LOGI(TAG, "Self-test passed (%s kernels)", dsp_kernels_variant());
+    } else if (DSP_USE_ESP_DSP) {
+        s_fallback = true;
+        ESP_LOGW(TAG, "Self-test failed, all kernels fall back to the reference code");
+    } else {
+        // The references themselves disagree with the float model: nothing to fall back to
+        ESP_LOGE(TAG, "Self-test failed in the reference kernels, no fallback available");
+    }
+    return ok;
+}
+
+// Benchmark fixtures: one set of buffers shared by every case
+static int16_t *s_bench_a;
+static int16_t *s_bench_b;
+static int16_t *s_bench_out;
+static int32_t *s_bench_s32;
+static dsp_fir_t s_bench_fir;
+static dsp_biquad_t s_bench_biquads[BENCH_BIQUAD_SECTIONS];
+static volatile int64_t s_bench_sink;  // Keeps results of pure kernels alive
+
+static void bench_fft_ref(size_t n)      { ref_fft_s16(s_bench_out, n); }
+static void bench_fft_sel(size_t n)      { dsp_fft_s16(s_bench_out, n); }
+static void bench_rfft_ref(size_t n)     { rfft_run(s_bench_a, s_bench_out, n, ref_fft_s16); }
+static void bench_rfft_sel(size_t n)     { dsp_rfft_s16(s_bench_a, s_bench_out, n); }
+static void bench_fir_ref(size_t n)      { fir_run(&s_bench_fir, s_bench_a, s_bench_out, n, ref_dot_q15); }
+static void bench_fir_sel(size_t n)      { dsp_fir_process(&s_bench_fir, s_bench_a, s_bench_out, n); }
+static void bench_dot_q15_ref(size_t n)  { s_bench_sink += ref_dot_q15(s_bench_a, s_bench_b, n); }
+static void bench_dot_q15_sel(size_t n)  { s_bench_sink += dsp_dot_q15(s_bench_a, s_bench_b, n); }
+static void bench_dot_s16(size_t n)      { s_bench_sink += dsp_dot_s16(s_bench_a, s_bench_b, n); }
+static void bench_energy(size_t n)       { s_bench_sink += (int64_t)dsp_energy_s16(s_bench_a, n); }
+static void bench_peak(size_t n)         { s_bench_sink += dsp_peak_s16(s_bench_a, n); }
+static void bench_mix(size_t n)          { dsp_mix_sat_s16(s_bench_out, s_bench_a, n, 16384); }
+static void bench_gain(size_t n)         { dsp_gain_sat_s16(s_bench_out, n, 3 << 15); }
+static void bench_biquads(size_t n)      { dsp_biquad_cascade_s32(s_bench_biquads, BENCH_BIQUAD_SECTIONS, s_bench_s32, n); }
+
+typedef struct {
+    const char *name;
+    size_t size;
+    void (*reference)(size_t n);
+    void (*selected)(size_t n);     // NULL: the reference is the only implementation
+} bench_case_t;
+
+// Sizes follow the audio stages: 16 ms capture frames, 40 ms playback blocks, analysis FFTs
+static const bench_case_t s_bench_cases[] = {
+    { "fft_s16",       256,                bench_fft_ref,     bench_fft_sel },
+    { "fft_s16",       DSP_FFT_MAX_POINTS, bench_fft_ref,     bench_fft_sel },
+    { "rfft_s16",      512,                bench_rfft_ref,    bench_rfft_sel },
+    { "fir_q15 x32",   256,                bench_fir_ref,     bench_fir_sel },
+    { "dot_q15",       256,                bench_dot_q15_ref, bench_dot_q15_sel },
+    { "dot_s16",       4800,               bench_dot_s16,     NULL },
+    { "energy_s16",    256,                bench_energy,      NULL },
+    { "peak_s16",      256,                bench_peak,        NULL },
+    { "mix_sat_s16",   960,                bench_mix,         NULL },
+    { "gain_sat_s16",  960,                bench_gain,        NULL },
+    { "biquad x6",     240,                bench_biquads,     NULL },
+};
+
+static uint32_t bench_cycles(void (*fn)(size_t n), size_t n)
+{
+    fn(n);  // Warm the cache
+    uint32_t start = esp_cpu_get_cycle_count();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        fn(n);
+    }
+    return (esp_cpu_get_cycle_count() - start) / BENCH_ITERATIONS;
+}
+
+void dsp_kernels_benchmark(void)
+{
+    int16_t taps[BENCH_FIR_TAPS];
+    uint32_t seed = SELFTEST_SEED;
+
+    dsp_fft_init();
+    s_bench_a = heap_caps_aligned_alloc(DSP_ALIGN, BENCH_BUFFER_SAMPLES * sizeof(int16_t), DSP_BUFFER_CAPS);
+    s_bench_b = heap_caps_aligned_alloc(DSP_ALIGN, BENCH_BUFFER_SAMPLES * sizeof(int16_t), DSP_BUFFER_CAPS);
+    s_bench_out = heap_caps_aligned_alloc(DSP_ALIGN, BENCH_BUFFER_SAMPLES * sizeof(int16_t), DSP_BUFFER_CAPS);
+    s_bench_s32 = heap_caps_aligned_alloc(DSP_ALIGN, BENCH_S32_SAMPLES * sizeof(int32_t), DSP_BUFFER_CAPS);
+    fill_random(taps, BENCH_FIR_TAPS, 1000, &seed);
+    bool fir_ok = dsp_fir_init(&s_bench_fir, taps, BENCH_FIR_TAPS, 256);
+
+    if (!s_bench_a || !s_bench_b || !s_bench_out || !s_bench_s32 || !fir_ok) {
+        ESP_LOGW(TAG, "Benchmark skipped: out of memory");
+        goto cleanup;
+    }
+
+    fill_random(s_bench_a, BENCH_BUFFER_SAMPLES, 16384, &seed);
+    fill_random(s_bench_b, BENCH_BUFFER_SAMPLES, 16384, &seed);
+    fill_random(s_bench_out, BENCH_BUFFER_SAMPLES, 16384, &seed);
+    for (size_t i = 0; i < BENCH_S32_SAMPLES; i++) {
+        s_bench_s32[i] = s_bench_a[i];
+    }
+    for (size_t i = 0; i < BENCH_BIQUAD_SECTIONS; i++) {
+        dsp_biquad_design(&s_bench_biquads[i], DSP_BIQUAD_PEAK, 24000, 500.0f * (i + 1), 1.0f, 3.0f);
+    }
+
+    ESP_LOGI(TAG, "Kernel benchmark (%s, %d MHz, %d iterations):", dsp_kernels_variant(),
+             CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ, BENCH_ITERATIONS);
+    ESP_LOGI(TAG, "  %-13s %5s %10s %10s %9s %8s", "kernel", "size", "ref cyc", "sel cyc", "cyc/smp", "speedup");
+
+    for (size_t i = 0; i < sizeof(s_bench_cases) / sizeof(s_bench_cases[0]); i++) {
+        const bench_case_t *bc = &s_bench_cases[i];
+        uint32_t ref = bench_cycles(bc->reference, bc->size);
+        uint32_t sel = bc->selected ? bench_cycles(bc->selected, bc->size) : ref;
+        ESP_LOGI(TAG, "  %-13s %5zu %10lu %10lu %9.2f %7.2fx", bc->name, bc->size, (unsigned long)ref,
+                 (unsigned long)sel, (float)sel / (float)bc->size, sel ? (float)ref / (float)sel : 0.0f);
+    }
+
+cleanup:
+    dsp_fir_deinit(&s_bench_fir);
+    heap_caps_free(s_bench_a);
+    heap_caps_free(s_bench_b);
+    heap_caps_free(s_bench_out);
+    heap_caps_free(s_bench_s32);
+    s_bench_a = s_bench_b = s_bench_out = NULL;
+    s_bench_s32 = NULL;
+}
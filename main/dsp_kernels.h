@@ -0,0 +1,192 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * @brief Shared fixed-point DSP kernels for the audio stages
+ *
+ * Every kernel has a portable C reference implementation. On ESP32-S3 builds
+ * the kernels for which esp-dsp has an assembly version with the same
+ * fixed-point semantics (complex FFT, Q15 dot product and therefore the FIR)
+ * are routed to esp-dsp; define DSP_KERNELS_FORCE_REFERENCE to build the
+ * reference code everywhere. The remaining kernels are plain C loops on every
+ * target.
+ *
+ * dsp_kernels_selftest() checks the selected kernels against the references on
+ * deterministic data and falls back to the references if any of them differ;
+ * dsp_kernels_benchmark() logs a per-kernel cycle table.
+ *
+ * Conventions: samples are int16 (or int32 where a stage needs headroom), gains
+ * and FIR taps are Q15, biquad coefficients are Q28, complex data is
+ * interleaved re/im.
+ */
+
+#define DSP_FFT_MAX_POINTS      1024    // Largest FFT (complex points or real samples)
+#define DSP_BIQUAD_SHIFT        28      // Q28 coefficients: range +/-8 covers shelf/peak gains
+
+static inline int16_t dsp_sat16(int32_t v)
+{
+    if (v > INT16_MAX) {
+        return INT16_MAX;
+    }
+    if (v < INT16_MIN) {
+        return INT16_MIN;
+    }
+    return (int16_t)v;
+}
+
+/**
+ * @brief Integer square root (floor)
+ */
+uint32_t dsp_isqrt64(uint64_t v);
+
+/**
+ * @brief Sum of squares, mean square, RMS and peak magnitude of a block
+ *
+ * dsp_mean_square_s16() and dsp_rms_s16() return 0 for an empty block;
+ * dsp_peak_s16() returns 32768 for a block containing INT16_MIN.
+ */
+uint64_t dsp_energy_s16(const int16_t *x, size_t n);
+uint32_t dsp_mean_square_s16(const int16_t *x, size_t n);
+uint32_t dsp_rms_s16(const int16_t *x, size_t n);
+uint32_t dsp_peak_s16(const int16_t *x, size_t n);
+
+/**
+ * @brief Exact dot product (64-bit accumulator, any length)
+ */
+int64_t dsp_dot_s16(const int16_t *a, const int16_t *b, size_t n);
+
+/**
+ * @brief Q15 dot product, rounded to 16 bits
+ *
+ * The result must fit in 16 bits. The reference saturates, but the esp-dsp
+ * version keeps the low 16 bits, so an out-of-range result differs between
+ * targets. Use dsp_dot_s16() when the range is not known.
+ */
+int16_t dsp_dot_q15(const int16_t *a, const int16_t *b, size_t n);
+
+/**
+ * @brief dst = saturate(dst + src * gain) with a Q15 gain
+ */
+void dsp_mix_sat_s16(int16_t *dst, const int16_t *src, size_t n, int16_t gain_q15);
+
+/**
+ * @brief buf = saturate(buf * gain) with a Q16 gain (up to +/-32768)
+ */
+void dsp_gain_sat_s16(int16_t *buf, size_t n, int32_t gain_q16);
+
+// Direct Form I biquad, a1/a2 stored negated so the MAC loop only adds
+typedef struct {
+    int32_t b0, b1, b2, na1, na2;
+    int32_t x1, x2, y1, y2;
+} dsp_biquad_t;
+
+typedef enum {
+    DSP_BIQUAD_LOWPASS,
+    DSP_BIQUAD_HIGHPASS,
+    DSP_BIQUAD_PEAK,
+    DSP_BIQUAD_LOW_SHELF,
+    DSP_BIQUAD_HIGH_SHELF,
+} dsp_biquad_type_t;
+
+/**
+ * @brief RBJ cookbook design, computed in float and stored as Q28 (clears the state)
+ *
+ * @param gain_db Used by the peak and shelf types only
+ */
+void dsp_biquad_design(dsp_biquad_t *bq, dsp_biquad_type_t type, uint32_t sample_rate_hz,
+                       float freq_hz, float q, float gain_db);
+
+static inline void dsp_biquad_clear(dsp_biquad_t *bq)
+{
+    bq->x1 = bq->x2 = bq->y1 = bq->y2 = 0;
+}
+
+/**
+ * @brief Run one biquad over a block of 32-bit samples (in == out is allowed)
+ */
+void dsp_biquad_process_s32(dsp_biquad_t *bq, const int32_t *in, int32_t *out, size_t n);
+
+/**
+ * @brief Run a cascade of biquads over a block in place, one section at a time
+ */
+void dsp_biquad_cascade_s32(dsp_biquad_t *sections, size_t num_sections, int32_t *buf, size_t n);
+
+/**
+ * @brief Block FIR with Q15 taps
+ *
+ * The delay line keeps the last num_taps - 1 inputs followed by the current
+ * block, so every output is one contiguous dot product with the reversed taps.
+ * Outputs saturate on every target: filters whose taps sum in magnitude to
+ * more than 1.0 always use the saturating reference dot product.
+ */
+typedef struct {
+    int16_t *rev_taps;      // Taps, last first
+    size_t num_taps;
+    int16_t *line;          // num_taps - 1 history samples + max_block inputs
+    size_t max_block;
+    bool bounded;           // Sum of |taps| <= 1.0: no output can overflow
+} dsp_fir_t;
+
+/**
+ * @brief Allocate the delay line (internal RAM) and copy the taps
+ *
+ * @return false on invalid arguments or out of memory
+ */
+bool dsp_fir_init(dsp_fir_t *fir, const int16_t *taps, size_t num_taps, size_t max_block);
+void dsp_fir_reset(dsp_fir_t *fir);
+void dsp_fir_deinit(dsp_fir_t *fir);
+
+/**
+ * @brief Filter a block (n <= max_block, in == out is allowed)
+ */
+void dsp_fir_process(dsp_fir_t *fir, const int16_t *in, int16_t *out, size_t n);
+
+/**
+ * @brief Build the FFT twiddle tables (called by dsp_kernels_selftest(), safe to repeat)
+ */
+bool dsp_fft_init(void);
+
+/**
+ * @brief In-place complex FFT
+ *
+ * @param data n complex points, interleaved re/im, natural order in and out
+ * @param n Power of two, 2..DSP_FFT_MAX_POINTS
+ *
+ * Every stage halves the data, so the output is the DFT scaled by 1/n.
+ */
+void dsp_fft_s16(int16_t *data, size_t n);
+
+/**
+ * @brief Real FFT through a half-size complex FFT
+ *
+ * @param in n real samples
+ * @param spectrum n + 2 values: bins 0..n/2, interleaved re/im, scaled by 1/n
+ * @param n Power of two, 4..DSP_FFT_MAX_POINTS
+ *
+ * in and spectrum may be the same buffer if it has room for n + 2 values.
+ */
+void dsp_rfft_s16(const int16_t *in, int16_t *spectrum, size_t n);
+
+/**
+ * @brief Compare the selected kernels with the reference implementations
+ *
+ * Any mismatch is logged. If esp-dsp kernels are selected, all kernels then
+ * fall back to the references; if the references themselves fail (against the
+ * float DFT), there is nothing to fall back to and it is logged as an error.
+ *
+ * @return true if every kernel matched
+ */
+bool dsp_kernels_selftest(void);
+
+/**
+ * @brief Log reference and selected cycle counts for every kernel
+ */
+void dsp_kernels_benchmark(void);
+
+/**
+ * @brief Name of the selected kernel set ("esp-dsp", "reference" or "reference (fallback)")
+ */
+const char *dsp_kernels_variant(void);
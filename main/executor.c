@@ -0,0 +1,346 @@
+#include "executor.h"
+#include "latency_hist.h"
+
+#include <stdio.h>
+
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#define EXECUTOR_CORES              2
+#define EXECUTOR_WORKERS_CORE0      2       // A probe's TCP connect cannot hold up a failover
+#define EXECUTOR_WORKERS_CORE1      1
+#define EXECUTOR_QUEUE_DEPTH        8       // Per core and priority
+#define EXECUTOR_MAX_FUTURES        4
+#define EXECUTOR_TASK_PRIORITY      4       // Below audio (5-6) and the UI (5)
+#define EXECUTOR_TASK_STACK         8192    // As WS_CLIENT_TASK_STACK: the same TLS send and app callbacks
+#define EXECUTOR_STACK_MARGIN       1024    // Warn when a job leaves less than this unused
+#define BENCH_ROUNDS                50
+#define BENCH_WAIT_MS               1000
+
+static const char *TAG = "executor";
+
+typedef struct {
+    executor_fn_t fn;
+    void *arg;
+    executor_done_cb_t done;
+    void *done_ctx;
+    executor_future_t *future;
+    uint32_t enqueued_us;
+} executor_job_t;
+
+struct executor_future {
+    SemaphoreHandle_t done;
+    esp_err_t result;
+    uint8_t refs;                   // Submitter and worker; back in the pool at zero
+    volatile bool finished;
+};
+
+typedef struct {
+    QueueHandle_t queues[EXECUTOR_PRIORITY_COUNT];
+    SemaphoreHandle_t pending;      // One count per queued job, across priorities
+} executor_core_t;
+
+static executor_core_t s_cores[EXECUTOR_CORES];
+static executor_future_t s_futures[EXECUTOR_MAX_FUTURES];
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static executor_stats_t s_stats;
+static bool s_started = false;
+
+static void put_future(executor_future_t *future)
+{
+    portENTER_CRITICAL(&s_lock);
+    future->refs--;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+static executor_future_t *get_future(void)
+{
+    executor_future_t *future = NULL;
+    portENTER_CRITICAL(&s_lock);
+    for (size_t i = 0; i < EXECUTOR_MAX_FUTURES; i++) {
+        if (s_futures[i].refs == 0) {
+            future = &s_futures[i];
+            future->refs = 2;
+            future->finished = false;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&s_lock);
+
+    if (future) {
+        xSemaphoreTake(future->done, 0);  // Left given by an earlier job nobody waited for
+    }
+    return future;
+}
+
+static void worker_task(void *arg)
+{
+    executor_core_t *core = arg;
+    UBaseType_t stack_free = EXECUTOR_TASK_STACK;
+
+    while (true) {
+        xSemaphoreTake(core->pending, portMAX_DELAY);
+
+        executor_job_t job;
+        bool got = false;
+        for (int p = 0; p < EXECUTOR_PRIORITY_COUNT && !got; p++) {
+            got = xQueueReceive(core->queues[p], &job, 0) == pdTRUE;
+        }
+        if (!got) {
+            continue;  // Another worker on this core took it
+        }
+
+        latency_hist_record_since(LATENCY_METRIC_EXECUTOR_QUEUE, job.enqueued_us);
+        int64_t start_us = esp_timer_get_time();
+        esp_err_t result = job.fn(job.arg);
+        int64_t busy_us = esp_timer_get_time() - start_us;
+
+        if (job.done) {
+            job.done(result, job.done_ctx);
+        }
+        if (job.future) {
+            job.future->result = result;
+            job.future->finished = true;
+            xSemaphoreGive(job.future->done);
+            put_future(job.future);
+        }
+
+        // The high-water mark only falls, so a drop belongs to the job just run
+        UBaseType_t now_free = uxTaskGetStackHighWaterMark(NULL);
+        if (now_free < stack_free) {
+            stack_free = now_free;
+            if (stack_free < EXECUTOR_STACK_MARGIN) {
+                ESP_LOGW(TAG, "Job %p left %u of %d stack bytes unused on %s", (void *)job.fn, (unsigned)stack_free,
+                         EXECUTOR_TASK_STACK, pcTaskGetName(NULL));
+            }
+        }
+
+        portENTER_CRITICAL(&s_lock);
+        s_stats.completed++;
+        s_stats.busy_us += busy_us;
+        if (stack_free < s_stats.min_stack_free) {
+            s_stats.min_stack_free = stack_free;
+        }
+        portEXIT_CRITICAL(&s_lock);
+    }
+}
+
+static bool enqueue(int core, executor_priority_t priority, const executor_job_t *job)
+{
+    if (!s_started || core < 0 || core >= EXECUTOR_CORES || priority >= EXECUTOR_PRIORITY_COUNT) {
+        ESP_LOGE(TAG, "Cannot queue job (core %d, priority %d)", core, (int)priority);
+        portENTER_CRITICAL(&s_lock);
+        s_stats.rejected++;
+        portEXIT_CRITICAL(&s_lock);
+        return false;
+    }
+
+    executor_core_t *c = &s_cores[core];
+    if (xQueueSend(c->queues[priority], job, 0) != pdTRUE) {
+        ESP_LOGW(TAG, "Core %d priority %d queue full, job dropped", core, (int)priority);
+        portENTER_CRITICAL(&s_lock);
+        s_stats.rejected++;
+        portEXIT_CRITICAL(&s_lock);
+        return false;
+    }
+    xSemaphoreGive(c->pending);
+
+    uint32_t queued = (uint32_t)uxSemaphoreGetCount(c->pending);
+    portENTER_CRITICAL(&s_lock);
+    s_stats.submitted++;
+    if (queued > s_stats.max_queued) {
+        s_stats.max_queued = queued;
+    }
+    portEXIT_CRITICAL(&s_lock);
+    return true;
+}
+
+void executor_init(void)
+{
+    if (s_started) {
+        return;
+    }
+
+    for (size_t i = 0; i < EXECUTOR_MAX_FUTURES; i++) {
+        s_futures[i].done = xSemaphoreCreateBinary();
+        if (!s_futures[i].done) {
+            ESP_LOGE(TAG, "Failed to create future semaphores");
+            return;
+        }
+    }
+
+    static const uint8_t workers[EXECUTOR_CORES] = { EXECUTOR_WORKERS_CORE0, EXECUTOR_WORKERS_CORE1 };
+    for (int core = 0; core < EXECUTOR_CORES; core++) {
+        executor_core_t *c = &s_cores[core];
+        for (int p = 0; p < EXECUTOR_PRIORITY_COUNT; p++) {
+            c->queues[p] = xQueueCreate(EXECUTOR_QUEUE_DEPTH, sizeof(executor_job_t));
+        }
+        c->pending = xSemaphoreCreateCounting(EXECUTOR_QUEUE_DEPTH * EXECUTOR_PRIORITY_COUNT, 0);
+        if (!c->queues[EXECUTOR_PRIORITY_HIGH] || !c->queues[EXECUTOR_PRIORITY_NORMAL] ||
+            !c->queues[EXECUTOR_PRIORITY_LOW] || !c->pending) {
+            ESP_LOGE(TAG, "Failed to create core %d queues", core);
+            return;
+        }
+
+        for (int w = 0; w < workers[core]; w++) {
+            char name[16];
+            snprintf(name, sizeof(name), "exec%d_%d", core, w);
+            if (xTaskCreatePinnedToCore(worker_task, name, EXECUTOR_TASK_STACK, c, EXECUTOR_TASK_PRIORITY, NULL,
+                                        core) != pdPASS) {
+                ESP_LOGE(TAG, "Failed to create worker %s", name);
+                return;
+            }
+        }
+    }
+
+    s_stats.min_stack_free = EXECUTOR_TASK_STACK;
+    s_started = true;
+    ESP_LOGI(TAG, "Executor started: %d + %d workers, %d jobs per queue", EXECUTOR_WORKERS_CORE0,
+             EXECUTOR_WORKERS_CORE1, EXECUTOR_QUEUE_DEPTH);
+}
+
+bool executor_submit(int core, executor_priority_t priority, executor_fn_t fn, void *arg,
+                     executor_done_cb_t done, void *done_ctx)
+{
+    const executor_job_t job = {
+        .fn = fn,
+        .arg = arg,
+        .done = done,
+        .done_ctx = done_ctx,
+        .enqueued_us = latency_hist_now_us(),
+    };
+    return fn && enqueue(core, priority, &job);
+}
+
+executor_future_t *executor_submit_future(int core, executor_priority_t priority, executor_fn_t fn, void *arg)
+{
+    executor_future_t *future = fn && s_started ? get_future() : NULL;
+    if (!future) {
+        ESP_LOGW(TAG, "No future available");
+        return NULL;
+    }
+
+    const executor_job_t job = {
+        .fn = fn,
+        .arg = arg,
+        .future = future,
+        .enqueued_us = latency_hist_now_us(),
+    };
+    if (!enqueue(core, priority, &job)) {
+        put_future(future);
+        put_future(future);
+        return NULL;
+    }
+    return future;
+}
+
+bool executor_future_wait(executor_future_t *future, uint32_t timeout_ms, esp_err_t *result)
+{
+    if (!future->finished && xSemaphoreTake(future->done, pdMS_TO_TICKS(timeout_ms)) != pdTRUE) {
+        return false;
+    }
+    if (result) {
+        *result = future->result;
+    }
+    return true;
+}
+
+void executor_future_release(executor_future_t *future)
+{
+    if (future) {
+        put_future(future);
+    }
+}
+
+bool executor_spawn(TaskFunction_t fn, const char *name, uint32_t stack_bytes, void *arg, UBaseType_t priority,
+                    TaskHandle_t *handle, BaseType_t core)
+{
+    if (xTaskCreatePinnedToCore(fn, name, stack_bytes, arg, priority, handle, core) != pdPASS) {
+        return false;
+    }
+    portENTER_CRITICAL(&s_lock);
+    s_stats.spawned++;
+    portEXIT_CRITICAL(&s_lock);
+    return true;
+}
+
+executor_stats_t executor_get_stats(void)
+{
+    portENTER_CRITICAL(&s_lock);
+    executor_stats_t stats = s_stats;
+    portEXIT_CRITICAL(&s_lock);
+    return stats;
+}
+
+void executor_log_stats(void)
+{
+    executor_stats_t stats = executor_get_stats();
+    latency_hist_snapshot_t wait;
+    latency_hist_snapshot_metric(LATENCY_METRIC_EXECUTOR_QUEUE, &wait, false);
+
+    ESP_LOGI(TAG, "%lu jobs run (%lu rejected, deepest queue %lu), workers busy %llu ms, %lu tasks spawned, "
+             "least worker stack unused %lu of %d bytes, queue wait p50 %lu us / p99 %lu us",
+             (unsigned long)stats.completed, (unsigned long)stats.rejected, (unsigned long)stats.max_queued,
+             (unsigned long long)(stats.busy_us / 1000), (unsigned long)stats.spawned,
+             (unsigned long)stats.min_stack_free, EXECUTOR_TASK_STACK,
+             (unsigned long)latency_hist_percentile(&wait, 50), (unsigned long)latency_hist_percentile(&wait, 99));
+}
+
+static esp_err_t bench_job(void *arg)
+{
+    (void)arg;
+    return ESP_OK;
+}
+
+static void bench_task(void *arg)
+{
+    xSemaphoreGive((SemaphoreHandle_t)arg);
+    vTaskDelete(NULL);
+}
+
+void executor_benchmark(void)
+{
+    SemaphoreHandle_t done = xSemaphoreCreateBinary();
+    if (!done || !s_started) {
+        ESP_LOGE(TAG, "Benchmark needs the executor running");
+        if (done) {
+            vSemaphoreDelete(done);
+        }
+        return;
+    }
+
+    // A spawn as the old code did it: create, run to completion, delete
+    size_t heap_before = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+    int64_t start_us = esp_timer_get_time();
+    for (int i = 0; i < BENCH_ROUNDS; i++) {
+        if (xTaskCreatePinnedToCore(bench_task, "bench_spawn", 4096, done, EXECUTOR_TASK_PRIORITY, NULL,
+                                    EXECUTOR_CORE_NETWORK) != pdPASS) {
+            break;
+        }
+        xSemaphoreTake(done, portMAX_DELAY);
+    }
+    int64_t spawn_us = esp_timer_get_time() - start_us;
+    vTaskDelay(pdMS_TO_TICKS(10));  // Idle task frees the deleted TCBs and stacks
+    size_t heap_after = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+
+    start_us = esp_timer_get_time();
+    for (int i = 0; i < BENCH_ROUNDS; i++) {
+        executor_future_t *future =
+            executor_submit_future(EXECUTOR_CORE_NETWORK, EXECUTOR_PRIORITY_NORMAL, bench_job, NULL);
+        if (!future) {
+            break;
+        }
+        executor_future_wait(future, BENCH_WAIT_MS, NULL);
+        executor_future_release(future);
+    }
+    int64_t exec_us = esp_timer_get_time() - start_us;
+    vSemaphoreDelete(done);
+
+    ESP_LOGI(TAG, "Round trip: task spawn %lld us, executor job %lld us (%d rounds; internal heap drift %d bytes)",
+             spawn_us / BENCH_ROUNDS, exec_us / BENCH_ROUNDS, BENCH_ROUNDS, (int)(heap_before - heap_after));
+}
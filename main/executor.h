@@ -0,0 +1,117 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/**
+ * @brief Shared worker executor for non-real-time async work
+ *
+ * A few worker tasks are created once at boot, pinned per core. Each core has
+ * one work queue per priority; its workers always take the highest-priority
+ * job first. Submitting a job copies a small descriptor into a queue. Nothing
+ * is allocated and no task is created, so one-off work (session negotiation,
+ * a barge-in flush, calibration, enrollment) no longer pays a task spawn and
+ * its heap churn.
+ *
+ * Completion is reported through an optional callback, run on the worker
+ * right after the job, or through a future the submitter can wait on.
+ * Futures come from a small fixed pool.
+ *
+ * A job holds its worker until it returns, and every job behind it waits. A
+ * job may block briefly on real work (a TCP connect, an NVS write, a bounded
+ * wait for an acknowledgement) but must not sleep-poll for something to
+ * happen: wait for it with a timer or an event and submit a job then.
+ * Real-time audio work does not belong here. Queue wait is recorded in the
+ * executor_queue latency histogram, and each worker's stack high-water mark is
+ * checked after every job.
+ *
+ * A task that is still needed after boot is created through executor_spawn(),
+ * so the stats would show it. Nothing in the app spawns one at present.
+ */
+
+#define EXECUTOR_CORE_NETWORK   0   // Alongside Wi-Fi and the WebSocket client
+#define EXECUTOR_CORE_AUDIO     1   // Alongside playback
+
+typedef enum {
+    EXECUTOR_PRIORITY_HIGH = 0,
+    EXECUTOR_PRIORITY_NORMAL,
+    EXECUTOR_PRIORITY_LOW,
+    EXECUTOR_PRIORITY_COUNT,
+} executor_priority_t;
+
+typedef esp_err_t (*executor_fn_t)(void *arg);
+
+/**
+ * @brief Called on the worker with the job's result
+ */
+typedef void (*executor_done_cb_t)(esp_err_t result, void *ctx);
+
+typedef struct executor_future executor_future_t;
+
+typedef struct {
+    uint32_t submitted;
+    uint32_t completed;
+    uint32_t rejected;              // Queue full or executor not started
+    uint32_t max_queued;            // Deepest any core's queues have been
+    uint64_t busy_us;               // Time workers spent running jobs
+    uint32_t spawned;               // Tasks created through executor_spawn() since boot
+    uint32_t min_stack_free;        // Least stack any worker had left after a job, bytes
+} executor_stats_t;
+
+/**
+ * @brief Create the queues, the future pool and the worker tasks
+ */
+void executor_init(void);
+
+/**
+ * @brief Queue a job
+ *
+ * @param core EXECUTOR_CORE_*
+ * @param done Called after the job (can be NULL)
+ * @return false if the queue is full (the job will not run and done is not called)
+ */
+bool executor_submit(int core, executor_priority_t priority, executor_fn_t fn, void *arg,
+                     executor_done_cb_t done, void *done_ctx);
+
+/**
+ * @brief Queue a job and get a future for its result
+ *
+ * @return NULL if the queue is full or no future is free
+ */
+executor_future_t *executor_submit_future(int core, executor_priority_t priority, executor_fn_t fn, void *arg);
+
+/**
+ * @brief Wait for a future's job to finish
+ *
+ * @param result The job's return value (can be NULL)
+ * @return false on timeout (the future stays valid)
+ */
+bool executor_future_wait(executor_future_t *future, uint32_t timeout_ms, esp_err_t *result);
+
+/**
+ * @brief Give a future back to the pool; the job may still be queued or running
+ */
+void executor_future_release(executor_future_t *future);
+
+/**
+ * @brief xTaskCreatePinnedToCore() for a task created after boot, counted in the stats
+ *
+ * @return true if the task was created
+ */
+bool executor_spawn(TaskFunction_t fn, const char *name, uint32_t stack_bytes, void *arg, UBaseType_t priority,
+                    TaskHandle_t *handle, BaseType_t core);
+
+executor_stats_t executor_get_stats(void);
+
+/**
+ * @brief Log job counts, worker load, spawn count, stack headroom and queue wait percentiles
+ */
+void executor_log_stats(void);
+
+/**
+ * @brief Log the cost of a task spawn against an executor round trip
+ */
+void executor_benchmark(void);
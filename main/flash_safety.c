@@ -0,0 +1,152 @@
+#include "flash_safety.h"
+#include "audio_controller.h"
+#include "audio_playback.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_memory_utils.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define STRESS_NAMESPACE        "flash_stress"
+#define STRESS_KEY              "blob"
+#define STRESS_BLOB_BYTES       512     // A few blobs per NVS page, so pages fill and get erased too
+#define STRESS_PERIOD_MS        20
+#define STRESS_REPORT_MS        5000
+#define STRESS_TASK_PRIORITY    3       // Below the audio tasks, like any other NVS writer
+
+static const char *TAG = "flash_safety";
+
+static TaskHandle_t s_stress_task = NULL;
+
+size_t flash_safety_verify(const char *owner, const flash_safety_entry_t *entries, size_t num_entries)
+{
+    size_t misplaced = 0;
+    size_t num_code = 0;
+
+    for (size_t i = 0; i < num_entries; i++) {
+        const flash_safety_entry_t *entry = &entries[i];
+        bool ok = entry->code ? esp_ptr_in_iram(entry->addr) : esp_ptr_internal(entry->addr);
+        if (entry->code) {
+            num_code++;
+        }
+        if (!ok) {
+            misplaced++;
+            ESP_LOGW(TAG, "%s: %s %s at %p is not in %s", owner, entry->code ? "function" : "buffer",
+                     entry->name, entry->addr, entry->code ? "IRAM" : "internal RAM");
+        }
+    }
+
+    if (misplaced == 0) {
+        ESP_LOGI(TAG, "%s: %u ISR functions in IRAM, %u buffers in internal RAM", owner,
+                 (unsigned)num_code, (unsigned)(num_entries - num_code));
+    }
+    return misplaced;
+}
+
+static void stress_task(void *arg)
+{
+    uint32_t duration_s = (uint32_t)(uintptr_t)arg;
+    nvs_handle_t nvs_handle;
+    uint8_t *blob = malloc(STRESS_BLOB_BYTES);
+
+    if (!blob || nvs_open(STRESS_NAMESPACE, NVS_READWRITE, &nvs_handle) != ESP_OK) {
+        ESP_LOGE(TAG, "Flash stress: cannot open NVS");
+        free(blob);
+        s_stress_task = NULL;
+        vTaskDelete(NULL);
+        return;
+    }
+
+    ESP_LOGW(TAG, "Flash stress: %u-byte NVS commit every %d ms for %lu s", STRESS_BLOB_BYTES,
+             STRESS_PERIOD_MS, (unsigned long)duration_s);
+
+    const uint32_t overruns_start = audio_get_capture_overruns();
+    const uint32_t underruns_start = audio_playback_get_underruns();
+    uint32_t overruns_report = overruns_start;
+    uint32_t underruns_report = underruns_start;
+    uint32_t commits = 0, failures = 0, window_commits = 0;
+    int64_t total_us = 0, max_us = 0, window_max_us = 0;
+    const int64_t start_us = esp_timer_get_time();
+    int64_t report_us = start_us;
+
+    while (esp_timer_get_time() - start_us < (int64_t)duration_s * 1000000) {
+        memset(blob, (int)commits, STRESS_BLOB_BYTES);
+
+        int64_t t0 = esp_timer_get_time();
+        esp_err_t err = nvs_set_blob(nvs_handle, STRESS_KEY, blob, STRESS_BLOB_BYTES);
+        if (err == ESP_OK) {
+            err = nvs_commit(nvs_handle);
+        }
+        int64_t now = esp_timer_get_time();
+
+        if (err != ESP_OK) {
+            failures++;
+        } else {
+            int64_t us = now - t0;
+            commits++;
+            window_commits++;
+            total_us += us;
+            if (us > max_us) {
+                max_us = us;
+            }
+            if (us > window_max_us) {
+                window_max_us = us;
+            }
+        }
+
+        if (now - report_us >= STRESS_REPORT_MS * 1000) {
+            uint32_t overruns = audio_get_capture_overruns();
+            uint32_t underruns = audio_playback_get_underruns();
+            ESP_LOGI(TAG, "Flash stress: %lu commits (max %lld us), capture overruns +%lu, playback underruns +%lu",
+                     (unsigned long)window_commits, window_max_us, (unsigned long)(overruns - overruns_report),
+                     (unsigned long)(underruns - underruns_report));
+            overruns_report = overruns;
+            underruns_report = underruns;
+            window_commits = 0;
+            window_max_us = 0;
+            report_us = now;
+        }
+
+        vTaskDelay(pdMS_TO_TICKS(STRESS_PERIOD_MS));
+    }
+
+    nvs_erase_all(nvs_handle);
+    nvs_commit(nvs_handle);
+    nvs_close(nvs_handle);
+    free(blob);
+
+    uint32_t overrun_glitches = audio_get_capture_overruns() - overruns_start;
+    uint32_t underrun_glitches = audio_playback_get_underruns() - underruns_start;
+    ESP_LOGI(TAG, "Flash stress done: %lu commits (%lu failed), mean %lld us, max %lld us",
+             (unsigned long)commits, (unsigned long)failures, commits ? total_us / commits : 0, max_us);
+    if (overrun_glitches || underrun_glitches) {
+        ESP_LOGW(TAG, "Flash stress glitches: %lu capture overruns, %lu playback underruns",
+                 (unsigned long)overrun_glitches, (unsigned long)underrun_glitches);
+    } else {
+        ESP_LOGI(TAG, "Flash stress glitches: none");
+    }
+
+    s_stress_task = NULL;
+    vTaskDelete(NULL);
+}
+
+bool flash_safety_stress_start(uint32_t duration_s)
+{
+    if (s_stress_task) {
+        ESP_LOGW(TAG, "Flash stress already running");
+        return false;
+    }
+
+    if (xTaskCreatePinnedToCore(stress_task, "flash_stress", 3072, (void *)(uintptr_t)duration_s,
+                                STRESS_TASK_PRIORITY, &s_stress_task, 0) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create flash stress task");
+        s_stress_task = NULL;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * @brief Placement checks and a flash-write stress test for the audio hot paths
+ *
+ * Flash writes (NVS commits, OTA, logging to flash) disable the cache on both
+ * cores for their duration. Only IRAM code and internal-RAM data are usable
+ * then; anything running from flash or touching PSRAM waits until the write
+ * finishes. Tasks are held off for the whole write, so task code gains nothing
+ * from IRAM and stays in flash. What keeps running is the I2S driver's ISR:
+ * its callbacks are IRAM_ATTR, call only IRAM-safe code and touch only
+ * internal RAM, and the DMA rings are sized to carry the streams meanwhile.
+ *
+ * Modules list those callbacks and the buffers they touch in a
+ * flash_safety_entry_t table and call flash_safety_verify() at init, so a
+ * placement regression (a missing IRAM_ATTR, a buffer that moved to PSRAM)
+ * shows up in the boot log.
+ */
+
+typedef struct {
+    const char *name;
+    const void *addr;
+    bool code;                      // true: must be in IRAM, false: must be in internal RAM
+} flash_safety_entry_t;
+
+#define FLASH_SAFETY_CODE(fn)       { #fn, (const void *)(fn), true }
+#define FLASH_SAFETY_DATA(buf)      { #buf, (const void *)(buf), false }
+
+/**
+ * @brief Check that every entry lives where it must and log the result
+ *
+ * @return Number of misplaced entries (0 if all are flash-safe)
+ */
+size_t flash_safety_verify(const char *owner, const flash_safety_entry_t *entries, size_t num_entries);
+
+/**
+ * @brief Hammer NVS with writes and commits for duration_s seconds (background task)
+ *
+ * Logs commit times and the capture overrun / playback underrun counters every
+ * few seconds; run it with a session streaming in both directions. Wears the
+ * flash, so it is for bench testing only.
+ *
+ * @return false if a stress run is already active or the task could not start
+ */
+bool flash_safety_stress_start(uint32_t duration_s);
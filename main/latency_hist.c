@@ -0,0 +1,191 @@
+#include "latency_hist.h"
+
+#include <string.h>
+
+#include "esp_cpu.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#define BENCH_RECORDS   1000
+
+static const char *TAG = "latency";
+
+// Recorded from any task without a lock: buckets and max are updated atomically
+static latency_hist_t s_metrics[LATENCY_METRIC_COUNT];
+
+// The same values again for telemetry, cleared only by latency_hist_take_window()
+static latency_hist_t s_windows[LATENCY_METRIC_COUNT];
+
+// Lifetime totals are only touched at session end (PSRAM, allocated on first use)
+static latency_hist_snapshot_t *s_lifetime = NULL;
+
+static const char *const s_metric_names[LATENCY_METRIC_COUNT] = {
+    [LATENCY_METRIC_CAPTURE_TO_SEND] = "capture_to_send",
+    [LATENCY_METRIC_SEND] = "send",
+    [LATENCY_METRIC_RTT] = "rtt",
+    [LATENCY_METRIC_FIRST_BYTE_TO_SAMPLE] = "first_byte_to_sample",
+    [LATENCY_METRIC_PREBUFFER_WAIT] = "prebuffer_wait",
+    [LATENCY_METRIC_TOUCH_TO_ACTION] = "touch_to_action",
+    [LATENCY_METRIC_EXECUTOR_QUEUE] = "executor_queue",
+    [LATENCY_METRIC_LINK_LOSS] = "link_loss",
+    [LATENCY_METRIC_UPLINK_BACKLOG] = "uplink_backlog",
+    [LATENCY_METRIC_CONTROL_RTT] = "control_rtt",
+};
+
+static inline uint32_t bucket_index(uint32_t us)
+{
+    if (us < LATENCY_HIST_SUB_BUCKETS) {
+        return us;
+    }
+    if (us >= (1u << LATENCY_HIST_MAX_BITS)) {
+        return LATENCY_HIST_BUCKETS - 1;
+    }
+    uint32_t msb = 31 - __builtin_clz(us);
+    return (msb - LATENCY_HIST_SUB_BITS + 1) * LATENCY_HIST_SUB_BUCKETS +
+           ((us >> (msb - LATENCY_HIST_SUB_BITS)) & (LATENCY_HIST_SUB_BUCKETS - 1));
+}
+
+static uint32_t bucket_midpoint(uint32_t index)
+{
+    if (index < LATENCY_HIST_SUB_BUCKETS) {
+        return index;
+    }
+    uint32_t shift = index / LATENCY_HIST_SUB_BUCKETS - 1;
+    uint32_t lower = (LATENCY_HIST_SUB_BUCKETS + index % LATENCY_HIST_SUB_BUCKETS) << shift;
+    return lower + ((1u << shift) >> 1);
+}
+
+uint32_t latency_hist_now_us(void)
+{
+    return (uint32_t)esp_timer_get_time();
+}
+
+void latency_hist_record(latency_hist_t *hist, uint32_t us)
+{
+    __atomic_fetch_add(&hist->counts[bucket_index(us)], 1, __ATOMIC_RELAXED);
+
+    uint32_t max = __atomic_load_n(&hist->max_us, __ATOMIC_RELAXED);
+    while (us > max &&
+           !__atomic_compare_exchange_n(&hist->max_us, &max, us, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+void latency_hist_record_metric(latency_metric_t metric, uint32_t us)
+{
+    latency_hist_record(&s_metrics[metric], us);
+    latency_hist_record(&s_windows[metric], us);
+}
+
+void latency_hist_record_since(latency_metric_t metric, uint32_t start_us)
+{
+    latency_hist_record_metric(metric, latency_hist_now_us() - start_us);
+}
+
+void latency_hist_snapshot(latency_hist_t *hist, latency_hist_snapshot_t *snap, bool reset)
+{
+    snap->total = 0;
+    for (size_t i = 0; i < LATENCY_HIST_BUCKETS; i++) {
+        snap->counts[i] = reset ? __atomic_exchange_n(&hist->counts[i], 0, __ATOMIC_RELAXED)
+                                : __atomic_load_n(&hist->counts[i], __ATOMIC_RELAXED);
+        snap->total += snap->counts[i];
+    }
+    snap->max_us = reset ? __atomic_exchange_n(&hist->max_us, 0, __ATOMIC_RELAXED)
+                         : __atomic_load_n(&hist->max_us, __ATOMIC_RELAXED);
+}
+
+void latency_hist_snapshot_metric(latency_metric_t metric, latency_hist_snapshot_t *snap, bool reset)
+{
+    latency_hist_snapshot(&s_metrics[metric], snap, reset);
+}
+
+void latency_hist_take_window(latency_metric_t metric, latency_hist_snapshot_t *snap)
+{
+    latency_hist_snapshot(&s_windows[metric], snap, true);
+}
+
+void latency_hist_merge(latency_hist_snapshot_t *dst, const latency_hist_snapshot_t *src)
+{
+    for (size_t i = 0; i < LATENCY_HIST_BUCKETS; i++) {
+        dst->counts[i] += src->counts[i];
+    }
+    dst->total += src->total;
+    if (src->max_us > dst->max_us) {
+        dst->max_us = src->max_us;
+    }
+}
+
+uint32_t latency_hist_percentile(const latency_hist_snapshot_t *snap, float pct)
+{
+    if (snap->total == 0) {
+        return 0;
+    }
+
+    // Rank of the percentile value, 1-based
+    uint32_t rank = (uint32_t)(snap->total * pct / 100.0f + 0.999f);
+    if (rank < 1) {
+        rank = 1;
+    }
+
+    uint32_t seen = 0;
+    for (size_t i = 0; i < LATENCY_HIST_BUCKETS; i++) {
+        seen += snap->counts[i];
+        if (seen >= rank) {
+            uint32_t value = bucket_midpoint(i);
+            return value < snap->max_us ? value : snap->max_us;
+        }
+    }
+    return snap->max_us;
+}
+
+const char *latency_hist_metric_name(latency_metric_t metric)
+{
+    return metric < LATENCY_METRIC_COUNT ? s_metric_names[metric] : "unknown";
+}
+
+void latency_hist_log_session(void)
+{
+    if (!s_lifetime) {
+        s_lifetime = heap_caps_calloc(LATENCY_METRIC_COUNT, sizeof(latency_hist_snapshot_t),
+                                      MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    }
+
+    latency_hist_snapshot_t session;
+    ESP_LOGI(TAG, "Session latency (p50 / p95 / p99 / max, ms):");
+    for (int m = 0; m < LATENCY_METRIC_COUNT; m++) {
+        latency_hist_snapshot(&s_metrics[m], &session, true);
+        if (s_lifetime) {
+            latency_hist_merge(&s_lifetime[m], &session);
+        }
+        if (session.total == 0) {
+            continue;
+        }
+
+        ESP_LOGI(TAG, "  %-20s %7.1f %7.1f %7.1f %7.1f  (n=%lu, lifetime p99 %.1f over %lu)",
+                 s_metric_names[m], latency_hist_percentile(&session, 50) / 1000.0f,
+                 latency_hist_percentile(&session, 95) / 1000.0f, latency_hist_percentile(&session, 99) / 1000.0f,
+                 session.max_us / 1000.0f, (unsigned long)session.total,
+                 s_lifetime ? latency_hist_percentile(&s_lifetime[m], 99) / 1000.0f : 0.0f,
+                 s_lifetime ? (unsigned long)s_lifetime[m].total : 0UL);
+    }
+}
+
+void latency_hist_benchmark(void)
+{
+    static latency_hist_t scratch;  // Static: too large for a small task stack
+    memset(&scratch, 0, sizeof(scratch));
+
+    uint32_t start = esp_cpu_get_cycle_count();
+    for (uint32_t i = 0; i < BENCH_RECORDS; i++) {
+        latency_hist_record(&scratch, i * 7919);  // Spread across buckets, the max grows every time
+    }
+    uint32_t cycles = esp_cpu_get_cycle_count() - start;
+
+    latency_hist_snapshot_t snap;
+    latency_hist_snapshot(&scratch, &snap, false);
+    ESP_LOGI(TAG, "latency_hist_record: %lu cycles per record (worst case, growing max); %u bytes per histogram",
+             (unsigned long)(cycles / BENCH_RECORDS), (unsigned)sizeof(latency_hist_t));
+    if (snap.total != BENCH_RECORDS) {
+        ESP_LOGE(TAG, "Benchmark recorded %lu of %d values", (unsigned long)snap.total, BENCH_RECORDS);
+    }
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Fixed-memory, log-bucketed latency histograms
+ *
+ * Each power of two of microseconds is split into 8 linear sub-buckets, so a
+ * recorded value is known to within 12.5%, from 1 us up to 67 s (larger
+ * values land in the top bucket). A histogram is 772 bytes whatever it
+ * records.
+ *
+ * Recording is a count-leading-zeros, a shift and an atomic add (plus a
+ * compare-and-swap when the maximum grows). It takes no lock, so any task can
+ * record into any histogram. It is not for ISRs: it runs from flash, like the
+ * tasks that call it. Readers take a snapshot. Snapshots merge by adding counts, so
+ * per-session snapshots can be summed into lifetime totals.
+ */
+
+#define LATENCY_HIST_SUB_BITS       3
+#define LATENCY_HIST_SUB_BUCKETS    (1 << LATENCY_HIST_SUB_BITS)
+#define LATENCY_HIST_MAX_BITS       26      // Values from 2^26 us (67 s) up share the top bucket
+#define LATENCY_HIST_BUCKETS        ((LATENCY_HIST_MAX_BITS - LATENCY_HIST_SUB_BITS + 1) * LATENCY_HIST_SUB_BUCKETS)
+
+typedef struct {
+    uint32_t counts[LATENCY_HIST_BUCKETS];  // Updated with atomic adds
+    uint32_t max_us;
+} latency_hist_t;
+
+typedef struct {
+    uint32_t counts[LATENCY_HIST_BUCKETS];
+    uint32_t total;
+    uint32_t max_us;
+} latency_hist_snapshot_t;
+
+/**
+ * @brief Pipeline intervals tracked by the shared histograms
+ */
+typedef enum {
+    LATENCY_METRIC_CAPTURE_TO_SEND = 0, // Age of an uplink chunk's first sample when it is handed to the sender
+    LATENCY_METRIC_SEND,                // One WebSocket binary send (encode and socket write)
+    LATENCY_METRIC_RTT,                 // WebSocket round trip (hello/ack, timestamped ping/pong)
+    LATENCY_METRIC_FIRST_BYTE_TO_SAMPLE,// Downlink audio after a gap: first byte received → first sample to I2S
+    LATENCY_METRIC_PREBUFFER_WAIT,      // First downlink byte of a stream → pre-buffer full
+    LATENCY_METRIC_TOUCH_TO_ACTION,     // Tap to start → first live microphone chunk sent
+    LATENCY_METRIC_EXECUTOR_QUEUE,      // Job queued on the executor → a worker starts it
+    LATENCY_METRIC_LINK_LOSS,           // Last frame received → link declared dead
+    LATENCY_METRIC_UPLINK_BACKLOG,      // Oldest unsent uplink audio when a backlog peaks (once per backlog)
+    LATENCY_METRIC_CONTROL_RTT,         // control_ping → control_pong, over the path control messages take
+    LATENCY_METRIC_COUNT,
+} latency_metric_t;
+
+/**
+ * @brief Current time for latency stamps (microseconds, wraps every 71 minutes)
+ *
+ * Differences of two stamps stay correct across the wrap.
+ */
+uint32_t latency_hist_now_us(void);
+
+/**
+ * @brief Record one value (microseconds); safe from any task, lock-free
+ */
+void latency_hist_record(latency_hist_t *hist, uint32_t us);
+
+/**
+ * @brief Record into one of the shared pipeline histograms
+ */
+void latency_hist_record_metric(latency_metric_t metric, uint32_t us);
+
+/**
+ * @brief Record the time elapsed since a latency_hist_now_us() stamp
+ */
+void latency_hist_record_since(latency_metric_t metric, uint32_t start_us);
+
+/**
+ * @brief Copy a histogram's counts
+ *
+ * @param reset Also clear the histogram; values recorded meanwhile land in either the snapshot or the histogram
+ */
+void latency_hist_snapshot(latency_hist_t *hist, latency_hist_snapshot_t *snap, bool reset);
+
+/**
+ * @brief Snapshot one of the shared pipeline histograms
+ */
+void latency_hist_snapshot_metric(latency_metric_t metric, latency_hist_snapshot_t *snap, bool reset);
+
+/**
+ * @brief Take and clear a metric's telemetry window
+ *
+ * Every metric is also recorded into a second histogram that only this call
+ * reads, so the session log and benchmarks clearing the shared histograms do
+ * not lose counts from the window, and its maximum is the window's own.
+ */
+void latency_hist_take_window(latency_metric_t metric, latency_hist_snapshot_t *snap);
+
+/**
+ * @brief Add src's counts into dst
+ */
+void latency_hist_merge(latency_hist_snapshot_t *dst, const latency_hist_snapshot_t *src);
+
+/**
+ * @brief Value below which pct percent of the recorded values fall
+ *
+ * @param pct Percentile, 0-100 (e.g. 50, 95, 99)
+ * @return Midpoint of the bucket holding the percentile, microseconds (0 if empty)
+ */
+uint32_t latency_hist_percentile(const latency_hist_snapshot_t *snap, float pct);
+
+/**
+ * @brief Short name of a metric ("capture_to_send", "send", ...)
+ */
+const char *latency_hist_metric_name(latency_metric_t metric);
+
+/**
+ * @brief Log p50/p95/p99/max for every metric recorded since the last session log
+ *
+ * Folds the session into lifetime totals, which are logged alongside. Call it
+ * when a session ends.
+ */
+void latency_hist_log_session(void);
+
+/**
+ * @brief Log the cost of one record in CPU cycles
+ */
+void latency_hist_benchmark(void);
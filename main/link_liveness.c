@@ -0,0 +1,54 @@
+#include "link_liveness.h"
+
+void link_liveness_reset(link_liveness_t *live, uint32_t window_us, uint32_t now_us)
+{
+    live->window_us = window_us;
+    live->last_rx_us = now_us;
+    live->paused_us = 0;
+    live->blocked_since_us = now_us;
+    // sends_blocked is left alone: a send can outlive the connection it started on
+}
+
+void link_liveness_rx(link_liveness_t *live, uint32_t now_us)
+{
+    live->last_rx_us = now_us;
+    live->paused_us = 0;
+    if (live->sends_blocked > 0) {
+        live->blocked_since_us = now_us;  // Only blocked time after this frame counts
+    }
+}
+
+void link_liveness_send_begin(link_liveness_t *live, uint32_t now_us)
+{
+    if (live->sends_blocked++ == 0) {
+        live->blocked_since_us = now_us;
+    }
+}
+
+void link_liveness_send_end(link_liveness_t *live, uint32_t now_us)
+{
+    if (live->sends_blocked == 0) {
+        return;
+    }
+    if (--live->sends_blocked == 0) {
+        live->paused_us += now_us - live->blocked_since_us;
+    }
+}
+
+uint32_t link_liveness_silent_us(const link_liveness_t *live, uint32_t now_us)
+{
+    uint32_t silent = now_us - live->last_rx_us;
+    uint32_t paused = live->paused_us;
+    if (live->sends_blocked > 0) {
+        paused += now_us - live->blocked_since_us;
+    }
+    if (paused > live->window_us) {
+        paused = live->window_us;  // A send blocked this long is itself a sign of a dead path
+    }
+    return silent > paused ? silent - paused : 0;
+}
+
+bool link_liveness_dead(const link_liveness_t *live, uint32_t now_us)
+{
+    return link_liveness_silent_us(live, now_us) > live->window_us;
+}
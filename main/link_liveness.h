@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief Heartbeat miss clock for the WebSocket link
+ *
+ * Only frames received from the proxy show the link is alive. The clock runs
+ * from the last one, with one exception: while a send holds the client, the
+ * client reads nothing, so frames that did arrive sit unread. That blocked
+ * time is subtracted from the silence, but at most one full window of it. A
+ * dead path also blocks sends once the TCP window fills, so back-to-back
+ * blocked sends still get the link declared dead, within two windows of the
+ * last frame.
+ *
+ * Plain C with no ESP-IDF dependency: websocket_client.c runs it under its own
+ * lock, and tools/heartbeat_check.c drives it through the net_impair shim on
+ * the host. Times are microseconds on a wrapping 32-bit clock.
+ */
+
+typedef struct {
+    uint32_t window_us;             // Heartbeat period × misses
+    uint32_t last_rx_us;
+    uint32_t paused_us;             // Finished blocked sends since last_rx_us
+    uint32_t blocked_since_us;      // While sends_blocked > 0
+    uint32_t sends_blocked;         // Sends in progress
+} link_liveness_t;
+
+/**
+ * @brief Start the clock on a new connection
+ */
+void link_liveness_reset(link_liveness_t *live, uint32_t window_us, uint32_t now_us);
+
+/**
+ * @brief A frame arrived from the proxy
+ */
+void link_liveness_rx(link_liveness_t *live, uint32_t now_us);
+
+/**
+ * @brief A send starts holding the client; pair with link_liveness_send_end()
+ */
+void link_liveness_send_begin(link_liveness_t *live, uint32_t now_us);
+void link_liveness_send_end(link_liveness_t *live, uint32_t now_us);
+
+/**
+ * @brief Silence that counts as missed heartbeats: since the last frame, less the forgiven blocked time
+ */
+uint32_t link_liveness_silent_us(const link_liveness_t *live, uint32_t now_us);
+
+/**
+ * @brief Whether the counted silence exceeds the window
+ */
+bool link_liveness_dead(const link_liveness_t *live, uint32_t now_us);
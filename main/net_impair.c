@@ -0,0 +1,178 @@
+#include "net_impair.h"
+
+#include <string.h>
+
+#define DEFAULT_SEED        1
+#define DOWNLINK_SEED_SALT  0x9E3779B9u
+
+typedef struct {
+    const char *name;
+    net_impair_profile_t profile;
+} preset_t;
+
+static const preset_t s_presets[] = {
+    { "wifi_fair", { .delay_ms = 20, .jitter_ms = 20, .loss_permille = 5, .burst_frames = 2 } },
+    { "wifi_poor", { .delay_ms = 60, .jitter_ms = 80, .rate_kbps = 256, .loss_permille = 20, .burst_frames = 4 } },
+    { "cellular", { .delay_ms = 120, .jitter_ms = 60, .rate_kbps = 128, .loss_permille = 10, .burst_frames = 3 } },
+    { "flaky", { .delay_ms = 40, .jitter_ms = 40, .outage_every_ms = 30000, .outage_ms = 3000 } },
+};
+
+// xorshift32; tools/stand_in_proxy.py has the same generator
+static uint32_t next_random(uint32_t *state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+static bool parse_number(const char *text, size_t len, uint32_t *value)
+{
+    if (len == 0 || len > 10) {
+        return false;
+    }
+    uint64_t v = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (text[i] < '0' || text[i] > '9') {
+            return false;
+        }
+        v = v * 10 + (uint64_t)(text[i] - '0');
+    }
+    if (v > UINT32_MAX) {
+        return false;
+    }
+    *value = (uint32_t)v;
+    return true;
+}
+
+static bool apply_token(const char *token, size_t len, net_impair_profile_t *p)
+{
+    const char *eq = memchr(token, '=', len);
+    if (!eq) {
+        for (size_t i = 0; i < sizeof(s_presets) / sizeof(s_presets[0]); i++) {
+            if (strlen(s_presets[i].name) == len && memcmp(s_presets[i].name, token, len) == 0) {
+                uint32_t seed = p->seed;
+                *p = s_presets[i].profile;
+                p->seed = seed;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    size_t key_len = (size_t)(eq - token);
+    const char *value = eq + 1;
+    size_t value_len = len - key_len - 1;
+    uint32_t v = 0;
+
+    if (key_len == 6 && memcmp(token, "outage", 6) == 0) {
+        const char *slash = memchr(value, '/', value_len);
+        uint32_t every = 0;
+        uint32_t length = 0;
+        if (!slash || !parse_number(value, (size_t)(slash - value), &every) ||
+            !parse_number(slash + 1, value_len - (size_t)(slash - value) - 1, &length) || length >= every) {
+            return false;
+        }
+        p->outage_every_ms = every;
+        p->outage_ms = length;
+        return true;
+    }
+    if (!parse_number(value, value_len, &v)) {
+        return false;
+    }
+
+    if (key_len == 5 && memcmp(token, "delay", 5) == 0 && v <= UINT16_MAX) {
+        p->delay_ms = (uint16_t)v;
+    } else if (key_len == 6 && memcmp(token, "jitter", 6) == 0 && v <= UINT16_MAX) {
+        p->jitter_ms = (uint16_t)v;
+    } else if (key_len == 4 && memcmp(token, "rate", 4) == 0) {
+        p->rate_kbps = v;
+    } else if (key_len == 4 && memcmp(token, "loss", 4) == 0 && v <= 1000) {
+        p->loss_permille = (uint16_t)v;
+    } else if (key_len == 5 && memcmp(token, "burst", 5) == 0 && v >= 1 && v <= UINT8_MAX) {
+        p->burst_frames = (uint8_t)v;
+    } else if (key_len == 4 && memcmp(token, "seed", 4) == 0) {
+        p->seed = v;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool net_impair_parse(const char *text, net_impair_profile_t *profile)
+{
+    net_impair_profile_t p = { .seed = DEFAULT_SEED };
+
+    while (text && *text) {
+        const char *end = strchr(text, ',');
+        size_t len = end ? (size_t)(end - text) : strlen(text);
+        if (len > 0 && !apply_token(text, len, &p)) {
+            return false;
+        }
+        text = end ? end + 1 : NULL;
+    }
+    if (p.loss_permille > 0 && p.burst_frames == 0) {
+        p.burst_frames = 1;
+    }
+    *profile = p;
+    return true;
+}
+
+void net_impair_init(net_impair_t *imp, const net_impair_profile_t *profile, net_impair_direction_t direction)
+{
+    memset(imp, 0, sizeof(*imp));
+    imp->profile = *profile;
+    imp->rng = profile->seed ^ (direction == NET_IMPAIR_DOWNLINK ? DOWNLINK_SEED_SALT : 0);
+    if (imp->rng == 0) {
+        imp->rng = DEFAULT_SEED;
+    }
+}
+
+net_impair_verdict_t net_impair_frame(net_impair_t *imp, size_t bytes, uint32_t now_ms)
+{
+    const net_impair_profile_t *p = &imp->profile;
+    net_impair_verdict_t verdict = { 0 };
+
+    // Exactly two draws per frame, so the sequence only depends on the frame count
+    uint32_t loss_draw = next_random(&imp->rng);
+    uint32_t jitter_draw = next_random(&imp->rng);
+    imp->frames++;
+
+    if (imp->in_burst) {
+        // Each further frame ends the burst with chance 1/burst: bursts average burst_frames
+        imp->in_burst = loss_draw % p->burst_frames != 0;
+        verdict.drop = imp->in_burst;
+    } else if (p->loss_permille > 0 && loss_draw % 1000 < p->loss_permille) {
+        imp->in_burst = p->burst_frames > 1;
+        verdict.drop = true;
+    }
+    if (verdict.drop) {
+        imp->dropped++;
+        return verdict;
+    }
+
+    // A capped link sends one frame at a time: wait for the previous one, then serialise
+    uint32_t depart_ms = now_ms;
+    if (p->rate_kbps > 0) {
+        if ((int32_t)(imp->link_free_ms - now_ms) > 0) {
+            depart_ms = imp->link_free_ms;
+        }
+        depart_ms += (uint32_t)((uint64_t)bytes * 8 / p->rate_kbps);
+        imp->link_free_ms = depart_ms;
+    }
+
+    verdict.delay_ms = depart_ms - now_ms + p->delay_ms;
+    if (p->jitter_ms > 0) {
+        verdict.delay_ms += jitter_draw % (p->jitter_ms + 1u);
+    }
+    imp->delay_ms_total += verdict.delay_ms;
+    return verdict;
+}
+
+bool net_impair_outage(const net_impair_profile_t *profile, uint32_t now_ms)
+{
+    return profile->outage_every_ms > 0 && now_ms >= profile->outage_every_ms &&
+           now_ms % profile->outage_every_ms < profile->outage_ms;
+}
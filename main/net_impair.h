@@ -0,0 +1,93 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Deterministic network impairment for bench tests
+ *
+ * Decides, frame by frame, what a bad network would do to a WebSocket message:
+ * added latency and jitter, a bandwidth cap, burst loss (Gilbert model: a good
+ * and a lossy state), and scheduled outages where nothing gets through. The
+ * random draws depend only on the seed and the frame count, never on timing,
+ * so the same profile and seed replay the same loss and jitter sequence.
+ *
+ * Plain C with no ESP-IDF dependency: websocket_client.c applies it on the
+ * device, tools/net_impair_trace.c runs it on the host, and
+ * tools/stand_in_proxy.py implements the same generator (--impair).
+ *
+ * Profile text is a preset name and/or comma-separated overrides:
+ *   "wifi_poor"
+ *   "wifi_poor,seed=9"
+ *   "delay=80,jitter=40,rate=256,loss=20,burst=4,outage=30000/2000,seed=7"
+ *
+ *   delay    ms added to every frame
+ *   jitter   up to this many ms more, uniform
+ *   rate     bandwidth cap, kbit/s (0: none)
+ *   loss     chance per mille that a frame starts a loss burst
+ *   burst    mean burst length, frames
+ *   outage   EVERY/LENGTH ms: a blackhole of LENGTH ms every EVERY ms
+ *   seed     generator seed
+ */
+
+typedef struct {
+    uint32_t seed;
+    uint16_t delay_ms;
+    uint16_t jitter_ms;
+    uint32_t rate_kbps;
+    uint16_t loss_permille;
+    uint8_t burst_frames;
+    uint32_t outage_every_ms;
+    uint32_t outage_ms;
+} net_impair_profile_t;
+
+typedef enum {
+    NET_IMPAIR_UPLINK = 0,
+    NET_IMPAIR_DOWNLINK,
+} net_impair_direction_t;
+
+/**
+ * @brief Impairment state for one direction of one connection
+ */
+typedef struct {
+    net_impair_profile_t profile;
+    uint32_t rng;
+    bool in_burst;
+    uint32_t link_free_ms;          // When the capped link finishes the previous frame
+    uint32_t frames;
+    uint32_t dropped;
+    uint64_t delay_ms_total;
+} net_impair_t;
+
+typedef struct {
+    bool drop;
+    uint32_t delay_ms;              // Hold the frame this long before it goes on
+} net_impair_verdict_t;
+
+/**
+ * @brief Parse profile text
+ *
+ * @return false on an unknown preset or key (profile untouched)
+ */
+bool net_impair_parse(const char *text, net_impair_profile_t *profile);
+
+/**
+ * @brief Start a direction; each direction draws its own sequence from the seed
+ */
+void net_impair_init(net_impair_t *imp, const net_impair_profile_t *profile, net_impair_direction_t direction);
+
+/**
+ * @brief Decide the fate of one frame
+ *
+ * @param bytes Frame size, for the bandwidth cap
+ * @param now_ms Time since the connection started
+ */
+net_impair_verdict_t net_impair_frame(net_impair_t *imp, size_t bytes, uint32_t now_ms);
+
+/**
+ * @brief Whether a scheduled outage is in progress
+ *
+ * @param now_ms Time since the connection started
+ */
+bool net_impair_outage(const net_impair_profile_t *profile, uint32_t now_ms);
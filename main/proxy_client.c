@@ -5,21 +5,31 @@
 #include <string.h>
 
 #include "audio_playback.h"
-#include "esp_heap_caps.h"
+#include "deep_sleep.h"
+#include "executor.h"
 #include "esp_log.h"
 #include "esp_random.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "nvs_flash.h"
 #include "nvs.h"
 
+#include "proxy_endpoints.h"
 #include "smart_assistant.h"
 #include "websocket_client.h"
 #include "wifi_credentials.h"
 
 static const char *TAG = "proxy_client";
 
-#define PROXY_DEFAULT_URL   WEBSOCKET_URL
+// Comma-separated list in wifi_credentials.h, or the single WEBSOCKET_URL
+#ifdef WEBSOCKET_URLS
+#define PROXY_DEFAULT_URLS  WEBSOCKET_URLS
+#else
+#define PROXY_DEFAULT_URLS  WEBSOCKET_URL
+#endif
+
+#define PROXY_PROBE_INTERVAL_MS     10000   // Background RTT probe rounds (two or more endpoints only)
 
 #define PROXY_DEFAULT_TOKEN "498b1b65-26a3-49e8-a55e-46a0b47365e2"
 
@@ -28,14 +38,14 @@ static const char *TAG = "proxy_client";
 #define NVS_SESSION_ID_KEY  "session_id"
 
 typedef struct {
-    char url[128];
+    char urls[PROXY_MAX_ENDPOINTS * PROXY_URL_MAX];
     char token[64];
     char session_id[32];  // Persistent session ID
     bool session_id_loaded;
 } proxy_config_t;
 
 static proxy_config_t s_config = {
-    .url = PROXY_DEFAULT_URL,
+    .urls = PROXY_DEFAULT_URLS,
     .token = PROXY_DEFAULT_TOKEN,
     .session_id = {0},
     .session_id_loaded = false,
@@ -43,32 +53,32 @@ static proxy_config_t s_config = {
 
 // WebSocket state for receiving audio
 static bool s_ws_connected = false;
-static bool s_ws_receiving_audio = false;
-static size_t s_received_audio_bytes = 0;
+
+// Endpoint selection and failover
+static int s_endpoint = 0;
+static uint32_t s_tried_mask = 0;              // Endpoints that failed since the last good session
+static bool s_attempt_active = false;          // A connect is under way or a session is up
+static volatile bool s_failover_pending = false;
+static volatile bool s_link_up = true;
+static esp_timer_handle_t s_probe_timer = NULL;
+static volatile bool s_probe_running = false;
 
 // User callbacks
 static proxy_ws_state_cb_t s_user_ws_state_cb = NULL;
 static proxy_audio_received_cb_t s_user_audio_cb = NULL;
 static void *s_user_ctx = NULL;
 
-static void *proxy_alloc(size_t size)
+static void load_or_create_session_id(void)
 {
-    void *ptr = heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-    if (!ptr) {
-        ptr = heap_caps_malloc(size, MALLOC_CAP_8BIT);
+    // A wake from deep sleep kept the id in RTC memory
+    const char *retained = deep_sleep_session_id();
+    if (retained) {
+        snprintf(s_config.session_id, sizeof(s_config.session_id), "%s", retained);
+        s_config.session_id_loaded = true;
+        ESP_LOGI(TAG, "Retained session ID: %s", s_config.session_id);
+        return;
     }
-    return ptr;
-}
 
-static void proxy_free(void *ptr)
-{
-    if (ptr) {
-        heap_caps_free(ptr);
-    }
-}
-
-static void load_or_create_session_id(void)
-{
     nvs_handle_t nvs_handle;
     esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
     if (err != ESP_OK) {
@@ -127,6 +137,72 @@ static void ws_audio_received_handler(const uint8_t *data, size_t len, void *use
     }
 }
 
+static void use_endpoint(int index)
+{
+    s_endpoint = index;
+    ws_client_set_uri(proxy_endpoints_url(index));
+}
+
+static esp_err_t failover_job(void *arg)
+{
+    (void)arg;
+    s_failover_pending = false;
+    s_attempt_active = true;
+    ws_client_set_session(proxy_get_session_id(), true);
+
+    esp_err_t err = ws_client_connect();
+    if (err != ESP_OK) {
+        s_attempt_active = false;
+        if (s_user_ws_state_cb) {
+            s_user_ws_state_cb(false, 0, s_user_ctx);
+        }
+    }
+    return err;
+}
+
+/**
+ * @brief Move a failed connection to the next endpoint
+ *
+ * Called with the first disconnect report of an attempt. Normal closures and
+ * Wi-Fi losses stay on the same endpoint. After a link loss the WebSocket
+ * client reconnects by itself (to the URI set here); any other failure
+ * reconnects from a network worker, which the WebSocket client holds back
+ * until the failed connection has closed.
+ *
+ * @return true if another endpoint takes over
+ */
+static bool start_failover(uint16_t close_code)
+{
+    if (close_code == 1000 || !s_link_up) {
+        return false;
+    }
+    proxy_endpoints_report_session(s_endpoint, false);
+    if (proxy_endpoints_count() < 2) {
+        return false;
+    }
+
+    s_tried_mask |= 1u << s_endpoint;
+    int next = proxy_endpoints_select(s_tried_mask, true);
+    if (next < 0) {
+        ESP_LOGE(TAG, "All %d proxy endpoints failed", proxy_endpoints_count());
+        s_tried_mask = 0;
+        return false;
+    }
+    use_endpoint(next);
+    ws_client_set_session(proxy_get_session_id(), true);
+    if (close_code == WS_CLOSE_LINK_LOST) {
+        return true;
+    }
+
+    s_failover_pending = true;
+    if (!executor_submit(EXECUTOR_CORE_NETWORK, EXECUTOR_PRIORITY_HIGH, failover_job, NULL, NULL, NULL)) {
+        ESP_LOGE(TAG, "Failed to queue failover");
+        s_failover_pending = false;
+        return false;
+    }
+    return true;
+}
+
 static void ws_state_change_handler(bool connected, uint16_t close_code, void *user_ctx)
 {
     (void)user_ctx;
@@ -134,9 +210,23 @@ static void ws_state_change_handler(bool connected, uint16_t close_code, void *u
     s_ws_connected = connected;
     if (connected) {
         ESP_LOGI(TAG, "WebSocket connected to proxy");
+        s_attempt_active = true;
+        s_tried_mask = 0;
+        proxy_endpoints_report_session(s_endpoint, true);
     } else {
         ESP_LOGW(TAG, "WebSocket disconnected from proxy (code=%d)", close_code);
-        s_ws_receiving_audio = false;
+
+        if (s_attempt_active) {
+            s_attempt_active = false;
+            // The app sees a failover like a lost link: it keeps its state until the new session is up
+            if (start_failover(close_code)) {
+                close_code = WS_CLOSE_LINK_LOST;
+            }
+            // After a link loss the fast reconnect is the next attempt; a failover job marks its own
+            s_attempt_active = close_code == WS_CLOSE_LINK_LOST && !s_failover_pending;
+        } else if (s_failover_pending) {
+            return;  // Second report of a connection already being replaced
+        }
     }
 
     // Call user callback if registered
@@ -145,6 +235,26 @@ static void ws_state_change_handler(bool connected, uint16_t close_code, void *u
     }
 }
 
+static esp_err_t probe_job(void *arg)
+{
+    (void)arg;
+    proxy_endpoints_probe_all();
+    s_probe_running = false;
+    return ESP_OK;
+}
+
+static void probe_timer_cb(void *arg)
+{
+    (void)arg;
+    if (s_probe_running || !s_link_up) {
+        return;
+    }
+    s_probe_running = true;
+    if (!executor_submit(EXECUTOR_CORE_NETWORK, EXECUTOR_PRIORITY_LOW, probe_job, NULL, NULL, NULL)) {
+        s_probe_running = false;
+    }
+}
+
 void proxy_client_init(proxy_ws_state_cb_t ws_state_cb, proxy_audio_received_cb_t audio_cb, proxy_speech_event_cb_t speech_cb, void *user_ctx)
 {
     // Store user callbacks
@@ -153,15 +263,33 @@ void proxy_client_init(proxy_ws_state_cb_t ws_state_cb, proxy_audio_received_cb_
     s_user_ctx = user_ctx;
 
     load_or_create_session_id();
-    ESP_LOGI(TAG, "Proxy client initialised using %s (session: %s)", s_config.url, s_config.session_id);
+    if (proxy_endpoints_init(s_config.urls) == 0) {
+        ESP_LOGE(TAG, "No usable proxy URL in '%s'", s_config.urls);
+        return;
+    }
+    ESP_LOGI(TAG, "Proxy client initialised with %d endpoint(s) (session: %s)", proxy_endpoints_count(),
+             s_config.session_id);
 
     // Initialize WebSocket client (but don't connect yet - wait for WiFi)
-    esp_err_t err = ws_client_init(s_config.url, ws_audio_received_handler, ws_state_change_handler, speech_cb, user_ctx);
+    esp_err_t err = ws_client_init(proxy_endpoints_url(0), ws_audio_received_handler, ws_state_change_handler,
+                                   speech_cb, user_ctx);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Failed to initialize WebSocket client: %s", esp_err_to_name(err));
         return;
     }
 
+    // With a choice of proxies, keep their RTTs fresh in the background
+    if (proxy_endpoints_count() > 1) {
+        const esp_timer_create_args_t probe_timer_args = {
+            .callback = probe_timer_cb,
+            .name = "proxy_probe",
+        };
+        if (esp_timer_create(&probe_timer_args, &s_probe_timer) != ESP_OK ||
+            esp_timer_start_periodic(s_probe_timer, PROXY_PROBE_INTERVAL_MS * 1000ULL) != ESP_OK) {
+            ESP_LOGW(TAG, "Failed to start endpoint probes, selection falls back to list order");
+        }
+    }
+
     ESP_LOGI(TAG, "WebSocket client initialized (waiting for WiFi to connect)");
     // TODO: load proxy URL/token from NVS, warm up TLS credentials.
 }
@@ -170,9 +298,19 @@ void proxy_client_connect(void)
 {
     ESP_LOGI(TAG, "WiFi ready, connecting WebSocket to proxy...");
 
+    // A new conversation: every endpoint gets a chance again
+    s_tried_mask = 0;
+    int index = proxy_endpoints_select(0, false);
+    if (index >= 0) {
+        use_endpoint(index);
+    }
+    ws_client_set_session(proxy_get_session_id(), false);
+
     // Connect to WebSocket server
+    s_attempt_active = true;
     esp_err_t err = ws_client_connect();
     if (err != ESP_OK) {
+        s_attempt_active = false;
         ESP_LOGE(TAG, "Failed to start WebSocket connection: %s", esp_err_to_name(err));
         return;
     }
@@ -180,219 +318,19 @@ void proxy_client_connect(void)
     ESP_LOGI(TAG, "WebSocket connection initiated");
 }
 
-const char *proxy_get_session_id(void)
-{
-    if (!s_config.session_id_loaded) {
-        load_or_create_session_id();
-    }
-    return s_config.session_id;
-}
-
-// ==================== Chunked Streaming API ====================
-
-typedef struct {
-    char session_id[32];
-} proxy_stream_ctx_t;
-
-proxy_stream_handle_t proxy_stream_begin(const char *session_id)
+void proxy_client_set_link_up(bool up)
 {
-    if (!session_id) {
-        ESP_LOGE(TAG, "session_id is NULL");
-        return NULL;
-    }
-
-    proxy_stream_ctx_t *ctx = malloc(sizeof(proxy_stream_ctx_t));
-    if (!ctx) {
-        ESP_LOGE(TAG, "Failed to allocate stream context");
-        return NULL;
+    s_link_up = up;
+    ws_client_set_link_up(up);
+    if (up) {
+        probe_timer_cb(NULL);  // Fresh RTTs before the first connect
     }
-
-    snprintf(ctx->session_id, sizeof(ctx->session_id), "%s", session_id);
-    ESP_LOGI(TAG, "Started streaming session: %s", ctx->session_id);
-    return (proxy_stream_handle_t)ctx;
 }
 
-bool proxy_stream_send_chunk(proxy_stream_handle_t handle, const uint8_t *pcm_data, size_t pcm_len, int chunk_index)
-{
-    if (!handle || !pcm_data || pcm_len == 0) {
-        ESP_LOGE(TAG, "Invalid chunk parameters");
-        return false;
-    }
-
-    // Send raw binary PCM directly via WebSocket
-    if (!s_ws_connected) {
-        ESP_LOGW(TAG, "WebSocket not connected, cannot send chunk %d", chunk_index);
-        return false;
-    }
-
-    // Enable receiving mode on FIRST chunk (proxy echoes immediately)
-    if (chunk_index == 0 && !s_ws_receiving_audio) {
-        ESP_LOGI(TAG, "First chunk - enabling audio receiving and starting playback buffer");
-        s_received_audio_bytes = 0;
-        s_ws_receiving_audio = true;
-
-        // Start playback stream to receive echoed audio (but don't change state yet - still recording)
-        if (!audio_playback_stream_start()) {
-            ESP_LOGE(TAG, "Failed to start streaming playback");
-            s_ws_receiving_audio = false;
-            return false;
-        }
-    }
-
-    esp_err_t err = ws_client_send_audio(pcm_data, pcm_len);
-    if (err == ESP_OK) {
-        ESP_LOGD(TAG, "Chunk %d sent via WebSocket (%zu bytes PCM)", chunk_index, pcm_len);
-        return true;
-    } else {
-        ESP_LOGE(TAG, "Failed to send chunk %d via WebSocket: %s", chunk_index, esp_err_to_name(err));
-        return false;
-    }
-}
-
-typedef struct {
-    proxy_stream_ctx_t *stream_ctx;
-    uint8_t *pcm_data;
-    size_t pcm_len;
-    int chunk_index;
-    proxy_result_cb_t cb;
-    void *user_ctx;
-} proxy_stream_end_task_ctx_t;
-
-static void proxy_stream_end_task(void *arg)
-{
-    proxy_stream_end_task_ctx_t *task_ctx = (proxy_stream_end_task_ctx_t *)arg;
-    proxy_result_t result = PROXY_RESULT_FAILED;
-
-    ESP_LOGI(TAG, "Sending final chunk %d via WebSocket (%zu bytes PCM)", task_ctx->chunk_index, task_ctx->pcm_len);
-
-    // Check WebSocket connection
-    if (!s_ws_connected) {
-        ESP_LOGE(TAG, "WebSocket not connected, cannot send final chunk");
-        goto cleanup;
-    }
-
-    // Playback and receiving should already be started from first chunk
-    // NOTE: This code path is no longer used - keeping for compatibility
-    ESP_LOGI(TAG, "Sending final chunk (playback already active)");
-
-    // Send final chunk (raw binary PCM) - proxy will echo immediately
-    esp_err_t err = ws_client_send_audio(task_ctx->pcm_data, task_ctx->pcm_len);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to send final chunk via WebSocket: %s", esp_err_to_name(err));
-        goto cleanup;
-    }
-
-    ESP_LOGI(TAG, "Final chunk sent, waiting for response");
-
-    // Wait for audio to complete (with timeout)
-    // TODO: Implement proper end-of-stream detection from proxy
-    const int max_wait_seconds = 30;
-    const int check_interval_ms = 100;
-    int elapsed_ms = 0;
-    size_t last_audio_bytes = 0;
-    int idle_checks = 0;
-    const int idle_threshold = 20;  // 2 seconds of no new audio = done
-
-    while (elapsed_ms < (max_wait_seconds * 1000)) {
-        vTaskDelay(pdMS_TO_TICKS(check_interval_ms));
-        elapsed_ms += check_interval_ms;
-
-        // Check if WebSocket disconnected during streaming
-        if (!s_ws_connected) {
-            ESP_LOGW(TAG, "WebSocket disconnected during stream end, aborting");
-            result = PROXY_RESULT_FAILED;
-            break;
-        }
-
-        // Check if we're still receiving audio
-        size_t current_audio_bytes = s_received_audio_bytes;
-        if (current_audio_bytes == last_audio_bytes) {
-            idle_checks++;
-            if (idle_checks >= idle_threshold) {
-                ESP_LOGI(TAG, "No new audio for %d checks, assuming complete (received %zu bytes total)",
-                         idle_checks, current_audio_bytes);
-                break;
-            }
-        } else {
-            idle_checks = 0;
-            last_audio_bytes = current_audio_bytes;
-        }
-    }
-
-    // End streaming playback
-    audio_playback_stream_end();
-    s_ws_receiving_audio = false;
-
-    ESP_LOGI(TAG, "WebSocket audio streaming completed");
-    result = PROXY_RESULT_OK;
-
-cleanup:
-    proxy_free(task_ctx->pcm_data);
-    free(task_ctx->stream_ctx);
-
-    if (task_ctx->cb) {
-        task_ctx->cb(result, task_ctx->user_ctx);
-    }
-
-    free(task_ctx);
-    vTaskDelete(NULL);
-}
-
-void proxy_stream_end(proxy_stream_handle_t handle, const uint8_t *pcm_data, size_t pcm_len,
-                     int chunk_index, proxy_result_cb_t cb, void *user_ctx)
+const char *proxy_get_session_id(void)
 {
-    if (!handle) {
-        ESP_LOGE(TAG, "Invalid stream handle");
-        if (cb) {
-            cb(PROXY_RESULT_FAILED, user_ctx);
-        }
-        return;
-    }
-
-    proxy_stream_ctx_t *stream_ctx = (proxy_stream_ctx_t *)handle;
-
-    // Allocate task context
-    proxy_stream_end_task_ctx_t *task_ctx = malloc(sizeof(proxy_stream_end_task_ctx_t));
-    if (!task_ctx) {
-        ESP_LOGE(TAG, "Failed to allocate stream end task context");
-        free(stream_ctx);
-        if (cb) {
-            cb(PROXY_RESULT_FAILED, user_ctx);
-        }
-        return;
-    }
-
-    // Copy PCM data for async processing (if any)
-    if (pcm_len > 0) {
-        task_ctx->pcm_data = proxy_alloc(pcm_len);
-        if (!task_ctx->pcm_data) {
-            ESP_LOGE(TAG, "Failed to allocate PCM data copy");
-            free(task_ctx);
-            free(stream_ctx);
-            if (cb) {
-                cb(PROXY_RESULT_FAILED, user_ctx);
-            }
-            return;
-        }
-        memcpy(task_ctx->pcm_data, pcm_data, pcm_len);
-    } else {
-        task_ctx->pcm_data = NULL;  // No data for empty final chunk
-    }
-
-    task_ctx->stream_ctx = stream_ctx;
-    task_ctx->pcm_len = pcm_len;
-    task_ctx->chunk_index = chunk_index;
-    task_ctx->cb = cb;
-    task_ctx->user_ctx = user_ctx;
-
-    // Spawn task to handle final chunk and streaming response
-    if (xTaskCreatePinnedToCore(proxy_stream_end_task, "proxy_stream_end", 24576, task_ctx, 4, NULL, 0) != pdPASS) {
-        ESP_LOGE(TAG, "Failed to start stream end task");
-        proxy_free(task_ctx->pcm_data);
-        free(task_ctx);
-        free(stream_ctx);
-        if (cb) {
-            cb(PROXY_RESULT_FAILED, user_ctx);
-        }
+    if (!s_config.session_id_loaded) {
+        load_or_create_session_id();
     }
+    return s_config.session_id;
 }
@@ -4,14 +4,6 @@
 #include <stdint.h>
 #include <stdbool.h>
 
-typedef enum {
-    PROXY_RESULT_OK = 0,
-    PROXY_RESULT_RETRY,
-    PROXY_RESULT_FAILED,
-} proxy_result_t;
-
-typedef void (*proxy_result_cb_t)(proxy_result_t result, void *user_ctx);
-
 /**
  * @brief Callback for assistant speech events (start/end)
  *
@@ -48,20 +40,26 @@ typedef void (*proxy_audio_received_cb_t)(const uint8_t *audio_data, size_t audi
  */
 void proxy_client_init(proxy_ws_state_cb_t ws_state_cb, proxy_audio_received_cb_t audio_cb, proxy_speech_event_cb_t speech_cb, void *user_ctx);
 
-// Connect to proxy (call after WiFi is connected)
+/**
+ * @brief Connect to the best proxy endpoint (call after WiFi is connected)
+ *
+ * The proxy URLs come from WEBSOCKET_URLS (comma-separated) or WEBSOCKET_URL
+ * in wifi_credentials.h. With more than one, the healthy endpoint with the
+ * lowest probed RTT is used. If a connection fails or drops, the next endpoint
+ * takes over and the hello asks it to resume the session; the state callback
+ * reports this as WS_CLOSE_LINK_LOST until the new session is up. See
+ * proxy_endpoints.h for the scores and stats.
+ */
 void proxy_client_connect(void);
 
+/**
+ * @brief Report the Wi-Fi link state (from the Wi-Fi event handler)
+ *
+ * Passed on to the WebSocket client. Failures while the link is down are not
+ * held against an endpoint, and probing pauses.
+ */
+void proxy_client_set_link_up(bool up);
+
 // Get persistent session ID (loaded from NVS, persists across reboots)
 const char *proxy_get_session_id(void);
 
-// Chunked streaming API
-typedef void *proxy_stream_handle_t;
-
-// Start a new streaming session
-proxy_stream_handle_t proxy_stream_begin(const char *session_id);
-
-// Send a chunk (non-blocking, queues for background send)
-bool proxy_stream_send_chunk(proxy_stream_handle_t handle, const uint8_t *pcm_data, size_t pcm_len, int chunk_index);
-
-// Send final chunk and receive streaming response
-void proxy_stream_end(proxy_stream_handle_t handle, const uint8_t *pcm_data, size_t pcm_len, int chunk_index, proxy_result_cb_t cb, void *user_ctx);
@@ -0,0 +1,347 @@
+#include "proxy_endpoints.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "lwip/netdb.h"
+#include "lwip/sockets.h"
+
+static const char *TAG = "proxy_endpoints";
+
+#define PROXY_PROBE_TIMEOUT_MS      1000    // A connect slower than this counts as failed
+#define PROXY_UNHEALTHY_PROBES      2       // Failed probes in a row before an endpoint is unhealthy
+#define PROXY_SRTT_WEIGHT           4       // New samples move the smoothed RTT by 1/4
+#define PROXY_UNPROBED_SCORE_MS     1000    // Score until the first successful probe
+#define PROXY_STRIKE_PENALTY_MS     1000    // Added per recent failed session
+#define PROXY_STRIKE_FORGET_MS      300000  // Failed sessions stop counting after 5 min
+#define PROXY_SWITCH_MARGIN_MS      20      // A better score must win by this much to move a healthy device
+
+typedef struct {
+    char url[PROXY_URL_MAX];
+    char host[64];
+    uint16_t port;
+    uint32_t srtt_us;
+    uint32_t last_rtt_us;
+    uint8_t probe_fail_streak;
+    uint8_t strikes;                // Recent failed sessions
+    int64_t last_strike_us;
+    uint32_t probes;
+    uint32_t probe_failures;
+    uint32_t sessions;
+    uint32_t session_failures;
+} endpoint_t;
+
+static endpoint_t s_endpoints[PROXY_MAX_ENDPOINTS];
+static int s_count = 0;
+static int s_selected = -1;
+static uint32_t s_selections = 0;
+static uint32_t s_switches = 0;
+static uint32_t s_failovers = 0;
+static uint32_t s_probe_rounds = 0;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// ws://host[:port][/path] or wss://...
+static bool parse_url(const char *url, size_t len, endpoint_t *ep)
+{
+    if (len >= sizeof(ep->url)) {
+        return false;
+    }
+    memcpy(ep->url, url, len);
+    ep->url[len] = '\0';
+
+    const char *p = ep->url;
+    if (strncmp(p, "ws://", 5) == 0) {
+        ep->port = 80;
+        p += 5;
+    } else if (strncmp(p, "wss://", 6) == 0) {
+        ep->port = 443;
+        p += 6;
+    } else {
+        return false;
+    }
+
+    size_t host_len = strcspn(p, ":/");
+    if (host_len == 0 || host_len >= sizeof(ep->host)) {
+        return false;
+    }
+    memcpy(ep->host, p, host_len);
+    ep->host[host_len] = '\0';
+
+    if (p[host_len] == ':') {
+        char *end = NULL;
+        unsigned long port = strtoul(p + host_len + 1, &end, 10);
+        if (port == 0 || port > UINT16_MAX || (*end != '\0' && *end != '/')) {
+            return false;
+        }
+        ep->port = (uint16_t)port;
+    }
+    return true;
+}
+
+int proxy_endpoints_init(const char *urls)
+{
+    s_count = 0;
+    s_selected = -1;
+    memset(s_endpoints, 0, sizeof(s_endpoints));
+
+    while (urls && *urls) {
+        while (*urls == ' ') {
+            urls++;
+        }
+        size_t len = strcspn(urls, ", ");
+        if (len > 0) {
+            if (s_count == PROXY_MAX_ENDPOINTS) {
+                ESP_LOGW(TAG, "More than %d endpoints, ignoring the rest", PROXY_MAX_ENDPOINTS);
+                break;
+            }
+            if (parse_url(urls, len, &s_endpoints[s_count])) {
+                s_count++;
+            } else {
+                ESP_LOGW(TAG, "Ignoring unusable endpoint '%.*s'", (int)len, urls);
+            }
+        }
+        urls += len;
+        while (*urls == ',' || *urls == ' ') {
+            urls++;
+        }
+    }
+
+    for (int i = 0; i < s_count; i++) {
+        ESP_LOGI(TAG, "Endpoint %d: %s (%s port %u)", i, s_endpoints[i].url, s_endpoints[i].host,
+                 s_endpoints[i].port);
+    }
+    return s_count;
+}
+
+int proxy_endpoints_count(void)
+{
+    return s_count;
+}
+
+const char *proxy_endpoints_url(int index)
+{
+    return index >= 0 && index < s_count ? s_endpoints[index].url : NULL;
+}
+
+static bool is_healthy(const endpoint_t *ep)
+{
+    return ep->probe_fail_streak < PROXY_UNHEALTHY_PROBES;
+}
+
+// Under s_lock
+static uint32_t endpoint_score(endpoint_t *ep, int64_t now_us)
+{
+    if (ep->strikes > 0 && now_us - ep->last_strike_us >= (int64_t)PROXY_STRIKE_FORGET_MS * 1000) {
+        ep->strikes = 0;
+    }
+    uint32_t score = ep->srtt_us > 0 ? ep->srtt_us / 1000 : PROXY_UNPROBED_SCORE_MS;
+    return score + ep->strikes * PROXY_STRIKE_PENALTY_MS;
+}
+
+int proxy_endpoints_select(uint32_t exclude_mask, bool failover)
+{
+    int best = -1;
+    uint32_t best_score = 0;
+    bool best_healthy = false;
+    int current = -1;
+    uint32_t current_score = 0;
+    bool current_healthy = false;
+
+    portENTER_CRITICAL(&s_lock);
+    int64_t now_us = esp_timer_get_time();
+    for (int i = 0; i < s_count; i++) {
+        if (exclude_mask & (1u << i)) {
+            continue;
+        }
+        uint32_t score = endpoint_score(&s_endpoints[i], now_us);
+        bool healthy = is_healthy(&s_endpoints[i]);
+        // Ties go to the earlier endpoint in the list
+        if (best < 0 || (healthy && !best_healthy) || (healthy == best_healthy && score < best_score)) {
+            best = i;
+            best_score = score;
+            best_healthy = healthy;
+        }
+        if (i == s_selected) {
+            current = i;
+            current_score = score;
+            current_healthy = healthy;
+        }
+    }
+
+    // Stay on the current proxy unless the other one is clearly better
+    if (current >= 0 && best != current && current_healthy == best_healthy &&
+        current_score <= best_score + PROXY_SWITCH_MARGIN_MS) {
+        best = current;
+        best_score = current_score;
+    }
+
+    if (best >= 0) {
+        s_selections++;
+        if (s_selected >= 0 && best != s_selected) {
+            s_switches++;
+            s_failovers += failover ? 1 : 0;
+        }
+        s_selected = best;
+    }
+    portEXIT_CRITICAL(&s_lock);
+
+    if (best < 0) {
+        ESP_LOGW(TAG, "No endpoint left to try");
+    } else if (failover) {
+        ESP_LOGW(TAG, "Failing over to endpoint %d: %s (score %lu ms%s)", best, s_endpoints[best].url,
+                 (unsigned long)best_score, best_healthy ? "" : ", unhealthy");
+    } else {
+        ESP_LOGI(TAG, "Selected endpoint %d: %s (score %lu ms%s)", best, s_endpoints[best].url,
+                 (unsigned long)best_score, best_healthy ? "" : ", unhealthy");
+    }
+    return best;
+}
+
+void proxy_endpoints_report_session(int index, bool ok)
+{
+    if (index < 0 || index >= s_count) {
+        return;
+    }
+    portENTER_CRITICAL(&s_lock);
+    endpoint_t *ep = &s_endpoints[index];
+    if (ok) {
+        ep->sessions++;
+    } else {
+        ep->session_failures++;
+        if (ep->strikes < UINT8_MAX) {
+            ep->strikes++;
+        }
+        ep->last_strike_us = esp_timer_get_time();
+    }
+    portEXIT_CRITICAL(&s_lock);
+}
+
+// Time a TCP connect; DNS is resolved first and not counted
+static bool probe_connect(const endpoint_t *ep, uint32_t *rtt_us)
+{
+    char port[6];
+    snprintf(port, sizeof(port), "%u", ep->port);
+    const struct addrinfo hints = {
+        .ai_family = AF_INET,
+        .ai_socktype = SOCK_STREAM,
+    };
+    struct addrinfo *res = NULL;
+    if (getaddrinfo(ep->host, port, &hints, &res) != 0 || !res) {
+        return false;
+    }
+
+    bool ok = false;
+    int sock = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (sock >= 0) {
+        fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+        int64_t start_us = esp_timer_get_time();
+        if (connect(sock, res->ai_addr, res->ai_addrlen) == 0 || errno == EINPROGRESS) {
+            fd_set writable;
+            FD_ZERO(&writable);
+            FD_SET(sock, &writable);
+            struct timeval timeout = {
+                .tv_sec = PROXY_PROBE_TIMEOUT_MS / 1000,
+                .tv_usec = (PROXY_PROBE_TIMEOUT_MS % 1000) * 1000,
+            };
+            int err = 0;
+            socklen_t err_len = sizeof(err);
+            if (select(sock + 1, NULL, &writable, NULL, &timeout) == 1 &&
+                getsockopt(sock, SOL_SOCKET, SO_ERROR, &err, &err_len) == 0 && err == 0) {
+                *rtt_us = (uint32_t)(esp_timer_get_time() - start_us);
+                ok = true;
+            }
+        }
+        close(sock);
+    }
+    freeaddrinfo(res);
+    return ok;
+}
+
+void proxy_endpoints_probe_all(void)
+{
+    for (int i = 0; i < s_count; i++) {
+        uint32_t rtt_us = 0;
+        bool ok = probe_connect(&s_endpoints[i], &rtt_us);
+
+        portENTER_CRITICAL(&s_lock);
+        endpoint_t *ep = &s_endpoints[i];
+        bool was_healthy = is_healthy(ep);
+        ep->probes++;
+        if (ok) {
+            ep->last_rtt_us = rtt_us;
+            ep->srtt_us = ep->srtt_us == 0 ? rtt_us
+                                           : (uint32_t)((int32_t)ep->srtt_us +
+                                                        ((int32_t)rtt_us - (int32_t)ep->srtt_us) / PROXY_SRTT_WEIGHT);
+            ep->probe_fail_streak = 0;
+        } else {
+            ep->probe_failures++;
+            if (ep->probe_fail_streak < UINT8_MAX) {
+                ep->probe_fail_streak++;
+            }
+        }
+        bool healthy = is_healthy(ep);
+        portEXIT_CRITICAL(&s_lock);
+
+        if (healthy != was_healthy) {
+            ESP_LOGW(TAG, "Endpoint %d %s is %s", i, s_endpoints[i].url, healthy ? "healthy again" : "unhealthy");
+        }
+    }
+    portENTER_CRITICAL(&s_lock);
+    s_probe_rounds++;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+void proxy_endpoints_get_stats(proxy_endpoints_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+
+    portENTER_CRITICAL(&s_lock);
+    int64_t now_us = esp_timer_get_time();
+    stats->count = (uint8_t)s_count;
+    stats->selected = (int8_t)s_selected;
+    stats->selections = s_selections;
+    stats->switches = s_switches;
+    stats->failovers = s_failovers;
+    stats->probe_rounds = s_probe_rounds;
+    for (int i = 0; i < s_count; i++) {
+        endpoint_t *ep = &s_endpoints[i];
+        proxy_endpoint_info_t *info = &stats->endpoints[i];
+        info->healthy = is_healthy(ep);
+        info->score_ms = endpoint_score(ep, now_us);
+        info->srtt_us = ep->srtt_us;
+        info->last_rtt_us = ep->last_rtt_us;
+        info->probes = ep->probes;
+        info->probe_failures = ep->probe_failures;
+        info->sessions = ep->sessions;
+        info->session_failures = ep->session_failures;
+    }
+    portEXIT_CRITICAL(&s_lock);
+
+    for (int i = 0; i < s_count; i++) {
+        memcpy(stats->endpoints[i].url, s_endpoints[i].url, sizeof(stats->endpoints[i].url));
+    }
+}
+
+void proxy_endpoints_log(void)
+{
+    proxy_endpoints_stats_t stats;
+    proxy_endpoints_get_stats(&stats);
+
+    ESP_LOGI(TAG, "%u endpoints, using %d: %lu selections, %lu switches (%lu failovers), %lu probe rounds",
+             stats.count, stats.selected, (unsigned long)stats.selections, (unsigned long)stats.switches,
+             (unsigned long)stats.failovers, (unsigned long)stats.probe_rounds);
+    for (int i = 0; i < stats.count; i++) {
+        const proxy_endpoint_info_t *info = &stats.endpoints[i];
+        ESP_LOGI(TAG, "  %d %s: %s, score %lu ms, srtt %.1f ms, last %.1f ms, probes %lu (%lu failed), "
+                 "sessions %lu (%lu failed)",
+                 i, info->url, info->healthy ? "healthy" : "unhealthy", (unsigned long)info->score_ms,
+                 info->srtt_us / 1000.0, info->last_rtt_us / 1000.0, (unsigned long)info->probes,
+                 (unsigned long)info->probe_failures, (unsigned long)info->sessions,
+                 (unsigned long)info->session_failures);
+    }
+}
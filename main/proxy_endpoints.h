@@ -0,0 +1,85 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief Proxy endpoint list with RTT probing and health scoring
+ *
+ * Holds up to PROXY_MAX_ENDPOINTS WebSocket URLs. A probe round times a TCP
+ * connect to each endpoint; the smoothed RTT is its score. Endpoints whose
+ * probes keep failing are unhealthy, and a session that fails on an endpoint
+ * adds a penalty to its score for a few minutes, so a proxy that accepts
+ * connections but then stalls loses out too.
+ *
+ * proxy_client.c picks the endpoint at connect and on failover, and runs the
+ * probe rounds in the background.
+ */
+
+#define PROXY_MAX_ENDPOINTS     4
+#define PROXY_URL_MAX           128
+
+typedef struct {
+    char url[PROXY_URL_MAX];
+    bool healthy;                   // Fewer than PROXY_UNHEALTHY_PROBES failed probes in a row
+    uint32_t score_ms;              // Lower is better
+    uint32_t srtt_us;               // Smoothed connect RTT (0: no successful probe yet)
+    uint32_t last_rtt_us;
+    uint32_t probes;
+    uint32_t probe_failures;
+    uint32_t sessions;              // Sessions that reached the connected state
+    uint32_t session_failures;      // Sessions or connects that failed (not counting Wi-Fi losses)
+} proxy_endpoint_info_t;
+
+typedef struct {
+    uint8_t count;
+    int8_t selected;                // -1 before the first selection
+    uint32_t selections;
+    uint32_t switches;              // Selections that moved to another endpoint
+    uint32_t failovers;             // Switches after a failure
+    uint32_t probe_rounds;
+    proxy_endpoint_info_t endpoints[PROXY_MAX_ENDPOINTS];
+} proxy_endpoints_stats_t;
+
+/**
+ * @brief Load the endpoint list
+ *
+ * @param urls Comma-separated WebSocket URLs, in order of preference for ties
+ * @return Number of endpoints (extra ones are ignored with a warning)
+ */
+int proxy_endpoints_init(const char *urls);
+
+int proxy_endpoints_count(void);
+
+const char *proxy_endpoints_url(int index);
+
+/**
+ * @brief Choose an endpoint
+ *
+ * Healthy endpoints come first, then the lowest score. The current endpoint is
+ * kept unless another one scores better by a clear margin.
+ *
+ * @param exclude_mask Bit i set: endpoint i already failed in this round
+ * @param failover The selection replaces an endpoint that just failed
+ * @return Endpoint index, or -1 if every endpoint is excluded
+ */
+int proxy_endpoints_select(uint32_t exclude_mask, bool failover);
+
+/**
+ * @brief Record how a session on an endpoint went
+ *
+ * @param ok true when it reached the connected state, false when it failed
+ */
+void proxy_endpoints_report_session(int index, bool ok);
+
+/**
+ * @brief Probe every endpoint once (blocks for up to a timeout per endpoint)
+ */
+void proxy_endpoints_probe_all(void);
+
+void proxy_endpoints_get_stats(proxy_endpoints_stats_t *stats);
+
+/**
+ * @brief Log the selection and each endpoint's RTT and health
+ */
+void proxy_endpoints_log(void);
@@ -0,0 +1,431 @@
+#include "psram_bench.h"
+#include "dsp_kernels.h"
+#include "ST77916.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_cpu.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_memory_utils.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define BENCH_PHASE_MS            2000
+#define BENCH_CPU_MHZ             CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ
+#define BENCH_COLD_BYTES          (256 * 1024)  // 4x the largest data cache: streaming through it misses every line
+#define BENCH_HOT_BYTES           (4 * 1024)    // Stays cached
+#define BENCH_CHUNK_BYTES         4096
+#define BENCH_AUDIO_BLOCK_BYTES   1920          // One playback block
+#define BENCH_AUDIO_PERIOD_MS     10            // 4x the playback block rate, for more samples per phase
+#define BENCH_STRIP_LINES         (EXAMPLE_LCD_HEIGHT / 20)  // Same strip as the LVGL draw buffers
+#define BENCH_STRIP_PIXELS        (EXAMPLE_LCD_WIDTH * BENCH_STRIP_LINES)
+#define BENCH_TASK_PRIORITY       5             // Same as the playback and LVGL tasks
+#define BENCH_MAX_BUFFERS         12
+#define ADVISOR_STALL_PERMILLE    10            // Move a real-time buffer once its stall passes 1% of its period
+#define ADVISOR_INTERNAL_RESERVE  (48 * 1024)   // Left for Wi-Fi, lwIP and task stacks
+
+static const char *TAG = "psram_bench";
+
+typedef struct {
+    const char *name;
+    const void *addr;
+    size_t bytes;
+    uint32_t bytes_per_s;
+    uint32_t period_ms;
+} tracked_buffer_t;
+
+typedef struct {
+    uint32_t strips;
+    uint64_t render_cycles;
+} display_stats_t;
+
+typedef struct {
+    uint32_t blocks;
+    uint64_t cycles;
+    uint32_t max_cycles;
+    uint64_t stall_cycles;
+    uint32_t max_stall_cycles;
+} audio_stats_t;
+
+typedef struct {
+    uint64_t read_bytes, read_cycles;
+    uint64_t write_bytes, write_cycles;
+    uint32_t internal_cycles_per_kb;
+    uint32_t hit_cycles_per_kb;
+} probe_stats_t;
+
+typedef struct {
+    const char *name;
+    bool display;
+    bool audio;
+    bool probe;
+} phase_t;
+
+typedef struct {
+    display_stats_t display;
+    audio_stats_t audio;
+    probe_stats_t probe;
+} phase_result_t;
+
+enum { PHASE_DISPLAY, PHASE_PROBE, PHASE_PROBE_DISPLAY, PHASE_AUDIO, PHASE_AUDIO_DISPLAY, PHASE_COUNT };
+
+static const phase_t s_phases[PHASE_COUNT] = {
+    [PHASE_DISPLAY]       = { "display",       true,  false, false },
+    [PHASE_PROBE]         = { "probe",         false, false, true  },
+    [PHASE_PROBE_DISPLAY] = { "probe+display", true,  false, true  },
+    [PHASE_AUDIO]         = { "audio",         false, true,  false },
+    [PHASE_AUDIO_DISPLAY] = { "audio+display", true,  true,  false },
+};
+
+static tracked_buffer_t s_buffers[BENCH_MAX_BUFFERS];
+static size_t s_num_buffers = 0;
+
+static volatile bool s_stop = false;
+static TaskHandle_t s_runner = NULL;
+static display_stats_t s_display;
+static audio_stats_t s_audio;
+
+static uint16_t *s_strip = NULL;    // PSRAM draw buffer, rendered by the CPU and read by the LCD DMA
+static uint8_t *s_cold = NULL;      // PSRAM: audio reads the first half and writes the second
+static uint8_t *s_hot = NULL;       // PSRAM, small enough to stay cached
+static uint8_t *s_internal_a = NULL;
+static uint8_t *s_internal_b = NULL;
+static int16_t *s_work = NULL;      // Internal audio work block
+
+void psram_bench_track_buffer(const char *name, const void *addr, size_t bytes, uint32_t bytes_per_s,
+                              uint32_t period_ms)
+{
+    size_t i = 0;
+    while (i < s_num_buffers && strcmp(s_buffers[i].name, name) != 0) {
+        i++;
+    }
+    if (i == BENCH_MAX_BUFFERS) {
+        ESP_LOGW(TAG, "Too many tracked buffers, ignoring %s", name);
+        return;
+    }
+    if (i == s_num_buffers) {
+        s_num_buffers++;
+    }
+
+    s_buffers[i] = (tracked_buffer_t){
+        .name = name,
+        .addr = addr,
+        .bytes = bytes,
+        .bytes_per_s = bytes_per_s,
+        .period_ms = period_ms,
+    };
+}
+
+static uint32_t us_from_cycles(uint64_t cycles)
+{
+    return (uint32_t)(cycles / BENCH_CPU_MHZ);
+}
+
+static float mb_per_s(uint64_t bytes, uint64_t cycles)
+{
+    return cycles ? (float)bytes * BENCH_CPU_MHZ / (float)cycles : 0.0f;
+}
+
+static void load_done(void)
+{
+    xTaskNotifyGive(s_runner);
+    vTaskDelete(NULL);
+}
+
+// Render strips into PSRAM and flush them to the panel, like LVGL with a partial draw buffer
+static void display_load_task(void *arg)
+{
+    int y = 0;
+    uint16_t color = 0;
+
+    while (!s_stop) {
+        uint32_t start = esp_cpu_get_cycle_count();
+        for (size_t i = 0; i < BENCH_STRIP_PIXELS; i++) {
+            s_strip[i] = (uint16_t)(color + i);
+        }
+        s_display.render_cycles += esp_cpu_get_cycle_count() - start;
+
+        esp_lcd_panel_draw_bitmap(panel_handle, 0, y, EXAMPLE_LCD_WIDTH, y + BENCH_STRIP_LINES, s_strip);
+        s_display.strips++;
+
+        y += BENCH_STRIP_LINES;
+        if (y >= EXAMPLE_LCD_HEIGHT) {
+            y = 0;
+            color += 0x0841;
+        }
+    }
+    load_done();
+}
+
+static void audio_block(const uint8_t *src, uint8_t *dst)
+{
+    memcpy(s_work, src, BENCH_AUDIO_BLOCK_BYTES);
+    dsp_gain_sat_s16(s_work, BENCH_AUDIO_BLOCK_BYTES / sizeof(int16_t), 1 << 15);
+    memcpy(dst, s_work, BENCH_AUDIO_BLOCK_BYTES);
+}
+
+// Periodic ring-to-ring block, timed against the same work on internal buffers
+static void audio_load_task(void *arg)
+{
+    TickType_t wake = xTaskGetTickCount();
+    size_t pos = 0;
+
+    while (!s_stop) {
+        uint32_t t0 = esp_cpu_get_cycle_count();
+        audio_block(s_cold + pos, s_cold + BENCH_COLD_BYTES / 2 + pos);
+        uint32_t t1 = esp_cpu_get_cycle_count();
+        audio_block(s_internal_a, s_internal_b);
+        uint32_t t2 = esp_cpu_get_cycle_count();
+
+        uint32_t cycles = t1 - t0;
+        uint32_t baseline = t2 - t1;
+        uint32_t stall = cycles > baseline ? cycles - baseline : 0;
+        s_audio.blocks++;
+        s_audio.cycles += cycles;
+        s_audio.stall_cycles += stall;
+        if (cycles > s_audio.max_cycles) {
+            s_audio.max_cycles = cycles;
+        }
+        if (stall > s_audio.max_stall_cycles) {
+            s_audio.max_stall_cycles = stall;
+        }
+
+        pos += BENCH_AUDIO_BLOCK_BYTES;
+        if (pos + BENCH_AUDIO_BLOCK_BYTES > BENCH_COLD_BYTES / 2) {
+            pos = 0;
+        }
+        vTaskDelayUntil(&wake, pdMS_TO_TICKS(BENCH_AUDIO_PERIOD_MS));
+    }
+    load_done();
+}
+
+static uint32_t copy_cycles_per_kb(const uint8_t *src)
+{
+    const int passes = 16;
+    memcpy(s_internal_b, src, BENCH_CHUNK_BYTES);  // Warm the cache
+
+    uint32_t start = esp_cpu_get_cycle_count();
+    for (int i = 0; i < passes; i++) {
+        memcpy(s_internal_b, src, BENCH_CHUNK_BYTES);
+    }
+    return (esp_cpu_get_cycle_count() - start) / (passes * BENCH_CHUNK_BYTES / 1024);
+}
+
+// Stream through the cold region in the calling task: half the time reading, half writing
+static void run_probe(probe_stats_t *probe, uint32_t duration_ms)
+{
+    probe->internal_cycles_per_kb = copy_cycles_per_kb(s_internal_a);
+    probe->hit_cycles_per_kb = copy_cycles_per_kb(s_hot);
+
+    for (int write = 0; write < 2; write++) {
+        const int64_t end_us = esp_timer_get_time() + (int64_t)duration_ms * 1000 / 2;
+        while (esp_timer_get_time() < end_us) {
+            // One pass over the region per burst, then yield so the idle task keeps the watchdog fed
+            for (size_t pos = 0; pos < BENCH_COLD_BYTES; pos += BENCH_CHUNK_BYTES) {
+                uint32_t start = esp_cpu_get_cycle_count();
+                if (write) {
+                    memcpy(s_cold + pos, s_internal_a, BENCH_CHUNK_BYTES);
+                } else {
+                    memcpy(s_internal_a, s_cold + pos, BENCH_CHUNK_BYTES);
+                }
+                uint32_t cycles = esp_cpu_get_cycle_count() - start;
+                if (write) {
+                    probe->write_cycles += cycles;
+                    probe->write_bytes += BENCH_CHUNK_BYTES;
+                } else {
+                    probe->read_cycles += cycles;
+                    probe->read_bytes += BENCH_CHUNK_BYTES;
+                }
+            }
+            vTaskDelay(1);
+        }
+    }
+}
+
+static void run_phase(const phase_t *phase, phase_result_t *result)
+{
+    int started = 0;
+
+    memset(&s_display, 0, sizeof(s_display));
+    memset(&s_audio, 0, sizeof(s_audio));
+    memset(result, 0, sizeof(*result));
+    s_stop = false;
+
+    // Display on core 1 with LVGL, audio and the probe on core 0 with the audio tasks
+    if (phase->display && xTaskCreatePinnedToCore(display_load_task, "bench_display", 3072, NULL,
+                                                  BENCH_TASK_PRIORITY, NULL, 1) == pdPASS) {
+        started++;
+    }
+    if (phase->audio && xTaskCreatePinnedToCore(audio_load_task, "bench_audio", 3072, NULL,
+                                                BENCH_TASK_PRIORITY, NULL, 0) == pdPASS) {
+        started++;
+    }
+
+    if (phase->probe) {
+        run_probe(&result->probe, BENCH_PHASE_MS);
+    } else {
+        vTaskDelay(pdMS_TO_TICKS(BENCH_PHASE_MS));
+    }
+
+    s_stop = true;
+    for (int i = 0; i < started; i++) {
+        ulTaskNotifyTake(pdFALSE, portMAX_DELAY);
+    }
+    result->display = s_display;
+    result->audio = s_audio;
+}
+
+static void log_results(const phase_result_t *r)
+{
+    const float phase_s = BENCH_PHASE_MS / 1000.0f;
+    const probe_stats_t *idle = &r[PHASE_PROBE].probe;
+    const probe_stats_t *busy = &r[PHASE_PROBE_DISPLAY].probe;
+
+    ESP_LOGI(TAG, "PSRAM bench (%d MHz, %d ms phases):", BENCH_CPU_MHZ, BENCH_PHASE_MS);
+    ESP_LOGI(TAG, "  copy cycles/KB:    internal %lu, PSRAM hit %lu, PSRAM miss %lu idle / %lu with display",
+             (unsigned long)idle->internal_cycles_per_kb, (unsigned long)idle->hit_cycles_per_kb,
+             (unsigned long)(idle->read_bytes ? idle->read_cycles * 1024 / idle->read_bytes : 0),
+             (unsigned long)(busy->read_bytes ? busy->read_cycles * 1024 / busy->read_bytes : 0));
+    ESP_LOGI(TAG, "  PSRAM throughput:  read %.1f MB/s, write %.1f MB/s idle; %.1f / %.1f MB/s with display",
+             mb_per_s(idle->read_bytes, idle->read_cycles), mb_per_s(idle->write_bytes, idle->write_cycles),
+             mb_per_s(busy->read_bytes, busy->read_cycles), mb_per_s(busy->write_bytes, busy->write_cycles));
+
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        const display_stats_t *d = &r[p].display;
+        if (!s_phases[p].display || d->strips == 0) {
+            continue;
+        }
+        ESP_LOGI(TAG, "  display (%-13s): %.0f strips/s (%.1f MB/s flushed), render %lu us/strip", s_phases[p].name,
+                 d->strips / phase_s, d->strips / phase_s * BENCH_STRIP_PIXELS * sizeof(uint16_t) / 1e6f,
+                 (unsigned long)us_from_cycles(d->render_cycles / d->strips));
+    }
+
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        const audio_stats_t *a = &r[p].audio;
+        if (!s_phases[p].audio || a->blocks == 0) {
+            continue;
+        }
+        ESP_LOGI(TAG, "  audio (%-13s): block %lu us mean, %lu us max; PSRAM stall %lu us/s, %lu us max per block",
+                 s_phases[p].name, (unsigned long)us_from_cycles(a->cycles / a->blocks),
+                 (unsigned long)us_from_cycles(a->max_cycles),
+                 (unsigned long)(us_from_cycles(a->stall_cycles) / phase_s),
+                 (unsigned long)us_from_cycles(a->max_stall_cycles));
+    }
+}
+
+// Estimate each tracked buffer's stall from the contended miss cost and pick the
+// real-time buffers worth moving, best stall saved per internal byte first
+static void log_advice(const phase_result_t *r)
+{
+    const probe_stats_t *idle = &r[PHASE_PROBE].probe;
+    const probe_stats_t *busy = &r[PHASE_PROBE_DISPLAY].probe;
+    uint32_t miss = busy->read_bytes ? (uint32_t)(busy->read_cycles * 1024 / busy->read_bytes) : 0;
+    uint32_t penalty = miss > idle->internal_cycles_per_kb ? miss - idle->internal_cycles_per_kb : 0;
+    float bandwidth = mb_per_s(idle->read_bytes, idle->read_cycles) * 1e6f;
+
+    size_t largest = heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    const size_t spare_total = largest > ADVISOR_INTERNAL_RESERVE ? largest - ADVISOR_INTERNAL_RESERVE : 0;
+    size_t spare = spare_total;
+
+    uint32_t stall_us_per_s[BENCH_MAX_BUFFERS];
+    bool move[BENCH_MAX_BUFFERS] = { false };
+    bool candidate[BENCH_MAX_BUFFERS] = { false };
+
+    for (size_t i = 0; i < s_num_buffers; i++) {
+        const tracked_buffer_t *b = &s_buffers[i];
+        stall_us_per_s[i] = (uint32_t)((uint64_t)b->bytes_per_s * penalty / 1024 / BENCH_CPU_MHZ);
+        candidate[i] = esp_ptr_external_ram(b->addr) && b->period_ms > 0 &&
+                       stall_us_per_s[i] >= ADVISOR_STALL_PERMILLE * 1000;
+    }
+
+    for (;;) {
+        int best = -1;
+        for (size_t i = 0; i < s_num_buffers; i++) {
+            if (candidate[i] && !move[i] && s_buffers[i].bytes <= spare &&
+                (best < 0 || (uint64_t)stall_us_per_s[i] * s_buffers[best].bytes >
+                             (uint64_t)stall_us_per_s[best] * s_buffers[i].bytes)) {
+                best = (int)i;
+            }
+        }
+        if (best < 0) {
+            break;
+        }
+        move[best] = true;
+        spare -= s_buffers[best].bytes;
+    }
+
+    ESP_LOGI(TAG, "Placement advice (miss penalty %lu cycles/KB with display, %u KB internal RAM to spare):",
+             (unsigned long)penalty, (unsigned)(spare_total / 1024));
+
+    for (size_t i = 0; i < s_num_buffers; i++) {
+        const tracked_buffer_t *b = &s_buffers[i];
+        bool in_psram = esp_ptr_external_ram(b->addr);
+        uint32_t stall_per_period = stall_us_per_s[i] * b->period_ms / 1000;
+        char advice[96];
+
+        if (!in_psram) {
+            snprintf(advice, sizeof(advice), "internal already");
+        } else if (move[i]) {
+            snprintf(advice, sizeof(advice), "MOVE to internal: saves %lu us per %lu ms period",
+                     (unsigned long)stall_per_period, (unsigned long)b->period_ms);
+        } else if (candidate[i]) {
+            snprintf(advice, sizeof(advice), "keep: %lu us stall per period, but %u KB does not fit",
+                     (unsigned long)stall_per_period, (unsigned)(b->bytes / 1024));
+        } else if (b->period_ms > 0) {
+            snprintf(advice, sizeof(advice), "keep: %lu us stall per %lu ms period",
+                     (unsigned long)stall_per_period, (unsigned long)b->period_ms);
+        } else {
+            snprintf(advice, sizeof(advice), "keep: not real-time, %.1f%% of PSRAM bandwidth",
+                     bandwidth > 0 ? 100.0f * b->bytes_per_s / bandwidth : 0.0f);
+        }
+
+        ESP_LOGI(TAG, "  %-14s %8u B %-8s %8lu B/s  %s", b->name, (unsigned)b->bytes, in_psram ? "PSRAM" : "internal",
+                 (unsigned long)b->bytes_per_s, advice);
+    }
+}
+
+void psram_bench_run(void)
+{
+    static phase_result_t results[PHASE_COUNT];
+
+    s_strip = heap_caps_malloc(BENCH_STRIP_PIXELS * sizeof(uint16_t), MALLOC_CAP_SPIRAM);
+    s_cold = heap_caps_malloc(BENCH_COLD_BYTES, MALLOC_CAP_SPIRAM);
+    s_hot = heap_caps_malloc(BENCH_HOT_BYTES, MALLOC_CAP_SPIRAM);
+    s_internal_a = heap_caps_malloc(BENCH_CHUNK_BYTES, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    s_internal_b = heap_caps_malloc(BENCH_CHUNK_BYTES, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    s_work = heap_caps_malloc(BENCH_AUDIO_BLOCK_BYTES, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+
+    if (!s_strip || !s_cold || !s_hot || !s_internal_a || !s_internal_b || !s_work) {
+        ESP_LOGW(TAG, "PSRAM bench skipped: out of memory");
+        goto cleanup;
+    }
+
+    memset(s_cold, 0x55, BENCH_COLD_BYTES);
+    memset(s_hot, 0x55, BENCH_HOT_BYTES);
+    memset(s_internal_a, 0x55, BENCH_CHUNK_BYTES);
+    s_runner = xTaskGetCurrentTaskHandle();
+
+    ESP_LOGI(TAG, "Running %d contention phases (%d ms each)", PHASE_COUNT, BENCH_PHASE_MS);
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        run_phase(&s_phases[p], &results[p]);
+    }
+    vTaskDelay(pdMS_TO_TICKS(50));  // Let the last strip's DMA finish before freeing it
+
+    log_results(results);
+    log_advice(results);
+
+cleanup:
+    heap_caps_free(s_strip);
+    heap_caps_free(s_cold);
+    heap_caps_free(s_hot);
+    heap_caps_free(s_internal_a);
+    heap_caps_free(s_internal_b);
+    heap_caps_free(s_work);
+    s_strip = NULL;
+    s_cold = s_hot = s_internal_a = s_internal_b = NULL;
+    s_work = NULL;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief PSRAM contention bench and buffer placement advisor
+ *
+ * The audio rings, the response history, the LVGL draw buffers and the proxy
+ * buffers all live in octal PSRAM, which the CPU reaches through the cache and
+ * the LCD SPI DMA reads directly. psram_bench_run() runs synthetic loads in
+ * phases and measures how much they slow each other down:
+ *
+ *   - display: renders strips into a PSRAM draw buffer and flushes them to the
+ *     panel, the same way LVGL does;
+ *   - audio: every 10 ms, copies a 1920-byte block out of a PSRAM ring,
+ *     applies a gain and writes it back. The same work on internal buffers is
+ *     timed alongside it, so the difference is the PSRAM stall;
+ *   - probe: streams through a 256 KB PSRAM region (larger than the data cache)
+ *     to measure read/write throughput and the cost of a cache miss.
+ *
+ * Modules register their PSRAM buffers with psram_bench_track_buffer(). After
+ * the phases, the advisor estimates each buffer's stall per deadline period
+ * from the measured miss cost. It then recommends which buffers to move to
+ * internal SRAM, within what internal RAM can spare.
+ */
+
+/**
+ * @brief Register (or update, by name) a buffer for the placement advisor
+ *
+ * @param name        Short label, must outlive the call (string literal)
+ * @param addr        Buffer start (placement is read from the address)
+ * @param bytes       Buffer size
+ * @param bytes_per_s Bytes the CPU reads plus writes per second at peak
+ * @param period_ms   Deadline of the task that touches it (0 = not real-time)
+ */
+void psram_bench_track_buffer(const char *name, const void *addr, size_t bytes, uint32_t bytes_per_s,
+                              uint32_t period_ms);
+
+/**
+ * @brief Run the contention phases and log the results and placement advice
+ *
+ * Blocks for about 10 s and draws test patterns on the panel. Call it before
+ * the LVGL task starts and invalidate the screen afterwards.
+ */
+void psram_bench_run(void);
@@ -0,0 +1,244 @@
+#include "session_caps.h"
+
+#include <string.h>
+
+#include "esp_log.h"
+
+#define HELLO_VERSION           1
+#define CACHE_REPLAY_SECONDS    30      // audio_history arena (HISTORY_SECONDS)
+#define CACHE_MAX_RESPONSES     8       // HISTORY_MAX_RESPONSES
+#define TELEMETRY_VERSION       1       // TELEMETRY_FORMAT_VERSION
+
+#define LEGACY_UPLINK_FRAME_MS      100
+#define LEGACY_DOWNLINK_FRAME_MS    20
+
+static const char *TAG = "session_caps";
+
+// Offered values, preferred first
+static const uint8_t s_header_versions[] = { SESSION_HEADER_TYPED, SESSION_HEADER_LEGACY };
+static const uint16_t s_uplink_frame_ms[] = { 100, 40, 20 };       // Multiples of the 20 ms ADPCM block, ≤ one chunk
+static const uint16_t s_downlink_frame_ms[] = { 20, 40, 10 };      // 480 / 960 / 240-sample ADPCM blocks
+static const audio_codec_t s_codecs[] = { AUDIO_CODEC_IMA_ADPCM, AUDIO_CODEC_ULAW, AUDIO_CODEC_PCM };
+
+#define COUNT_OF(a) (sizeof(a) / sizeof((a)[0]))
+
+void session_caps_legacy(session_params_t *params)
+{
+    memset(params, 0, sizeof(*params));
+    params->header_version = SESSION_HEADER_LEGACY;
+    params->uplink_codec = AUDIO_CODEC_PCM;
+    params->uplink_rate = SESSION_UPLINK_SAMPLE_RATE;
+    params->uplink_frame_ms = LEGACY_UPLINK_FRAME_MS;
+    params->downlink_codec = AUDIO_CODEC_PCM;
+    params->downlink_rate = SESSION_DOWNLINK_SAMPLE_RATE;
+    params->downlink_frame_ms = LEGACY_DOWNLINK_FRAME_MS;
+}
+
+static bool add_direction(cJSON *hello, const char *key, audio_codec_t pref, uint32_t rate,
+                          const uint16_t *frame_ms, size_t num_frame_ms, bool dtx)
+{
+    cJSON *dir = cJSON_CreateObject();
+    cJSON *codecs = dir ? cJSON_AddArrayToObject(dir, "codecs") : NULL;
+    cJSON *rates = dir ? cJSON_AddArrayToObject(dir, "rates") : NULL;
+    cJSON *frames = dir ? cJSON_AddArrayToObject(dir, "frame_ms") : NULL;
+    if (!codecs || !rates || !frames) {
+        cJSON_Delete(dir);
+        return false;
+    }
+
+    cJSON_AddItemToArray(codecs, cJSON_CreateString(audio_codec_name(pref)));
+    for (size_t i = 0; i < COUNT_OF(s_codecs); i++) {
+        if (s_codecs[i] != pref) {
+            cJSON_AddItemToArray(codecs, cJSON_CreateString(audio_codec_name(s_codecs[i])));
+        }
+    }
+    cJSON_AddItemToArray(rates, cJSON_CreateNumber(rate));
+    for (size_t i = 0; i < num_frame_ms; i++) {
+        cJSON_AddItemToArray(frames, cJSON_CreateNumber(frame_ms[i]));
+    }
+    if (dtx) {
+        cJSON_AddBoolToObject(dir, "dtx", true);
+    }
+    cJSON_AddItemToObject(hello, key, dir);
+    return true;
+}
+
+char *session_caps_build_hello(audio_codec_t uplink_pref, audio_codec_t downlink_pref, uint16_t heartbeat_ms,
+                               uint8_t heartbeat_misses, const char *session_id, bool resume,
+                               bool control_channel)
+{
+    cJSON *hello = cJSON_CreateObject();
+    if (!hello) {
+        return NULL;
+    }
+
+    cJSON_AddStringToObject(hello, "type", "hello");
+    cJSON_AddNumberToObject(hello, "version", HELLO_VERSION);
+
+    cJSON *headers = cJSON_AddArrayToObject(hello, "header_versions");
+    for (size_t i = 0; headers && i < COUNT_OF(s_header_versions); i++) {
+        cJSON_AddItemToArray(headers, cJSON_CreateNumber(s_header_versions[i]));
+    }
+
+    cJSON *cache = cJSON_CreateObject();
+    if (cache) {
+        cJSON_AddNumberToObject(cache, "replay_s", CACHE_REPLAY_SECONDS);
+        cJSON_AddNumberToObject(cache, "responses", CACHE_MAX_RESPONSES);
+        cJSON_AddItemToObject(hello, "cache", cache);
+    }
+
+    cJSON *telemetry = cJSON_CreateObject();
+    if (telemetry) {
+        cJSON_AddNumberToObject(telemetry, "version", TELEMETRY_VERSION);
+        cJSON_AddItemToObject(hello, "telemetry", telemetry);
+    }
+
+    // Informational: the proxy may drop a device that stays silent for period × misses
+    if (heartbeat_ms > 0) {
+        cJSON *heartbeat = cJSON_CreateObject();
+        if (heartbeat) {
+            cJSON_AddNumberToObject(heartbeat, "period_ms", heartbeat_ms);
+            cJSON_AddNumberToObject(heartbeat, "misses", heartbeat_misses);
+            cJSON_AddItemToObject(hello, "heartbeat", heartbeat);
+        }
+    }
+
+    // A proxy that shares session state can carry the conversation over to a new connection
+    if (session_id) {
+        cJSON *session = cJSON_CreateObject();
+        if (session) {
+            cJSON_AddStringToObject(session, "id", session_id);
+            cJSON_AddBoolToObject(session, "resume", resume);
+            cJSON_AddItemToObject(hello, "session", session);
+        }
+    }
+
+    // Control messages on their own connection never queue behind audio
+    if (control_channel) {
+        cJSON_AddBoolToObject(hello, "control_channel", true);
+    }
+
+    char *text = NULL;
+    if (headers && cache && telemetry &&
+        add_direction(hello, "uplink", uplink_pref, SESSION_UPLINK_SAMPLE_RATE, s_uplink_frame_ms,
+                      COUNT_OF(s_uplink_frame_ms), true) &&
+        add_direction(hello, "downlink", downlink_pref, SESSION_DOWNLINK_SAMPLE_RATE, s_downlink_frame_ms,
+                      COUNT_OF(s_downlink_frame_ms), false)) {
+        text = cJSON_PrintUnformatted(hello);
+    }
+    cJSON_Delete(hello);
+    return text;
+}
+
+static bool in_list(uint16_t value, const uint16_t *list, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        if (list[i] == value) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Read one direction of the ack; absent fields keep their (legacy) value
+static bool parse_direction(const cJSON *ack, const char *key, audio_codec_t *codec, uint32_t expected_rate,
+                            uint16_t *frame_ms, const uint16_t *offered_ms, size_t num_offered_ms, bool *dtx)
+{
+    const cJSON *dir = cJSON_GetObjectItem(ack, key);
+    if (!dir) {
+        return true;
+    }
+
+    const cJSON *item = cJSON_GetObjectItem(dir, "codec");
+    if (item && !audio_codec_from_name(cJSON_GetStringValue(item), codec)) {
+        ESP_LOGW(TAG, "%s: unknown codec", key);
+        return false;
+    }
+
+    item = cJSON_GetObjectItem(dir, "rate");
+    if (item && (!cJSON_IsNumber(item) || (uint32_t)item->valueint != expected_rate)) {
+        ESP_LOGW(TAG, "%s: rate not offered", key);
+        return false;
+    }
+
+    item = cJSON_GetObjectItem(dir, "frame_ms");
+    if (item) {
+        if (!cJSON_IsNumber(item) || !in_list((uint16_t)item->valueint, offered_ms, num_offered_ms)) {
+            ESP_LOGW(TAG, "%s: frame duration not offered", key);
+            return false;
+        }
+        *frame_ms = (uint16_t)item->valueint;
+    }
+
+    item = cJSON_GetObjectItem(dir, "dtx");
+    if (item) {
+        if (!cJSON_IsBool(item) || (cJSON_IsTrue(item) && !dtx)) {
+            ESP_LOGW(TAG, "%s: DTX not offered", key);
+            return false;
+        }
+        if (dtx) {
+            *dtx = cJSON_IsTrue(item);
+        }
+    }
+    return true;
+}
+
+bool session_caps_parse_ack(const cJSON *ack, session_params_t *params)
+{
+    session_caps_legacy(params);
+
+    const cJSON *item = cJSON_GetObjectItem(ack, "header_version");
+    if (item) {
+        if (!cJSON_IsNumber(item) ||
+            (item->valueint != SESSION_HEADER_LEGACY && item->valueint != SESSION_HEADER_TYPED)) {
+            ESP_LOGW(TAG, "Header version not offered");
+            session_caps_legacy(params);
+            return false;
+        }
+        params->header_version = (uint8_t)item->valueint;
+    }
+
+    if (!parse_direction(ack, "uplink", &params->uplink_codec, SESSION_UPLINK_SAMPLE_RATE,
+                         &params->uplink_frame_ms, s_uplink_frame_ms, COUNT_OF(s_uplink_frame_ms),
+                         &params->uplink_dtx) ||
+        !parse_direction(ack, "downlink", &params->downlink_codec, SESSION_DOWNLINK_SAMPLE_RATE,
+                         &params->downlink_frame_ms, s_downlink_frame_ms, COUNT_OF(s_downlink_frame_ms),
+                         NULL)) {
+        session_caps_legacy(params);
+        return false;
+    }
+
+    item = cJSON_GetObjectItem(ack, "cache");
+    params->cache = cJSON_IsTrue(item);
+
+    // Telemetry frames need the type byte to be told apart from audio
+    item = cJSON_GetObjectItem(ack, "telemetry");
+    params->telemetry = cJSON_IsTrue(item) && params->header_version == SESSION_HEADER_TYPED;
+
+    item = cJSON_GetObjectItem(ack, "session");
+    params->resumed = cJSON_IsTrue(cJSON_GetObjectItem(item, "resumed"));
+
+    // {"control_channel":{"token":"..."}}: a token that does not fit is treated as no channel
+    const char *token = cJSON_GetStringValue(cJSON_GetObjectItem(cJSON_GetObjectItem(ack, "control_channel"), "token"));
+    if (token && strlen(token) < sizeof(params->control_token)) {
+        strcpy(params->control_token, token);
+    }
+    params->negotiated = true;
+    return true;
+}
+
+uint16_t session_caps_downlink_block_samples(const session_params_t *params)
+{
+    return (uint16_t)(params->downlink_rate * params->downlink_frame_ms / 1000);
+}
+
+void session_caps_log(const session_params_t *params)
+{
+    ESP_LOGI(TAG, "Session %s: header v%u, uplink %s %lu Hz %u ms%s, downlink %s %lu Hz %u ms, cache %s, telemetry %s%s%s",
+             params->negotiated ? "negotiated" : "legacy", params->header_version,
+             audio_codec_name(params->uplink_codec), (unsigned long)params->uplink_rate,
+             params->uplink_frame_ms, params->uplink_dtx ? " DTX" : "",
+             audio_codec_name(params->downlink_codec), (unsigned long)params->downlink_rate,
+             params->downlink_frame_ms, params->cache ? "on" : "off", params->telemetry ? "on" : "off",
+             params->resumed ? ", resumed" : "", params->control_token[0] ? ", control channel" : "");
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "audio_codec.h"
+#include "cJSON.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief Session capability negotiation (hello / hello_ack)
+ *
+ * Right after the WebSocket connects, the device sends a "hello" listing what
+ * it can do: codecs in order of preference, sample rates, frame durations,
+ * DTX, binary header versions, response cache and telemetry support, its
+ * heartbeat period, its session id (with a resume flag after a failover) and
+ * whether it can open a separate control connection. The proxy picks one value of each and answers with
+ * "hello_ack". The device configures the audio pipeline from the ack before
+ * the first audio frame goes out.
+ *
+ * A proxy that does not answer in time, or answers with something the device
+ * did not offer, gets the legacy session: raw 16 kHz PCM up, 24 kHz PCM down,
+ * 100 ms uplink frames, no header byte.
+ */
+
+#define SESSION_UPLINK_SAMPLE_RATE      16000   // Microphone rate (audio_controller.c)
+#define SESSION_DOWNLINK_SAMPLE_RATE    24000   // Speaker rate (audio_playback.c)
+
+#define SESSION_HEADER_LEGACY           0       // Binary frames are bare audio
+#define SESSION_HEADER_TYPED            1       // Binary frames start with a SESSION_FRAME_* byte
+
+#define SESSION_FRAME_AUDIO             0x01
+#define SESSION_FRAME_TELEMETRY         0x02    // Device → proxy, see telemetry.h
+#define SESSION_FRAME_BENCH             0x03    // Both ways, transport benchmark only (see ws_bench.h)
+
+#define SESSION_UPLINK_BLOCK_SAMPLES    320     // 20 ms ADPCM blocks; every uplink frame_ms is a multiple
+
+#define SESSION_CONTROL_TOKEN_MAX       32      // Control channel token from the ack, with its NUL
+
+typedef struct {
+    bool negotiated;                // false: legacy defaults (no ack, or an unusable one)
+    uint8_t header_version;         // SESSION_HEADER_*
+    audio_codec_t uplink_codec;
+    uint32_t uplink_rate;
+    uint16_t uplink_frame_ms;       // Audio per uplink binary frame
+    bool uplink_dtx;                // Muted audio is not sent at all
+    audio_codec_t downlink_codec;
+    uint32_t downlink_rate;
+    uint16_t downlink_frame_ms;     // ADPCM block duration (ignored for other codecs)
+    bool cache;                     // Proxy keeps responses for replay by id
+    bool telemetry;                 // Proxy accepts SESSION_FRAME_TELEMETRY (typed headers only)
+    bool resumed;                   // Proxy picked up the conversation the hello asked to resume
+    char control_token[SESSION_CONTROL_TOKEN_MAX];  // Attaches the control connection ("": none)
+} session_params_t;
+
+/**
+ * @brief Fill in the legacy session (what every proxy understood before the handshake)
+ */
+void session_caps_legacy(session_params_t *params);
+
+/**
+ * @brief Build the hello message, the preferred codecs listed first
+ *
+ * @param heartbeat_ms Device ping period (0: no heartbeat, the field is left out)
+ * @param heartbeat_misses Silent periods after which either side may drop the link
+ * @param session_id Persistent session id (NULL: the field is left out)
+ * @param resume Ask the proxy to continue the conversation of session_id
+ * @param control_channel Offer a separate connection for text control messages
+ * @return JSON text to free with cJSON_free(), or NULL if out of memory
+ */
+char *session_caps_build_hello(audio_codec_t uplink_pref, audio_codec_t downlink_pref, uint16_t heartbeat_ms,
+                               uint8_t heartbeat_misses, const char *session_id, bool resume,
+                               bool control_channel);
+
+/**
+ * @brief Read a hello_ack into params
+ *
+ * Missing fields take their legacy value. A value the device did not offer
+ * fails the whole ack.
+ *
+ * @return false if the ack is unusable (params set to legacy)
+ */
+bool session_caps_parse_ack(const cJSON *ack, session_params_t *params);
+
+/**
+ * @brief Samples per downlink ADPCM block for the negotiated frame duration
+ */
+uint16_t session_caps_downlink_block_samples(const session_params_t *params);
+
+/**
+ * @brief Log the negotiated session
+ */
+void session_caps_log(const session_params_t *params);
@@ -0,0 +1,173 @@
+#include "telemetry.h"
+#include "audio_controller.h"
+#include "audio_playback.h"
+#include "latency_hist.h"
+#include "session_caps.h"
+#include "websocket_client.h"
+
+#include <string.h>
+
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define TELEMETRY_INTERVAL_MS       60000   // At most one report attempt per interval
+#define TELEMETRY_POLL_MS           1000    // How often an overdue report checks for an idle link
+#define TELEMETRY_MAX_FRAME_BYTES   1024
+#define TELEMETRY_SEND_TIMEOUT_MS   100     // Give up rather than wait behind audio
+#define TELEMETRY_TASK_PRIORITY     2       // Below audio, network and UI
+
+static const char *TAG = "telemetry";
+
+// Histograms and the frame live in PSRAM; only this task touches them
+typedef struct {
+    latency_hist_snapshot_t pending[LATENCY_METRIC_COUNT];     // Taken since the last report sent
+    uint8_t frame[TELEMETRY_MAX_FRAME_BYTES];
+} telemetry_state_t;
+
+static telemetry_state_t *s_state = NULL;
+static telemetry_idle_fn_t s_is_idle = NULL;
+static TaskHandle_t s_task = NULL;
+static uint16_t s_sequence = 0;
+
+static uint8_t *put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    return p + 2;
+}
+
+static uint8_t *put_u32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+    return p + 4;
+}
+
+static size_t build_report(uint32_t window_ms)
+{
+    uint8_t *const start = s_state->frame;
+    uint8_t *const end = start + TELEMETRY_MAX_FRAME_BYTES;
+    uint8_t *p = start;
+
+    ws_client_stats_t ws = ws_client_get_stats();
+    wifi_ap_record_t ap = {0};
+    int8_t rssi = esp_wifi_sta_get_ap_info(&ap) == ESP_OK ? ap.rssi : 0;
+
+    *p++ = TELEMETRY_FORMAT_VERSION;
+    uint8_t *flags = p++;
+    *flags = 0;
+    p = put_u16(p, s_sequence);
+    p = put_u32(p, (uint32_t)(esp_timer_get_time() / 1000000));
+    p = put_u32(p, window_ms);
+    p = put_u32(p, audio_get_capture_overruns());
+    p = put_u32(p, audio_playback_get_underruns());
+    p = put_u32(p, audio_get_capture_drops());
+    p = put_u32(p, ws.connects);
+    p = put_u32(p, ws.send_failures);
+    p = put_u32(p, heap_caps_get_free_size(MALLOC_CAP_INTERNAL));
+    p = put_u32(p, heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL));
+    p = put_u32(p, heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL));
+    p = put_u32(p, heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
+    *p++ = (uint8_t)rssi;
+    uint8_t *num_histograms = p++;
+    *num_histograms = 0;
+
+    // Windows taken since the last report sent accumulate until one is sent
+    latency_hist_snapshot_t window;
+    for (int m = 0; m < LATENCY_METRIC_COUNT; m++) {
+        latency_hist_take_window(m, &window);
+        latency_hist_merge(&s_state->pending[m], &window);
+        const latency_hist_snapshot_t *hist = &s_state->pending[m];
+        if (hist->total == 0) {
+            continue;
+        }
+
+        uint8_t num_buckets = 0;
+        for (size_t i = 0; i < LATENCY_HIST_BUCKETS; i++) {
+            num_buckets += hist->counts[i] ? 1 : 0;
+        }
+        if (end - p < 6 + 3 * num_buckets) {
+            *flags |= TELEMETRY_FLAG_TRUNCATED;
+            continue;
+        }
+
+        *p++ = (uint8_t)m;
+        *p++ = num_buckets;
+        p = put_u32(p, hist->max_us);
+        for (size_t i = 0; i < LATENCY_HIST_BUCKETS; i++) {
+            if (hist->counts[i]) {
+                *p++ = (uint8_t)i;
+                p = put_u16(p, hist->counts[i] > UINT16_MAX ? UINT16_MAX : (uint16_t)hist->counts[i]);
+            }
+        }
+        (*num_histograms)++;
+    }
+
+    return (size_t)(p - start);
+}
+
+static void telemetry_task(void *arg)
+{
+    (void)arg;
+    int64_t last_attempt_us = esp_timer_get_time();
+    int64_t window_start_us = last_attempt_us;
+
+    while (true) {
+        vTaskDelay(pdMS_TO_TICKS(TELEMETRY_POLL_MS));
+
+        int64_t now_us = esp_timer_get_time();
+        if (now_us - last_attempt_us < (int64_t)TELEMETRY_INTERVAL_MS * 1000) {
+            continue;
+        }
+        if (!ws_client_is_connected() || !ws_client_get_session().telemetry) {
+            continue;
+        }
+        if (s_is_idle && !s_is_idle()) {
+            continue;  // Overdue: try again at the next poll
+        }
+
+        last_attempt_us = now_us;
+        size_t len = build_report((uint32_t)((now_us - window_start_us) / 1000));
+        esp_err_t err = ws_client_send_frame(SESSION_FRAME_TELEMETRY, s_state->frame, len,
+                                             TELEMETRY_SEND_TIMEOUT_MS);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "Report %u not sent (%s), next one covers it", s_sequence, esp_err_to_name(err));
+            continue;
+        }
+
+        ESP_LOGI(TAG, "Report %u sent (%u bytes)", s_sequence, (unsigned)len);
+        memset(s_state->pending, 0, sizeof(s_state->pending));
+        window_start_us = now_us;
+        s_sequence++;
+    }
+}
+
+void telemetry_start(telemetry_idle_fn_t is_idle)
+{
+    if (s_task) {
+        return;
+    }
+
+    s_state = heap_caps_calloc(1, sizeof(telemetry_state_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!s_state) {
+        ESP_LOGE(TAG, "Failed to allocate telemetry state (%u bytes)", (unsigned)sizeof(telemetry_state_t));
+        return;
+    }
+    s_is_idle = is_idle;
+
+    if (xTaskCreatePinnedToCore(telemetry_task, "telemetry", 4096, NULL, TELEMETRY_TASK_PRIORITY, &s_task, 0) !=
+        pdPASS) {
+        ESP_LOGE(TAG, "Failed to create telemetry task");
+        heap_caps_free(s_state);
+        s_state = NULL;
+        s_task = NULL;
+        return;
+    }
+    ESP_LOGI(TAG, "Telemetry every %d s while idle, if the proxy accepts it", TELEMETRY_INTERVAL_MS / 1000);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Periodic binary telemetry report to the proxy
+ *
+ * A low-priority task batches the pipeline latency histograms, glitch and
+ * connection counters, heap figures and Wi-Fi RSSI into one binary
+ * SESSION_FRAME_TELEMETRY frame. It is sent only when the proxy accepted
+ * telemetry in its hello_ack, and only while the link is idle (no live
+ * microphone audio, no assistant speech). There is at most one attempt per
+ * report interval, with a short send timeout. A report that cannot be sent is
+ * not queued; the next one covers the gap.
+ *
+ * Frame payload (after the type byte), little-endian:
+ *
+ *   u8  version (TELEMETRY_FORMAT_VERSION)
+ *   u8  flags (TELEMETRY_FLAG_*)
+ *   u16 sequence number (per boot)
+ *   u32 uptime, s
+ *   u32 time covered by the histograms, ms
+ *   u32 capture overruns, playback underruns, capture drops,
+ *       WebSocket connects, WebSocket send failures (since boot)
+ *   u32 internal heap free, internal heap minimum free,
+ *       largest internal block, PSRAM free (bytes)
+ *   i8  Wi-Fi RSSI, dBm (0 if unknown)
+ *   u8  number of histograms, then for each:
+ *       u8 metric (latency_metric_t), u8 number of buckets,
+ *       u32 max over the report's window, us,
+ *       then per non-empty bucket: u8 index, u16 count (saturating)
+ *
+ * Histograms hold only what was recorded since the previous report, from
+ * histograms of their own that the session log does not clear. Bucket
+ * bounds follow latency_hist.h. tools/stand_in_proxy.py decodes the frame.
+ */
+
+#define TELEMETRY_FORMAT_VERSION    1
+#define TELEMETRY_FLAG_TRUNCATED    0x01    // Some histograms did not fit in the frame
+
+/**
+ * @brief Reports whether the link can take a telemetry frame now
+ */
+typedef bool (*telemetry_idle_fn_t)(void);
+
+/**
+ * @brief Start the telemetry task
+ *
+ * @param is_idle Called before each report; the report waits while it returns false
+ */
+void telemetry_start(telemetry_idle_fn_t is_idle);
@@ -1,6 +1,10 @@
 #include "ui.h"
+#include "latency_hist.h"
+#include "psram_bench.h"
 
 #include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include "lvgl.h"
 #include <string.h>
 #include "ST77916.h"
@@ -12,6 +16,16 @@ static ui_event_cb_t s_event_cb = NULL;
 static void *s_event_ctx = NULL;
 static lv_obj_t *s_button = NULL;
 static lv_obj_t *s_label = NULL;
+static SemaphoreHandle_t s_lock = NULL;
+static StaticSemaphore_t s_lock_buf;
+static bool s_long_pressed = false;  // This press became a long press: replay on release
+static bool s_enroll_fired = false;  // Very long press already handled, no replay on release
+static uint32_t s_press_start = 0;
+
+#define ENROLL_PRESS_MS 3000
+
+// Full-screen redraw at 30 fps: each draw buffer is rendered (write) and flushed (DMA read) for half the strips
+#define UI_DRAW_BUF_PEAK_BYTES_PER_S (EXAMPLE_LCD_WIDTH * EXAMPLE_LCD_HEIGHT * sizeof(lv_color_t) * 30)
 
 static void button_event_cb(lv_event_t *event)
 {
@@ -19,14 +33,59 @@ static void button_event_cb(lv_event_t *event)
         return;
     }
 
-    assistant_status_t status = assistant_get_status();
-    ui_event_t ui_event = {
-        .type = (status.state == ASSISTANT_STATE_STREAMING) ? UI_EVENT_RECORD_STOP : UI_EVENT_RECORD_START,
-    };
+    lv_event_code_t code = lv_event_get_code(event);
+    ui_event_t ui_event = { .type = UI_EVENT_NONE, .time_us = latency_hist_now_us() };
+
+    // A short click toggles recording. A long press replays on release;
+    // holding on past ENROLL_PRESS_MS enrolls a wake word instead. Every
+    // press starts clean, so a long press that ended in PRESS_LOST cannot
+    // turn the next tap into a replay.
+    if (code == LV_EVENT_PRESSED) {
+        s_press_start = lv_tick_get();
+        s_long_pressed = false;
+        s_enroll_fired = false;
+        return;
+    } else if (code == LV_EVENT_LONG_PRESSED) {
+        s_long_pressed = true;
+        return;
+    } else if (code == LV_EVENT_LONG_PRESSED_REPEAT) {
+        if (s_enroll_fired || lv_tick_elaps(s_press_start) < ENROLL_PRESS_MS) {
+            return;
+        }
+        s_enroll_fired = true;
+        ui_event.type = UI_EVENT_WAKEWORD_ENROLL;
+    } else if (code == LV_EVENT_RELEASED) {
+        if (!s_long_pressed || s_enroll_fired) {
+            return;
+        }
+        ui_event.type = UI_EVENT_REPLAY;
+    } else if (code == LV_EVENT_SHORT_CLICKED) {
+        assistant_status_t status = assistant_get_status();
+        ui_event.type = (status.state == ASSISTANT_STATE_STREAMING) ? UI_EVENT_RECORD_STOP : UI_EVENT_RECORD_START;
+    } else {
+        return;
+    }
 
     s_event_cb(&ui_event, s_event_ctx);
 }
 
+void ui_lock_init(void)
+{
+    if (!s_lock) {
+        s_lock = xSemaphoreCreateRecursiveMutexStatic(&s_lock_buf);
+    }
+}
+
+void ui_lock(void)
+{
+    xSemaphoreTakeRecursive(s_lock, portMAX_DELAY);
+}
+
+void ui_unlock(void)
+{
+    xSemaphoreGiveRecursive(s_lock);
+}
+
 void ui_init(ui_event_cb_t cb, void *user_ctx)
 {
     s_event_cb = cb;
@@ -36,30 +95,45 @@ void ui_init(ui_event_cb_t cb, void *user_ctx)
     LCD_Init();     // Initializes ST77916, backlight, and touch
     LVGL_Init();    // Initializes LVGL with hardware display driver
     ESP_LOGI(TAG, "LCD and LVGL initialized");
+    psram_bench_track_buffer("lvgl_buf1", disp_buf.buf1, disp_buf.size * sizeof(lv_color_t), UI_DRAW_BUF_PEAK_BYTES_PER_S, 0);
+    psram_bench_track_buffer("lvgl_buf2", disp_buf.buf2, disp_buf.size * sizeof(lv_color_t), UI_DRAW_BUF_PEAK_BYTES_PER_S, 0);
 
     // Create UI elements
     lv_obj_t *screen = lv_scr_act();
     s_button = lv_btn_create(screen);
     lv_obj_set_size(s_button, 300, 120);  // 2x bigger button (default is ~150x60)
     lv_obj_center(s_button);
-    lv_obj_add_event_cb(s_button, button_event_cb, LV_EVENT_CLICKED, NULL);
+    lv_obj_add_event_cb(s_button, button_event_cb, LV_EVENT_SHORT_CLICKED, NULL);
+    lv_obj_add_event_cb(s_button, button_event_cb, LV_EVENT_LONG_PRESSED, NULL);
+    lv_obj_add_event_cb(s_button, button_event_cb, LV_EVENT_PRESSED, NULL);
+    lv_obj_add_event_cb(s_button, button_event_cb, LV_EVENT_LONG_PRESSED_REPEAT, NULL);
+    lv_obj_add_event_cb(s_button, button_event_cb, LV_EVENT_RELEASED, NULL);
 
-    s_label = lv_label_create(s_button);
-    lv_label_set_text(s_label, "Unmute");
-    lv_obj_center(s_label);
+    lv_obj_t *label = lv_label_create(s_button);
+    lv_label_set_text(label, "Unmute");
+    lv_obj_center(label);
 
     // Make label text 2x bigger
     static lv_style_t style_label;
     lv_style_init(&style_label);
     lv_style_set_text_font(&style_label, &lv_font_montserrat_28);
-    lv_obj_add_style(s_label, &style_label, 0);
+    lv_obj_add_style(label, &style_label, 0);
+
+    // Nothing else calls into LVGL until the label is published. On a wake this
+    // runs beside the Wi-Fi bring-up, whose state updates are ignored until then;
+    // publishing under the lock makes the finished widgets visible to them.
+    ui_lock();
+    s_label = label;
+    ui_unlock();
 
     ESP_LOGI(TAG, "UI initialised");
 }
 
 void ui_update_state(assistant_status_t status)
 {
+    ui_lock();
     if (!s_label) {
+        ui_unlock();
         return;
     }
 
@@ -81,4 +155,18 @@ void ui_update_state(assistant_status_t status)
     }
 
     lv_label_set_text(s_label, text);
+    ui_unlock();
+}
+
+void ui_show_text(const char *text)
+{
+    if (!text) {
+        return;
+    }
+
+    ui_lock();
+    if (s_label) {
+        lv_label_set_text(s_label, text);
+    }
+    ui_unlock();
 }
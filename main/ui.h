@@ -2,17 +2,34 @@
 
 #include "smart_assistant.h"
 
+#include <stdint.h>
+
 typedef enum {
     UI_EVENT_NONE = 0,
     UI_EVENT_RECORD_START,
     UI_EVENT_RECORD_STOP,
+    UI_EVENT_REPLAY,        // Long press: replay last assistant response
+    UI_EVENT_WAKEWORD_ENROLL, // Very long press: enroll a new wake word
 } ui_event_type_t;
 
 typedef struct {
     ui_event_type_t type;
+    uint32_t time_us;       // latency_hist_now_us() when LVGL delivered the touch
 } ui_event_t;
 
 typedef void (*ui_event_cb_t)(const ui_event_t *event, void *user_ctx);
 
+// LVGL is not thread-safe. ui_update_state() and ui_show_text() take the UI
+// lock themselves; any other LVGL call made once the UI is up (the LVGL task's
+// timer handler) must hold it. Recursive, since button events are delivered
+// from inside the timer handler. ui_lock_init() runs before anything that can
+// update the UI.
+void ui_lock_init(void);
+void ui_lock(void);
+void ui_unlock(void);
+
 void ui_init(ui_event_cb_t cb, void *user_ctx);
 void ui_update_state(assistant_status_t status);
+
+// Show a prompt on the button until the next state update (e.g. enrollment instructions)
+void ui_show_text(const char *text);
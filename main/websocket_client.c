@@ -1,11 +1,36 @@
 #include "websocket_client.h"
+#include "executor.h"
+#include "latency_hist.h"
+#include "link_liveness.h"
+#include "net_impair.h"
 #include "esp_websocket_client.h"
+#include "esp_heap_caps.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
+#include "freertos/ringbuf.h"
 #include "freertos/semphr.h"
+#include "freertos/task.h"
 #include "cJSON.h"
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
+#define WS_ENCODE_SLICE_SAMPLES     1600    // One uplink chunk per binary frame
+#define WS_NEGOTIATION_TIMEOUT_MS   1000    // Wait for hello_ack before falling back to legacy
+#define WS_NEGOTIATION_TIMED_OUT    0       // Negotiation outcomes
+#define WS_NEGOTIATION_ACK          1
+#define WS_NEGOTIATION_LEGACY       2       // Reported without waiting for an ack
+#define WS_RTT_PROBE_INTERVAL_MS    5000    // Timestamped pings sent alongside uplink audio
+#define WS_HEARTBEAT_PERIOD_MS      200     // Default ping period on a live link
+#define WS_HEARTBEAT_MISSES         4       // Silent periods before the link is declared dead
+#define WS_HEARTBEAT_TASK_PRIORITY  6       // Above the senders, so a blocked send cannot delay the check
+#define WS_HEARTBEAT_TASK_STACK     8192    // Runs the app's state callback, as the event task does
+#define WS_IMPAIR_LINE_BYTES        32768   // Frames held by each impairment delay line (PSRAM)
+#define WS_CONTROL_BUFFER_SIZE      1024    // Control connection: JSON messages only
+#define WS_CONTROL_TASK_PRIORITY    (WS_CLIENT_TASK_PRIORITY + 1)  // Control is handled ahead of audio
+#define WS_CONTROL_SEND_TIMEOUT_MS  1000
+
 static const char *TAG = "ws_client";
 
 // WebSocket client state
@@ -13,10 +38,812 @@ static esp_websocket_client_handle_t s_client = NULL;
 static ws_audio_received_cb_t s_audio_cb = NULL;
 static ws_state_change_cb_t s_state_cb = NULL;
 static ws_speech_event_cb_t s_speech_cb = NULL;
+static ws_frame_cb_t s_frame_cb = NULL;            // Non-audio typed frames
+static void *s_frame_ctx = NULL;
 static void *s_user_ctx = NULL;
 static bool s_connected = false;
+static bool s_client_running = false;              // Started, closing event not seen yet (guarded by s_state_mutex)
+static bool s_connect_on_close = false;            // A connect waits for that event (guarded by s_state_mutex)
 static SemaphoreHandle_t s_state_mutex = NULL;
+static SemaphoreHandle_t s_callback_mutex = NULL;  // Orders state callbacks from the event task and negotiation jobs
 static uint16_t s_last_close_code = 0;
+static uint32_t s_hello_sent_us = 0;
+static uint32_t s_rtt_probe_us = 0;                // Last timestamped ping (uplink sender only)
+static ws_client_stats_t s_stats = {0};
+
+// Heartbeat: a timestamped ping every period while connected. Every frame
+// received from the proxy, on the media or the control connection, counts as a
+// sign of life (the proxy answers pings with pongs), so a silent link is
+// declared dead after period × misses. A media send holds the client's lock,
+// and frames are not read while it is blocked, so that time is not silence.
+// Losing Wi-Fi declares the link dead at once. Either way the transport is torn
+// down and, once Wi-Fi is up, one fast reconnect is attempted.
+static TaskHandle_t s_heartbeat_task = NULL;
+static uint16_t s_heartbeat_period_ms = WS_HEARTBEAT_PERIOD_MS;  // 0: heartbeat off
+static uint8_t s_heartbeat_misses = WS_HEARTBEAT_MISSES;
+static volatile bool s_heartbeat_armed = false;    // Connected, pings going out
+static link_liveness_t s_liveness = { 0 };         // Miss clock, under s_liveness_lock
+static portMUX_TYPE s_liveness_lock = portMUX_INITIALIZER_UNLOCKED;
+static volatile bool s_link_up = true;             // Wi-Fi, as reported by the app
+static volatile bool s_link_lost_request = false;  // Wi-Fi went down while armed
+static volatile bool s_link_dead = false;          // Declared dead; the transport's own disconnect is not reported
+static volatile bool s_reconnect_pending = false;
+
+// Endpoint and session identity, set by proxy_client.c
+static char s_uri[128];                            // In use by the media connection (guarded by s_state_mutex)
+static char s_pending_uri[128];                    // Applied at the next start (guarded by s_state_mutex)
+static bool s_uri_pending = false;
+static char s_session_id[32];
+static volatile bool s_resume_next = false;        // The next hello asks the proxy to resume the session
+
+// Control channel (optional, negotiated): a second connection to the same URI
+// carries the JSON control messages both ways. It attaches with the token
+// from the hello_ack; until then, and if it drops, control messages use the
+// media connection. The heartbeat task opens and closes it, off the event tasks.
+static bool s_control_offer = false;
+static esp_websocket_client_handle_t s_control_client = NULL;
+static bool s_control_running = false;             // Heartbeat task only
+static char s_control_token[SESSION_CONTROL_TOKEN_MAX];
+static volatile bool s_control_open_request = false;
+static volatile bool s_control_close_request = false;
+static volatile bool s_control_ready = false;      // Attached: control messages go this way
+
+// Network impairment (bench only, off unless a profile is set): binary frames
+// in each direction pass through a PSRAM delay line that a task drains in
+// order at each frame's due time, so latency and jitter pipeline like on a
+// real link. Lost frames and frames during an outage never enter the line.
+typedef void (*impair_deliver_t)(const uint8_t *data, size_t len, bool first_fragment);
+
+typedef struct {
+    RingbufHandle_t ring;
+    impair_deliver_t deliver;
+    net_impair_t state;
+    uint32_t last_due_ms;           // Frames leave in order, as on one TCP stream
+    uint32_t overflows;
+} impair_line_t;
+
+typedef struct {
+    uint32_t due_ms;                // esp_timer time in ms
+    bool first_fragment;
+} impair_item_t;
+
+static bool s_impair_enabled = false;
+static net_impair_profile_t s_impair_profile;
+static impair_line_t s_impair_up;
+static impair_line_t s_impair_down;
+static portMUX_TYPE s_impair_lock = portMUX_INITIALIZER_UNLOCKED;
+static int64_t s_impair_start_us = 0;              // Connect time: outages and the cap count from here
+static bool s_rx_impair_drop = false;              // Event task: the message being received is lost
+static uint32_t s_rx_impair_due_ms = 0;
+
+// Session negotiation: hello on connect, the app hears "connected" once the
+// proxy acknowledges (or the timeout picks the legacy session)
+static audio_codec_t s_codec_pref_uplink = AUDIO_CODEC_PCM;
+static audio_codec_t s_codec_pref_downlink = AUDIO_CODEC_PCM;
+static bool s_negotiating = false;                 // Hello sent, no ack or timeout yet (guarded by s_state_mutex)
+static uint32_t s_negotiation_gen = 0;             // Per connection, so a stale outcome is dropped (guarded by s_state_mutex)
+static uint32_t s_negotiation_start_us = 0;        // Guarded by s_state_mutex
+static esp_timer_handle_t s_negotiation_timer = NULL;  // Lives as long as the module
+static uint32_t s_negotiation_jobs = 0;            // Outcome jobs queued or running (atomic)
+static session_params_t s_session;                 // Applied session (guarded by s_codec_mutex)
+
+// Audio codecs and framing for the applied session
+static SemaphoreHandle_t s_codec_mutex = NULL;     // Encoder vs. session changes
+static audio_codec_encoder_t s_encoder;
+static uint8_t s_header_version = SESSION_HEADER_LEGACY;
+static audio_codec_decoder_t s_decoder;            // Only touched by the event task
+static uint8_t s_rx_frame_type = SESSION_FRAME_AUDIO;  // Type byte of the binary message being received
+static uint8_t s_encode_buf[1 + AUDIO_CODEC_ENCODE_BOUND(WS_ENCODE_SLICE_SAMPLES)];
+
+// Called from the event task, so the downlink decoder never changes under a receive
+static void apply_session(const session_params_t *params)
+{
+    xSemaphoreTake(s_codec_mutex, portMAX_DELAY);
+    if (!audio_codec_encoder_init(&s_encoder, params->uplink_codec, SESSION_UPLINK_BLOCK_SAMPLES)) {
+        audio_codec_encoder_init(&s_encoder, AUDIO_CODEC_PCM, 0);
+    }
+    s_header_version = params->header_version;
+    s_session = *params;
+    xSemaphoreGive(s_codec_mutex);
+
+    uint16_t downlink_block = session_caps_downlink_block_samples(params);
+    if (!audio_codec_decoder_init(&s_decoder, params->downlink_codec, downlink_block)) {
+        ESP_LOGW(TAG, "Unusable downlink block size %u, staying on PCM", downlink_block);
+        audio_codec_decoder_init(&s_decoder, AUDIO_CODEC_PCM, 0);
+    }
+    s_rx_frame_type = SESSION_FRAME_AUDIO;
+}
+
+/**
+ * @brief Settles a negotiation and reports the connection (network worker)
+ *
+ * The event task sends the hello and applies the ack itself, and a one-shot
+ * timer covers a proxy that never answers, leaving the legacy session set up
+ * at connect in place. Either way the app's state callback runs here, on a
+ * worker whose stack is sized for it like the event task's, and nothing
+ * waits for the ack. arg packs the connection's generation and the outcome.
+ */
+static esp_err_t negotiation_job(void *arg)
+{
+    uint32_t outcome = (uint32_t)(uintptr_t)arg & 3;
+    uint32_t gen = (uint32_t)(uintptr_t)arg >> 2;
+
+    xSemaphoreTake(s_callback_mutex, portMAX_DELAY);
+    xSemaphoreTake(s_state_mutex, portMAX_DELAY);
+    bool current = gen == (s_negotiation_gen & 0x3FFFFFFF);
+    if (outcome == WS_NEGOTIATION_TIMED_OUT) {
+        // An ack or an abort may have got there first, or the timer fired for an earlier connection
+        current = current && s_negotiating &&
+                  latency_hist_now_us() - s_negotiation_start_us >= WS_NEGOTIATION_TIMEOUT_MS * 1000;
+        if (current) {
+            s_negotiating = false;  // From here on a late hello_ack is ignored
+        }
+    }
+    bool connected = current && s_connected;
+    xSemaphoreGive(s_state_mutex);
+
+    if (connected) {
+        s_stats.connects++;
+        if (outcome == WS_NEGOTIATION_TIMED_OUT) {
+            ESP_LOGW(TAG, "No hello_ack within %d ms, assuming a legacy proxy", WS_NEGOTIATION_TIMEOUT_MS);
+        }
+        session_params_t session = ws_client_get_session();
+        session_caps_log(&session);
+        if (s_state_cb) {
+            s_state_cb(true, 0, s_user_ctx);  // 0 for connected
+        }
+    }
+    xSemaphoreGive(s_callback_mutex);
+    __atomic_fetch_sub(&s_negotiation_jobs, 1, __ATOMIC_RELEASE);
+    return ESP_OK;
+}
+
+// Any task; gen is the connection the outcome belongs to
+static void submit_negotiation_job(uint32_t outcome, uint32_t gen)
+{
+    __atomic_fetch_add(&s_negotiation_jobs, 1, __ATOMIC_RELAXED);
+    uintptr_t arg = (uintptr_t)((gen & 0x3FFFFFFF) << 2 | outcome);
+    if (!executor_submit(EXECUTOR_CORE_NETWORK, EXECUTOR_PRIORITY_HIGH, negotiation_job, (void *)arg, NULL, NULL)) {
+        __atomic_fetch_sub(&s_negotiation_jobs, 1, __ATOMIC_RELAXED);
+        ESP_LOGE(TAG, "Failed to queue the negotiation outcome, the app is not told about this connection");
+    }
+}
+
+// esp_timer task: the job checks under the lock whether this is still the negotiation it was armed for
+static void negotiation_timeout_cb(void *arg)
+{
+    (void)arg;
+    submit_negotiation_job(WS_NEGOTIATION_TIMED_OUT, s_negotiation_gen);
+}
+
+// Caller holds s_state_mutex
+static void end_negotiation_locked(void)
+{
+    s_negotiating = false;
+    esp_timer_stop(s_negotiation_timer);  // Not running is fine
+}
+
+// The connection went away before the outcome: nothing is reported
+static void abort_negotiation(void)
+{
+    xSemaphoreTake(s_state_mutex, portMAX_DELAY);
+    end_negotiation_locked();
+    xSemaphoreGive(s_state_mutex);
+}
+
+static void start_negotiation(void)
+{
+    session_params_t legacy;
+    session_caps_legacy(&legacy);
+    apply_session(&legacy);
+
+    xSemaphoreTake(s_state_mutex, portMAX_DELAY);
+    bool pending = s_negotiating;
+    end_negotiation_locked();
+    s_negotiation_gen++;
+    s_negotiation_start_us = latency_hist_now_us();
+    s_negotiating = esp_timer_start_once(s_negotiation_timer, WS_NEGOTIATION_TIMEOUT_MS * 1000ULL) == ESP_OK;
+    bool armed = s_negotiating;
+    uint32_t gen = s_negotiation_gen;
+    xSemaphoreGive(s_state_mutex);
+
+    if (pending) {
+        ESP_LOGW(TAG, "Previous negotiation still open, dropped");
+    }
+    if (!armed) {
+        ESP_LOGE(TAG, "Failed to arm the negotiation timeout, using legacy session");
+        submit_negotiation_job(WS_NEGOTIATION_LEGACY, gen);
+        return;
+    }
+
+    // If the hello cannot go out, the timeout settles on the legacy session
+    char *hello = session_caps_build_hello(s_codec_pref_uplink, s_codec_pref_downlink, s_heartbeat_period_ms,
+                                          s_heartbeat_misses, s_session_id[0] ? s_session_id : NULL, s_resume_next,
+                                          s_control_offer && s_heartbeat_task != NULL);
+    s_resume_next = false;
+    if (!hello) {
+        ESP_LOGE(TAG, "Failed to build hello");
+        return;
+    }
+    s_hello_sent_us = latency_hist_now_us();
+    ws_client_send_text(hello);
+    cJSON_free(hello);
+}
+
+// {"type":"hello_ack","header_version":1,"uplink":{"codec":"ima_adpcm","frame_ms":40,"dtx":true},...}
+static void handle_hello_ack(const cJSON *json)
+{
+    session_params_t params;
+    if (!session_caps_parse_ack(json, &params)) {
+        ESP_LOGW(TAG, "Unusable hello_ack, falling back to the legacy session");
+    }
+
+    // Applied before the app is told about the connection, so it never sees a session change
+    xSemaphoreTake(s_state_mutex, portMAX_DELAY);
+    if (s_negotiating) {
+        latency_hist_record_since(LATENCY_METRIC_RTT, s_hello_sent_us);
+        apply_session(&params);
+        if (params.control_token[0] && s_heartbeat_task) {
+            strcpy(s_control_token, params.control_token);
+            s_control_open_request = true;
+            xTaskNotifyGive(s_heartbeat_task);
+        }
+        end_negotiation_locked();
+        submit_negotiation_job(WS_NEGOTIATION_ACK, s_negotiation_gen);
+    } else {
+        ESP_LOGW(TAG, "Ignoring hello_ack outside of negotiation");
+    }
+    xSemaphoreGive(s_state_mutex);
+}
+
+static void handle_control_message(const char *text, size_t len)
+{
+    cJSON *json = cJSON_ParseWithLength(text, len);
+    if (json == NULL) {
+        ESP_LOGW(TAG, "Failed to parse JSON control message");
+        return;
+    }
+
+    cJSON *type = cJSON_GetObjectItem(json, "type");
+    if (cJSON_IsString(type) && type->valuestring != NULL) {
+        if (strcmp(type->valuestring, "speech_start") == 0) {
+            ESP_LOGI(TAG, "Assistant started speaking");
+            if (s_speech_cb) {
+                s_speech_cb(true, s_user_ctx);
+            }
+        } else if (strcmp(type->valuestring, "speech_end") == 0) {
+            ESP_LOGI(TAG, "Assistant stopped speaking");
+            if (s_speech_cb) {
+                s_speech_cb(false, s_user_ctx);
+            }
+        } else if (strcmp(type->valuestring, "hello_ack") == 0) {
+            handle_hello_ack(json);
+        } else if (strcmp(type->valuestring, "control_attach_ack") == 0) {
+            if (ws_client_is_connected()) {
+                s_control_ready = true;
+                s_stats.control_attaches++;
+                ESP_LOGI(TAG, "Control channel attached");
+            }
+        } else if (strcmp(type->valuestring, "control_pong") == 0) {
+            const cJSON *sent = cJSON_GetObjectItem(json, "t");
+            if (cJSON_IsNumber(sent)) {
+                latency_hist_record_since(LATENCY_METRIC_CONTROL_RTT, (uint32_t)sent->valuedouble);
+            }
+        }
+    }
+    cJSON_Delete(json);
+}
+
+// Media connection teardown: control messages fall back at once, the connection closes on the heartbeat task
+static void request_control_close(void)
+{
+    s_control_ready = false;
+    s_control_open_request = false;
+    if (s_heartbeat_task) {
+        s_control_close_request = true;
+        xTaskNotifyGive(s_heartbeat_task);
+    }
+}
+
+static uint32_t impair_now_ms(void)
+{
+    return (uint32_t)((esp_timer_get_time() - s_impair_start_us) / 1000);
+}
+
+// A frame arrived from the proxy (event tasks): the only sign the link is alive
+static inline void note_rx(void)
+{
+    uint32_t now_us = latency_hist_now_us();
+    portENTER_CRITICAL(&s_liveness_lock);
+    link_liveness_rx(&s_liveness, now_us);
+    portEXIT_CRITICAL(&s_liveness_lock);
+}
+
+// Bracket every send on the media connection: nothing is read while one holds the client
+static inline void media_send_begin(void)
+{
+    uint32_t now_us = latency_hist_now_us();
+    portENTER_CRITICAL(&s_liveness_lock);
+    link_liveness_send_begin(&s_liveness, now_us);
+    portEXIT_CRITICAL(&s_liveness_lock);
+}
+
+static inline void media_send_end(void)
+{
+    uint32_t now_us = latency_hist_now_us();
+    portENTER_CRITICAL(&s_liveness_lock);
+    link_liveness_send_end(&s_liveness, now_us);
+    portEXIT_CRITICAL(&s_liveness_lock);
+}
+
+// Control connection event task
+static void control_event_handler(void *handler_args, esp_event_base_t base, int32_t event_id, void *event_data)
+{
+    esp_websocket_event_data_t *data = (esp_websocket_event_data_t *)event_data;
+
+    switch (event_id) {
+    case WEBSOCKET_EVENT_CONNECTED: {
+        cJSON *attach = cJSON_CreateObject();
+        cJSON_AddStringToObject(attach, "type", "control_attach");
+        cJSON_AddStringToObject(attach, "token", s_control_token);
+        char *text = cJSON_PrintUnformatted(attach);
+        cJSON_Delete(attach);
+        if (!text || esp_websocket_client_send_text(s_control_client, text, strlen(text),
+                                                    pdMS_TO_TICKS(WS_CONTROL_SEND_TIMEOUT_MS)) < 0) {
+            ESP_LOGW(TAG, "Failed to attach the control connection");
+        }
+        cJSON_free(text);
+        break;
+    }
+
+    case WEBSOCKET_EVENT_DISCONNECTED:
+        if (s_control_ready) {
+            s_control_ready = false;
+            s_stats.control_losses++;
+            ESP_LOGW(TAG, "Control connection lost, control messages use the media connection");
+        }
+        break;
+
+    case WEBSOCKET_EVENT_DATA:
+        if (s_impair_enabled && net_impair_outage(&s_impair_profile, impair_now_ms())) {
+            break;  // Emulated outage covers both connections
+        }
+        note_rx();  // Control frames show the link is alive as much as media ones
+        if (data->op_code == 0x01 && data->data_ptr && data->data_len > 0) {
+            handle_control_message(data->data_ptr, data->data_len);
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+// Heartbeat task only
+static void control_close(void)
+{
+    s_control_ready = false;
+    if (s_control_running) {
+        s_control_running = false;
+        esp_websocket_client_stop(s_control_client);
+    }
+}
+
+// Heartbeat task only: connect to the media connection's URI and attach with the ack's token
+static void control_open(void)
+{
+    char uri[sizeof(s_uri)];
+    xSemaphoreTake(s_state_mutex, portMAX_DELAY);
+    strcpy(uri, s_uri);
+    xSemaphoreGive(s_state_mutex);
+
+    control_close();
+    if (!s_control_client) {
+        esp_websocket_client_config_t cfg = {
+            .uri = uri,
+            .buffer_size = WS_CONTROL_BUFFER_SIZE,
+            .task_stack = WS_CLIENT_TASK_STACK,    // Runs the app's speech callback, like the media event task
+            .task_prio = WS_CONTROL_TASK_PRIORITY,
+            .disable_auto_reconnect = true,
+            .network_timeout_ms = 10000,
+            .ping_interval_sec = 10,
+        };
+        s_control_client = esp_websocket_client_init(&cfg);
+        if (s_control_client &&
+            esp_websocket_register_events(s_control_client, WEBSOCKET_EVENT_ANY, control_event_handler, NULL) != ESP_OK) {
+            esp_websocket_client_destroy(s_control_client);
+            s_control_client = NULL;
+        }
+        if (!s_control_client) {
+            ESP_LOGE(TAG, "Failed to create the control connection, control stays on the media connection");
+            return;
+        }
+    } else if (esp_websocket_client_set_uri(s_control_client, uri) != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to point the control connection at %s", uri);
+        return;
+    }
+
+    if (esp_websocket_client_start(s_control_client) != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to start the control connection");
+        return;
+    }
+    s_control_running = true;
+}
+
+// Called from the event task on connect
+static void arm_heartbeat(void)
+{
+    s_link_dead = false;
+    s_reconnect_pending = false;
+    uint32_t now_us = latency_hist_now_us();
+    portENTER_CRITICAL(&s_liveness_lock);
+    link_liveness_reset(&s_liveness, (uint32_t)s_heartbeat_period_ms * s_heartbeat_misses * 1000, now_us);
+    portEXIT_CRITICAL(&s_liveness_lock);
+    s_heartbeat_armed = s_heartbeat_period_ms > 0 && s_heartbeat_task != NULL;
+    if (s_heartbeat_armed) {
+        xTaskNotifyGive(s_heartbeat_task);
+    }
+}
+
+// After a stop, which waits for the client task: no closing event is coming
+static void client_stopped(void)
+{
+    xSemaphoreTake(s_state_mutex, portMAX_DELAY);
+    s_client_running = false;
+    s_connect_on_close = false;
+    xSemaphoreGive(s_state_mutex);
+}
+
+// Heartbeat task only: report the loss, then tear the transport down
+static void declare_link_dead(const char *reason)
+{
+    uint32_t now_us = latency_hist_now_us();
+    portENTER_CRITICAL(&s_liveness_lock);
+    uint32_t silent_us = now_us - s_liveness.last_rx_us;
+    portEXIT_CRITICAL(&s_liveness_lock);
+    s_heartbeat_armed = false;
+    s_link_dead = true;
+    s_stats.link_losses++;
+    latency_hist_record_metric(LATENCY_METRIC_LINK_LOSS, silent_us);
+    ESP_LOGW(TAG, "Link declared dead: %s (%lu ms since the last frame)", reason, (unsigned long)(silent_us / 1000));
+
+    xSemaphoreTake(s_state_mutex, portMAX_DELAY);
+    s_connected = false;
+    xSemaphoreGive(s_state_mutex);
+    abort_negotiation();
+
+    xSemaphoreTake(s_callback_mutex, portMAX_DELAY);
+    if (s_state_cb) {
+        s_state_cb(false, WS_CLOSE_LINK_LOST, s_user_ctx);
+    }
+    xSemaphoreGive(s_callback_mutex);
+
+    // The client task may still sit in a blocked read or send; stopping waits it out
+    control_close();
+    esp_websocket_client_stop(s_client);
+    client_stopped();
+    s_resume_next = true;
+    s_reconnect_pending = true;
+}
+
+// The transport must be stopped; a URI set while it ran is applied here
+static esp_err_t start_client(void)
+{
+    xSemaphoreTake(s_state_mutex, portMAX_DELAY);
+    if (s_uri_pending) {
+        s_uri_pending = false;
+        esp_err_t err = esp_websocket_client_set_uri(s_client, s_pending_uri);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to set URI %s: %s", s_pending_uri, esp_err_to_name(err));
+        } else {
+            strcpy(s_uri, s_pending_uri);
+            ESP_LOGI(TAG, "Using %s", s_pending_uri);
+        }
+    }
+    s_client_running = true;  // Before the start: a failed connect reports its close at once
+    xSemaphoreGive(s_state_mutex);
+
+    esp_err_t err = esp_websocket_client_start(s_client);
+    if (err != ESP_OK) {
+        xSemaphoreTake(s_state_mutex, portMAX_DELAY);
+        s_client_running = false;
+        xSemaphoreGive(s_state_mutex);
+    }
+    return err;
+}
+
+static void report_connect_failed(void)
+{
+    xSemaphoreTake(s_callback_mutex, portMAX_DELAY);
+    if (s_state_cb) {
+        s_state_cb(false, 0, s_user_ctx);
+    }
+    xSemaphoreGive(s_callback_mutex);
+}
+
+// Network worker: the connect ws_client_connect() held back until the previous connection closed
+static esp_err_t deferred_connect_job(void *arg)
+{
+    (void)arg;
+    esp_err_t err = start_client();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start WebSocket client: %s", esp_err_to_name(err));
+        report_connect_failed();
+    }
+    return err;
+}
+
+// Event task, after the close is reported: the client is done with this connection
+static void connection_closed(void)
+{
+    xSemaphoreTake(s_state_mutex, portMAX_DELAY);
+    s_client_running = false;
+    bool connect = s_connect_on_close;
+    s_connect_on_close = false;
+    xSemaphoreGive(s_state_mutex);
+
+    if (connect &&
+        !executor_submit(EXECUTOR_CORE_NETWORK, EXECUTOR_PRIORITY_HIGH, deferred_connect_job, NULL, NULL, NULL)) {
+        ESP_LOGE(TAG, "Failed to queue the connect");
+        report_connect_failed();
+    }
+}
+
+static void heartbeat_task(void *arg)
+{
+    (void)arg;
+
+    while (true) {
+        uint32_t period_ms = s_heartbeat_period_ms;
+        ulTaskNotifyTake(pdTRUE, s_heartbeat_armed ? pdMS_TO_TICKS(period_ms) : portMAX_DELAY);
+
+        if (s_control_close_request) {
+            s_control_close_request = false;
+            control_close();
+        }
+        if (s_control_open_request) {
+            s_control_open_request = false;
+            control_open();
+        }
+
+        if (s_heartbeat_armed && s_client) {
+            uint32_t now_us = latency_hist_now_us();
+            portENTER_CRITICAL(&s_liveness_lock);
+            bool dead = link_liveness_dead(&s_liveness, now_us);
+            portEXIT_CRITICAL(&s_liveness_lock);
+            if (s_link_lost_request) {
+                declare_link_dead("Wi-Fi lost");
+            } else if (dead) {
+                declare_link_dead("heartbeat missed");
+            } else {
+                // Timestamped like the RTT probes, so every pong is also an RTT sample. Behind a
+                // blocked send the ping waits half a period at most, so the next check is on time.
+                esp_websocket_client_send_with_opcode(s_client, WS_TRANSPORT_OPCODES_PING, (const uint8_t *)&now_us,
+                                                      sizeof(now_us), pdMS_TO_TICKS(period_ms / 2));
+            }
+        }
+        s_link_lost_request = false;
+
+        if (s_reconnect_pending && s_link_up && s_client) {
+            s_reconnect_pending = false;
+            s_link_dead = false;
+            s_stats.fast_reconnects++;
+            ESP_LOGI(TAG, "Fast reconnect after link loss");
+            if (start_client() != ESP_OK) {
+                ESP_LOGE(TAG, "Fast reconnect failed to start");
+                report_connect_failed();
+            }
+        }
+    }
+}
+
+void ws_client_set_heartbeat(uint16_t period_ms, uint8_t misses)
+{
+    s_heartbeat_period_ms = period_ms;
+    s_heartbeat_misses = misses > 0 ? misses : 1;
+}
+
+void ws_client_set_link_up(bool up)
+{
+    s_link_up = up;
+    if (!s_heartbeat_task) {
+        return;
+    }
+    if (!up && s_heartbeat_armed) {
+        s_link_lost_request = true;
+        xTaskNotifyGive(s_heartbeat_task);
+    } else if (up && s_reconnect_pending) {
+        xTaskNotifyGive(s_heartbeat_task);
+    }
+}
+
+// Event task, or the downlink impairment task when a profile is set
+static void handle_binary(const uint8_t *payload, size_t payload_len, bool first_fragment)
+{
+    // Typed frames: the first fragment carries the type byte, later fragments inherit it
+    if (s_header_version == SESSION_HEADER_TYPED && first_fragment) {
+        s_rx_frame_type = payload[0];
+        payload++;
+        payload_len--;
+    }
+    if (s_rx_frame_type != SESSION_FRAME_AUDIO) {
+        if (s_frame_cb) {
+            s_frame_cb(s_rx_frame_type, payload, payload_len, first_fragment, s_frame_ctx);
+        } else {
+            ESP_LOGD(TAG, "Skipping binary frame of type 0x%02x", s_rx_frame_type);
+        }
+    } else if (payload_len > 0) {
+        // Fragments of a coded frame are reassembled into whole blocks by the decoder
+        audio_codec_decode(&s_decoder, payload, payload_len, s_audio_cb, s_user_ctx);
+    }
+}
+
+static void send_impaired(const uint8_t *frame, size_t len, bool first_fragment)
+{
+    (void)first_fragment;
+    media_send_begin();
+    int ret = esp_websocket_client_send_bin(s_client, (const char *)frame, len, pdMS_TO_TICKS(5000));
+    media_send_end();
+    if (ret < 0) {
+        s_stats.send_failures++;
+    }
+}
+
+static void impair_task(void *arg)
+{
+    impair_line_t *line = arg;
+
+    while (true) {
+        size_t size = 0;
+        uint8_t *item = xRingbufferReceive(line->ring, &size, portMAX_DELAY);
+        if (!item) {
+            continue;
+        }
+        impair_item_t header;
+        memcpy(&header, item, sizeof(header));
+        int32_t wait_ms = (int32_t)(header.due_ms - (uint32_t)(esp_timer_get_time() / 1000));
+        if (wait_ms > 0) {
+            vTaskDelay(pdMS_TO_TICKS(wait_ms));
+        }
+        line->deliver(item + sizeof(header), size - sizeof(header), header.first_fragment);
+        vRingbufferReturnItem(line->ring, item);
+    }
+}
+
+// Decides a frame's fate; returns false if it is lost, else its due time
+static bool impair_schedule(impair_line_t *line, size_t len, uint32_t *due_ms)
+{
+    uint32_t now_ms = impair_now_ms();
+    if (net_impair_outage(&s_impair_profile, now_ms)) {
+        return false;
+    }
+
+    portENTER_CRITICAL(&s_impair_lock);
+    net_impair_verdict_t verdict = net_impair_frame(&line->state, len, now_ms);
+    uint32_t due = (uint32_t)(esp_timer_get_time() / 1000) + verdict.delay_ms;
+    if ((int32_t)(line->last_due_ms - due) > 0) {
+        due = line->last_due_ms;
+    }
+    if (!verdict.drop) {
+        line->last_due_ms = due;
+    }
+    portEXIT_CRITICAL(&s_impair_lock);
+
+    *due_ms = due;
+    return !verdict.drop;
+}
+
+static void impair_enqueue(impair_line_t *line, const uint8_t *data, size_t len, uint32_t due_ms,
+                           bool first_fragment)
+{
+    uint8_t *item = NULL;
+    if (xRingbufferSendAcquire(line->ring, (void **)&item, sizeof(impair_item_t) + len, 0) != pdTRUE) {
+        line->overflows++;
+        return;
+    }
+    const impair_item_t header = { .due_ms = due_ms, .first_fragment = first_fragment };
+    memcpy(item, &header, sizeof(header));
+    memcpy(item + sizeof(header), data, len);
+    xRingbufferSendComplete(line->ring, item);
+}
+
+// Event task: one verdict per message, shared by its fragments
+static void impair_receive(const esp_websocket_event_data_t *data)
+{
+    bool first = data->payload_offset == 0;
+    if (first) {
+        s_rx_impair_drop = !impair_schedule(&s_impair_down, data->payload_len, &s_rx_impair_due_ms);
+    }
+    if (!s_rx_impair_drop) {
+        impair_enqueue(&s_impair_down, (const uint8_t *)data->data_ptr, data->data_len, s_rx_impair_due_ms, first);
+    }
+}
+
+// Senders: a binary frame goes out directly, or into the uplink delay line
+static int send_binary(const uint8_t *frame, size_t len, uint32_t timeout_ms)
+{
+    if (!s_impair_enabled) {
+        media_send_begin();
+        int ret = esp_websocket_client_send_bin(s_client, (const char *)frame, len, pdMS_TO_TICKS(timeout_ms));
+        media_send_end();
+        return ret;
+    }
+    uint32_t due_ms = 0;
+    if (impair_schedule(&s_impair_up, len, &due_ms)) {
+        impair_enqueue(&s_impair_up, frame, len, due_ms, true);
+    }
+    return (int)len;
+}
+
+// Called from the event task on connect: each connection replays the profile from the start
+static void impair_reset(void)
+{
+    if (!s_impair_enabled) {
+        return;
+    }
+    portENTER_CRITICAL(&s_impair_lock);
+    s_impair_start_us = esp_timer_get_time();
+    net_impair_init(&s_impair_up.state, &s_impair_profile, NET_IMPAIR_UPLINK);
+    net_impair_init(&s_impair_down.state, &s_impair_profile, NET_IMPAIR_DOWNLINK);
+    s_impair_up.last_due_ms = 0;
+    s_impair_down.last_due_ms = 0;
+    portEXIT_CRITICAL(&s_impair_lock);
+    s_rx_impair_drop = false;
+}
+
+static void impair_log(void)
+{
+    if (!s_impair_enabled) {
+        return;
+    }
+    const impair_line_t *lines[] = { &s_impair_up, &s_impair_down };
+    for (size_t i = 0; i < 2; i++) {
+        const net_impair_t *st = &lines[i]->state;
+        uint32_t passed = st->frames - st->dropped;
+        ESP_LOGI(TAG, "Impairment %s: %lu of %lu frames lost, mean delay %lu ms, %lu line overflows",
+                 i == 0 ? "uplink" : "downlink", (unsigned long)st->dropped, (unsigned long)st->frames,
+                 (unsigned long)(passed ? st->delay_ms_total / passed : 0), (unsigned long)lines[i]->overflows);
+    }
+}
+
+esp_err_t ws_client_set_impairment(const char *profile)
+{
+    if (!profile || !*profile) {
+        s_impair_enabled = false;
+        return ESP_OK;
+    }
+
+    net_impair_profile_t parsed;
+    if (!net_impair_parse(profile, &parsed)) {
+        ESP_LOGE(TAG, "Bad impairment profile: %s", profile);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // The downlink task runs the app's audio callback, so it gets the event task's stack size
+    impair_line_t *lines[] = { &s_impair_up, &s_impair_down };
+    const impair_deliver_t deliver[] = { send_impaired, handle_binary };
+    const char *names[] = { "ws_impair_up", "ws_impair_down" };
+    const uint32_t stacks[] = { 4096, 8192 };
+    for (size_t i = 0; i < 2; i++) {
+        if (lines[i]->ring) {
+            continue;  // Lines and tasks stay once created
+        }
+        lines[i]->deliver = deliver[i];
+        lines[i]->ring = xRingbufferCreateWithCaps(WS_IMPAIR_LINE_BYTES, RINGBUF_TYPE_NOSPLIT, MALLOC_CAP_SPIRAM);
+        if (!lines[i]->ring ||
+            xTaskCreatePinnedToCore(impair_task, names[i], stacks[i], lines[i], 5, NULL, 0) != pdPASS) {
+            ESP_LOGE(TAG, "Failed to create impairment delay line");
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    s_impair_profile = parsed;
+    s_impair_enabled = true;
+    ESP_LOGW(TAG, "Network impairment on: %s (delay %u ms, jitter %u ms, %lu kbit/s, loss %u/1000 x%u, seed %lu)",
+             profile, parsed.delay_ms, parsed.jitter_ms, (unsigned long)parsed.rate_kbps, parsed.loss_permille,
+             parsed.burst_frames, (unsigned long)parsed.seed);
+    return ESP_OK;
+}
 
 /**
  * @brief WebSocket event handler
@@ -31,25 +858,44 @@ static void websocket_event_handler(void *handler_args, esp_event_base_t base, i
         xSemaphoreTake(s_state_mutex, portMAX_DELAY);
         s_connected = true;
         xSemaphoreGive(s_state_mutex);
+        impair_reset();
+        arm_heartbeat();
 
-        if (s_state_cb) {
-            s_state_cb(true, 0, s_user_ctx);  // 0 for connected
-        }
+        // The app hears about the connection once the session is negotiated
+        start_negotiation();
         break;
 
     case WEBSOCKET_EVENT_DISCONNECTED:
         ESP_LOGW(TAG, "WebSocket disconnected");
+        s_stats.disconnects++;
+        impair_log();
+        s_heartbeat_armed = false;
+        request_control_close();
         xSemaphoreTake(s_state_mutex, portMAX_DELAY);
         s_connected = false;
         xSemaphoreGive(s_state_mutex);
+        abort_negotiation();
 
-        if (s_state_cb) {
+        // A link the heartbeat declared dead was already reported
+        xSemaphoreTake(s_callback_mutex, portMAX_DELAY);
+        if (s_state_cb && !s_link_dead) {
             s_state_cb(false, s_last_close_code, s_user_ctx);
         }
+        xSemaphoreGive(s_callback_mutex);
         s_last_close_code = 0;  // Reset after passing to callback
+        connection_closed();
+        break;
+
+    case WEBSOCKET_EVENT_CLOSED:
+        ESP_LOGI(TAG, "WebSocket closed");
+        connection_closed();
         break;
 
     case WEBSOCKET_EVENT_DATA:
+        if (s_impair_enabled && net_impair_outage(&s_impair_profile, impair_now_ms())) {
+            break;  // Emulated outage: nothing arrives, pongs included
+        }
+        note_rx();  // Any frame, pongs included, shows the link is alive
         ESP_LOGD(TAG, "WebSocket data received: %d bytes (offset=%d, payload_len=%d, fin=%d, opcode=0x%02x)",
                  data->data_len, data->payload_offset, data->payload_len, data->fin, data->op_code);
 
@@ -58,33 +904,18 @@ static void websocket_event_handler(void *handler_args, esp_event_base_t base, i
             if (s_audio_cb && data->data_ptr && data->data_len > 0) {
                 ESP_LOGD(TAG, "Calling audio callback with %d bytes (offset=%d/%d)",
                          data->data_len, data->payload_offset, data->payload_len);
-                s_audio_cb((const uint8_t *)data->data_ptr, data->data_len, s_user_ctx);
+                if (s_impair_enabled) {
+                    impair_receive(data);
+                } else {
+                    handle_binary((const uint8_t *)data->data_ptr, data->data_len, data->payload_offset == 0);
+                }
             } else {
                 ESP_LOGW(TAG, "Binary frame but no callback or empty data");
             }
         } else if (data->op_code == 0x01) {  // Text frame (control messages)
             if (data->data_ptr && data->data_len > 0) {
                 ESP_LOGD(TAG, "Received text message: %.*s", data->data_len, (char *)data->data_ptr);
-
-                // Parse JSON control message using cJSON
-                if (s_speech_cb) {
-                    cJSON *json = cJSON_ParseWithLength((char *)data->data_ptr, data->data_len);
-                    if (json != NULL) {
-                        cJSON *type = cJSON_GetObjectItem(json, "type");
-                        if (cJSON_IsString(type) && type->valuestring != NULL) {
-                            if (strcmp(type->valuestring, "speech_start") == 0) {
-                                ESP_LOGI(TAG, "Assistant started speaking");
-                                s_speech_cb(true, s_user_ctx);
-                            } else if (strcmp(type->valuestring, "speech_end") == 0) {
-                                ESP_LOGI(TAG, "Assistant stopped speaking");
-                                s_speech_cb(false, s_user_ctx);
-                            }
-                        }
-                        cJSON_Delete(json);
-                    } else {
-                        ESP_LOGW(TAG, "Failed to parse JSON control message");
-                    }
-                }
+                handle_control_message(data->data_ptr, data->data_len);
             }
         } else if (data->op_code == 0x08) {  // Close frame
             uint16_t close_code = 0;
@@ -112,21 +943,33 @@ static void websocket_event_handler(void *handler_args, esp_event_base_t base, i
             }
 
             // Update connected state and call disconnect callback immediately
+            s_heartbeat_armed = false;
+            request_control_close();
             xSemaphoreTake(s_state_mutex, portMAX_DELAY);
             s_connected = false;
             xSemaphoreGive(s_state_mutex);
+            abort_negotiation();
 
             // Call state callback immediately with close code
+            xSemaphoreTake(s_callback_mutex, portMAX_DELAY);
             if (s_state_cb) {
                 s_state_cb(false, close_code, s_user_ctx);
             }
+            xSemaphoreGive(s_callback_mutex);
 
             // Reset close code after callback (will be 0 if DISCONNECTED event fires later)
             s_last_close_code = 0;
         } else if (data->op_code == 0x09) {  // Ping frame
             ESP_LOGD(TAG, "Received WebSocket ping frame");
         } else if (data->op_code == 0x0a) {  // Pong frame
-            ESP_LOGD(TAG, "Received WebSocket pong frame (keepalive)");
+            // Our RTT probes carry a send timestamp; keepalive pings are empty
+            if (data->data_ptr && data->data_len == sizeof(uint32_t) && data->payload_offset == 0) {
+                uint32_t sent_us;
+                memcpy(&sent_us, data->data_ptr, sizeof(sent_us));
+                latency_hist_record_since(LATENCY_METRIC_RTT, sent_us);
+            } else {
+                ESP_LOGD(TAG, "Received WebSocket pong frame (keepalive)");
+            }
         } else {
             ESP_LOGW(TAG, "Unknown opcode: 0x%02x", data->op_code);
         }
@@ -172,6 +1015,48 @@ esp_err_t ws_client_init(const char *uri,
         return ESP_ERR_NO_MEM;
     }
 
+    // The codec and callback mutexes live as long as the module (senders and the
+    // negotiation jobs may still hold them across a destroy)
+    if (!s_codec_mutex) {
+        s_codec_mutex = xSemaphoreCreateMutex();
+        if (!s_codec_mutex) {
+            ESP_LOGE(TAG, "Failed to create codec mutex");
+            vSemaphoreDelete(s_state_mutex);
+            s_state_mutex = NULL;
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    if (!s_callback_mutex) {
+        s_callback_mutex = xSemaphoreCreateMutex();
+        if (!s_callback_mutex) {
+            ESP_LOGE(TAG, "Failed to create callback mutex");
+            vSemaphoreDelete(s_state_mutex);
+            s_state_mutex = NULL;
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    if (!s_negotiation_timer) {
+        const esp_timer_create_args_t timer_args = {
+            .callback = negotiation_timeout_cb,
+            .name = "ws_negotiate",
+        };
+        if (esp_timer_create(&timer_args, &s_negotiation_timer) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to create negotiation timer");
+            vSemaphoreDelete(s_state_mutex);
+            s_state_mutex = NULL;
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    if (!s_heartbeat_task &&
+        xTaskCreatePinnedToCore(heartbeat_task, "ws_heartbeat", WS_HEARTBEAT_TASK_STACK, NULL,
+                                WS_HEARTBEAT_TASK_PRIORITY, &s_heartbeat_task, 0) != pdPASS) {
+        ESP_LOGW(TAG, "Failed to create heartbeat task, dead links are left to the TCP timeout");
+        s_heartbeat_task = NULL;
+    }
+    session_caps_legacy(&s_session);
+    apply_session(&s_session);
+    snprintf(s_uri, sizeof(s_uri), "%s", uri);
+
     // Store callbacks
     s_audio_cb = audio_cb;
     s_state_cb = state_cb;
@@ -182,9 +1067,9 @@ esp_err_t ws_client_init(const char *uri,
     // Configure WebSocket client
     esp_websocket_client_config_t ws_cfg = {
         .uri = uri,
-        .buffer_size = 4096,  // Larger buffer for audio chunks
-        .task_stack = 8192,   // Increased stack for audio processing
-        .task_prio = 5,
+        .buffer_size = WS_CLIENT_BUFFER_SIZE,  // Larger buffer for audio chunks
+        .task_stack = WS_CLIENT_TASK_STACK,    // Increased stack for audio processing
+        .task_prio = WS_CLIENT_TASK_PRIORITY,
         .disable_auto_reconnect = true,   // Disable auto-reconnect for explicit state control
         .reconnect_timeout_ms = 10000,
         .network_timeout_ms = 10000,
@@ -217,6 +1102,43 @@ esp_err_t ws_client_init(const char *uri,
     return ESP_OK;
 }
 
+void ws_client_set_codec(audio_codec_t uplink, audio_codec_t downlink)
+{
+    s_codec_pref_uplink = uplink;
+    s_codec_pref_downlink = downlink;
+}
+
+esp_err_t ws_client_set_uri(const char *uri)
+{
+    if (!s_client || !uri || strlen(uri) >= sizeof(s_pending_uri)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    xSemaphoreTake(s_state_mutex, portMAX_DELAY);
+    strcpy(s_pending_uri, uri);
+    s_uri_pending = true;
+    xSemaphoreGive(s_state_mutex);
+    return ESP_OK;
+}
+
+void ws_client_set_session(const char *session_id, bool resume)
+{
+    snprintf(s_session_id, sizeof(s_session_id), "%s", session_id ? session_id : "");
+    s_resume_next = resume;
+}
+
+void ws_client_set_control_channel(bool enabled)
+{
+    s_control_offer = enabled;
+}
+
+session_params_t ws_client_get_session(void)
+{
+    xSemaphoreTake(s_codec_mutex, portMAX_DELAY);
+    session_params_t session = s_session;
+    xSemaphoreGive(s_codec_mutex);
+    return session;
+}
+
 esp_err_t ws_client_connect(void)
 {
     if (!s_client) {
@@ -224,8 +1146,20 @@ esp_err_t ws_client_connect(void)
         return ESP_ERR_INVALID_STATE;
     }
 
+    s_reconnect_pending = false;  // This connect replaces a pending fast reconnect
+
+    // A connection still closing holds the client task; start once its closing event is in
+    xSemaphoreTake(s_state_mutex, portMAX_DELAY);
+    bool defer = s_client_running && !s_connected;
+    s_connect_on_close = defer;
+    xSemaphoreGive(s_state_mutex);
+    if (defer) {
+        ESP_LOGI(TAG, "Connecting once the current connection has closed");
+        return ESP_OK;
+    }
+
     ESP_LOGI(TAG, "Connecting to WebSocket server...");
-    esp_err_t err = esp_websocket_client_start(s_client);
+    esp_err_t err = start_client();
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Failed to start WebSocket client: %s", esp_err_to_name(err));
     }
@@ -233,6 +1167,23 @@ esp_err_t ws_client_connect(void)
     return err;
 }
 
+// A ping whose payload is its send time; the pong echoes it back (RFC 6455)
+static void send_rtt_probe(void)
+{
+    if (s_heartbeat_armed) {
+        return;  // Heartbeat pings carry the same timestamp
+    }
+    uint32_t now_us = latency_hist_now_us();
+    if (now_us - s_rtt_probe_us < WS_RTT_PROBE_INTERVAL_MS * 1000) {
+        return;
+    }
+    s_rtt_probe_us = now_us;
+    media_send_begin();
+    esp_websocket_client_send_with_opcode(s_client, WS_TRANSPORT_OPCODES_PING, (const uint8_t *)&now_us,
+                                          sizeof(now_us), pdMS_TO_TICKS(100));
+    media_send_end();
+}
+
 esp_err_t ws_client_send_audio(const uint8_t *data, size_t len)
 {
     if (!s_client) {
@@ -250,22 +1201,153 @@ esp_err_t ws_client_send_audio(const uint8_t *data, size_t len)
         return ESP_ERR_INVALID_STATE;
     }
 
+    // Coded or typed uplink: whole blocks per frame behind the type byte, a
+    // partial block waits for the next chunk. The end-of-turn frame stays empty.
+    xSemaphoreTake(s_codec_mutex, portMAX_DELAY);
+    if ((s_encoder.codec != AUDIO_CODEC_PCM || s_header_version == SESSION_HEADER_TYPED) && len > 0) {
+        const int16_t *pcm = (const int16_t *)data;  // Uplink chunks are int16-aligned
+        size_t num_samples = len / sizeof(int16_t);
+        size_t header = s_header_version == SESSION_HEADER_TYPED ? 1 : 0;
+        esp_err_t result = ESP_OK;
+
+        s_encode_buf[0] = SESSION_FRAME_AUDIO;
+        while (num_samples > 0 && result == ESP_OK) {
+            size_t slice = num_samples < WS_ENCODE_SLICE_SAMPLES ? num_samples : WS_ENCODE_SLICE_SAMPLES;
+            uint32_t start_us = latency_hist_now_us();
+            size_t bytes = audio_codec_encode(&s_encoder, pcm, slice, s_encode_buf + header);
+            if (bytes > 0) {
+                if (send_binary(s_encode_buf, header + bytes, 5000) < 0) {
+                    ESP_LOGE(TAG, "Failed to send WebSocket data (timeout or network error)");
+                    s_stats.send_failures++;
+                    result = ESP_ERR_TIMEOUT;
+                } else {
+                    latency_hist_record_since(LATENCY_METRIC_SEND, start_us);
+                }
+            }
+            pcm += slice;
+            num_samples -= slice;
+        }
+        xSemaphoreGive(s_codec_mutex);
+        if (result == ESP_OK) {
+            send_rtt_probe();
+        }
+        return result;
+    }
+    xSemaphoreGive(s_codec_mutex);
+
     // Send binary frame (opcode 0x02) with timeout to prevent blocking
     // Empty frames (len=0) are sent to signal end of turn to the proxy
-    int ret = esp_websocket_client_send_bin(s_client, (const char *)data, len, pdMS_TO_TICKS(5000));
+    uint32_t start_us = latency_hist_now_us();
+    int ret = send_binary(data, len, 5000);
     if (ret < 0) {
         ESP_LOGE(TAG, "Failed to send WebSocket data (timeout or network error)");
+        s_stats.send_failures++;
         return ESP_ERR_TIMEOUT;
     }
 
     if (len == 0) {
         ESP_LOGI(TAG, "Sent empty frame to signal end of turn");
     } else {
+        latency_hist_record_since(LATENCY_METRIC_SEND, start_us);
+        send_rtt_probe();
         ESP_LOGD(TAG, "Sent %d bytes via WebSocket", ret);
     }
     return ESP_OK;
 }
 
+esp_err_t ws_client_send_frame(uint8_t type, const uint8_t *data, size_t len, uint32_t timeout_ms)
+{
+    if (!s_client || !ws_client_is_connected()) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xSemaphoreTake(s_codec_mutex, portMAX_DELAY);
+    bool typed = s_header_version == SESSION_HEADER_TYPED;
+    xSemaphoreGive(s_codec_mutex);
+    if (!typed) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    uint8_t *frame = malloc(1 + len);
+    if (!frame) {
+        return ESP_ERR_NO_MEM;
+    }
+    frame[0] = type;
+    memcpy(frame + 1, data, len);
+    int ret = send_binary(frame, 1 + len, timeout_ms);
+    free(frame);
+
+    if (ret < 0) {
+        ESP_LOGW(TAG, "Failed to send frame type 0x%02x", type);
+        return ESP_ERR_TIMEOUT;
+    }
+    ESP_LOGD(TAG, "Sent frame type 0x%02x, %u bytes", type, (unsigned)len);
+    return ESP_OK;
+}
+
+void ws_client_set_frame_handler(ws_frame_cb_t cb, void *ctx)
+{
+    s_frame_ctx = ctx;
+    s_frame_cb = cb;
+}
+
+ws_client_stats_t ws_client_get_stats(void)
+{
+    return s_stats;
+}
+
+// Over the control connection once attached, else (or if that fails) over the media connection
+static int send_control_text(const char *text)
+{
+    if (s_control_ready) {
+        int ret = esp_websocket_client_send_text(s_control_client, text, strlen(text),
+                                                 pdMS_TO_TICKS(WS_CONTROL_SEND_TIMEOUT_MS));
+        if (ret >= 0) {
+            return ret;
+        }
+        ESP_LOGW(TAG, "Control connection send failed, using the media connection");
+    }
+    media_send_begin();
+    int ret = esp_websocket_client_send_text(s_client, text, strlen(text), pdMS_TO_TICKS(WS_CONTROL_SEND_TIMEOUT_MS));
+    media_send_end();
+    return ret;
+}
+
+esp_err_t ws_client_send_control_ping(void)
+{
+    if (!s_client || !ws_client_is_connected()) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    char ping[48];
+    snprintf(ping, sizeof(ping), "{\"type\":\"control_ping\",\"t\":%lu}", (unsigned long)latency_hist_now_us());
+    return send_control_text(ping) < 0 ? ESP_ERR_TIMEOUT : ESP_OK;
+}
+
+esp_err_t ws_client_send_text(const char *text)
+{
+    if (!s_client || !text) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xSemaphoreTake(s_state_mutex, portMAX_DELAY);
+    bool connected = s_connected;
+    xSemaphoreGive(s_state_mutex);
+
+    if (!connected) {
+        ESP_LOGW(TAG, "Cannot send control message: WebSocket not connected");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    int ret = send_control_text(text);
+    if (ret < 0) {
+        ESP_LOGE(TAG, "Failed to send control message");
+        return ESP_ERR_TIMEOUT;
+    }
+
+    ESP_LOGI(TAG, "Sent control message: %s", text);
+    return ESP_OK;
+}
+
 bool ws_client_is_connected(void)
 {
     if (!s_state_mutex) {
@@ -286,14 +1368,19 @@ esp_err_t ws_client_disconnect(void)
     }
 
     ESP_LOGI(TAG, "Disconnecting WebSocket client...");
+    s_heartbeat_armed = false;
+    s_reconnect_pending = false;
+    request_control_close();
     esp_err_t err = esp_websocket_client_stop(s_client);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Failed to stop WebSocket client: %s", esp_err_to_name(err));
     }
+    client_stopped();
 
     xSemaphoreTake(s_state_mutex, portMAX_DELAY);
     s_connected = false;
     xSemaphoreGive(s_state_mutex);
+    abort_negotiation();
 
     return err;
 }
@@ -307,6 +1394,20 @@ esp_err_t ws_client_destroy(void)
     // Stop if still running
     ws_client_disconnect();
 
+    // A queued negotiation job still takes the state mutex
+    while (__atomic_load_n(&s_negotiation_jobs, __ATOMIC_ACQUIRE) > 0) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+
+    // The control connection goes with it (stopped by the heartbeat task, or never started)
+    for (int waited_ms = 0; s_control_running && waited_ms < 1000; waited_ms += 10) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    if (s_control_client && !s_control_running) {
+        esp_websocket_client_destroy(s_control_client);
+        s_control_client = NULL;
+    }
+
     // Destroy client
     esp_err_t err = esp_websocket_client_destroy(s_client);
     if (err != ESP_OK) {
@@ -1,6 +1,8 @@
 #pragma once
 
+#include "audio_codec.h"
 #include "esp_err.h"
+#include "session_caps.h"
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -31,6 +33,32 @@ typedef void (*ws_state_change_cb_t)(bool connected, uint16_t close_code, void *
  */
 typedef void (*ws_speech_event_cb_t)(bool is_speaking, void *user_ctx);
 
+/**
+ * @brief Callback for non-audio binary frames of a typed session
+ *
+ * Called from the client's receive path for each fragment: the type byte is
+ * stripped from the first one, later fragments of the same message follow
+ * with first_fragment false.
+ *
+ * @param type SESSION_FRAME_* of the message
+ */
+typedef void (*ws_frame_cb_t)(uint8_t type, const uint8_t *data, size_t len, bool first_fragment, void *ctx);
+
+// esp_websocket_client settings; override from the build to compare transports (see ws_bench.h)
+#ifndef WS_CLIENT_BUFFER_SIZE
+#define WS_CLIENT_BUFFER_SIZE       4096    // Receive buffer: larger messages arrive in fragments
+#endif
+#ifndef WS_CLIENT_TASK_STACK
+#define WS_CLIENT_TASK_STACK        8192
+#endif
+#ifndef WS_CLIENT_TASK_PRIORITY
+#define WS_CLIENT_TASK_PRIORITY     5
+#endif
+
+// Close code reported when the heartbeat or a Wi-Fi loss declares the link dead
+// (RFC 6455 "abnormal closure": no close frame was received)
+#define WS_CLOSE_LINK_LOST  1006
+
 /**
  * @brief Initialize WebSocket client
  *
@@ -47,22 +75,162 @@ esp_err_t ws_client_init(const char *uri,
                           ws_speech_event_cb_t speech_cb,
                           void *user_ctx);
 
+/**
+ * @brief Set the preferred codecs offered at the next connect
+ *
+ * The hello lists these first, then the other codecs. Audio stays raw PCM
+ * unless the proxy's hello_ack picks a codec, so a legacy proxy keeps the
+ * session on PCM. Callers always send and receive PCM; encoding and decoding
+ * happen inside the client.
+ *
+ * @param uplink Preferred codec for microphone audio
+ * @param downlink Preferred codec for assistant audio
+ */
+void ws_client_set_codec(audio_codec_t uplink, audio_codec_t downlink);
+
+/**
+ * @brief Switch the proxy URI (takes effect at the next connect or fast reconnect)
+ *
+ * @return ESP_ERR_INVALID_ARG if the client is not initialized or the URI is too long
+ */
+esp_err_t ws_client_set_uri(const char *uri);
+
+/**
+ * @brief Identify the session in the next hello
+ *
+ * With resume set, the hello asks the proxy to continue the conversation of
+ * session_id rather than start a new one. A fast reconnect after a link loss
+ * always asks to resume. The hello_ack says whether the proxy did
+ * (session_params_t.resumed).
+ *
+ * @param session_id Persistent session id (NULL or "" leaves it out of the hello)
+ */
+void ws_client_set_session(const char *session_id, bool resume);
+
+/**
+ * @brief Offer a separate control connection (takes effect at the next connect)
+ *
+ * If the proxy accepts, a second WebSocket to the same URI carries the JSON
+ * control messages in both directions, so none of them waits behind queued
+ * audio in either TCP stream. Until it attaches, and if it drops, control
+ * messages use the media connection as before. The media connection's
+ * heartbeat still decides whether the link is alive.
+ */
+void ws_client_set_control_channel(bool enabled);
+
+/**
+ * @brief Parameters of the current session
+ *
+ * Valid from the connected state callback on; legacy defaults before that.
+ */
+session_params_t ws_client_get_session(void);
+
+/**
+ * @brief Configure the heartbeat (takes effect at the next connect)
+ *
+ * While connected, a timestamped ping goes out every period_ms. Any frame
+ * received counts as a sign of life. After misses silent periods the link is
+ * declared dead (time blocked in a media send is forgiven, up to one more
+ * window, see link_liveness.h): the state callback gets WS_CLOSE_LINK_LOST, the transport is
+ * stopped and one reconnect is attempted once Wi-Fi is up. The hello tells the
+ * proxy the period so it can detect a dead device the same way.
+ *
+ * @param period_ms Ping period (0 turns the heartbeat off; default 200)
+ * @param misses Silent periods before the link is dead (default 4)
+ */
+void ws_client_set_heartbeat(uint16_t period_ms, uint8_t misses);
+
+/**
+ * @brief Report the Wi-Fi link state (from the Wi-Fi event handler)
+ *
+ * Losing the link declares a connected WebSocket dead at once. A fast
+ * reconnect after a dead link waits until the link is back.
+ */
+void ws_client_set_link_up(bool up);
+
+/**
+ * @brief Emulate a bad network on this connection (bench tests only)
+ *
+ * Binary frames in both directions get the latency, jitter, bandwidth cap,
+ * burst loss and outages of the profile (see net_impair.h), replayed from the
+ * seed at every connect. Nothing is received during an outage, so the
+ * heartbeat sees it as a dead link. Control text frames are not impaired.
+ *
+ * @param profile Profile text, e.g. "wifi_poor,seed=7" (NULL or "" turns it off)
+ * @return ESP_ERR_INVALID_ARG for a bad profile
+ */
+esp_err_t ws_client_set_impairment(const char *profile);
+
 /**
  * @brief Connect to WebSocket server
  *
- * @return ESP_OK on success
+ * While the previous connection is still closing, the connect is held back
+ * until the client reports the close, then started from a network worker; a
+ * start that fails then is reported through the state callback.
+ *
+ * @return ESP_OK on success (or once the connect is held back)
  */
 esp_err_t ws_client_connect(void);
 
 /**
  * @brief Send binary audio data over WebSocket
  *
- * @param data Pointer to audio data
+ * Encoded with the negotiated uplink codec, behind a type byte if the session
+ * uses typed frames; an empty frame (end of turn) is sent as is.
+ *
+ * @param data Pointer to 16-bit PCM audio data
  * @param len Length of data in bytes
  * @return ESP_OK on success
  */
 esp_err_t ws_client_send_audio(const uint8_t *data, size_t len);
 
+/**
+ * @brief Send a non-audio binary frame (typed-header sessions only)
+ *
+ * The frame goes out as the type byte followed by data. Gives up after
+ * timeout_ms rather than queueing behind audio.
+ *
+ * @param type SESSION_FRAME_* other than audio
+ * @return ESP_ERR_NOT_SUPPORTED if the session has no typed headers
+ */
+esp_err_t ws_client_send_frame(uint8_t type, const uint8_t *data, size_t len, uint32_t timeout_ms);
+
+/**
+ * @brief Send a timestamped control_ping the way control messages currently go
+ *
+ * The proxy answers with control_pong on the same connection; the round trip
+ * is recorded as the control_rtt latency metric.
+ */
+esp_err_t ws_client_send_control_ping(void);
+
+/**
+ * @brief Receive non-audio typed frames (NULL: they are dropped)
+ */
+void ws_client_set_frame_handler(ws_frame_cb_t cb, void *ctx);
+
+/**
+ * @brief Connection counters since boot
+ */
+typedef struct {
+    uint32_t connects;              // Sessions that reached the connected state
+    uint32_t disconnects;
+    uint32_t send_failures;         // Binary sends that timed out or failed
+    uint32_t link_losses;           // Links declared dead by the heartbeat or Wi-Fi
+    uint32_t fast_reconnects;       // Reconnects started after a link loss
+    uint32_t control_attaches;      // Control connections attached
+    uint32_t control_losses;        // Control connections that dropped while the media link stayed up
+} ws_client_stats_t;
+
+ws_client_stats_t ws_client_get_stats(void);
+
+/**
+ * @brief Send a text (JSON control) message over WebSocket
+ *
+ * @param text NUL-terminated message
+ * @return ESP_OK on success
+ */
+esp_err_t ws_client_send_text(const char *text);
+
 /**
  * @brief Check if WebSocket is connected
  *
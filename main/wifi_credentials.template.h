@@ -3,3 +3,7 @@
 #define WIFI_SSID "YOUR_WIFI_SSID"
 #define WIFI_PASSWORD "YOUR_WIFI_PASSWORD"
 #define WEBSOCKET_URL "ws://YOUR_SERVER_IP:8000/ws"
+
+// Optional: several proxies, comma-separated. The device probes them and uses
+// the fastest healthy one, failing over to the next if it drops.
+// #define WEBSOCKET_URLS "ws://10.0.0.2:8000/ws,ws://10.0.0.3:8000/ws"
@@ -0,0 +1,320 @@
+#include "ws_bench.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "latency_hist.h"
+#include "session_caps.h"
+#include "websocket_client.h"
+
+static const char *TAG = "ws_bench";
+
+#define WS_BENCH_STEP_MS            3000    // Traffic per step
+#define WS_BENCH_SETTLE_MS          500     // Quiet time between steps
+#define WS_BENCH_CALIBRATE_MS       1000    // Spinner baseline before the sweep
+#define WS_BENCH_REPORT_TIMEOUT_MS  3000    // Wait for the proxy's report after a step
+#define WS_BENCH_SEND_TIMEOUT_MS    2000
+#define WS_BENCH_HEADER_BYTES       8       // u32 sequence, u32 send time (us), little-endian
+#define WS_BENCH_REPORT_SEQ         0xFFFFFFFFu  // Proxy report: u32 messages, then u32 bytes
+#define WS_BENCH_TASK_PRIORITY      4       // Below the client task, like the app's uplink sender
+#define WS_BENCH_CORES              2
+#define WS_BENCH_CONTROL_PING_MS    100     // control_ping period during the sweep
+#define WS_BENCH_CONTROL_PRIORITY   5       // Above the bench sender, like a UI-driven control message
+
+static const uint16_t s_sizes[] = { 320, 1600, 3200, 6400, 12800 };
+static const uint8_t s_rates_hz[] = { 10, 50, 0 };  // 0: as fast as the transport takes them
+
+typedef struct {
+    uint32_t messages;
+    uint32_t bytes;
+    uint32_t failures;
+} bench_counts_t;
+
+static TaskHandle_t s_task = NULL;
+static latency_hist_t s_hist;                       // Send time (up) or delivery delay (down)
+
+// Receive side, written by the client's event task
+static volatile uint32_t s_rx_messages = 0;
+static volatile uint32_t s_rx_bytes = 0;
+static uint32_t s_first_rx_us = 0;
+static uint32_t s_first_sent_us = 0;
+static volatile uint32_t s_report_messages = 0;   // Messages the proxy received (up) or sent (down)
+
+// CPU load: idle-priority spinners count while nothing else wants the core
+static volatile bool s_spin_run = false;        // Also keeps the control pinger going
+static volatile uint32_t s_spin_counts[WS_BENCH_CORES];
+static float s_spin_base[WS_BENCH_CORES];           // Counts per ms with the link quiet
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Event task
+static void bench_frame_cb(uint8_t type, const uint8_t *data, size_t len, bool first_fragment, void *ctx)
+{
+    (void)ctx;
+    if (type != SESSION_FRAME_BENCH) {
+        return;
+    }
+    uint32_t now_us = latency_hist_now_us();
+    if (!first_fragment || len < WS_BENCH_HEADER_BYTES) {
+        s_rx_bytes += len;
+        return;
+    }
+
+    uint32_t seq = get_u32(data);
+    uint32_t sent_us = get_u32(data + 4);
+    if (seq == WS_BENCH_REPORT_SEQ) {
+        s_report_messages = sent_us;
+        if (s_task) {
+            xTaskNotifyGive(s_task);
+        }
+        return;
+    }
+
+    s_rx_bytes += len;
+    if (s_rx_messages++ == 0) {
+        s_first_rx_us = now_us;
+        s_first_sent_us = sent_us;
+    }
+    // How much later than the first message this one arrived, beyond the sender's own spacing
+    int32_t delay_us = (int32_t)((now_us - s_first_rx_us) - (sent_us - s_first_sent_us));
+    latency_hist_record(&s_hist, delay_us > 0 ? (uint32_t)delay_us : 0);
+}
+
+static void spin_task(void *arg)
+{
+    volatile uint32_t *count = (volatile uint32_t *)arg;
+    while (s_spin_run) {
+        (*count)++;
+    }
+    vTaskDelete(NULL);
+}
+
+// Control messages sent under the step's load; each pong lands in the control_rtt metric
+static void control_ping_task(void *arg)
+{
+    (void)arg;
+    TickType_t last_wake = xTaskGetTickCount();
+    while (s_spin_run) {
+        vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(WS_BENCH_CONTROL_PING_MS));
+        ws_client_send_control_ping();
+    }
+    vTaskDelete(NULL);
+}
+
+static void spin_read(uint32_t counts[WS_BENCH_CORES])
+{
+    for (int core = 0; core < WS_BENCH_CORES; core++) {
+        counts[core] = s_spin_counts[core];
+    }
+}
+
+// Percent of each core the step took beyond the quiet baseline
+static void cpu_load(const uint32_t start[WS_BENCH_CORES], int64_t elapsed_us, int load[WS_BENCH_CORES])
+{
+    uint32_t now[WS_BENCH_CORES];
+    spin_read(now);
+    for (int core = 0; core < WS_BENCH_CORES; core++) {
+        float rate = (now[core] - start[core]) / (elapsed_us / 1000.0f);
+        load[core] = s_spin_base[core] > 0 ? (int)(100.0f * (1.0f - rate / s_spin_base[core]) + 0.5f) : 0;
+    }
+}
+
+static bool wait_report(uint32_t timeout_ms)
+{
+    return ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(timeout_ms)) > 0;
+}
+
+static void log_step(const char *dir, uint16_t size, uint8_t rate_hz, const bench_counts_t *counts,
+                     int64_t elapsed_us, const int load[WS_BENCH_CORES], uint32_t delivered, bool reported)
+{
+    latency_hist_snapshot_t snap;
+    latency_hist_snapshot(&s_hist, &snap, true);
+    latency_hist_snapshot_t control;
+    latency_hist_snapshot_metric(LATENCY_METRIC_CONTROL_RTT, &control, true);
+
+    char rate[8] = "max";
+    if (rate_hz) {
+        snprintf(rate, sizeof(rate), "%u/s", rate_hz);
+    }
+    float seconds = elapsed_us / 1e6f;
+    ESP_LOGI(TAG, "%-4s %5u B @ %-4s %6.1f msg/s %7.1f kB/s | %s p50 %6.2f p90 %6.2f p99 %6.2f max %7.2f ms | "
+             "ctrl p50 %6.2f p99 %6.2f ms | cpu0 %+3d%% cpu1 %+3d%%",
+             dir, size, rate, counts->messages / seconds, counts->bytes / seconds / 1000.0f,
+             dir[0] == 'u' ? "send " : "delay", latency_hist_percentile(&snap, 50) / 1000.0f,
+             latency_hist_percentile(&snap, 90) / 1000.0f, latency_hist_percentile(&snap, 99) / 1000.0f,
+             snap.max_us / 1000.0f, latency_hist_percentile(&control, 50) / 1000.0f,
+             latency_hist_percentile(&control, 99) / 1000.0f, load[0], load[1]);
+    if (!reported) {
+        ESP_LOGW(TAG, "     no report from the proxy (%lu messages, %lu failed)", (unsigned long)counts->messages,
+                 (unsigned long)counts->failures);
+    } else if (delivered != counts->messages || counts->failures > 0) {
+        ESP_LOGW(TAG, "     %lu of %lu messages delivered, %lu failed sends", (unsigned long)delivered,
+                 (unsigned long)counts->messages, (unsigned long)counts->failures);
+    }
+}
+
+static void run_up(uint8_t *buf, uint16_t size, uint8_t rate_hz)
+{
+    bench_counts_t counts = { 0 };
+    memset(buf, 0x55, size);
+    ulTaskNotifyTake(pdTRUE, 0);
+    ws_client_send_text("{\"type\":\"bench\",\"dir\":\"up\"}");
+
+    uint32_t spin_start[WS_BENCH_CORES];
+    spin_read(spin_start);
+    int64_t start_us = esp_timer_get_time();
+    TickType_t last_wake = xTaskGetTickCount();
+    TickType_t period = rate_hz ? pdMS_TO_TICKS(1000 / rate_hz) : 0;  // Whole ticks: rates divide 100 Hz
+
+    while (esp_timer_get_time() - start_us < WS_BENCH_STEP_MS * 1000LL) {
+        if (period) {
+            vTaskDelayUntil(&last_wake, period);
+        }
+        uint32_t sent_us = latency_hist_now_us();
+        put_u32(buf, counts.messages + counts.failures);
+        put_u32(buf + 4, sent_us);
+        if (ws_client_send_frame(SESSION_FRAME_BENCH, buf, size, WS_BENCH_SEND_TIMEOUT_MS) == ESP_OK) {
+            latency_hist_record(&s_hist, latency_hist_now_us() - sent_us);
+            counts.messages++;
+            counts.bytes += size;
+        } else {
+            counts.failures++;
+            if (!ws_client_is_connected()) {
+                break;
+            }
+        }
+    }
+    int64_t elapsed_us = esp_timer_get_time() - start_us;
+    int load[WS_BENCH_CORES];
+    cpu_load(spin_start, elapsed_us, load);
+
+    ws_client_send_text("{\"type\":\"bench_end\"}");
+    bool reported = wait_report(WS_BENCH_REPORT_TIMEOUT_MS);
+    log_step("up", size, rate_hz, &counts, elapsed_us, load, s_report_messages, reported);
+}
+
+static void run_down(uint16_t size, uint8_t rate_hz)
+{
+    char request[128];
+    snprintf(request, sizeof(request),
+             "{\"type\":\"bench\",\"dir\":\"down\",\"size\":%u,\"rate_hz\":%u,\"duration_ms\":%d}", size, rate_hz,
+             WS_BENCH_STEP_MS);
+    s_rx_messages = 0;
+    s_rx_bytes = 0;
+    ulTaskNotifyTake(pdTRUE, 0);
+
+    uint32_t spin_start[WS_BENCH_CORES];
+    spin_read(spin_start);
+    int64_t start_us = esp_timer_get_time();
+    ws_client_send_text(request);
+    bool reported = wait_report(WS_BENCH_STEP_MS + WS_BENCH_REPORT_TIMEOUT_MS);
+    int64_t elapsed_us = esp_timer_get_time() - start_us;
+    int load[WS_BENCH_CORES];
+    cpu_load(spin_start, elapsed_us, load);
+
+    // The report follows the last message, so the rates cover everything the step delivered
+    bench_counts_t counts = { .messages = s_rx_messages, .bytes = s_rx_bytes };
+    log_step("down", size, rate_hz, &counts, elapsed_us, load, counts.messages, reported);
+    if (reported && s_report_messages != counts.messages) {
+        ESP_LOGW(TAG, "     proxy sent %lu messages, %lu arrived", (unsigned long)s_report_messages,
+                 (unsigned long)counts.messages);
+    }
+}
+
+static void bench_task(void *arg)
+{
+    (void)arg;
+    uint8_t *buf = heap_caps_malloc(s_sizes[sizeof(s_sizes) / sizeof(s_sizes[0]) - 1], MALLOC_CAP_SPIRAM);
+    if (!buf) {
+        ESP_LOGE(TAG, "No memory for the send buffer");
+        goto done;
+    }
+
+    s_spin_run = true;
+    for (int core = 0; core < WS_BENCH_CORES; core++) {
+        s_spin_counts[core] = 0;
+        if (xTaskCreatePinnedToCore(spin_task, "ws_bench_spin", 2048, (void *)&s_spin_counts[core], tskIDLE_PRIORITY,
+                                    NULL, core) != pdPASS) {
+            ESP_LOGW(TAG, "No spinner on core %d, its CPU load reads 0", core);
+        }
+    }
+    uint32_t spin_start[WS_BENCH_CORES];
+    spin_read(spin_start);
+    vTaskDelay(pdMS_TO_TICKS(WS_BENCH_CALIBRATE_MS));
+    uint32_t spin_end[WS_BENCH_CORES];
+    spin_read(spin_end);
+    for (int core = 0; core < WS_BENCH_CORES; core++) {
+        s_spin_base[core] = (spin_end[core] - spin_start[core]) / (float)WS_BENCH_CALIBRATE_MS;
+    }
+
+    ws_client_set_frame_handler(bench_frame_cb, NULL);
+    if (xTaskCreatePinnedToCore(control_ping_task, "ws_bench_ctl", 3072, NULL, WS_BENCH_CONTROL_PRIORITY, NULL,
+                                0) != pdPASS) {
+        ESP_LOGW(TAG, "No control pinger, ctrl columns read 0");
+    }
+    ESP_LOGI(TAG, "Transport: buffer %d B, client task stack %d, priority %d; %d ms per step; control over the %s",
+             WS_CLIENT_BUFFER_SIZE, WS_CLIENT_TASK_STACK, WS_CLIENT_TASK_PRIORITY, WS_BENCH_STEP_MS,
+             ws_client_get_session().control_token[0] ? "control connection" : "media connection");
+
+    for (int dir = 0; dir < 2; dir++) {
+        for (size_t i = 0; i < sizeof(s_sizes) / sizeof(s_sizes[0]); i++) {
+            for (size_t j = 0; j < sizeof(s_rates_hz) / sizeof(s_rates_hz[0]); j++) {
+                if (!ws_client_is_connected()) {
+                    ESP_LOGE(TAG, "Disconnected, stopping the sweep");
+                    goto stop;
+                }
+                latency_hist_snapshot_t discard;
+                latency_hist_snapshot(&s_hist, &discard, true);
+                latency_hist_snapshot_metric(LATENCY_METRIC_CONTROL_RTT, &discard, true);
+                if (dir == 0) {
+                    run_up(buf, s_sizes[i], s_rates_hz[j]);
+                } else {
+                    run_down(s_sizes[i], s_rates_hz[j]);
+                }
+                vTaskDelay(pdMS_TO_TICKS(WS_BENCH_SETTLE_MS));
+            }
+        }
+    }
+    ESP_LOGI(TAG, "Sweep done");
+
+stop:
+    ws_client_set_frame_handler(NULL, NULL);
+    s_spin_run = false;
+    vTaskDelay(pdMS_TO_TICKS(20));  // Spinners see the flag and exit
+done:
+    heap_caps_free(buf);
+    s_task = NULL;
+    vTaskDelete(NULL);
+}
+
+void ws_bench_start(void)
+{
+    if (s_task) {
+        ESP_LOGW(TAG, "Benchmark already running");
+        return;
+    }
+    if (!ws_client_is_connected() || ws_client_get_session().header_version != SESSION_HEADER_TYPED) {
+        ESP_LOGE(TAG, "Benchmark needs a connected session with typed frames");
+        return;
+    }
+    if (xTaskCreatePinnedToCore(bench_task, "ws_bench", 4096, NULL, WS_BENCH_TASK_PRIORITY, &s_task, 1) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create benchmark task");
+        s_task = NULL;
+    }
+}
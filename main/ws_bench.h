@@ -0,0 +1,31 @@
+#pragma once
+
+/**
+ * @brief WebSocket transport benchmark against tools/stand_in_proxy.py
+ *
+ * Sweeps message sizes and rates in both directions through the ws_client_*
+ * API, using SESSION_FRAME_BENCH frames on a live, typed session:
+ *
+ *   up    The device sends for a few seconds, timing every
+ *         ws_client_send_frame() call; the proxy reports what it received.
+ *   down  The proxy sends, stamping each message with its send time. The
+ *         device reports each message's delay relative to the first one of
+ *         the step, which is how far delivery falls behind the sender
+ *         (clock offsets cancel out).
+ *
+ * Each step logs messages/s, bytes/s, latency percentiles, the round trip of
+ * control_ping messages sent every 100 ms alongside (the control_rtt metric,
+ * over the control connection if one is attached) and the CPU load of both
+ * cores (from idle-priority spinner tasks calibrated before the sweep).
+ * The WS_CLIENT_* transport settings are logged with the results; rebuild
+ * with other values to compare them. tools/ws_bench.py runs the same sweep
+ * from a host for a baseline.
+ *
+ * Bench only: audio keeps streaming alongside, and a proxy that does not
+ * know the bench messages makes every step time out.
+ */
+
+/**
+ * @brief Run the sweep in a background task (needs a connected typed session)
+ */
+void ws_bench_start(void);
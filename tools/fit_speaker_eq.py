@@ -0,0 +1,214 @@
+#!/usr/bin/env python3
+"""Fit playback EQ parameters from a measured speaker response.
+
+Fit mode reads a CSV of `freq_hz,level_db` pairs (e.g. exported from REW with a
+measurement microphone in front of the device), fits a cascade of peaking
+biquads that flattens the response around the speech band and writes an NVS
+partition CSV holding the `audio_playback_dsp_params_t` blob:
+
+    tools/fit_speaker_eq.py fit response.csv -o speaker_eq.csv
+    python $IDF_PATH/components/nvs_flash/nvs_partition_generator/nvs_partition_gen.py \\
+        generate speaker_eq.csv speaker_eq.bin 0x6000
+
+Bench mode summarises the `playback_dsp` cycle counters from a monitor log:
+
+    idf.py monitor | tee device.log
+    tools/fit_speaker_eq.py bench device.log
+
+Only the Python standard library is used.
+"""
+
+import argparse
+import cmath
+import csv
+import math
+import re
+import struct
+import sys
+
+# Must match main/audio_playback_dsp.h
+PARAMS_VERSION = 1
+MAX_EQ_BANDS = 6
+MAX_COMP_BANDS = 3
+EQ_PEAK = 0
+
+SAMPLE_RATE = 24000
+FIT_MIN_HZ = 200
+FIT_MAX_HZ = 8000
+MAX_BOOST_DB = 6.0
+MAX_CUT_DB = 12.0
+MIN_CORRECTION_DB = 1.0
+
+# Compressor defaults written alongside the fitted EQ (match s_default_params)
+DEFAULT_CROSSOVERS = (400, 3000)
+DEFAULT_COMP = (
+    (-2400, 200, 10, 150, 0),
+    (-2000, 250, 5, 100, 200),
+    (-2200, 250, 2, 80, 100),
+)
+
+
+def load_response(path):
+    points = []
+    with open(path, newline="") as f:
+        for row in csv.reader(f):
+            if not row or row[0].lstrip().startswith("#"):
+                continue
+            try:
+                points.append((float(row[0]), float(row[1])))
+            except ValueError:
+                continue  # Header line
+    points.sort()
+    if len(points) < 8:
+        sys.exit(f"{path}: need at least 8 frequency points")
+    return points
+
+
+def interpolate(points, freq):
+    if freq <= points[0][0]:
+        return points[0][1]
+    for (f0, l0), (f1, l1) in zip(points, points[1:]):
+        if f0 <= freq <= f1:
+            t = math.log(freq / f0) / math.log(f1 / f0)
+            return l0 + t * (l1 - l0)
+    return points[-1][1]
+
+
+def log_grid(lo, hi, per_octave=24):
+    n = int(math.log2(hi / lo) * per_octave) + 1
+    return [lo * 2 ** (i / per_octave) for i in range(n)]
+
+
+def smooth(grid, levels, octave_fraction=6):
+    half = 1.0 / (2 * octave_fraction)
+    out = []
+    for f in grid:
+        window = [l for g, l in zip(grid, levels) if abs(math.log2(g / f)) <= half]
+        out.append(sum(window) / len(window))
+    return out
+
+
+def peak_response_db(freq, f0, q, gain_db):
+    """Magnitude of the RBJ peaking biquad used on the device, in dB."""
+    a = 10 ** (gain_db / 40)
+    w0 = 2 * math.pi * f0 / SAMPLE_RATE
+    alpha = math.sin(w0) / (2 * q)
+    b = (1 + alpha * a, -2 * math.cos(w0), 1 - alpha * a)
+    den = (1 + alpha / a, -2 * math.cos(w0), 1 - alpha / a)
+    z = cmath.exp(-1j * 2 * math.pi * freq / SAMPLE_RATE)
+    h = (b[0] + b[1] * z + b[2] * z * z) / (den[0] + den[1] * z + den[2] * z * z)
+    return 20 * math.log10(abs(h))
+
+
+def fit(points, max_bands):
+    grid = log_grid(FIT_MIN_HZ, FIT_MAX_HZ)
+    measured = smooth(grid, [interpolate(points, f) for f in grid])
+    target = sum(measured) / len(measured)
+    error = [m - target for m in measured]
+    bands = []
+
+    for _ in range(max_bands):
+        idx = max(range(len(grid)), key=lambda i: abs(error[i]))
+        peak = error[idx]
+        if abs(peak) < MIN_CORRECTION_DB:
+            break
+
+        # Bandwidth from where the deviation falls to half its peak
+        lo = idx
+        while lo > 0 and abs(error[lo - 1]) > abs(peak) / 2 and error[lo - 1] * peak > 0:
+            lo -= 1
+        hi = idx
+        while hi < len(grid) - 1 and abs(error[hi + 1]) > abs(peak) / 2 and error[hi + 1] * peak > 0:
+            hi += 1
+        octaves = max(math.log2(grid[hi] / grid[lo]), 1 / 6)
+        q = math.sqrt(2 ** octaves) / (2 ** octaves - 1)
+        q = min(max(q, 0.3), 10.0)
+
+        gain = max(min(-peak, MAX_BOOST_DB), -MAX_CUT_DB)
+        freq = grid[idx]
+        bands.append((freq, q, gain))
+        error = [e + peak_response_db(f, freq, q, gain) for f, e in zip(grid, error)]
+
+    residual = max(abs(e) for e in error)
+    return bands, target, residual
+
+
+def pack_params(bands):
+    blob = struct.pack("<BBBB", PARAMS_VERSION, len(bands), MAX_COMP_BANDS, 0)
+    for i in range(MAX_EQ_BANDS):
+        if i < len(bands):
+            freq, q, gain = bands[i]
+            blob += struct.pack("<BBHhH", EQ_PEAK, 0, round(freq), round(gain * 100), round(q * 1000))
+        else:
+            blob += struct.pack("<BBHhH", 0, 0, 0, 0, 0)
+    blob += struct.pack("<HH", *DEFAULT_CROSSOVERS)
+    for threshold, ratio, attack, release, makeup in DEFAULT_COMP:
+        blob += struct.pack("<hHHHhH", threshold, ratio, attack, release, makeup, 0)
+    assert len(blob) == 92, "layout drifted from audio_playback_dsp_params_t"
+    return blob
+
+
+def cmd_fit(args):
+    points = load_response(args.response)
+    bands, target, residual = fit(points, args.bands)
+
+    print(f"Reference level {target:.1f} dB over {FIT_MIN_HZ}-{FIT_MAX_HZ} Hz")
+    for i, (freq, q, gain) in enumerate(bands):
+        print(f"  band {i}: peak {freq:7.0f} Hz  Q {q:4.2f}  {gain:+5.1f} dB")
+    print(f"Residual deviation {residual:.1f} dB")
+
+    with open(args.output, "w") as f:
+        f.write("key,type,encoding,value\n")
+        f.write("playback_dsp,namespace,,\n")
+        f.write(f"params,data,hex2bin,{pack_params(bands).hex()}\n")
+    print(f"Wrote {args.output}")
+
+
+STAGES = ("hpf", "eq", "comp", "loudness", "limiter")
+CYCLES_RE = re.compile(r"playback_dsp: Cycles/block: " + " ".join(rf"{s}=(\d+)" for s in STAGES))
+CPU_RE = re.compile(r"playback_dsp: CPU ([\d.]+)% \(max block (\d+) cycles, (\d+) overruns\)")
+
+
+def cmd_bench(args):
+    cycles, cpu = None, None
+    with open(args.log, errors="replace") as f:
+        for line in f:
+            m = CYCLES_RE.search(line)
+            if m:
+                cycles = [int(v) for v in m.groups()]
+            m = CPU_RE.search(line)
+            if m:
+                cpu = (float(m.group(1)), int(m.group(2)), int(m.group(3)))
+
+    if not cycles:
+        sys.exit(f"{args.log}: no playback_dsp cycle counters found")
+
+    total = sum(cycles)
+    print(f"{'stage':<10} {'cycles/block':>12} {'share':>7}")
+    for name, value in zip(STAGES, cycles):
+        print(f"{name:<10} {value:>12} {100 * value / total:>6.1f}%")
+    print(f"{'total':<10} {total:>12}")
+    if cpu:
+        print(f"CPU {cpu[0]:.2f}% of one core, worst block {cpu[1]} cycles, {cpu[2]} budget overruns")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    p = sub.add_parser("fit", help="fit EQ bands from a measured response CSV")
+    p.add_argument("response", help="CSV with freq_hz,level_db rows")
+    p.add_argument("-o", "--output", default="speaker_eq.csv", help="NVS partition CSV to write")
+    p.add_argument("-n", "--bands", type=int, default=MAX_EQ_BANDS, choices=range(1, MAX_EQ_BANDS + 1))
+    p.set_defaults(func=cmd_fit)
+
+    p = sub.add_parser("bench", help="summarise playback DSP cycles per block from a monitor log")
+    p.add_argument("log", help="captured idf.py monitor output")
+    p.set_defaults(func=cmd_bench)
+
+    args = parser.parse_args()
+    args.func(args)
+
+
+if __name__ == "__main__":
+    main()
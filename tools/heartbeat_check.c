@@ -0,0 +1,192 @@
+/*
+ * Check the link heartbeat's miss clock (main/link_liveness.c) on the host.
+ *
+ * Simulates the device side of a session in 1 ms steps. The heartbeat checks
+ * the clock and pings every period; a ping due while a send holds the client
+ * waits behind it for up to half a period, as its send timeout allows. The
+ * proxy answers each ping with a pong. Uplink audio goes out in 100 ms
+ * chunks, each send holding the client for a while. Both directions go
+ * through the net_impair shim (main/net_impair.c), and a frame sent or
+ * answered during a scheduled outage is lost. As on the device, a frame that
+ * arrives while a send holds the client is read only when the send returns.
+ *
+ * Each case must either never declare a live link dead, or declare a dead one
+ * within its bound after the outage starts: one window plus one period with
+ * an idle uplink, two windows plus one period when every send blocks for the
+ * full 5 s timeout meanwhile. Exits non-zero if a case fails:
+ *
+ *     gcc -O2 -Imain -o heartbeat_check tools/heartbeat_check.c main/link_liveness.c main/net_impair.c
+ *     ./heartbeat_check
+ */
+
+#include "link_liveness.h"
+#include "net_impair.h"
+
+#include <stdio.h>
+
+#define PERIOD_MS       200     // LINK_HEARTBEAT_MS in app_main.c
+#define MISSES          4       // LINK_HEARTBEAT_MISSES
+#define CHUNK_MS        100     // Uplink chunk interval
+#define SEND_TIMEOUT_MS 5000    // A send on a dead path blocks this long
+#define MAX_PENDING     256
+
+typedef struct {
+    const char *name;
+    const char *profile;
+    uint32_t send_block_ms;     // How long each uplink send holds the client
+    bool stall_in_outage;       // Sends block for the full timeout during an outage
+    uint32_t run_ms;
+} check_case_t;
+
+typedef struct {
+    uint32_t arrivals[MAX_PENDING];
+    size_t count;
+} pending_t;
+
+static void push_arrival(pending_t *pending, uint32_t at_ms)
+{
+    if (pending->count < MAX_PENDING) {
+        pending->arrivals[pending->count++] = at_ms;
+    }
+}
+
+// Read every frame that has arrived by now; false if none
+static bool read_arrivals(pending_t *pending, uint32_t now_ms)
+{
+    bool any = false;
+    size_t kept = 0;
+    for (size_t i = 0; i < pending->count; i++) {
+        if (pending->arrivals[i] <= now_ms) {
+            any = true;
+        } else {
+            pending->arrivals[kept++] = pending->arrivals[i];
+        }
+    }
+    pending->count = kept;
+    return any;
+}
+
+static void send_ping(net_impair_t *up, net_impair_t *down, const net_impair_profile_t *profile,
+                      pending_t *pending, uint32_t now_ms)
+{
+    if (net_impair_outage(profile, now_ms)) {
+        return;
+    }
+    net_impair_verdict_t ping = net_impair_frame(up, 8, now_ms);
+    uint32_t at_proxy = now_ms + ping.delay_ms;
+    if (ping.drop || net_impair_outage(profile, at_proxy)) {
+        return;
+    }
+    net_impair_verdict_t pong = net_impair_frame(down, 8, at_proxy);
+    if (!pong.drop) {
+        push_arrival(pending, at_proxy + pong.delay_ms);
+    }
+}
+
+// Returns the time the link was declared dead, or 0 if it never was
+static uint32_t run_case(const check_case_t *c, const net_impair_profile_t *profile)
+{
+    net_impair_t up, down;
+    net_impair_init(&up, profile, NET_IMPAIR_UPLINK);
+    net_impair_init(&down, profile, NET_IMPAIR_DOWNLINK);
+
+    link_liveness_t live = { 0 };
+    link_liveness_reset(&live, PERIOD_MS * MISSES * 1000, 0);
+    pending_t pending = { 0 };
+    uint32_t backlog = 0;
+    bool sending = false;
+    uint32_t send_end_ms = 0;
+    bool ping_waiting = false;
+    uint32_t ping_deadline_ms = 0;
+
+    for (uint32_t t = 1; t <= c->run_ms; t++) {
+        if (t % CHUNK_MS == 0) {
+            backlog++;
+        }
+        if (sending && t >= send_end_ms) {
+            sending = false;
+            link_liveness_send_end(&live, t * 1000);
+        }
+        // The client reads only between sends
+        if (!sending && read_arrivals(&pending, t)) {
+            link_liveness_rx(&live, t * 1000);
+        }
+        if (ping_waiting && !sending) {
+            ping_waiting = false;
+            if (t <= ping_deadline_ms) {
+                send_ping(&up, &down, profile, &pending, t);
+            }
+        }
+        if (!sending && backlog > 0) {
+            backlog--;
+            uint32_t block_ms = c->send_block_ms;
+            if (c->stall_in_outage && net_impair_outage(profile, t)) {
+                block_ms = SEND_TIMEOUT_MS;
+            }
+            if (block_ms > 0) {
+                sending = true;
+                send_end_ms = t + block_ms;
+                link_liveness_send_begin(&live, t * 1000);
+            }
+        }
+
+        if (t % PERIOD_MS != 0) {
+            continue;
+        }
+        if (link_liveness_dead(&live, t * 1000)) {
+            return t;
+        }
+        if (sending) {
+            ping_waiting = true;
+            ping_deadline_ms = t + PERIOD_MS / 2;
+        } else {
+            send_ping(&up, &down, profile, &pending, t);
+        }
+    }
+    return 0;
+}
+
+int main(void)
+{
+    // Live links carry no loss: a pong lost for a whole window is what the heartbeat is for
+    const check_case_t cases[] = {
+        { "live, poor Wi-Fi latency", "delay=60,jitter=80,rate=256,seed=3", 5, false, 300000 },
+        { "live, cellular, sends back to back", "delay=120,jitter=60,rate=128,seed=5", 95, false, 300000 },
+        { "live, jitter, sends block 600 ms", "delay=80,jitter=120,seed=11", 600, false, 300000 },
+        { "outage, idle uplink", "flaky,seed=7", 5, false, 40000 },
+        { "outage, every send stalls", "flaky,seed=7", 5, true, 40000 },
+    };
+    uint32_t window_ms = PERIOD_MS * MISSES;
+    int failures = 0;
+
+    printf("period %d ms x %d misses: window %lu ms\n", PERIOD_MS, MISSES, (unsigned long)window_ms);
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        const check_case_t *c = &cases[i];
+        net_impair_profile_t profile;
+        if (!net_impair_parse(c->profile, &profile)) {
+            fprintf(stderr, "bad profile: %s\n", c->profile);
+            return 2;
+        }
+
+        uint32_t dead_ms = run_case(c, &profile);
+        bool ok;
+        if (profile.outage_every_ms == 0) {
+            ok = dead_ms == 0;
+            printf("%-4s %-38s %s\n", ok ? "ok" : "FAIL", c->name, ok ? "never declared dead" : "declared dead");
+        } else {
+            uint32_t bound_ms = (c->stall_in_outage ? 2 * window_ms : window_ms) + PERIOD_MS;
+            uint32_t after_ms = dead_ms >= profile.outage_every_ms ? dead_ms - profile.outage_every_ms : 0;
+            ok = dead_ms >= profile.outage_every_ms && after_ms <= bound_ms;
+            if (dead_ms == 0) {
+                printf("%-4s %-38s never declared dead\n", "FAIL", c->name);
+            } else {
+                printf("%-4s %-38s dead %lu ms into the outage (bound %lu ms)\n", ok ? "ok" : "FAIL", c->name,
+                       (unsigned long)after_ms, (unsigned long)bound_ms);
+            }
+        }
+        failures += !ok;
+    }
+
+    printf("%s\n", failures ? "FAILED" : "all checks passed");
+    return failures ? 1 : 0;
+}
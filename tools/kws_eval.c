@@ -0,0 +1,328 @@
+/*
+ * Evaluate the wake-word spotter (main/audio_kws.c) on recorded fixtures.
+ *
+ * Enrolls the keyword from up to three recordings exactly like the device
+ * does, then reports detection rate and latency on positive recordings,
+ * false accepts per hour on negative recordings (background speech, TV, room
+ * noise) and the per-frame processing cost. With -o it writes an NVS partition
+ * CSV holding the templates, so a unit can be provisioned with a keyword
+ * enrolled on the bench:
+ *
+ *     gcc -O2 -Imain -o kws_eval tools/kws_eval.c main/audio_kws.c main/audio_vad.c main/dsp_kernels.c -lm
+ *     ./kws_eval -e hey1.wav -e hey2.wav -e hey3.wav -p hey_kitchen.wav -p hey_far.wav -n tv_1h.wav -o wakeword.csv
+ *     python $IDF_PATH/components/nvs_flash/nvs_partition_generator/nvs_partition_gen.py \
+ *         generate wakeword.csv wakeword.bin 0x6000
+ *
+ * Recordings must be 16 kHz mono 16-bit PCM WAV. Latency is measured from the
+ * end of the keyword (last VAD speech frame before the detection) to the
+ * detection, in 16 ms frames.
+ */
+
+#include "audio_kws.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define SAMPLE_RATE     16000
+#define FRAME_MS        16
+#define MAX_FILES       256
+
+typedef struct {
+    int16_t *samples;
+    size_t num_samples;
+} wav_t;
+
+static uint32_t read_le(const uint8_t *p, int bytes)
+{
+    uint32_t v = 0;
+    for (int i = bytes - 1; i >= 0; i--) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+static int load_wav(const char *path, wav_t *wav)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        fprintf(stderr, "%s: cannot open\n", path);
+        return -1;
+    }
+
+    uint8_t header[12];
+    if (fread(header, 1, sizeof(header), f) != sizeof(header) || memcmp(header, "RIFF", 4) || memcmp(header + 8, "WAVE", 4)) {
+        fprintf(stderr, "%s: not a WAV file\n", path);
+        fclose(f);
+        return -1;
+    }
+
+    int format_ok = 0;
+    uint8_t chunk[8];
+    while (fread(chunk, 1, sizeof(chunk), f) == sizeof(chunk)) {
+        uint32_t size = read_le(chunk + 4, 4);
+        if (!memcmp(chunk, "fmt ", 4)) {
+            uint8_t fmt[16];
+            if (size < sizeof(fmt) || fread(fmt, 1, sizeof(fmt), f) != sizeof(fmt)) {
+                break;
+            }
+            format_ok = read_le(fmt, 2) == 1 && read_le(fmt + 2, 2) == 1 && read_le(fmt + 4, 4) == SAMPLE_RATE &&
+                        read_le(fmt + 14, 2) == 16;
+            fseek(f, (long)(size - sizeof(fmt) + (size & 1)), SEEK_CUR);
+        } else if (!memcmp(chunk, "data", 4)) {
+            if (!format_ok) {
+                break;
+            }
+            wav->num_samples = size / 2;
+            wav->samples = malloc(size);
+            if (!wav->samples) {
+                break;
+            }
+            wav->num_samples = fread(wav->samples, 2, wav->num_samples, f);  // Host is little-endian
+            fclose(f);
+            return 0;
+        } else {
+            fseek(f, (long)(size + (size & 1)), SEEK_CUR);
+        }
+    }
+
+    fprintf(stderr, "%s: expected 16 kHz mono 16-bit PCM\n", path);
+    fclose(f);
+    return -1;
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+typedef struct {
+    uint32_t detections;
+    uint32_t first_latency_frames;  // Of the first detection
+    uint16_t best_score;
+    uint32_t frames;
+    uint32_t active_frames;
+    double ns;
+} run_t;
+
+// Feed a recording frame by frame through a fresh spotter
+static void run_file(const wav_t *wav, const audio_kws_template_t *templates, size_t num_templates,
+                     uint16_t threshold, run_t *run)
+{
+    static audio_kws_t kws;
+    audio_kws_init(&kws, templates, num_templates, threshold);
+    memset(run, 0, sizeof(*run));
+
+    uint32_t last_speech = 0;
+    for (size_t i = 0; i + AUDIO_KWS_FRAME_SAMPLES <= wav->num_samples; i += AUDIO_KWS_FRAME_SAMPLES) {
+        double start = now_ns();
+        audio_kws_result_t result = audio_kws_process(&kws, wav->samples + i);
+        run->ns += now_ns() - start;
+
+        if (kws.vad.speech) {
+            last_speech = kws.frames;
+        }
+        if (result == AUDIO_KWS_DETECTED && run->detections++ == 0) {
+            run->first_latency_frames = kws.frames - last_speech;
+        }
+    }
+    run->best_score = kws.best_score;
+    run->frames = kws.frames;
+    run->active_frames = kws.active_frames;
+}
+
+static int enroll(const char *path, audio_kws_template_t *tpl)
+{
+    static audio_kws_t kws;
+    wav_t wav;
+    if (load_wav(path, &wav)) {
+        return -1;
+    }
+
+    audio_kws_init(&kws, NULL, 0, 0);
+    audio_kws_record(&kws, tpl);
+    audio_kws_result_t result = AUDIO_KWS_NONE;
+    for (size_t i = 0; i + AUDIO_KWS_FRAME_SAMPLES <= wav.num_samples && result != AUDIO_KWS_RECORDED;
+         i += AUDIO_KWS_FRAME_SAMPLES) {
+        result = audio_kws_process(&kws, wav.samples + i);
+        if (result == AUDIO_KWS_REJECTED) {
+            fprintf(stderr, "%s: utterance rejected (%d-%d ms), trying the next one\n", path,
+                    AUDIO_KWS_MIN_FRAMES * FRAME_MS, AUDIO_KWS_MAX_FRAMES * FRAME_MS);
+        }
+    }
+    free(wav.samples);
+
+    if (result != AUDIO_KWS_RECORDED) {
+        fprintf(stderr, "%s: no usable utterance (leave 300 ms of silence after the keyword)\n", path);
+        return -1;
+    }
+    printf("Enrolled %s: %u frames (%u ms)\n", path, tpl->num_frames, tpl->num_frames * FRAME_MS);
+    return 0;
+}
+
+static void write_nvs_csv(const char *path, const audio_kws_template_t *templates, size_t count, uint16_t threshold)
+{
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        fprintf(stderr, "%s: cannot write\n", path);
+        return;
+    }
+
+    fprintf(f, "key,type,encoding,value\n");
+    fprintf(f, "wakeword,namespace,,\n");
+    for (size_t t = 0; t < count; t++) {
+        const uint8_t *blob = (const uint8_t *)&templates[t];
+        fprintf(f, "tpl%u,data,hex2bin,", (unsigned)t);
+        for (size_t i = 0; i < sizeof(templates[t]); i++) {
+            fprintf(f, "%02x", blob[i]);
+        }
+        fprintf(f, "\n");
+    }
+    fprintf(f, "threshold,data,u16,%u\n", threshold);
+    fprintf(f, "count,data,u8,%u\n", (unsigned)count);
+    fclose(f);
+    printf("Wrote %s\n", path);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s -e enroll.wav [-e ...] [-p positive.wav ...] [-n negative.wav ...] [-t threshold] [-o nvs.csv]\n"
+            "  -e  keyword recording to enroll (up to %d)\n"
+            "  -p  recording that contains the keyword once\n"
+            "  -n  recording without the keyword (false accepts)\n"
+            "  -t  detection threshold (default: derived from the enrolled templates)\n"
+            "  -o  write an NVS partition CSV with the templates\n",
+            prog, AUDIO_KWS_MAX_TEMPLATES);
+}
+
+int main(int argc, char **argv)
+{
+    static audio_kws_template_t templates[AUDIO_KWS_MAX_TEMPLATES];
+    const char *positives[MAX_FILES], *negatives[MAX_FILES];
+    size_t num_templates = 0, num_pos = 0, num_neg = 0;
+    int threshold = -1;
+    const char *output = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        if (arg[0] != '-' || arg[1] == '\0' || arg[2] != '\0' || i + 1 >= argc) {
+            usage(argv[0]);
+            return 2;
+        }
+        const char *value = argv[++i];
+        switch (arg[1]) {
+        case 'e':
+            if (num_templates == AUDIO_KWS_MAX_TEMPLATES || enroll(value, &templates[num_templates])) {
+                return 1;
+            }
+            num_templates++;
+            break;
+        case 'p':
+            if (num_pos < MAX_FILES) {
+                positives[num_pos++] = value;
+            }
+            break;
+        case 'n':
+            if (num_neg < MAX_FILES) {
+                negatives[num_neg++] = value;
+            }
+            break;
+        case 't':
+            threshold = atoi(value);
+            break;
+        case 'o':
+            output = value;
+            break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (num_templates == 0) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    uint16_t derived = audio_kws_threshold_from_templates(templates, num_templates);
+    uint16_t used = threshold >= 0 ? (uint16_t)threshold : derived;
+    printf("Threshold %u (derived from templates: %u)\n", used, derived);
+
+    uint64_t frames = 0, active_frames = 0;
+    double ns = 0;
+
+    if (num_pos > 0) {
+        uint32_t detected = 0, latency_sum = 0, latency_max = 0;
+        printf("\nPositives:\n");
+        for (size_t i = 0; i < num_pos; i++) {
+            wav_t wav;
+            run_t run;
+            if (load_wav(positives[i], &wav)) {
+                continue;
+            }
+            run_file(&wav, templates, num_templates, used, &run);
+            free(wav.samples);
+            frames += run.frames;
+            active_frames += run.active_frames;
+            ns += run.ns;
+
+            printf("  %-40s best score %5u  %s", positives[i], run.best_score, run.detections ? "detected" : "MISSED");
+            if (run.detections) {
+                detected++;
+                latency_sum += run.first_latency_frames;
+                if (run.first_latency_frames > latency_max) {
+                    latency_max = run.first_latency_frames;
+                }
+                printf(" (+%u ms after keyword end)", run.first_latency_frames * FRAME_MS);
+            }
+            printf("\n");
+        }
+        printf("Detection rate %u/%zu (%.1f%%)", detected, num_pos, 100.0 * detected / num_pos);
+        if (detected) {
+            printf(", latency mean %u ms, max %u ms", latency_sum * FRAME_MS / detected, latency_max * FRAME_MS);
+        }
+        printf("\n");
+    }
+
+    if (num_neg > 0) {
+        uint32_t false_accepts = 0;
+        uint64_t neg_frames = 0;
+        uint16_t closest = UINT16_MAX;
+        printf("\nNegatives:\n");
+        for (size_t i = 0; i < num_neg; i++) {
+            wav_t wav;
+            run_t run;
+            if (load_wav(negatives[i], &wav)) {
+                continue;
+            }
+            run_file(&wav, templates, num_templates, used, &run);
+            free(wav.samples);
+            frames += run.frames;
+            active_frames += run.active_frames;
+            ns += run.ns;
+            neg_frames += run.frames;
+            false_accepts += run.detections;
+            if (run.best_score < closest) {
+                closest = run.best_score;
+            }
+            printf("  %-40s best score %5u  %u false accepts\n", negatives[i], run.best_score, run.detections);
+        }
+        double hours = neg_frames * FRAME_MS / 3600000.0;
+        printf("False accepts %u in %.2f h (%.2f/h), closest negative score %u\n", false_accepts, hours,
+               hours > 0 ? false_accepts / hours : 0.0, closest);
+    }
+
+    if (frames > 0) {
+        double per_frame_ns = ns / frames;
+        printf("\nCost: %.1f us/frame on this host (%.3f%% of real time), front-end active on %.1f%% of frames\n",
+               per_frame_ns / 1000.0, per_frame_ns / (FRAME_MS * 1e6) * 100.0, 100.0 * active_frames / frames);
+    }
+
+    if (output) {
+        write_nvs_csv(output, templates, num_templates, used);
+    }
+    return 0;
+}
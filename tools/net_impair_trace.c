@@ -0,0 +1,84 @@
+/*
+ * Print the impairment sequence a profile produces (main/net_impair.c).
+ *
+ * Shows what the device will do to each frame for a given profile and seed,
+ * so a robustness run can be described and repeated exactly. The stand-in
+ * proxy prints the same sequence with --impair-trace, which checks that both
+ * sides agree:
+ *
+ *     gcc -O2 -Imain -o net_impair_trace tools/net_impair_trace.c main/net_impair.c
+ *     ./net_impair_trace -n 50 -b 3200 -i 100 "wifi_poor,seed=7"
+ *     tools/stand_in_proxy.py --impair "wifi_poor,seed=7" --impair-trace 50
+ *
+ * Frames are sent every -i ms with -b bytes each (default: 100 ms uplink
+ * chunks of 3200 bytes). -d down traces the downlink sequence instead.
+ */
+
+#include "net_impair.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+int main(int argc, char **argv)
+{
+    net_impair_direction_t direction = NET_IMPAIR_UPLINK;
+    unsigned frames = 100;
+    unsigned bytes = 3200;
+    unsigned interval_ms = 100;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "d:n:b:i:")) != -1) {
+        switch (opt) {
+        case 'd':
+            direction = strcmp(optarg, "down") == 0 ? NET_IMPAIR_DOWNLINK : NET_IMPAIR_UPLINK;
+            break;
+        case 'n':
+            frames = (unsigned)atoi(optarg);
+            break;
+        case 'b':
+            bytes = (unsigned)atoi(optarg);
+            break;
+        case 'i':
+            interval_ms = (unsigned)atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-d up|down] [-n frames] [-b bytes] [-i interval_ms] PROFILE\n", argv[0]);
+            return 2;
+        }
+    }
+    if (optind != argc - 1) {
+        fprintf(stderr, "usage: %s [-d up|down] [-n frames] [-b bytes] [-i interval_ms] PROFILE\n", argv[0]);
+        return 2;
+    }
+
+    net_impair_profile_t profile;
+    if (!net_impair_parse(argv[optind], &profile)) {
+        fprintf(stderr, "bad profile: %s\n", argv[optind]);
+        return 2;
+    }
+
+    net_impair_t imp;
+    net_impair_init(&imp, &profile, direction);
+    unsigned outage_frames = 0;
+    for (unsigned i = 0; i < frames; i++) {
+        uint32_t now_ms = i * interval_ms;
+        if (net_impair_outage(&profile, now_ms)) {
+            printf("%5u %8u outage\n", i, (unsigned)now_ms);
+            outage_frames++;
+            continue;
+        }
+        net_impair_verdict_t v = net_impair_frame(&imp, bytes, now_ms);
+        if (v.drop) {
+            printf("%5u %8u drop\n", i, (unsigned)now_ms);
+        } else {
+            printf("%5u %8u delay %u\n", i, (unsigned)now_ms, (unsigned)v.delay_ms);
+        }
+    }
+
+    unsigned passed = imp.frames - imp.dropped;
+    printf("# %u frames: %u dropped, %u in outages, mean delay %.1f ms\n", frames, (unsigned)imp.dropped,
+           outage_frames, passed ? (double)imp.delay_ms_total / passed : 0.0);
+    return 0;
+}
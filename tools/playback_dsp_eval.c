@@ -0,0 +1,359 @@
+/*
+ * Run the playback DSP chain (main/audio_playback_dsp.c) on the host.
+ *
+ * Without recordings it runs built-in checks on synthetic signals and exits
+ * non-zero if one fails:
+ *
+ *   - ceiling:  full-scale tones and noise never leave the limiter above -1 dBFS
+ *   - loudness: quiet and loud speech-band noise both end up near the target
+ *   - flush:    after audio_playback_dsp_flush() silence comes out as silence,
+ *               so the end of one response cannot open the next
+ *   - bypass:   with the stages disabled only the volume is applied
+ *
+ * With recordings it processes each one in 40 ms blocks, as the playback task
+ * does, and reports peak and RMS in and out, limited samples and the time per
+ * stage. -o writes the processed audio of the last recording:
+ *
+ *     gcc -O2 -Imain -o playback_dsp_eval tools/playback_dsp_eval.c main/audio_playback_dsp.c main/dsp_kernels.c -lm
+ *     ./playback_dsp_eval
+ *     ./playback_dsp_eval -v 80 -o processed.wav response.wav
+ *
+ * Recordings must be 24 kHz mono 16-bit PCM WAV. The chain runs with its
+ * default EQ and compressor parameters (NVS is not available on the host).
+ */
+
+#include "audio_playback_dsp.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define SAMPLE_RATE         24000
+#define BLOCK_SAMPLES       960     // 40 ms, as the playback task
+#define LIMITER_CEILING     29205   // LIMITER_THRESHOLD in audio_playback_dsp.c (-1 dBFS)
+#define LOUDNESS_TARGET_DB  (-20.0) // LOUDNESS_TARGET_RMS in audio_playback_dsp.c
+#define LOUDNESS_TOL_DB     1.0     // The 400 ms window keeps the level moving around the target
+
+typedef struct {
+    int16_t *samples;
+    size_t num_samples;
+} wav_t;
+
+static uint32_t read_le(const uint8_t *p, int bytes)
+{
+    uint32_t v = 0;
+    for (int i = bytes - 1; i >= 0; i--) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+static int load_wav(const char *path, wav_t *wav)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        fprintf(stderr, "%s: cannot open\n", path);
+        return -1;
+    }
+
+    uint8_t header[12];
+    if (fread(header, 1, sizeof(header), f) != sizeof(header) || memcmp(header, "RIFF", 4) || memcmp(header + 8, "WAVE", 4)) {
+        fprintf(stderr, "%s: not a WAV file\n", path);
+        fclose(f);
+        return -1;
+    }
+
+    int format_ok = 0;
+    uint8_t chunk[8];
+    while (fread(chunk, 1, sizeof(chunk), f) == sizeof(chunk)) {
+        uint32_t size = read_le(chunk + 4, 4);
+        if (!memcmp(chunk, "fmt ", 4)) {
+            uint8_t fmt[16];
+            if (size < sizeof(fmt) || fread(fmt, 1, sizeof(fmt), f) != sizeof(fmt)) {
+                break;
+            }
+            format_ok = read_le(fmt, 2) == 1 && read_le(fmt + 2, 2) == 1 && read_le(fmt + 4, 4) == SAMPLE_RATE &&
+                        read_le(fmt + 14, 2) == 16;
+            fseek(f, (long)(size - sizeof(fmt) + (size & 1)), SEEK_CUR);
+        } else if (!memcmp(chunk, "data", 4)) {
+            if (!format_ok) {
+                break;
+            }
+            wav->num_samples = size / 2;
+            wav->samples = malloc(size);
+            if (!wav->samples) {
+                break;
+            }
+            wav->num_samples = fread(wav->samples, 2, wav->num_samples, f);  // Host is little-endian
+            fclose(f);
+            return 0;
+        } else {
+            fseek(f, (long)(size + (size & 1)), SEEK_CUR);
+        }
+    }
+
+    fprintf(stderr, "%s: expected 24 kHz mono 16-bit PCM\n", path);
+    fclose(f);
+    return -1;
+}
+
+static void put_le(uint8_t *p, uint32_t v, int bytes)
+{
+    for (int i = 0; i < bytes; i++) {
+        p[i] = (uint8_t)(v >> (8 * i));
+    }
+}
+
+static int save_wav(const char *path, const int16_t *samples, size_t num_samples)
+{
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        fprintf(stderr, "%s: cannot create\n", path);
+        return -1;
+    }
+    uint8_t header[44];
+    memcpy(header, "RIFF", 4);
+    put_le(header + 4, (uint32_t)(36 + num_samples * 2), 4);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    put_le(header + 16, 16, 4);
+    put_le(header + 20, 1, 2);
+    put_le(header + 22, 1, 2);
+    put_le(header + 24, SAMPLE_RATE, 4);
+    put_le(header + 28, SAMPLE_RATE * 2, 4);
+    put_le(header + 32, 2, 2);
+    put_le(header + 34, 16, 2);
+    memcpy(header + 36, "data", 4);
+    put_le(header + 40, (uint32_t)(num_samples * 2), 4);
+    fwrite(header, 1, sizeof(header), f);
+    fwrite(samples, 2, num_samples, f);
+    fclose(f);
+    return 0;
+}
+
+// Process a buffer in place in playback-sized blocks
+static void process(int16_t *samples, size_t num_samples, uint8_t volume)
+{
+    for (size_t i = 0; i < num_samples; i += BLOCK_SAMPLES) {
+        size_t n = num_samples - i < BLOCK_SAMPLES ? num_samples - i : BLOCK_SAMPLES;
+        audio_playback_dsp_process(samples + i, n, volume);
+    }
+}
+
+static int peak_of(const int16_t *samples, size_t num_samples)
+{
+    int peak = 0;
+    for (size_t i = 0; i < num_samples; i++) {
+        int mag = abs(samples[i]);
+        if (mag > peak) {
+            peak = mag;
+        }
+    }
+    return peak;
+}
+
+static double rms_db(const int16_t *samples, size_t num_samples)
+{
+    double sum = 0.0;
+    for (size_t i = 0; i < num_samples; i++) {
+        sum += (double)samples[i] * samples[i];
+    }
+    double rms = num_samples ? sqrt(sum / num_samples) : 0.0;
+    return rms > 0.0 ? 20.0 * log10(rms / 32768.0) : -120.0;
+}
+
+static void tone(int16_t *out, size_t num_samples, double freq_hz, double amplitude)
+{
+    for (size_t i = 0; i < num_samples; i++) {
+        out[i] = (int16_t)lrint(amplitude * sin(2.0 * M_PI * freq_hz * i / SAMPLE_RATE));
+    }
+}
+
+// Noise roughly shaped like speech: white noise through a one-pole low-pass
+static void speech_noise(int16_t *out, size_t num_samples, double rms_dbfs, uint32_t seed)
+{
+    double *tmp = malloc(num_samples * sizeof(double));
+    double state = 0.0, sum = 0.0;
+    for (size_t i = 0; i < num_samples; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        state += 0.3 * (((double)(seed >> 8) / (1 << 24)) * 2.0 - 1.0 - state);
+        tmp[i] = state;
+        sum += state * state;
+    }
+    double scale = 32768.0 * pow(10.0, rms_dbfs / 20.0) / sqrt(sum / num_samples);
+    for (size_t i = 0; i < num_samples; i++) {
+        double v = tmp[i] * scale;
+        out[i] = (int16_t)(v > 32767.0 ? 32767.0 : v < -32768.0 ? -32768.0 : v);
+    }
+    free(tmp);
+}
+
+static int report(const char *name, int ok, const char *detail)
+{
+    printf("%-9s %s  %s\n", name, ok ? "ok  " : "FAIL", detail);
+    return ok ? 0 : 1;
+}
+
+static int check_ceiling(void)
+{
+    const size_t n = SAMPLE_RATE * 2;
+    int16_t *buf = malloc(n * sizeof(int16_t));
+    const double freqs[] = { 200.0, 1000.0, 3000.0, 8000.0 };
+    int worst = 0;
+
+    for (size_t f = 0; f < sizeof(freqs) / sizeof(freqs[0]); f++) {
+        audio_playback_dsp_reset();
+        tone(buf, n, freqs[f], 32767.0);
+        process(buf, n, 100);
+        int peak = peak_of(buf, n);
+        worst = peak > worst ? peak : worst;
+    }
+    audio_playback_dsp_reset();
+    speech_noise(buf, n, -3.0, 1);
+    process(buf, n, 100);
+    int peak = peak_of(buf, n);
+    worst = peak > worst ? peak : worst;
+    free(buf);
+
+    char detail[64];
+    snprintf(detail, sizeof(detail), "peak %d (ceiling %d)", worst, LIMITER_CEILING);
+    return report("ceiling", worst <= LIMITER_CEILING, detail);
+}
+
+static int check_loudness(void)
+{
+    const size_t n = SAMPLE_RATE * 6;
+    const size_t tail = SAMPLE_RATE * 2;  // Measured once the 400 ms window has settled
+    int16_t *buf = malloc(n * sizeof(int16_t));
+    const double levels[] = { -28.0, -12.0 };
+    int failed = 0;
+
+    for (size_t l = 0; l < sizeof(levels) / sizeof(levels[0]); l++) {
+        audio_playback_dsp_reset();
+        speech_noise(buf, n, levels[l], 2 + (uint32_t)l);
+        process(buf, n, 100);
+        double out_db = rms_db(buf + n - tail, tail);
+        char detail[80];
+        snprintf(detail, sizeof(detail), "%.0f dBFS in -> %.1f dBFS out (target %.0f)", levels[l], out_db,
+                 LOUDNESS_TARGET_DB);
+        failed |= report("loudness", fabs(out_db - LOUDNESS_TARGET_DB) <= LOUDNESS_TOL_DB, detail);
+    }
+    free(buf);
+    return failed;
+}
+
+// The tail left in the chain after a response, as the first block of the next one
+static int tail_peak(int flush)
+{
+    int16_t buf[BLOCK_SAMPLES];
+    audio_playback_dsp_reset();
+    for (int i = 0; i < 5; i++) {
+        tone(buf, BLOCK_SAMPLES, 1000.0, 20000.0);
+        audio_playback_dsp_process(buf, BLOCK_SAMPLES, 100);
+    }
+    if (flush) {
+        audio_playback_dsp_flush();
+    }
+    memset(buf, 0, sizeof(buf));
+    audio_playback_dsp_process(buf, BLOCK_SAMPLES, 100);
+    return peak_of(buf, BLOCK_SAMPLES);
+}
+
+static int check_flush(void)
+{
+    int kept = tail_peak(0);
+    int flushed = tail_peak(1);
+    char detail[80];
+    snprintf(detail, sizeof(detail), "next response opens with peak %d (%d without a flush)", flushed, kept);
+    return report("flush", flushed == 0 && kept > 0, detail);
+}
+
+static int check_bypass(void)
+{
+    int16_t in[BLOCK_SAMPLES], out[BLOCK_SAMPLES];
+    speech_noise(in, BLOCK_SAMPLES, -10.0, 3);
+    memcpy(out, in, sizeof(out));
+
+    audio_playback_dsp_set_enabled(false);
+    audio_playback_dsp_process(out, BLOCK_SAMPLES, 50);
+    audio_playback_dsp_set_enabled(true);
+
+    int max_err = 0;
+    for (size_t i = 0; i < BLOCK_SAMPLES; i++) {
+        int err = abs(out[i] - in[i] / 2);
+        max_err = err > max_err ? err : max_err;
+    }
+    char detail[64];
+    snprintf(detail, sizeof(detail), "volume 50%%, max error %d LSB", max_err);
+    return report("bypass", max_err <= 1, detail);
+}
+
+static void run_file(const char *path, uint8_t volume, const char *out_path)
+{
+    wav_t wav;
+    if (load_wav(path, &wav) != 0) {
+        return;
+    }
+    int in_peak = peak_of(wav.samples, wav.num_samples);
+    double in_db = rms_db(wav.samples, wav.num_samples);
+
+    audio_playback_dsp_stats_t before, after;
+    audio_playback_dsp_reset();
+    audio_playback_dsp_get_stats(&before);
+    process(wav.samples, wav.num_samples, volume);
+    audio_playback_dsp_get_stats(&after);
+
+    uint32_t blocks = after.blocks - before.blocks;
+    double audio_ns = wav.num_samples * 1e9 / SAMPLE_RATE;
+    printf("%s: %.1f s, peak %d -> %d, RMS %.1f -> %.1f dBFS, limited %u samples\n", path,
+           wav.num_samples / (double)SAMPLE_RATE, in_peak, peak_of(wav.samples, wav.num_samples), in_db,
+           rms_db(wav.samples, wav.num_samples), after.limited_samples - before.limited_samples);
+    printf("  host time %.3f%% of real time; ns/block hpf=%.0f eq=%.0f comp=%.0f loudness=%.0f limiter=%.0f\n",
+           audio_ns > 0 ? 100.0 * (after.cycles - before.cycles) / audio_ns : 0.0,
+           blocks ? (double)(after.stage_cycles[AUDIO_PLAYBACK_DSP_STAGE_HPF] - before.stage_cycles[AUDIO_PLAYBACK_DSP_STAGE_HPF]) / blocks : 0.0,
+           blocks ? (double)(after.stage_cycles[AUDIO_PLAYBACK_DSP_STAGE_EQ] - before.stage_cycles[AUDIO_PLAYBACK_DSP_STAGE_EQ]) / blocks : 0.0,
+           blocks ? (double)(after.stage_cycles[AUDIO_PLAYBACK_DSP_STAGE_COMP] - before.stage_cycles[AUDIO_PLAYBACK_DSP_STAGE_COMP]) / blocks : 0.0,
+           blocks ? (double)(after.stage_cycles[AUDIO_PLAYBACK_DSP_STAGE_LOUDNESS] - before.stage_cycles[AUDIO_PLAYBACK_DSP_STAGE_LOUDNESS]) / blocks : 0.0,
+           blocks ? (double)(after.stage_cycles[AUDIO_PLAYBACK_DSP_STAGE_LIMITER] - before.stage_cycles[AUDIO_PLAYBACK_DSP_STAGE_LIMITER]) / blocks : 0.0);
+
+    if (out_path) {
+        save_wav(out_path, wav.samples, wav.num_samples);
+    }
+    free(wav.samples);
+}
+
+int main(int argc, char **argv)
+{
+    uint8_t volume = 100;
+    const char *out_path = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "v:o:")) != -1) {
+        switch (opt) {
+        case 'v':
+            volume = (uint8_t)atoi(optarg);
+            break;
+        case 'o':
+            out_path = optarg;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-v volume] [-o out.wav] [recording.wav ...]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    audio_playback_dsp_init(SAMPLE_RATE);
+
+    if (optind == argc) {
+        int failed = check_ceiling();
+        failed |= check_loudness();
+        failed |= check_flush();
+        failed |= check_bypass();
+        return failed;
+    }
+    for (int i = optind; i < argc; i++) {
+        run_file(argv[i], volume, i == argc - 1 ? out_path : NULL);
+    }
+    return 0;
+}
@@ -0,0 +1,119 @@
+/*
+ * Check the calibration probe search (main/audio_probe.c) on the host.
+ *
+ * Builds synthetic 16 kHz recordings the way the device sees them: the chirp
+ * is generated at the 24 kHz playback rate, resampled to 16 kHz, attenuated,
+ * delayed and buried in white noise. For each delay and SNR the lag found by
+ * audio_probe_find() must be within one sample of the true one, with a
+ * correlation above AUDIO_PROBE_MIN_CORRELATION. A recording with noise only
+ * must stay below it, so a unit that cannot hear itself is reported as a
+ * failure rather than given a random delay. Exits non-zero if a case fails:
+ *
+ *     gcc -O2 -Imain -o probe_delay_check tools/probe_delay_check.c main/audio_probe.c main/dsp_kernels.c -lm
+ *     ./probe_delay_check
+ */
+
+#include "audio_probe.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PLAY_RATE       24000   // CAL_PLAYBACK_RATE in audio_calibration.c
+#define CAPTURE_RATE    16000   // CAL_CAPTURE_RATE
+#define CAPTURE_MS      1200    // CAL_CAPTURE_MS
+#define LEAD_IN_MS      200     // CAL_LEAD_IN_MS
+#define CAPTURE_SAMPLES (CAPTURE_RATE * CAPTURE_MS / 1000)
+#define LEAD_IN_SAMPLES (CAPTURE_RATE * LEAD_IN_MS / 1000)
+#define ECHO_GAIN       0.25f   // A small speaker a few cm from the mic
+#define LAG_TOLERANCE   1
+
+static uint32_t s_rng = 0x12345678;
+
+// Uniform white noise in [-1, 1)
+static float noise(void)
+{
+    s_rng = s_rng * 1664525u + 1013904223u;
+    return (float)(int32_t)s_rng / 2147483648.0f;
+}
+
+// Capture with the played chirp arriving delay_samples after the playback start
+static void make_capture(int16_t *capture, const int16_t *play, size_t play_len, size_t delay_samples,
+                         float noise_rms)
+{
+    const float noise_scale = noise_rms * sqrtf(3.0f);  // Uniform noise: rms = amplitude / sqrt(3)
+    for (size_t i = 0; i < CAPTURE_SAMPLES; i++) {
+        float v = noise_scale * noise();
+        if (i >= LEAD_IN_SAMPLES + delay_samples) {
+            // Linear interpolation from 24 kHz to 16 kHz
+            float pos = (float)(i - LEAD_IN_SAMPLES - delay_samples) * PLAY_RATE / CAPTURE_RATE;
+            size_t k = (size_t)pos;
+            if (k + 1 < play_len) {
+                float frac = pos - (float)k;
+                v += ECHO_GAIN * ((1.0f - frac) * play[k] + frac * play[k + 1]);
+            }
+        }
+        if (v > 32767.0f) {
+            v = 32767.0f;
+        } else if (v < -32768.0f) {
+            v = -32768.0f;
+        }
+        capture[i] = (int16_t)lrintf(v);
+    }
+}
+
+int main(void)
+{
+    const size_t play_len = AUDIO_PROBE_SAMPLES(PLAY_RATE);
+    const size_t ref_len = AUDIO_PROBE_SAMPLES(CAPTURE_RATE);
+    int16_t *play = malloc(play_len * sizeof(int16_t));
+    int16_t *ref = malloc(ref_len * sizeof(int16_t));
+    int16_t *capture = malloc(CAPTURE_SAMPLES * sizeof(int16_t));
+    if (!play || !ref || !capture) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    audio_probe_chirp(play, PLAY_RATE);
+    audio_probe_chirp(ref, CAPTURE_RATE);
+
+    const size_t last_lag = CAPTURE_SAMPLES - ref_len;
+    const float echo_rms = ECHO_GAIN * 10000.0f / sqrtf(2.0f);
+    const size_t delays_ms[] = { 0, 5, 23, 80, 250, 600 };
+    const float snrs_db[] = { 20.0f, 6.0f, 0.0f, -6.0f };
+    int failures = 0;
+
+    for (size_t d = 0; d < sizeof(delays_ms) / sizeof(delays_ms[0]); d++) {
+        for (size_t s = 0; s < sizeof(snrs_db) / sizeof(snrs_db[0]); s++) {
+            size_t delay = delays_ms[d] * CAPTURE_RATE / 1000;
+            float noise_rms = echo_rms / powf(10.0f, snrs_db[s] / 20.0f);
+            make_capture(capture, play, play_len, delay, noise_rms);
+
+            float corr;
+            size_t lag = audio_probe_find(capture, CAPTURE_SAMPLES, ref, ref_len, LEAD_IN_SAMPLES, last_lag, &corr);
+            long error = (long)lag - (long)(LEAD_IN_SAMPLES + delay);
+            int ok = labs(error) <= LAG_TOLERANCE && corr >= AUDIO_PROBE_MIN_CORRELATION;
+            printf("%-4s delay %3zu ms  SNR %5.1f dB  lag error %+ld  corr %.2f\n", ok ? "ok" : "FAIL",
+                   delays_ms[d], snrs_db[s], error, corr);
+            failures += !ok;
+        }
+    }
+
+    // Nothing heard: noise alone, loud and quiet
+    const float noise_only[] = { 30.0f, 3000.0f };
+    for (size_t n = 0; n < sizeof(noise_only) / sizeof(noise_only[0]); n++) {
+        make_capture(capture, play, 0, 0, noise_only[n]);
+        float corr;
+        audio_probe_find(capture, CAPTURE_SAMPLES, ref, ref_len, LEAD_IN_SAMPLES, last_lag, &corr);
+        int ok = corr < AUDIO_PROBE_MIN_CORRELATION;
+        printf("%-4s no probe, noise rms %.0f  corr %.2f (must stay below %.2f)\n", ok ? "ok" : "FAIL",
+               noise_only[n], corr, AUDIO_PROBE_MIN_CORRELATION);
+        failures += !ok;
+    }
+
+    free(play);
+    free(ref);
+    free(capture);
+    printf("%s\n", failures ? "FAILED" : "all checks passed");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,548 @@
+#!/usr/bin/env python3
+"""Local stand-in for the proxy, for bench tests of the device protocol.
+
+Accepts the device's WebSocket connection, answers its hello with a
+configurable hello_ack, sinks uplink audio (logging the rate every 5 s) and
+decodes telemetry frames. Point the device at it by setting WEBSOCKET_URL to
+ws://<this machine>:8000/ws:
+
+    tools/stand_in_proxy.py                        # typed frames, PCM, telemetry on
+    tools/stand_in_proxy.py --codec ima_adpcm --frame-ms 40 --dtx
+    tools/stand_in_proxy.py --legacy               # ignore the hello like an old proxy
+    tools/stand_in_proxy.py --telemetry-log fleet.jsonl
+    tools/stand_in_proxy.py --stall-after 20       # go silent mid-session (dead-link test)
+    tools/stand_in_proxy.py --impair wifi_poor,seed=7
+    tools/stand_in_proxy.py --port 8000 8001       # two endpoints for failover tests
+
+The device sends telemetry once a minute at most, and only while nobody is
+talking. With --telemetry-log each decoded report is appended as one JSON
+line, which is the shape a fleet dashboard would ingest.
+
+If the hello announces a heartbeat, a device that stays silent for
+period × misses is dropped, the same rule the device applies to the proxy.
+--stall-after stops reading and answering partway through a connection, like
+a path that died without a FIN, to time the device's dead-link detection.
+--impair delays, drops and blacks out what the device sends, with the same
+profiles and seeded sequence as the device-side shim (main/net_impair.h).
+
+Each --port is a separate endpoint for WEBSOCKET_URLS. They share one
+session table, like proxies behind a shared store: a hello that asks to
+resume a session any of them has seen is acked as resumed. Endpoint probes
+(a TCP connect and close) are ignored.
+
+The device's transport benchmark (main/ws_bench.h) and tools/ws_bench.py
+need no option: bench requests are always answered.
+
+A hello that offers "control_channel" gets a token in the ack. A second
+connection that sends control_attach with that token then carries the
+session's text messages, so a control_ping is answered on it without
+queueing behind audio. --no-control-channel declines the offer.
+
+Only the Python standard library is used.
+"""
+
+import argparse
+import asyncio
+import base64
+import hashlib
+import json
+import secrets
+import struct
+import sys
+import time
+
+WS_GUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+STALL_HOLD_S = 60                                  # A stalled connection is dropped after this
+SESSIONS_SEEN = set()                              # Session ids from hellos, across all ports
+CONTROL_TOKENS = {}                                # Control channel token -> media Session, across all ports
+
+OP_CONT, OP_TEXT, OP_BINARY, OP_CLOSE, OP_PING, OP_PONG = 0x0, 0x1, 0x2, 0x8, 0x9, 0xA
+
+# Must match main/session_caps.h
+FRAME_AUDIO = 0x01
+FRAME_TELEMETRY = 0x02
+FRAME_BENCH = 0x03
+BENCH_REPORT_SEQ = 0xFFFFFFFF                      # Bench report: u32 messages, u32 bytes follow
+
+# Must match main/telemetry.h and main/latency_hist.h
+TELEMETRY_FORMAT_VERSION = 1
+TELEMETRY_FLAG_TRUNCATED = 0x01
+HIST_SUB_BITS = 3
+METRICS = ["capture_to_send", "send", "rtt", "first_byte_to_sample", "prebuffer_wait", "touch_to_action",
+           "executor_queue", "link_loss", "uplink_backlog",
+           "control_rtt"]
+COUNTERS = ["capture_overruns", "playback_underruns", "capture_drops", "ws_connects", "ws_send_failures"]
+HEAP = ["internal_free", "internal_min_free", "internal_largest", "psram_free"]
+
+
+def bucket_midpoint(index):
+    """Midpoint of a latency_hist bucket, microseconds (as latency_hist_percentile())."""
+    sub = 1 << HIST_SUB_BITS
+    if index < sub:
+        return index
+    shift = index // sub - 1
+    lower = (sub + index % sub) << shift
+    return lower + ((1 << shift) >> 1)
+
+
+def percentile(buckets, max_us, pct):
+    total = sum(buckets.values())
+    if total == 0:
+        return 0
+    rank = max(1, -(-total * pct // 100))
+    seen = 0
+    for index in sorted(buckets):
+        seen += buckets[index]
+        if seen >= rank:
+            return min(bucket_midpoint(index), max_us)
+    return max_us
+
+
+def decode_telemetry(payload):
+    """Decode a telemetry frame payload (after the type byte) into a dict."""
+    version, flags, seq, uptime_s, window_ms = struct.unpack_from("<BBHII", payload, 0)
+    if version != TELEMETRY_FORMAT_VERSION:
+        raise ValueError(f"unknown telemetry version {version}")
+    offset = 12
+    counters = struct.unpack_from("<5I", payload, offset)
+    offset += 20
+    heap = struct.unpack_from("<4I", payload, offset)
+    offset += 16
+    rssi, num_hist = struct.unpack_from("<bB", payload, offset)
+    offset += 2
+
+    histograms = {}
+    for _ in range(num_hist):
+        metric, num_buckets, max_us = struct.unpack_from("<BBI", payload, offset)
+        offset += 6
+        buckets = {}
+        for _ in range(num_buckets):
+            index, count = struct.unpack_from("<BH", payload, offset)
+            offset += 3
+            buckets[index] = count
+        name = METRICS[metric] if metric < len(METRICS) else f"metric_{metric}"
+        histograms[name] = {
+            "n": sum(buckets.values()),
+            "p50_us": percentile(buckets, max_us, 50),
+            "p95_us": percentile(buckets, max_us, 95),
+            "p99_us": percentile(buckets, max_us, 99),
+            "max_us": max_us,
+            "buckets": buckets,
+        }
+    if offset != len(payload):
+        raise ValueError(f"{len(payload) - offset} trailing bytes")
+
+    return {
+        "seq": seq,
+        "uptime_s": uptime_s,
+        "window_ms": window_ms,
+        "truncated": bool(flags & TELEMETRY_FLAG_TRUNCATED),
+        "counters": dict(zip(COUNTERS, counters)),
+        "heap": dict(zip(HEAP, heap)),
+        "rssi_dbm": rssi,
+        "histograms": histograms,
+    }
+
+
+# Must match main/net_impair.c: same presets, parser and generator, so a
+# profile and seed give the same loss and jitter sequence on both sides
+IMPAIR_PRESETS = {
+    "wifi_fair": {"delay": 20, "jitter": 20, "loss": 5, "burst": 2},
+    "wifi_poor": {"delay": 60, "jitter": 80, "rate": 256, "loss": 20, "burst": 4},
+    "cellular": {"delay": 120, "jitter": 60, "rate": 128, "loss": 10, "burst": 3},
+    "flaky": {"delay": 40, "jitter": 40, "outage_every": 30000, "outage": 3000},
+}
+IMPAIR_KEYS = ["delay", "jitter", "rate", "loss", "burst", "outage_every", "outage"]
+
+
+def parse_impairment(text):
+    profile = dict.fromkeys(IMPAIR_KEYS, 0)
+    profile["seed"] = 1
+    for token in filter(None, text.split(",")):
+        key, _, value = token.partition("=")
+        if not _:
+            if token not in IMPAIR_PRESETS:
+                raise ValueError(f"unknown preset {token!r}")
+            profile.update(dict.fromkeys(IMPAIR_KEYS, 0), **IMPAIR_PRESETS[token])
+        elif key == "outage":
+            every, length = (int(v) for v in value.split("/"))
+            if length >= every:
+                raise ValueError("outage length must be shorter than its period")
+            profile["outage_every"], profile["outage"] = every, length
+        elif key in ("delay", "jitter", "rate", "loss", "burst", "seed"):
+            profile[key] = int(value)
+        else:
+            raise ValueError(f"unknown key {key!r}")
+    if profile["loss"] and not profile["burst"]:
+        profile["burst"] = 1
+    return profile
+
+
+class NetImpair:
+    """One direction of main/net_impair.c (the uplink sequence)."""
+
+    def __init__(self, profile):
+        self.profile = profile
+        self.rng = profile["seed"] & 0xFFFFFFFF or 1
+        self.in_burst = False
+        self.link_free_ms = 0
+        self.frames = self.dropped = self.delay_ms_total = 0
+
+    def _next(self):
+        x = self.rng
+        x ^= (x << 13) & 0xFFFFFFFF
+        x ^= x >> 17
+        x ^= (x << 5) & 0xFFFFFFFF
+        self.rng = x
+        return x
+
+    def outage(self, now_ms):
+        every = self.profile["outage_every"]
+        return every > 0 and now_ms >= every and now_ms % every < self.profile["outage"]
+
+    def frame(self, size, now_ms):
+        """Returns None to drop the frame, else the delay in ms."""
+        p = self.profile
+        loss_draw, jitter_draw = self._next(), self._next()
+        self.frames += 1
+        if self.in_burst:
+            self.in_burst = loss_draw % p["burst"] != 0
+            drop = self.in_burst
+        else:
+            drop = p["loss"] > 0 and loss_draw % 1000 < p["loss"]
+            self.in_burst = drop and p["burst"] > 1
+        if drop:
+            self.dropped += 1
+            return None
+        depart_ms = now_ms
+        if p["rate"]:
+            depart_ms = max(depart_ms, self.link_free_ms) + size * 8 // p["rate"]
+            self.link_free_ms = depart_ms
+        delay = depart_ms - now_ms + p["delay"]
+        if p["jitter"]:
+            delay += jitter_draw % (p["jitter"] + 1)
+        self.delay_ms_total += delay
+        return delay
+
+
+def impairment_trace(profile, frames, size=3200, interval_ms=100):
+    """Same output as tools/net_impair_trace.c."""
+    imp = NetImpair(profile)
+    outages = 0
+    for i in range(frames):
+        now_ms = i * interval_ms
+        if imp.outage(now_ms):
+            print(f"{i:5d} {now_ms:8d} outage")
+            outages += 1
+            continue
+        delay = imp.frame(size, now_ms)
+        print(f"{i:5d} {now_ms:8d} " + ("drop" if delay is None else f"delay {delay}"))
+    passed = imp.frames - imp.dropped
+    print(f"# {frames} frames: {imp.dropped} dropped, {outages} in outages, "
+          f"mean delay {imp.delay_ms_total / passed if passed else 0:.1f} ms")
+
+
+def hello_ack(args, resumed=None, control_token=None):
+    ack = {
+        "type": "hello_ack",
+        "header_version": 1,
+        "uplink": {"codec": args.codec, "rate": 16000, "frame_ms": args.frame_ms, "dtx": args.dtx},
+        "downlink": {"codec": "pcm16", "rate": 24000, "frame_ms": 20},
+        "cache": False,
+        "telemetry": not args.no_telemetry,
+    }
+    if resumed is not None:
+        ack["session"] = {"resumed": resumed}
+    if control_token:
+        ack["control_channel"] = {"token": control_token}
+    return json.dumps(ack)
+
+
+async def read_frame(reader):
+    b0, b1 = await reader.readexactly(2)
+    opcode = b0 & 0x0F
+    fin = bool(b0 & 0x80)
+    length = b1 & 0x7F
+    if length == 126:
+        length = struct.unpack(">H", await reader.readexactly(2))[0]
+    elif length == 127:
+        length = struct.unpack(">Q", await reader.readexactly(8))[0]
+    mask = await reader.readexactly(4) if b1 & 0x80 else None
+    data = bytearray(await reader.readexactly(length))
+    if mask:
+        for i in range(length):
+            data[i] ^= mask[i % 4]
+    return fin, opcode, bytes(data)
+
+
+def write_frame(writer, opcode, data=b""):
+    header = bytearray([0x80 | opcode])
+    if len(data) < 126:
+        header.append(len(data))
+    elif len(data) < 1 << 16:
+        header += bytes([126]) + struct.pack(">H", len(data))
+    else:
+        header += bytes([127]) + struct.pack(">Q", len(data))
+    writer.write(bytes(header) + data)
+
+
+class Session:
+    def __init__(self, args, peer, writer):
+        self.args = args
+        self.peer = peer
+        self.writer = writer                       # This connection; binary replies always go here
+        self.media = None                          # On a control connection: the Session it serves
+        self.control_writer = None                 # On a media connection: its attached control connection
+        self.control_token = None
+        self.typed = False
+        self.audio_bytes = 0
+        self.audio_frames = 0
+        self.last_report = time.monotonic()
+        self.heartbeat_timeout = None              # Seconds of silence before the device is dropped
+        self.bench_messages = 0
+        self.bench_bytes = 0
+
+    def log(self, message):
+        print(f"[{time.strftime('%H:%M:%S')}] {self.peer}: {message}", flush=True)
+
+    def on_text(self, writer, text):
+        """Handle a text message; writer is the connection it came in on, which text replies use."""
+        try:
+            message = json.loads(text)
+        except json.JSONDecodeError:
+            self.log(f"bad JSON: {text!r}")
+            return
+        if self.media:
+            self.media.on_text(writer, text)
+        elif message.get("type") == "control_attach":
+            media = CONTROL_TOKENS.get(message.get("token"))
+            if not media:
+                self.log("control_attach with an unknown token")
+                return
+            self.media = media
+            media.control_writer = writer
+            write_frame(writer, OP_TEXT, json.dumps({"type": "control_attach_ack"}).encode())
+            media.log(f"control channel attached from {self.peer}")
+        elif message.get("type") == "control_ping":
+            write_frame(writer, OP_TEXT, json.dumps({"type": "control_pong", "t": message.get("t")}).encode())
+        elif message.get("type") == "hello":
+            self.log(f"hello: {text}")
+            heartbeat = message.get("heartbeat")
+            if isinstance(heartbeat, dict) and heartbeat.get("period_ms"):
+                self.heartbeat_timeout = heartbeat["period_ms"] * heartbeat.get("misses", 1) / 1000
+            if self.args.legacy:
+                self.log("legacy mode: not answering")
+                return
+            resumed = None
+            session = message.get("session")
+            if isinstance(session, dict) and session.get("id"):
+                resumed = bool(session.get("resume")) and session["id"] in SESSIONS_SEEN
+                if session.get("resume"):
+                    self.log(f"session {session['id']}: resume {'accepted' if resumed else 'requested, unknown here'}")
+                SESSIONS_SEEN.add(session["id"])
+            if message.get("control_channel") and not self.args.no_control_channel:
+                self.control_token = secrets.token_hex(8)
+                CONTROL_TOKENS[self.control_token] = self
+            ack = hello_ack(self.args, resumed, self.control_token)
+            write_frame(writer, OP_TEXT, ack.encode())
+            self.typed = True
+            self.log(f"hello_ack: {ack}")
+        elif message.get("type") == "bench":
+            self.bench_messages = self.bench_bytes = 0
+            if message.get("dir") == "down":
+                asyncio.get_running_loop().create_task(self.bench_source(
+                    self.writer, int(message.get("size", 3200)), int(message.get("rate_hz", 0)),
+                    int(message.get("duration_ms", 3000))))
+        elif message.get("type") == "bench_end":
+            self.bench_report(self.writer, self.bench_messages, self.bench_bytes)
+            self.log(f"bench up: {self.bench_messages} messages, {self.bench_bytes} bytes")
+        else:
+            self.log(f"control: {text}")
+
+    def bench_report(self, writer, messages, size):
+        write_frame(writer, OP_BINARY, bytes([FRAME_BENCH]) + struct.pack("<III", BENCH_REPORT_SEQ, messages, size))
+
+    async def bench_source(self, writer, size, rate_hz, duration_ms):
+        """Send bench messages stamped with their send time, then the report."""
+        padding = bytes(max(size - 8, 0))
+        start = time.monotonic()
+        sent = 0
+        try:
+            while time.monotonic() - start < duration_ms / 1000:
+                if rate_hz:
+                    await asyncio.sleep(max(start + sent / rate_hz - time.monotonic(), 0))
+                stamp = (time.monotonic_ns() // 1000) & 0xFFFFFFFF
+                write_frame(writer, OP_BINARY, bytes([FRAME_BENCH]) + struct.pack("<II", sent, stamp) + padding)
+                sent += 1
+                await writer.drain()
+            self.bench_report(writer, sent, sent * size)
+            await writer.drain()
+        except ConnectionError:
+            return
+        self.log(f"bench down: {sent} messages of {size} bytes at {rate_hz or 'max'}/s")
+
+    def on_binary(self, data):
+        if not data:
+            self.log("end of turn")
+            return
+        frame_type = FRAME_AUDIO
+        if self.typed:
+            frame_type, data = data[0], data[1:]
+
+        if frame_type == FRAME_AUDIO:
+            self.audio_bytes += len(data)
+            self.audio_frames += 1
+        elif frame_type == FRAME_TELEMETRY:
+            self.on_telemetry(data)
+        elif frame_type == FRAME_BENCH:
+            self.bench_messages += 1
+            self.bench_bytes += len(data)
+            return
+        else:
+            self.log(f"ignoring frame type 0x{frame_type:02x} ({len(data)} bytes)")
+
+        now = time.monotonic()
+        if now - self.last_report >= 5.0 and self.audio_frames:
+            elapsed = now - self.last_report
+            self.log(f"uplink audio: {self.audio_frames / elapsed:.1f} frames/s, "
+                     f"{self.audio_bytes * 8 / elapsed / 1000:.1f} kbit/s")
+            self.audio_bytes = self.audio_frames = 0
+            self.last_report = now
+
+    def on_telemetry(self, data):
+        try:
+            report = decode_telemetry(data)
+        except (ValueError, struct.error) as err:
+            self.log(f"bad telemetry frame ({len(data)} bytes): {err}")
+            return
+        self.log(f"telemetry #{report['seq']}: {len(data) + 1} bytes, window {report['window_ms'] / 1000:.0f} s, "
+                 f"RSSI {report['rssi_dbm']} dBm, {report['counters']}, heap {report['heap']}"
+                 + (" (truncated)" if report["truncated"] else ""))
+        for name, hist in report["histograms"].items():
+            self.log(f"  {name:<22} n={hist['n']:<5} p50 {hist['p50_us'] / 1000:8.1f} ms  "
+                     f"p95 {hist['p95_us'] / 1000:8.1f} ms  p99 {hist['p99_us'] / 1000:8.1f} ms  "
+                     f"max {hist['max_us'] / 1000:8.1f} ms")
+        if self.args.telemetry_log:
+            report["peer"] = self.peer
+            report["received"] = time.time()
+            with open(self.args.telemetry_log, "a") as log:
+                log.write(json.dumps(report) + "\n")
+
+
+async def handle(reader, writer, args):
+    peer = "%s:%d -> :%d" % (*writer.get_extra_info("peername")[:2], writer.get_extra_info("sockname")[1])
+    try:
+        request = await reader.readuntil(b"\r\n\r\n")
+    except (asyncio.IncompleteReadError, asyncio.LimitOverrunError, ConnectionError):
+        writer.close()                             # An endpoint probe: connect, then close
+        return
+    headers = {}
+    for line in request.decode(errors="replace").split("\r\n")[1:]:
+        if ":" in line:
+            key, value = line.split(":", 1)
+            headers[key.strip().lower()] = value.strip()
+    key = headers.get("sec-websocket-key")
+    if not key:
+        writer.write(b"HTTP/1.1 400 Bad Request\r\n\r\n")
+        writer.close()
+        return
+
+    accept = base64.b64encode(hashlib.sha1((key + WS_GUID).encode()).digest()).decode()
+    writer.write(("HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                  f"Sec-WebSocket-Accept: {accept}\r\n\r\n").encode())
+    session = Session(args, peer, writer)
+    session.log("connected")
+
+    message_opcode, message = None, b""
+    connected_at = time.monotonic()
+    impair = NetImpair(args.impair) if args.impair else None
+    try:
+        while True:
+            if args.stall_after is not None and time.monotonic() - connected_at >= args.stall_after:
+                session.log(f"stalling: not reading or answering for {STALL_HOLD_S} s")
+                await asyncio.sleep(STALL_HOLD_S)
+                break
+            try:
+                fin, opcode, data = await asyncio.wait_for(read_frame(reader), session.heartbeat_timeout)
+            except asyncio.TimeoutError:
+                session.log(f"heartbeat lost: nothing for {session.heartbeat_timeout * 1000:.0f} ms, dropping device")
+                break
+            if impair and opcode != OP_CLOSE:
+                now_ms = int((time.monotonic() - connected_at) * 1000)
+                if impair.outage(now_ms):
+                    continue                       # Nothing gets through, nothing is answered
+                delay = impair.frame(len(data), now_ms)
+                if delay is None and opcode in (OP_BINARY, OP_CONT, OP_PING):
+                    continue                       # Lost; text frames (hello) always arrive
+                if delay:
+                    await asyncio.sleep(delay / 1000)
+            if opcode == OP_PING:
+                write_frame(writer, OP_PONG, data)
+            elif opcode == OP_CLOSE:
+                write_frame(writer, OP_CLOSE, data[:2])
+                break
+            elif opcode in (OP_TEXT, OP_BINARY, OP_CONT):
+                if opcode != OP_CONT:
+                    message_opcode, message = opcode, b""
+                message += data
+                if fin:
+                    if message_opcode == OP_TEXT:
+                        session.on_text(writer, message.decode(errors="replace"))
+                    else:
+                        session.on_binary(message)
+            await writer.drain()
+    except (asyncio.IncompleteReadError, ConnectionError):
+        pass
+    if impair:
+        passed = impair.frames - impair.dropped
+        session.log(f"impairment: {impair.dropped} of {impair.frames} frames dropped, mean delay "
+                    f"{impair.delay_ms_total / passed if passed else 0:.1f} ms")
+    session.log("disconnected")
+    writer.close()
+    if session.control_token:
+        CONTROL_TOKENS.pop(session.control_token, None)
+    if session.control_writer:
+        session.control_writer.close()             # The control channel lives as long as the media connection
+    if session.media and session.media.control_writer is writer:
+        session.media.control_writer = None
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--host", default="0.0.0.0")
+    parser.add_argument("--port", type=int, nargs="+", default=[8000], help="one endpoint per port")
+    parser.add_argument("--legacy", action="store_true", help="ignore the hello, like a proxy without negotiation")
+    parser.add_argument("--codec", default="pcm16", choices=["pcm16", "ulaw", "ima_adpcm"], help="uplink codec")
+    parser.add_argument("--frame-ms", type=int, default=100, choices=[20, 40, 100], help="uplink frame duration")
+    parser.add_argument("--dtx", action="store_true", help="let the device skip muted audio")
+    parser.add_argument("--no-telemetry", action="store_true", help="decline telemetry in the hello_ack")
+    parser.add_argument("--no-control-channel", action="store_true", help="decline a separate control connection")
+    parser.add_argument("--telemetry-log", metavar="FILE", help="append decoded telemetry reports as JSON lines")
+    parser.add_argument("--stall-after", type=float, metavar="SECONDS",
+                        help="stop reading and answering this long into each connection")
+    parser.add_argument("--impair", metavar="PROFILE", type=parse_impairment,
+                        help="impair what the device sends, as main/net_impair.h describes (e.g. wifi_poor,seed=7)")
+    parser.add_argument("--impair-trace", type=int, metavar="FRAMES",
+                        help="print the --impair sequence for this many 100 ms frames and exit")
+    args = parser.parse_args()
+
+    if args.impair_trace:
+        impairment_trace(args.impair or parse_impairment(""), args.impair_trace)
+        return 0
+
+    async def serve():
+        servers = []
+        for port in args.port:
+            servers.append(await asyncio.start_server(lambda r, w: handle(r, w, args), args.host, port))
+            print(f"Stand-in proxy listening on ws://{args.host}:{port}/ws", flush=True)
+        await asyncio.gather(*(server.serve_forever() for server in servers))
+
+    try:
+        asyncio.run(serve())
+    except KeyboardInterrupt:
+        return 0
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,258 @@
+#!/usr/bin/env python3
+"""Host baseline for the WebSocket transport benchmark (main/ws_bench.h).
+
+Runs the device's sweep from this machine against tools/stand_in_proxy.py:
+the same bench frames, sizes, rates and report lines, so the numbers show
+what the network and the proxy cost before the ESP32 is involved.
+
+    tools/stand_in_proxy.py &
+    tools/ws_bench.py                              # ws://127.0.0.1:8000/ws
+    tools/ws_bench.py --url ws://10.0.0.2:8000/ws --step 5
+    tools/ws_bench.py --control-channel            # control messages on their own connection
+
+up lines time each send (frame write and drain); down lines give each
+message's delay relative to the first one of the step. ctrl is the round
+trip of a control_ping sent every 100 ms during the step, over the media
+connection or, with --control-channel, a second one. cpu is this process's
+CPU time over the step, in percent of one core.
+
+Only the Python standard library is used.
+"""
+
+import argparse
+import asyncio
+import base64
+import json
+import os
+import struct
+import sys
+import time
+from urllib.parse import urlparse
+
+SIZES = (320, 1600, 3200, 6400, 12800)
+RATES_HZ = (10, 50, 0)                             # 0: as fast as the transport takes them
+SETTLE_S = 0.5
+CONTROL_PING_S = 0.1
+REPORT_TIMEOUT_S = 3.0
+FRAME_BENCH = 0x03
+BENCH_REPORT_SEQ = 0xFFFFFFFF
+OP_CONT, OP_TEXT, OP_BINARY, OP_CLOSE, OP_PING, OP_PONG = 0x0, 0x1, 0x2, 0x8, 0x9, 0xA
+
+
+def now_us():
+    return (time.monotonic_ns() // 1000) & 0xFFFFFFFF
+
+
+def percentile(values, pct):
+    if not values:
+        return 0.0
+    ordered = sorted(values)
+    return ordered[min(int(len(ordered) * pct / 100), len(ordered) - 1)]
+
+
+class Client:
+    def __init__(self, reader, writer):
+        self.reader = reader
+        self.writer = writer
+        self.report = None                         # Future for the next bench report
+        self.acked = asyncio.get_running_loop().create_future()   # Resolves to the hello_ack
+        self.attached = asyncio.get_running_loop().create_future()
+        self.control_rtts = []                     # Shared with the control connection's Client
+        self.reset_rx()
+
+    def reset_rx(self):
+        self.rx_messages = 0
+        self.rx_bytes = 0
+        self.rx_first = None
+        self.delays = []
+
+    @classmethod
+    async def connect(cls, url):
+        reader, writer = await asyncio.open_connection(url.hostname, url.port or 80)
+        key = base64.b64encode(os.urandom(16)).decode()
+        writer.write((f"GET {url.path or '/'} HTTP/1.1\r\nHost: {url.netloc}\r\nUpgrade: websocket\r\n"
+                      f"Connection: Upgrade\r\nSec-WebSocket-Key: {key}\r\nSec-WebSocket-Version: 13\r\n\r\n").encode())
+        await reader.readuntil(b"\r\n\r\n")
+        client = cls(reader, writer)
+        client.receiver = asyncio.get_running_loop().create_task(client.receive())
+        return client
+
+    def send_json(self, message):
+        self.send(OP_TEXT, json.dumps(message).encode())
+
+    def send(self, opcode, data=b""):
+        mask = os.urandom(4)
+        header = bytearray([0x80 | opcode])
+        if len(data) < 126:
+            header.append(0x80 | len(data))
+        elif len(data) < 1 << 16:
+            header += bytes([0x80 | 126]) + struct.pack(">H", len(data))
+        else:
+            header += bytes([0x80 | 127]) + struct.pack(">Q", len(data))
+        self.writer.write(bytes(header) + mask + bytes(b ^ mask[i % 4] for i, b in enumerate(data)))
+
+    async def read_frame(self):
+        b0, b1 = await self.reader.readexactly(2)
+        length = b1 & 0x7F
+        if length == 126:
+            length = struct.unpack(">H", await self.reader.readexactly(2))[0]
+        elif length == 127:
+            length = struct.unpack(">Q", await self.reader.readexactly(8))[0]
+        return b0 & 0x0F, await self.reader.readexactly(length)
+
+    async def receive(self):
+        while True:
+            opcode, data = await self.read_frame()
+            if opcode == OP_TEXT:
+                message = json.loads(data)
+                if message.get("type") == "hello_ack" and not self.acked.done():
+                    self.acked.set_result(message)
+                elif message.get("type") == "control_attach_ack" and not self.attached.done():
+                    self.attached.set_result(True)
+                elif message.get("type") == "control_pong":
+                    self.control_rtts.append((now_us() - message["t"]) & 0xFFFFFFFF)
+            elif opcode == OP_BINARY and data[:1] == bytes([FRAME_BENCH]):
+                self.on_bench(data[1:])
+            elif opcode == OP_PING:
+                self.send(OP_PONG, data)
+            elif opcode == OP_CLOSE:
+                return
+
+    def on_bench(self, data):
+        arrived = now_us()
+        seq, sent = struct.unpack_from("<II", data)
+        if seq == BENCH_REPORT_SEQ:
+            if self.report and not self.report.done():
+                self.report.set_result(sent)
+            return
+        self.rx_messages += 1
+        self.rx_bytes += len(data)
+        if self.rx_first is None:
+            self.rx_first = (arrived, sent)
+        delay = ((arrived - self.rx_first[0]) - (sent - self.rx_first[1])) & 0xFFFFFFFF
+        self.delays.append(delay if delay < 1 << 31 else 0)
+
+    async def wait_report(self, timeout):
+        try:
+            return await asyncio.wait_for(self.report, timeout)
+        except asyncio.TimeoutError:
+            return None
+
+
+def log_step(direction, size, rate_hz, messages, size_bytes, seconds, latencies_us, control_us, cpu, delivered):
+    rate = f"{rate_hz}/s" if rate_hz else "max"
+    label = "send " if direction == "up" else "delay"
+    p50, p90, p99 = (percentile(latencies_us, p) / 1000 for p in (50, 90, 99))
+    peak = max(latencies_us, default=0) / 1000
+    c50, c99 = (percentile(control_us, p) / 1000 for p in (50, 99))
+    print(f"{direction:<4} {size:5} B @ {rate:<4} {messages / seconds:6.1f} msg/s {size_bytes / seconds / 1000:7.1f} kB/s"
+          f" | {label} p50 {p50:6.2f} p90 {p90:6.2f} p99 {p99:6.2f} max {peak:7.2f} ms"
+          f" | ctrl p50 {c50:6.2f} p99 {c99:6.2f} ms | cpu {cpu:+3.0f}%", flush=True)
+    if delivered is None:
+        print(f"     no report from the proxy ({messages} messages)", flush=True)
+    elif delivered != messages:
+        print(f"     {delivered} of {messages} messages delivered", flush=True)
+
+
+async def run_up(client, size, rate_hz, step_s):
+    loop = asyncio.get_running_loop()
+    padding = bytes([0x55]) * (size - 8)
+    client.send(OP_TEXT, json.dumps({"type": "bench", "dir": "up"}).encode())
+    client.control_rtts.clear()
+    latencies = []
+    cpu_start, start = time.process_time(), time.monotonic()
+    while time.monotonic() - start < step_s:
+        # Always yield, so the control pinger gets its turn even at max rate
+        await asyncio.sleep(max(start + len(latencies) / rate_hz - time.monotonic(), 0) if rate_hz else 0)
+        t0 = time.perf_counter()
+        client.send(OP_BINARY, bytes([FRAME_BENCH]) + struct.pack("<II", len(latencies), now_us()) + padding)
+        await client.writer.drain()
+        latencies.append((time.perf_counter() - t0) * 1e6)
+    elapsed = time.monotonic() - start
+    cpu = (time.process_time() - cpu_start) / elapsed * 100
+
+    client.report = loop.create_future()
+    client.send(OP_TEXT, json.dumps({"type": "bench_end"}).encode())
+    delivered = await client.wait_report(REPORT_TIMEOUT_S)
+    log_step("up", size, rate_hz, len(latencies), len(latencies) * size, elapsed, latencies, client.control_rtts, cpu,
+             delivered)
+
+
+async def run_down(client, size, rate_hz, step_s):
+    loop = asyncio.get_running_loop()
+    client.reset_rx()
+    client.control_rtts.clear()
+    client.report = loop.create_future()
+    cpu_start, start = time.process_time(), time.monotonic()
+    client.send(OP_TEXT, json.dumps({"type": "bench", "dir": "down", "size": size, "rate_hz": rate_hz,
+                                     "duration_ms": int(step_s * 1000)}).encode())
+    sent = await client.wait_report(step_s + REPORT_TIMEOUT_S)
+    elapsed = time.monotonic() - start
+    cpu = (time.process_time() - cpu_start) / elapsed * 100
+    log_step("down", size, rate_hz, client.rx_messages, client.rx_bytes, elapsed, client.delays, client.control_rtts,
+             cpu, None if sent is None else client.rx_messages)
+    if sent is not None and sent != client.rx_messages:
+        print(f"     proxy sent {sent} messages, {client.rx_messages} arrived", flush=True)
+
+
+async def ping_control(control):
+    """Send a control_ping every CONTROL_PING_S the way control messages go."""
+    while True:
+        await asyncio.sleep(CONTROL_PING_S)
+        control.send_json({"type": "control_ping", "t": now_us()})
+
+
+async def main_async(args):
+    url = urlparse(args.url)
+    client = await Client.connect(url)
+    hello = {"type": "hello", "version": 1, "header_versions": [1]}
+    if args.control_channel:
+        hello["control_channel"] = True
+    client.send_json(hello)
+    ack = await asyncio.wait_for(client.acked, REPORT_TIMEOUT_S)
+
+    control, path = client, "media connection"
+    token = (ack.get("control_channel") or {}).get("token")
+    if args.control_channel and token:
+        control = await Client.connect(url)
+        control.control_rtts = client.control_rtts
+        control.send_json({"type": "control_attach", "token": token})
+        await asyncio.wait_for(control.attached, REPORT_TIMEOUT_S)
+        path = "control connection"
+    elif args.control_channel:
+        print("The proxy declined the control channel", flush=True)
+    print(f"Host baseline against {args.url}, {args.step:.0f} s per step, control over the {path}", flush=True)
+    pinger = asyncio.get_running_loop().create_task(ping_control(control))
+
+    for run in (run_up, run_down):
+        for size in args.sizes:
+            for rate_hz in args.rates:
+                await run(client, size, rate_hz, args.step)
+                await asyncio.sleep(SETTLE_S)
+
+    pinger.cancel()
+    for conn in {client, control}:
+        conn.send(OP_CLOSE, struct.pack(">H", 1000))
+        await conn.writer.drain()
+        conn.receiver.cancel()
+        conn.writer.close()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--url", default="ws://127.0.0.1:8000/ws")
+    parser.add_argument("--step", type=float, default=3.0, help="seconds of traffic per step")
+    parser.add_argument("--sizes", type=int, nargs="+", default=SIZES, help="message sizes, bytes (at least 8)")
+    parser.add_argument("--control-channel", action="store_true", help="send control messages on a second connection")
+    parser.add_argument("--rates", type=int, nargs="+", default=RATES_HZ, help="messages per second (0: max)")
+    args = parser.parse_args()
+    try:
+        asyncio.run(main_async(args))
+    except (ConnectionError, asyncio.TimeoutError, asyncio.IncompleteReadError) as err:
+        print(f"Benchmark failed: {err!r}", file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())